@@ -428,6 +428,8 @@ $O/ProgressUtils.o: ../../Common/ProgressUtils.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/PropId.o: ../../Common/PropId.cpp
 	$(CXX) $(CXXFLAGS) $<
+$O/SolidCache.o: ../../Common/SolidCache.cpp
+	$(CXX) $(CXXFLAGS) $<
 $O/StreamBinder.o: ../../Common/StreamBinder.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/StreamObjects.o: ../../Common/StreamObjects.cpp
@@ -727,6 +729,8 @@ $O/LzOutWindow.o: ../../Compress/LzOutWindow.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/LzxDecoder.o: ../../Compress/LzxDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
+$O/LzxEncoder.o: ../../Compress/LzxEncoder.cpp
+	$(CXX) $(CXXFLAGS) $<
 $O/PpmdDecoder.o: ../../Compress/PpmdDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/PpmdEncoder.o: ../../Compress/PpmdEncoder.cpp
@@ -753,6 +757,8 @@ $O/ShrinkDecoder.o: ../../Compress/ShrinkDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/XpressDecoder.o: ../../Compress/XpressDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
+$O/XpressEncoder.o: ../../Compress/XpressEncoder.cpp
+	$(CXX) $(CXXFLAGS) $<
 $O/XzDecoder.o: ../../Compress/XzDecoder.cpp
 	$(CXX) $(CXXFLAGS) $<
 $O/XzEncoder.o: ../../Compress/XzEncoder.cpp
@@ -7,6 +7,7 @@
 #include "../../../Common/ComTry.h"
 
 #include "../../Common/ProgressUtils.h"
+#include "../../Common/StreamUtils.h"
 
 #include "7zDecode.h"
 #include "7zHandler.h"
@@ -212,6 +213,78 @@ HRESULT CFolderOutStream::FlushCorrupted(Int32 callbackOperationResult)
   return S_OK;
 }
 
+
+#ifdef Z7_7Z_SOLID_CACHE
+
+/* CCacheOutStream writes unpacked data of folder to (Stream) and to (Cache).
+   If (WholeFolder) is set, it doesn't stop the decoder after the end of
+   required files, and the data of whole folder is written to (Cache). */
+
+Z7_CLASS_IMP_COM_1(
+  CCacheOutStream
+  , ISequentialOutStream
+)
+public:
+  CMyComPtr<ISequentialOutStream> Stream;
+  CSolidCache *Cache;
+  bool WholeFolder;
+  bool StreamFinished;
+};
+
+Z7_COM7F_IMF(CCacheOutStream::Write(const void *data, UInt32 size, UInt32 *processedSize))
+{
+  if (processedSize)
+    *processedSize = 0;
+  if (!StreamFinished)
+  {
+    UInt32 cur = 0;
+    const HRESULT res = Stream->Write(data, size, &cur);
+    if (res != k_My_HRESULT_WritingWasCut || !WholeFolder)
+    {
+      Cache->Append(data, cur);
+      if (processedSize)
+        *processedSize = cur;
+      return res;
+    }
+    StreamFinished = true;
+  }
+  Cache->Append(data, size);
+  if (processedSize)
+    *processedSize = size;
+  return S_OK;
+}
+
+
+void CHandler::SolidCache_Free()
+{
+  _solidCache.Free();
+  _solidCacheFolder = kNumNoIndex;
+  _solidCacheFull = false;
+}
+
+static const size_t kCacheReadBufSize = (size_t)1 << 20;
+
+HRESULT CHandler::SolidCache_Write(UInt64 pos, UInt64 size,
+    ISequentialOutStream *outStream, ICompressProgressInfo *progress)
+{
+  CByteBuffer buf(kCacheReadBufSize);
+  UInt64 processed = 0;
+  while (processed != size)
+  {
+    size_t cur = kCacheReadBufSize;
+    if (cur > size - processed)
+      cur = (size_t)(size - processed);
+    RINOK(_solidCache.Read(pos + processed, buf, cur))
+    RINOK(WriteStream(outStream, buf, cur))
+    processed += cur;
+    RINOK(progress->SetRatioInfo(NULL, &processed))
+  }
+  return S_OK;
+}
+
+#endif
+
+
 /*
 Z7_COM7F_IMF(CFolderOutStream::GetSubStreamSize(UInt64 subStream, UInt64 *value))
 {
@@ -304,6 +377,13 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   folderOutStream->TestMode = (testModeSpec != 0);
   folderOutStream->CheckCrc = (_crcSize != 0);
 
+ #ifdef Z7_7Z_SOLID_CACHE
+  CCacheOutStream *cacheOutStreamSpec = new CCacheOutStream;
+  CMyComPtr<ISequentialOutStream> cacheOutStream(cacheOutStreamSpec);
+  cacheOutStreamSpec->Stream = outStream;
+  cacheOutStreamSpec->Cache = &_solidCache;
+ #endif
+
   for (UInt32 i = 0;; lps->OutSize += curUnpacked, lps->InSize += curPacked)
   {
     RINOK(lps->SetCur())
@@ -341,6 +421,42 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
         curUnpacked += _db.Files[k].Size;
     }
 
+   #ifdef Z7_7Z_SOLID_CACHE
+    /* If the caller extracts only some files of solid folder, we keep unpacked data in cache.
+       First call unpacks only required part of folder to cache in memory.
+       If next call needs data after the end of cache, it unpacks whole folder
+       to cache that can use temp file. Then next calls read the data from cache.
+       We don't cache encrypted folders, because temp file can contain the data. */
+    bool useCache = false;
+    bool readCache = false;
+    UInt64 cachePos = 0;
+    if (folderIndex != kNumNoIndex
+        && !allFilesMode
+        && numSolidFiles < _db.NumUnpackStreamsVector[folderIndex]
+        && !IsFolderEncrypted(folderIndex))
+    {
+      useCache = true;
+      if (_solidCacheFolder == folderIndex && _solidCache.Size >= curUnpacked)
+      {
+        // we skip the files before first required file
+        readCache = true;
+        const UInt32 firstFile = indices[i];
+        for (; fileIndex < firstFile; fileIndex++)
+          cachePos += _db.Files[fileIndex].Size;
+      }
+      else
+      {
+        const bool wholeFolder = (_solidCacheFolder == folderIndex && !_solidCacheFull);
+        SolidCache_Free();
+        _solidCacheFolder = folderIndex;
+        _solidCacheFull = wholeFolder;
+        _solidCache.UseTempFile = wholeFolder;
+        cacheOutStreamSpec->WholeFolder = wholeFolder;
+        cacheOutStreamSpec->StreamFinished = false;
+      }
+    }
+   #endif
+
     {
       const HRESULT result = folderOutStream->Init(fileIndex,
           allFilesMode ? NULL : indices + i,
@@ -361,6 +477,20 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     if (folderIndex == kNumNoIndex)
       return E_FAIL;
 
+   #ifdef Z7_7Z_SOLID_CACHE
+    if (readCache)
+    {
+      const HRESULT result = SolidCache_Write(cachePos, curUnpacked - cachePos, outStream, progress);
+      if (result != S_OK)
+      {
+        SolidCache_Free();
+        return result;
+      }
+      RINOK(folderOutStream->FlushCorrupted(NExtract::NOperationResult::kDataError))
+      continue;
+    }
+   #endif
+
     #ifndef Z7_NO_CRYPTO
     CMyComPtr<ICryptoGetTextPassword> getTextPassword;
     if (extractCallback)
@@ -377,14 +507,25 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
       bool dataAfterEnd_Error = false;
 
+      ISequentialOutStream *decoderOutStream = outStream;
+      const UInt64 *unpackSize = &curUnpacked;
+     #ifdef Z7_7Z_SOLID_CACHE
+      if (useCache)
+      {
+        decoderOutStream = cacheOutStream;
+        if (cacheOutStreamSpec->WholeFolder)
+          unpackSize = NULL;
+      }
+     #endif
+
       const HRESULT result = decoder.Decode(
           EXTERNAL_CODECS_VARS
           _inStream,
           _db.ArcInfo.DataStartPosition,
           _db, folderIndex,
-          &curUnpacked,
+          unpackSize,
 
-          outStream,
+          decoderOutStream,
           progress,
           NULL // *inStreamMainRes
           , dataAfterEnd_Error
@@ -395,6 +536,11 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
           #endif
           );
 
+     #ifdef Z7_7Z_SOLID_CACHE
+      if (useCache && (result != S_OK || dataAfterEnd_Error))
+        SolidCache_Free();
+     #endif
+
       if (result == S_FALSE || result == E_NOTIMPL || dataAfterEnd_Error)
       {
         const bool wasFinished = folderOutStream->WasWritingFinished();
@@ -430,6 +576,10 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     }
     catch(...)
     {
+     #ifdef Z7_7Z_SOLID_CACHE
+      if (useCache)
+        SolidCache_Free();
+     #endif
       RINOK(folderOutStream->FlushCorrupted(NExtract::NOperationResult::kDataError))
       // continue;
       // return E_FAIL;
@@ -9,7 +9,7 @@
 namespace NArchive {
 namespace N7z {
 
-void CFolderInStream::Init(IArchiveUpdateCallback *updateCallback,
+HRESULT CFolderInStream::Init(IArchiveUpdateCallback *updateCallback,
     const UInt32 *indexes, unsigned numFiles)
 {
   _updateCallback = updateCallback;
@@ -30,6 +30,24 @@ void CFolderInStream::Init(IArchiveUpdateCallback *updateCallback,
 
   // FolderCrc = CRC_INIT_VAL;
   _stream.Release();
+
+ #ifndef Z7_ST
+  _readAhead.Stop();
+  _raBlock = NULL;
+  _raFinished = false;
+  _raResult = S_OK;
+  // read-ahead is useless for one file
+  if (NumReadAheadFiles != 0 && numFiles > 1)
+  {
+    _readAhead.Need_MTime = Need_MTime;
+    _readAhead.Need_CTime = Need_CTime;
+    _readAhead.Need_ATime = Need_ATime;
+    _readAhead.Need_Attrib = Need_Attrib;
+    // we need one additional block for the end of files marker
+    RINOK(_readAhead.Start(updateCallback, indexes, numFiles, NumReadAheadFiles + 1))
+  }
+ #endif
+  return S_OK;
 }
 
 void CFolderInStream::ClearFileInfo()
@@ -118,7 +136,7 @@ HRESULT ReportItemProps(IArchiveUpdateCallbackArcProp *reportArcProp,
 }
 */
 
-HRESULT CFolderInStream::AddFileInfo(bool isProcessed)
+void CFolderInStream::AddFileInfo_NoReport(bool isProcessed)
 {
   // const UInt32 index = _indexes[Processed.Size()];
   Processed.AddInReserved(isProcessed);
@@ -134,11 +152,20 @@ HRESULT CFolderInStream::AddFileInfo(bool isProcessed)
   if (isProcessed && _reportArcProp)
     RINOK(ReportItemProps(_reportArcProp, index, _pos, &crc))
   */
+}
+
+HRESULT CFolderInStream::AddFileInfo(bool isProcessed)
+{
+  AddFileInfo_NoReport(isProcessed);
   return _updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK);
 }
 
 Z7_COM7F_IMF(CFolderInStream::Read(void *data, UInt32 size, UInt32 *processedSize))
 {
+ #ifndef Z7_ST
+  if (_readAhead.IsStarted())
+    return Read_ReadAhead(data, size, processedSize);
+ #endif
   if (processedSize)
     *processedSize = 0;
   while (size != 0)
@@ -197,6 +224,288 @@ Z7_COM7F_IMF(CFolderInStream::Read(void *data, UInt32 size, UInt32 *processedSiz
   return S_OK;
 }
 
+#ifndef Z7_ST
+
+static const UInt32 kReadAheadBlockSize = (UInt32)1 << 16;
+
+THREAD_FUNC_DECL CReadAheadFiles::ThreadFuncStatic(void *p)
+{
+  ((CReadAheadFiles *)p)->ThreadFunc();
+  return 0;
+}
+
+HRESULT CReadAheadFiles::Start(IArchiveUpdateCallback *updateCallback,
+    const UInt32 *indexes, unsigned numFiles, unsigned numBlocks)
+{
+  Stop();
+  
+  _updateCallback = updateCallback;
+  _indexes = indexes;
+  _numFiles = numFiles;
+  Files.ClearAndSetSize(numFiles);
+  
+  if (_numBlocks != numBlocks || !_buf.IsAllocated())
+  {
+    _numBlocks = 0;
+    _buf.Alloc((size_t)numBlocks * kReadAheadBlockSize);
+    if (!_buf.IsAllocated())
+      return E_OUTOFMEMORY;
+    _blocks.Alloc(numBlocks);
+    for (unsigned i = 0; i < numBlocks; i++)
+      _blocks[i].Data = (Byte *)_buf + (size_t)i * kReadAheadBlockSize;
+    _numBlocks = numBlocks;
+  }
+  
+  _writeIndex = 0;
+  _readIndex = 0;
+  _stop = false;
+  _result = S_OK;
+
+  // (Stop()) can release one additional item of (_freeSem)
+  WRes wres = _freeSem.OptCreateInit(numBlocks, numBlocks + 1);
+  if (wres == 0)
+    wres = _filledSem.OptCreateInit(0, numBlocks);
+  if (wres == 0)
+    wres = _thread.Create(ThreadFuncStatic, this);
+  return HRESULT_FROM_WIN32(wres);
+}
+
+void CReadAheadFiles::Stop()
+{
+  if (!_thread.IsCreated())
+    return;
+  _stop = true;
+  _freeSem.Release();
+  _thread.Wait_Close();
+  _updateCallback.Release();
+}
+
+HRESULT CReadAheadFiles::GetFreeBlock(CReadAheadBlock *&block)
+{
+  const WRes wres = _freeSem.Lock();
+  if (wres != 0)
+    return HRESULT_FROM_WIN32(wres);
+  if (_stop)
+    return E_ABORT;
+  block = &_blocks[_writeIndex];
+  block->Size = 0;
+  block->FileStart = false;
+  block->FileEnd = false;
+  return S_OK;
+}
+
+void CReadAheadFiles::PostBlock()
+{
+  if (++_writeIndex == _numBlocks)
+    _writeIndex = 0;
+  _filledSem.Release();
+}
+
+HRESULT CReadAheadFiles::ReadFile(unsigned fileIndex)
+{
+  CReadAheadFileInfo &fi = Files[fileIndex];
+  fi.IsProcessed = false;
+  fi.Size_Defined = false;
+  fi.Times_Defined = false;
+  fi.Size = 0;
+  fi.Attrib = 0;
+  FILETIME_Clear(fi.MTime);
+  FILETIME_Clear(fi.CTime);
+  FILETIME_Clear(fi.ATime);
+  
+  CMyComPtr<ISequentialInStream> stream;
+  const HRESULT result = _updateCallback->GetStream(_indexes[fileIndex], &stream);
+  if (result != S_OK && result != S_FALSE)
+    return result;
+  fi.IsProcessed = (result == S_OK);
+
+  if (stream)
+  {
+    CMyComPtr<IStreamGetProps> getProps;
+    stream.QueryInterface(IID_IStreamGetProps, (void **)&getProps);
+    if (getProps)
+    {
+      if (getProps->GetProps(&fi.Size,
+          Need_CTime ? &fi.CTime : NULL,
+          Need_ATime ? &fi.ATime : NULL,
+          Need_MTime ? &fi.MTime : NULL,
+          Need_Attrib ? &fi.Attrib : NULL)
+          == S_OK)
+      {
+        fi.Size_Defined = true;
+        fi.Times_Defined = true;
+      }
+    }
+    else
+    {
+      CMyComPtr<IStreamGetSize> streamGetSize;
+      stream.QueryInterface(IID_IStreamGetSize, &streamGetSize);
+      if (streamGetSize)
+      {
+        if (streamGetSize->GetSize(&fi.Size) == S_OK)
+          fi.Size_Defined = true;
+      }
+    }
+    fi.IsProcessed = true;
+  }
+
+  UInt32 crc = CRC_INIT_VAL;
+  bool isStart = true;
+  
+  for (;;)
+  {
+    CReadAheadBlock *block;
+    RINOK(GetFreeBlock(block))
+    block->FileIndex = fileIndex;
+    block->FileStart = isStart;
+    isStart = false;
+    bool isEnd = true;
+    if (stream)
+    {
+      isEnd = false;
+      while (block->Size != kReadAheadBlockSize)
+      {
+        UInt32 cur = 0;
+        RINOK(stream->Read(block->Data + block->Size, kReadAheadBlockSize - block->Size, &cur))
+        if (cur == 0)
+        {
+          isEnd = true;
+          break;
+        }
+        crc = CrcUpdate(crc, block->Data + block->Size, cur);
+        block->Size += cur;
+      }
+    }
+    if (isEnd)
+    {
+      fi.Crc = crc;
+      block->FileEnd = true;
+    }
+    PostBlock();
+    if (isEnd)
+      break;
+  }
+  
+  stream.Release();
+  return _updateCallback->SetOperationResult(NArchive::NUpdate::NOperationResult::kOK);
+}
+
+void CReadAheadFiles::ThreadFunc()
+{
+  HRESULT res = S_OK;
+  try
+  {
+    for (unsigned i = 0; i < _numFiles; i++)
+    {
+      res = ReadFile(i);
+      if (res != S_OK)
+        break;
+    }
+  }
+  catch(...) { res = E_FAIL; }
+  
+  if (res == E_ABORT && _stop)
+    return;
+  
+  _result = res;
+  // we send end marker block
+  CReadAheadBlock *block;
+  if (GetFreeBlock(block) != S_OK)
+    return;
+  block->FileIndex = _numFiles;
+  PostBlock();
+}
+
+HRESULT CReadAheadFiles::GetFilledBlock(const CReadAheadBlock *&block)
+{
+  const WRes wres = _filledSem.Lock();
+  if (wres != 0)
+    return HRESULT_FROM_WIN32(wres);
+  block = &_blocks[_readIndex];
+  if (block->FileIndex == _numFiles)
+    return _result;
+  return S_OK;
+}
+
+void CReadAheadFiles::FreeBlock()
+{
+  if (++_readIndex == _numBlocks)
+    _readIndex = 0;
+  _freeSem.Release();
+}
+
+
+HRESULT CFolderInStream::Read_ReadAhead(void *data, UInt32 size, UInt32 *processedSize)
+{
+  if (processedSize)
+    *processedSize = 0;
+  
+  while (size != 0)
+  {
+    if (!_raBlock)
+    {
+      if (_raFinished)
+        return _raResult;
+      const CReadAheadBlock *block;
+      const HRESULT res = _readAhead.GetFilledBlock(block);
+      if (res != S_OK)
+      {
+        // the thread doesn't post blocks after end marker.
+        // So we must not wait for (_filledSem) in next Read() calls.
+        _raFinished = true;
+        _raResult = res;
+        return res;
+      }
+      if (block->FileIndex == _numFiles)
+      {
+        _raFinished = true;
+        break;
+      }
+      if (block->FileIndex != Processed.Size())
+        return E_FAIL;
+      if (block->FileStart)
+      {
+        const CReadAheadFileInfo &fi = _readAhead.Files[block->FileIndex];
+        _size_Defined = fi.Size_Defined;
+        _times_Defined = fi.Times_Defined;
+        _size = fi.Size;
+        _mTime = fi.MTime;
+        _cTime = fi.CTime;
+        _aTime = fi.ATime;
+        _attrib = fi.Attrib;
+      }
+      _raBlock = block;
+      _raPos = 0;
+    }
+
+    const UInt32 rem = _raBlock->Size - _raPos;
+    if (rem != 0)
+    {
+      const UInt32 cur = (size < rem ? size : rem);
+      memcpy(data, _raBlock->Data + _raPos, cur);
+      _raPos += cur;
+      _pos += cur;
+      _totalSize_for_Coder += cur;
+      if (processedSize)
+        *processedSize = cur;
+      return S_OK;
+    }
+
+    if (_raBlock->FileEnd)
+    {
+      const CReadAheadFileInfo &fi = _readAhead.Files[_raBlock->FileIndex];
+      _crc = fi.Crc;
+      AddFileInfo_NoReport(fi.IsProcessed);
+    }
+    _raBlock = NULL;
+    _readAhead.FreeBlock();
+  }
+  
+  return S_OK;
+}
+
+#endif
+
 Z7_COM7F_IMF(CFolderInStream::GetSubStreamSize(UInt64 subStream, UInt64 *value))
 {
   *value = 0;
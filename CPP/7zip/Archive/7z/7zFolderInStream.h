@@ -5,16 +5,103 @@
 
 #include "../../../../C/7zCrc.h"
 
+#include "../../../Common/MyBuffer.h"
+#include "../../../Common/MyBuffer2.h"
 #include "../../../Common/MyCom.h"
 #include "../../../Common/MyVector.h"
 // #include "../Common/InStreamWithCRC.h"
 
+#ifndef Z7_ST
+#include "../../../Windows/Synchronization.h"
+#include "../../../Windows/Thread.h"
+#endif
+
 #include "../../ICoder.h"
 #include "../IArchive.h"
 
 namespace NArchive {
 namespace N7z {
 
+#ifndef Z7_ST
+
+/*
+  CReadAheadFiles opens the files and reads their data in separate thread
+  to the queue of blocks. So the encoder doesn't wait for file opening.
+  The thread calls IArchiveUpdateCallback::GetStream() and
+  SetOperationResult() in same order as CFolderInStream does it without read-ahead.
+  We use only one thread here: IArchiveUpdateCallback is not thread-safe,
+  and the callback expects each GetStream() call to be followed by
+  SetOperationResult() for that file before next GetStream() call.
+*/
+
+struct CReadAheadFileInfo
+{
+  bool IsProcessed;
+  bool Size_Defined;
+  bool Times_Defined;
+  UInt64 Size;
+  UInt32 Crc;
+  UInt32 Attrib;
+  FILETIME MTime;
+  FILETIME CTime;
+  FILETIME ATime;
+};
+
+struct CReadAheadBlock
+{
+  Byte *Data;
+  UInt32 Size;
+  unsigned FileIndex; // (FileIndex == numFiles) means end of all files
+  bool FileStart;
+  bool FileEnd;
+};
+
+class CReadAheadFiles
+{
+  Z7_CLASS_NO_COPY(CReadAheadFiles)
+
+  NWindows::CThread _thread;
+  NWindows::NSynchronization::CSemaphore _freeSem;
+  NWindows::NSynchronization::CSemaphore _filledSem;
+  CMidBuffer _buf;
+  CObjArray<CReadAheadBlock> _blocks;
+  unsigned _numBlocks;
+  unsigned _writeIndex;
+  unsigned _readIndex;
+  bool _stop;
+  HRESULT _result;
+
+  CMyComPtr<IArchiveUpdateCallback> _updateCallback;
+  const UInt32 *_indexes;
+  unsigned _numFiles;
+
+  HRESULT GetFreeBlock(CReadAheadBlock *&block);
+  void PostBlock();
+  HRESULT ReadFile(unsigned fileIndex);
+  void ThreadFunc();
+  static THREAD_FUNC_DECL ThreadFuncStatic(void *p);
+public:
+  CRecordVector<CReadAheadFileInfo> Files;
+  bool Need_MTime;
+  bool Need_CTime;
+  bool Need_ATime;
+  bool Need_Attrib;
+
+  CReadAheadFiles(): _numBlocks(0), _stop(false), _result(S_OK) {}
+  ~CReadAheadFiles() { Stop(); }
+
+  HRESULT Start(IArchiveUpdateCallback *updateCallback,
+      const UInt32 *indexes, unsigned numFiles, unsigned numBlocks);
+  void Stop();
+  bool IsStarted() { return _thread.IsCreated(); }
+
+  // consumer side
+  HRESULT GetFilledBlock(const CReadAheadBlock *&block);
+  void FreeBlock();
+};
+
+#endif
+
 Z7_CLASS_IMP_COM_2(
   CFolderInStream
   , ISequentialInStream
@@ -44,7 +131,17 @@ Z7_CLASS_IMP_COM_2(
 
   void ClearFileInfo();
   HRESULT OpenStream();
+  void AddFileInfo_NoReport(bool isProcessed);
   HRESULT AddFileInfo(bool isProcessed);
+
+ #ifndef Z7_ST
+  CReadAheadFiles _readAhead;
+  const CReadAheadBlock *_raBlock;
+  UInt32 _raPos;
+  bool _raFinished;
+  HRESULT _raResult;
+  HRESULT Read_ReadAhead(void *data, UInt32 size, UInt32 *processedSize);
+ #endif
   // HRESULT CloseCrcStream();
 public:
   bool Need_MTime;
@@ -54,6 +151,9 @@ public:
   // bool Need_Crc;
   // bool Need_FolderCrc;
   // unsigned AlignLog;
+ #ifndef Z7_ST
+  unsigned NumReadAheadFiles; // (0) : no read-ahead, files are opened in Read() calls
+ #endif
   
   CRecordVector<bool> Processed;
   CRecordVector<UInt64> Sizes;
@@ -70,7 +170,7 @@ public:
   // CMyComPtr<ISequentialInStream> _crcStream;
   // CMyComPtr<IArchiveUpdateCallbackArcProp> _reportArcProp;
 
-  void Init(IArchiveUpdateCallback *updateCallback, const UInt32 *indexes, unsigned numFiles);
+  HRESULT Init(IArchiveUpdateCallback *updateCallback, const UInt32 *indexes, unsigned numFiles);
 
   bool WasFinished() const { return Processed.Size() == _numFiles; }
 
@@ -90,6 +190,9 @@ public:
       Need_CTime(false),
       Need_ATime(false),
       Need_Attrib(false)
+     #ifndef Z7_ST
+      , NumReadAheadFiles(0)
+     #endif
       // , Need_Crc(true)
       // , Need_FolderCrc(false)
       // , AlignLog(0)
@@ -35,6 +35,11 @@ CHandler::CHandler()
   _passwordIsDefined = false;
   #endif
 
+  #ifdef Z7_7Z_SOLID_CACHE
+  _solidCacheFolder = kNumNoIndex;
+  _solidCacheFull = false;
+  #endif
+
   #ifdef Z7_EXTRACT_ONLY
   
   _crcSize = 4;
@@ -735,6 +740,9 @@ Z7_COM7F_IMF(CHandler::Close())
   COM_TRY_BEGIN
   _inStream.Release();
   _db.Clear();
+  #ifdef Z7_7Z_SOLID_CACHE
+  SolidCache_Free();
+  #endif
   #ifndef Z7_NO_CRYPTO
   _isEncrypted = false;
   _passwordIsDefined = false;
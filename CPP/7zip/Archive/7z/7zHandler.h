@@ -20,10 +20,18 @@
 
 #endif
 
+#ifndef Z7_EXTRACT_ONLY
+  #define Z7_7Z_SOLID_CACHE
+#endif
+
 // #ifdef Z7_7Z_SET_PROPERTIES
 #include "../Common/HandlerOut.h"
 // #endif
 
+#ifdef Z7_7Z_SOLID_CACHE
+#include "../../Common/SolidCache.h"
+#endif
+
 #include "7zCompressionMode.h"
 #include "7zIn.h"
 
@@ -33,16 +41,20 @@ namespace N7z {
 
 #ifndef Z7_EXTRACT_ONLY
 
+struct CMergeArc;
+
 class COutHandler: public CMultiMethodProps
 {
   HRESULT SetSolidFromString(const UString &s);
   HRESULT SetSolidFromPROPVARIANT(const PROPVARIANT &value);
+  HRESULT SetReadAheadFromPROPVARIANT(const PROPVARIANT &value);
 public:
   UInt64 _numSolidFiles;
   UInt64 _numSolidBytes;
   bool _numSolidBytesDefined;
   bool _solidExtension;
   bool _useTypeSorting;
+  bool _useContentSorting;
 
   bool _compressHeaders;
   bool _encryptHeadersSpecified;
@@ -54,8 +66,11 @@ public:
   CBoolPair Write_Attrib;
 
   bool _useMultiThreadMixer;
+  UInt32 _numReadAheadFiles;
 
   bool _removeSfxBlock;
+
+  UStringVector _mergeArcNames;
   
   // bool _volumeMode;
 
@@ -146,12 +161,25 @@ private:
   CRecordVector<CBond2> _bonds;
 
   HRESULT PropsMethod_To_FullMethod(CMethodFull &dest, const COneMethodInfo &m);
-  HRESULT SetHeaderMethod(CCompressionMethodMode &headerMethod);
+  HRESULT SetHeaderMethod(CCompressionMethodMode &headerMethod, CCompressionMethodMode &headerMethodMt);
+  HRESULT OpenMergeArcs(IArchiveUpdateCallback *updateCallback, CObjectVector<CMergeArc> &mergeArcs);
   HRESULT SetMainMethod(CCompressionMethodMode &method);
 
   #endif
 
   bool IsFolderEncrypted(CNum folderIndex) const;
+
+ #ifdef Z7_7Z_SOLID_CACHE
+  /* (_solidCache) contains the unpacked data from start of folder (_solidCacheFolder).
+     It's kept between Extract() calls, if the caller extracts only some files of solid folder. */
+  CSolidCache _solidCache;
+  CNum _solidCacheFolder;
+  bool _solidCacheFull; // the cache was filled by unpacking of whole folder
+  void SolidCache_Free();
+  HRESULT SolidCache_Write(UInt64 pos, UInt64 size,
+      ISequentialOutStream *outStream, ICompressProgressInfo *progress);
+ #endif
+
   #ifndef Z7_SFX
 
   CRecordVector<UInt64> _fileInfoPopIDs;
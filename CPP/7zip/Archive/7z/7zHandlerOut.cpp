@@ -21,6 +21,7 @@ namespace NArchive {
 namespace N7z {
 
 #define k_LZMA_Name "LZMA"
+#define k_LZMA2_Name "LZMA2"
 #define kDefaultMethodName "LZMA2"
 #define k_Copy_Name "Copy"
 
@@ -54,20 +55,42 @@ HRESULT CHandler::PropsMethod_To_FullMethod(CMethodFull &dest, const COneMethodI
   return S_OK;
 }
 
-HRESULT CHandler::SetHeaderMethod(CCompressionMethodMode &headerMethod)
+static void SetHeaderMethodProps(COneMethodInfo &m, UInt32 numThreads)
 {
-  if (!_compressHeaders)
-    return S_OK;
-  COneMethodInfo m;
-  m.MethodName = k_LZMA_Name;
   m.AddProp_Ascii(NCoderPropID::kMatchFinder, k_MatchFinder_ForHeaders);
   m.AddProp_Level(k_Level_ForHeaders);
   m.AddProp32(NCoderPropID::kNumFastBytes, k_NumFastBytes_ForHeaders);
   m.AddProp32(NCoderPropID::kDictionarySize, k_Dictionary_ForHeaders);
-  m.AddProp_NumThreads(1);
+  m.AddProp_NumThreads(numThreads);
+}
+
+/* (headerMethodMt) is LZMA2 method that is used instead of LZMA for big headers,
+   if (headerMethodMt.NumThreads > 1) */
 
-  CMethodFull &methodFull = headerMethod.Methods.AddNew();
-  return PropsMethod_To_FullMethod(methodFull, m);
+HRESULT CHandler::SetHeaderMethod(CCompressionMethodMode &headerMethod, CCompressionMethodMode &headerMethodMt)
+{
+  if (!_compressHeaders)
+    return S_OK;
+  {
+    COneMethodInfo m;
+    m.MethodName = k_LZMA_Name;
+    SetHeaderMethodProps(m, 1);
+    CMethodFull &methodFull = headerMethod.Methods.AddNew();
+    RINOK(PropsMethod_To_FullMethod(methodFull, m))
+  }
+  #ifndef Z7_ST
+  if (headerMethodMt.NumThreads > 1)
+  {
+    COneMethodInfo m;
+    m.MethodName = k_LZMA2_Name;
+    SetHeaderMethodProps(m, headerMethodMt.NumThreads);
+    CMethodFull &methodFull = headerMethodMt.Methods.AddNew();
+    RINOK(PropsMethod_To_FullMethod(methodFull, m))
+  }
+  #else
+  UNUSED_VAR(headerMethodMt)
+  #endif
+  return S_OK;
 }
 
 
@@ -385,6 +408,62 @@ static int AddFolder(CObjectVector<CTreeFolder> &treeFolders, int cur, const USt
 }
 */
 
+/* The archives for merge are opened via IArchiveOpenVolumeCallback interface
+   of update callback, because the handler doesn't work with files directly. */
+
+HRESULT CHandler::OpenMergeArcs(IArchiveUpdateCallback *updateCallback, CObjectVector<CMergeArc> &mergeArcs)
+{
+  if (_mergeArcNames.IsEmpty())
+    return S_OK;
+  
+  Z7_DECL_CMyComPtr_QI_FROM(
+      IArchiveOpenVolumeCallback,
+      volumeCallback, updateCallback)
+  if (!volumeCallback)
+    return E_NOTIMPL;
+
+  #ifndef Z7_NO_CRYPTO
+  Z7_DECL_CMyComPtr_QI_FROM(
+      ICryptoGetTextPassword,
+      getTextPassword, updateCallback)
+  #endif
+
+  FOR_VECTOR (i, _mergeArcNames)
+  {
+    CMergeArc &mergeArc = mergeArcs.AddNew();
+    RINOK(volumeCallback->GetStream(_mergeArcNames[i], &mergeArc.Stream))
+    if (!mergeArc.Stream)
+      return E_INVALIDARG;
+    
+    CInArchive archive(_useMultiThreadMixer);
+    HRESULT res = archive.Open(mergeArc.Stream, NULL);
+    if (res == S_OK)
+    {
+      #ifndef Z7_NO_CRYPTO
+      bool isEncrypted = false;
+      bool passwordIsDefined = false;
+      UString password;
+      #endif
+      res = archive.ReadDatabase(
+          EXTERNAL_CODECS_VARS
+          mergeArc.Db
+          #ifndef Z7_NO_CRYPTO
+            , getTextPassword, isEncrypted, passwordIsDefined, password
+          #endif
+          );
+      #ifndef Z7_NO_CRYPTO
+      password.Wipe_and_Empty();
+      #endif
+    }
+    if (res == S_FALSE)
+      return E_INVALIDARG;
+    RINOK(res)
+    if (!mergeArc.Db.CanUpdate())
+      return E_NOTIMPL;
+  }
+  return S_OK;
+}
+
 Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numItems,
     IArchiveUpdateCallback *updateCallback))
 {
@@ -687,7 +766,7 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   }
   */
 
-  CCompressionMethodMode methodMode, headerMethod;
+  CCompressionMethodMode methodMode, headerMethod, headerMethodMt;
 
   methodMode.MemoryUsageLimit = _memUsage_Compress;
   methodMode.MemoryUsageLimit_WasSet = _memUsage_WasSet;
@@ -703,13 +782,15 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
     methodMode.MultiThreadMixer = _useMultiThreadMixer;
     // headerMethod.NumThreads = 1;
     headerMethod.MultiThreadMixer = _useMultiThreadMixer;
+    headerMethodMt.NumThreads = numThreads;
+    headerMethodMt.MultiThreadMixer = _useMultiThreadMixer;
   }
   #endif
 
   const HRESULT res = SetMainMethod(methodMode);
   RINOK(res)
 
-  RINOK(SetHeaderMethod(headerMethod))
+  RINOK(SetHeaderMethod(headerMethod, headerMethodMt))
   
   Z7_DECL_CMyComPtr_QI_FROM(
     ICryptoGetTextPassword2,
@@ -753,6 +834,8 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
     {
       headerMethod.PasswordIsDefined = methodMode.PasswordIsDefined;
       headerMethod.Password = methodMode.Password;
+      headerMethodMt.PasswordIsDefined = methodMode.PasswordIsDefined;
+      headerMethodMt.Password = methodMode.Password;
     }
   }
 
@@ -770,11 +853,15 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
 
   options.Method = &methodMode;
   options.HeaderMethod = (_compressHeaders || encryptHeaders) ? &headerMethod : NULL;
+  options.HeaderMethodMt = &headerMethodMt;
   options.UseFilters = (level != 0 && _autoFilter && !methodMode.Filter_was_Inserted);
   options.MaxFilter = (level >= 8);
   options.AnalysisLevel = GetAnalysisLevel();
 
   options.HeaderOptions.CompressMainHeader = compressMainHeader;
+  #ifndef Z7_ST
+  options.HeaderOptions.NumThreads = headerMethodMt.NumThreads;
+  #endif
   /*
   options.HeaderOptions.WriteCTime = Write_CTime;
   options.HeaderOptions.WriteATime = Write_ATime;
@@ -786,11 +873,13 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   options.NumSolidBytes = _numSolidBytes;
   options.SolidExtension = _solidExtension;
   options.UseTypeSorting = _useTypeSorting;
+  options.UseContentSorting = _useContentSorting;
 
   options.RemoveSfxBlock = _removeSfxBlock;
   // options.VolumeMode = _volumeMode;
 
   options.MultiThreadMixer = _useMultiThreadMixer;
+  options.NumReadAheadFiles = _numReadAheadFiles;
 
   /*
   if (secureBlocks.Sorted.Size() > 1)
@@ -804,6 +893,11 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   }
   */
 
+  CObjectVector<CMergeArc> mergeArcs;
+  RINOK(OpenMergeArcs(updateCallback, mergeArcs))
+  if (!mergeArcs.IsEmpty())
+    options.MergeArcs = &mergeArcs;
+
   return Update(
       EXTERNAL_CODECS_VARS
       #ifdef Z7_7Z_VOL
@@ -853,11 +947,14 @@ void COutHandler::InitProps7z()
   Write_Attrib.Init();
 
   _useMultiThreadMixer = true;
+  _numReadAheadFiles = 0;
+  _mergeArcNames.Clear();
 
   // _volumeMode = false;
 
   InitSolid();
   _useTypeSorting = false;
+  _useContentSorting = false;
 }
 
 void COutHandler::InitProps()
@@ -937,6 +1034,29 @@ HRESULT COutHandler::SetSolidFromPROPVARIANT(const PROPVARIANT &value)
   return S_OK;
 }
 
+static const UInt32 kNumReadAheadFiles_Default = 32;
+static const UInt32 kNumReadAheadFiles_Max = 1 << 12;
+
+HRESULT COutHandler::SetReadAheadFromPROPVARIANT(const PROPVARIANT &value)
+{
+  UInt32 v = kNumReadAheadFiles_Default;
+  if (value.vt == VT_BSTR || value.vt == VT_BOOL)
+  {
+    bool isOn;
+    RINOK(PROPVARIANT_to_bool(value, isOn))
+    if (!isOn)
+      v = 0;
+  }
+  else
+  {
+    RINOK(ParsePropToUInt32(UString(), value, v))
+  }
+  if (v > kNumReadAheadFiles_Max)
+    v = kNumReadAheadFiles_Max;
+  _numReadAheadFiles = v;
+  return S_OK;
+}
+
 static HRESULT PROPVARIANT_to_BoolPair(const PROPVARIANT &prop, CBoolPair &dest)
 {
   RINOK(PROPVARIANT_to_bool(prop, dest.Val))
@@ -1002,7 +1122,17 @@ HRESULT COutHandler::SetProperty(const wchar_t *nameSpec, const PROPVARIANT &val
     
     if (name.IsEqualTo("mtf")) return PROPVARIANT_to_bool(value, _useMultiThreadMixer);
 
+    if (name.IsEqualTo("ra")) return SetReadAheadFromPROPVARIANT(value);
+    if (name.IsEqualTo("merge"))
+    {
+      if (value.vt != VT_BSTR || value.bstrVal[0] == 0)
+        return E_INVALIDARG;
+      _mergeArcNames.Add(UString(value.bstrVal));
+      return S_OK;
+    }
+
     if (name.IsEqualTo("qs")) return PROPVARIANT_to_bool(value, _useTypeSorting);
+    if (name.IsEqualTo("qc")) return PROPVARIANT_to_bool(value, _useContentSorting);
 
     // if (name.IsEqualTo("v"))  return PROPVARIANT_to_bool(value, _volumeMode);
   }
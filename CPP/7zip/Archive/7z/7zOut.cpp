@@ -3,10 +3,13 @@
 #include "StdAfx.h"
 
 #include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
 
 #include "../../../Common/AutoPtr.h"
 // #include "../../../Common/UTFConvert.h"
 
+#include "../../../Windows/Thread.h"
+
 #include "../../Common/StreamObjects.h"
 
 #include "7zOut.h"
@@ -485,9 +488,164 @@ void COutArchive::WriteUInt64DefVector(const CUInt64DefVector &v, Byte type)
 
   WriteAlignedBools(v.Defs, numDefined, type, 3);
   
-  for (unsigned i = 0; i < v.Defs.Size(); i++)
-    if (v.Defs[i])
-      WriteUInt64(v.Vals[i]);
+  CHeaderSection s;
+  s.Vals64 = &v;
+  WriteSections(s, v.Defs.Size());
+}
+
+
+size_t CHeaderSection::GetSize() const
+{
+  size_t size = 0;
+  unsigned i;
+  if (Names)
+    for (i = Start; i < End; i++)
+      size += ((size_t)(*Names)[i].Len() + 1) * 2;
+  else
+  {
+    const CBoolVector &defs = Vals64 ? Vals64->Defs : Vals32->Defs;
+    for (i = Start; i < End; i++)
+      if (defs[i])
+        size++;
+    size *= (Vals64 ? 8 : 4);
+  }
+  return size;
+}
+
+void CHeaderSection::Fill() const
+{
+  Byte *p = Dest;
+  unsigned i;
+  if (Names)
+  {
+    for (i = Start; i < End; i++)
+    {
+      const UString &name = (*Names)[i];
+      const wchar_t *src = name.Ptr();
+      const unsigned len = name.Len();
+      for (unsigned t = 0; t <= len; t++)
+      {
+        const wchar_t c = src[t];
+        p[0] = (Byte)c;
+        p[1] = (Byte)(c >> 8);
+        p += 2;
+      }
+    }
+  }
+  else if (Vals64)
+  {
+    for (i = Start; i < End; i++)
+      if (Vals64->Defs[i])
+      {
+        SetUi64(p, Vals64->Vals[i])
+        p += 8;
+      }
+  }
+  else
+  {
+    for (i = Start; i < End; i++)
+      if (Vals32->Defs[i])
+      {
+        SetUi32(p, Vals32->Vals[i])
+        p += 4;
+      }
+  }
+}
+
+static const unsigned kSectionNumItems = 1 << 16;
+
+/*
+  WriteSections() writes the data of section (s) for items [0, numItems).
+  If the header is written to memory buffer, it only reserves the space for data,
+  and the data is filled later in FillSections(), that can use several threads.
+*/
+
+void COutArchive::WriteSections(CHeaderSection &s, unsigned numItems)
+{
+  for (unsigned start = 0; start < numItems;)
+  {
+    s.Start = start;
+    s.End = start + MyMin(numItems - start, kSectionNumItems);
+    start = s.End;
+    const size_t size = s.GetSize();
+    if (_countMode)
+      _countSize += size;
+    else if (_writeToStream)
+    {
+      CByteBuffer buf(size);
+      s.Dest = buf;
+      s.Fill();
+      WriteBytes(buf);
+    }
+    else
+    {
+      s.Dest = _outByte2.ReserveBytes(size);
+      if (_deferSections)
+        _sections.Add(s);
+      else
+        s.Fill();
+    }
+  }
+}
+
+#ifndef Z7_ST
+
+struct CFillSectionsThread
+{
+  NWindows::CThread Thread;
+  const CRecordVector<CHeaderSection> *Sections;
+  unsigned Start;
+  unsigned Step;
+
+  void Fill() const
+  {
+    for (unsigned i = Start; i < Sections->Size(); i += Step)
+      (*Sections)[i].Fill();
+  }
+  static THREAD_FUNC_DECL ThreadFunc(void *p)
+  {
+    ((const CFillSectionsThread *)p)->Fill();
+    return 0;
+  }
+};
+
+#endif
+
+void COutArchive::FillSections(UInt32 numThreads)
+{
+  #ifndef Z7_ST
+  if (numThreads > _sections.Size())
+    numThreads = _sections.Size();
+  if (numThreads > 1)
+  {
+    CObjArray<CFillSectionsThread> threads(numThreads);
+    UInt32 t;
+    for (t = 0; t < numThreads; t++)
+    {
+      CFillSectionsThread &thread = threads[t];
+      thread.Sections = &_sections;
+      thread.Start = t;
+      thread.Step = numThreads;
+      if (t != 0)
+        if (thread.Thread.Create(CFillSectionsThread::ThreadFunc, &thread) != 0)
+          thread.Fill();
+    }
+    threads[0].Fill();
+    for (t = 1; t < numThreads; t++)
+    {
+      CFillSectionsThread &thread = threads[t];
+      if (thread.Thread.IsCreated())
+        thread.Thread.Wait_Close();
+    }
+    _sections.Clear();
+    return;
+  }
+  #else
+  UNUSED_VAR(numThreads)
+  #endif
+  FOR_VECTOR (i, _sections)
+    _sections[i].Fill();
+  _sections.Clear();
 }
 
 HRESULT COutArchive::EncodeStream(
@@ -681,35 +839,9 @@ void COutArchive::WriteHeader(
       WriteByte(NID::kName);
       WriteNumber(namesDataSize);
       WriteByte(0);
-      FOR_VECTOR (i, db.Files)
-      {
-        const UString &name = db.Names[i];
-        for (unsigned t = 0; t <= name.Len(); t++)
-        {
-          wchar_t c = name[t];
-
-          /*
-          #if WCHAR_MAX > 0xffff
-          if (c >= 0x10000)
-          {
-            c -= 0x10000;
-            if (c < (1 << 20))
-            {
-              unsigned c0 = 0xd800 + ((c >> 10) & 0x3FF);
-              WriteByte((Byte)c0);
-              WriteByte((Byte)(c0 >> 8));
-              c = 0xdc00 + (c & 0x3FF);
-            }
-            else
-              c = '_'; // we change character unsupported by UTF16
-          }
-          #endif
-          */
-  
-          WriteByte((Byte)c);
-          WriteByte((Byte)(c >> 8));
-        }
-      }
+      CHeaderSection s;
+      s.Names = &db.Names;
+      WriteSections(s, db.Files.Size());
     }
   }
 
@@ -725,11 +857,9 @@ void COutArchive::WriteHeader(
     if (numDefined != 0)
     {
       WriteAlignedBools(db.Attrib.Defs, numDefined, NID::kWinAttrib, 2);
-      FOR_VECTOR (i, db.Attrib.Defs)
-      {
-        if (db.Attrib.Defs[i])
-          WriteUInt32(db.Attrib.Vals[i]);
-      }
+      CHeaderSection s;
+      s.Vals32 = &db.Attrib;
+      WriteSections(s, db.Attrib.Defs.Size());
     }
   }
 
@@ -809,10 +939,16 @@ void COutArchive::WriteHeader(
   WriteByte(NID::kEnd); // for headers
 }
 
+/* optionsMt is multithreaded method for big headers.
+   For small headers we use (options) that gives better compression ratio. */
+
+static const size_t kHeaderSize_for_MtMethod = (size_t)1 << 23;
+
 HRESULT COutArchive::WriteDatabase(
     DECL_EXTERNAL_CODECS_LOC_VARS
     const CArchiveDatabaseOut &db,
     const CCompressionMethodMode *options,
+    const CCompressionMethodMode *optionsMt,
     const CHeaderOptions &headerOptions)
 {
   if (!db.CheckNumFiles())
@@ -842,6 +978,7 @@ HRESULT COutArchive::WriteDatabase(
     _crc = CRC_INIT_VAL;
     _countMode = encodeHeaders;
     _writeToStream = true;
+    _deferSections = false;
     _countSize = 0;
     WriteHeader(db, /* headerOptions, */ headerOffset);
 
@@ -852,15 +989,23 @@ HRESULT COutArchive::WriteDatabase(
       
       _countMode = false;
       _writeToStream = false;
+      _deferSections = (headerOptions.NumThreads > 1);
+      _sections.Clear();
       WriteHeader(db, /* headerOptions, */ headerOffset);
       
       if (_countSize != _outByte2.GetPos())
         return E_FAIL;
+      FillSections(headerOptions.NumThreads);
+      _deferSections = false;
+
+      const CCompressionMethodMode *compressOptions = options;
+      if (optionsMt && !optionsMt->Methods.IsEmpty() && _countSize >= kHeaderSize_for_MtMethod)
+        compressOptions = optionsMt;
 
       CCompressionMethodMode encryptOptions;
       encryptOptions.PasswordIsDefined = options->PasswordIsDefined;
       encryptOptions.Password = options->Password;
-      CEncoder encoder(headerOptions.CompressMainHeader ? *options : encryptOptions);
+      CEncoder encoder(headerOptions.CompressMainHeader ? *compressOptions : encryptOptions);
       CRecordVector<UInt64> packSizes;
       CObjectVector<CFolder> folders;
       COutFolders outFolders;
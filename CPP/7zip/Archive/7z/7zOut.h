@@ -44,13 +44,43 @@ public:
       throw 1;
     _data[_pos++] = b;
   }
+  Byte *ReserveBytes(size_t size)
+  {
+    if (size > _size - _pos)
+      throw 1;
+    Byte *p = _data + _pos;
+    _pos += size;
+    return p;
+  }
   size_t GetPos() const { return _pos; }
 };
 
 
+/*
+  CHeaderSection is the data of property for items in range [Start, End)
+  that has fixed position in header: names, times, attributes.
+  Such sections can be filled independently of each other and of the rest of header.
+*/
+
+struct CHeaderSection
+{
+  Byte *Dest;
+  unsigned Start;
+  unsigned End;
+  const UStringVector *Names;
+  const CUInt64DefVector *Vals64;
+  const CUInt32DefVector *Vals32;
+
+  CHeaderSection(): Dest(NULL), Start(0), End(0), Names(NULL), Vals64(NULL), Vals32(NULL) {}
+  size_t GetSize() const;
+  void Fill() const;
+};
+
+
 struct CHeaderOptions
 {
   bool CompressMainHeader;
+  UInt32 NumThreads; // for filling of header sections
   /*
   bool WriteCTime;
   bool WriteATime;
@@ -59,6 +89,7 @@ struct CHeaderOptions
 
   CHeaderOptions():
       CompressMainHeader(true)
+      , NumThreads(1)
       /*
       , WriteCTime(false)
       , WriteATime(false)
@@ -278,6 +309,8 @@ class COutArchive
   void SkipToAligned(unsigned pos, unsigned alignShifts);
   void WriteAlignedBools(const CBoolVector &v, unsigned numDefined, Byte type, unsigned itemSizeShifts);
   void WriteUInt64DefVector(const CUInt64DefVector &v, Byte type);
+  void WriteSections(CHeaderSection &s, unsigned numItems);
+  void FillSections(UInt32 numThreads);
 
   HRESULT EncodeStream(
       DECL_EXTERNAL_CODECS_LOC_VARS
@@ -291,6 +324,7 @@ class COutArchive
   bool _countMode;
   bool _writeToStream;
   bool _useAlign;
+  bool _deferSections;
   #ifdef Z7_7Z_VOL
   bool _endMarker;
   #endif
@@ -298,6 +332,7 @@ class COutArchive
   size_t _countSize;
   CWriteBufferLoc _outByte2;
   COutBuffer _outByte;
+  CRecordVector<CHeaderSection> _sections;
   UInt64 _signatureHeaderPos;
   CMyComPtr<IOutStream> Stream;
 
@@ -317,6 +352,7 @@ public:
       DECL_EXTERNAL_CODECS_LOC_VARS
       const CArchiveDatabaseOut &db,
       const CCompressionMethodMode *options,
+      const CCompressionMethodMode *optionsMt,
       const CHeaderOptions &headerOptions);
 
   #ifdef Z7_7Z_VOL
@@ -537,14 +537,11 @@ static HRESULT WriteRange(IInStream *inStream, ISequentialOutStream *outStream,
     UInt64 position, UInt64 size, ICompressProgressInfo *progress)
 {
   RINOK(InStream_SeekSet(inStream, position))
-  CLimitedSequentialInStream *streamSpec = new CLimitedSequentialInStream;
-  CMyComPtr<ISequentialInStream> inStreamLimited(streamSpec);
-  streamSpec->SetStream(inStream);
-  streamSpec->Init(size);
-
+  /* we pass (inStream) directly instead of limited stream wrapper.
+     So (outStream) can copy data from (inStream) without buffers (copy_file_range()) */
   NCompress::CCopyCoder *copyCoderSpec = new NCompress::CCopyCoder;
   CMyComPtr<ICompressCoder> copyCoder = copyCoderSpec;
-  RINOK(copyCoder->Code(inStreamLimited, outStream, NULL, NULL, progress))
+  RINOK(copyCoder->Code(inStream, outStream, NULL, &size, progress))
   return (copyCoderSpec->TotalSize == size ? S_OK : E_FAIL);
 }
 
@@ -965,10 +962,61 @@ static bool IsExt_ExeUnix_NumericAllowed(const UString &path)
 }
 
 
+/*
+  Content signature is used to place the files with similar contents
+  next to each other in solid block, even if the files have different names.
+  We use one-permutation MinHash of 8-byte shingles from the start of file.
+  The signature is stored as (kSig_NumBands) hashes of bands of MinHash values.
+  The files with equal hash of any band are treated as similar.
+*/
+
+static const unsigned kSig_NumBinsLog = 4;
+static const unsigned kSig_NumBins = 1 << kSig_NumBinsLog;
+static const unsigned kSig_NumBands = 4;
+static const unsigned kSig_BandSize = kSig_NumBins / kSig_NumBands;
+static const size_t kSig_BufSize = 1 << 16;
+static const size_t kSig_ShingleSize = 8;
+
+static bool GetContentSignature(const Byte *buf, size_t size, UInt32 *bandKeys)
+{
+  if (size < kSig_ShingleSize + kSig_NumBins)
+    return false;
+  UInt32 mins[kSig_NumBins];
+  unsigned i;
+  for (i = 0; i < kSig_NumBins; i++)
+    mins[i] = (UInt32)0xFFFFFFFF;
+  const Byte *lim = buf + size - kSig_ShingleSize;
+  for (const Byte *p = buf; p <= lim; p++)
+  {
+    const UInt64 v = GetUi64(p) * (UInt64)0x9E3779B97F4A7C15;
+    const unsigned bin = (unsigned)(v >> (64 - kSig_NumBinsLog));
+    const UInt32 val = (UInt32)(v >> (32 - kSig_NumBinsLog));
+    if (mins[bin] > val)
+      mins[bin] = val;
+  }
+  for (unsigned band = 0; band < kSig_NumBands; band++)
+  {
+    UInt32 h = CRC_INIT_VAL;
+    for (i = 0; i < kSig_BandSize; i++)
+    {
+      Byte b[4];
+      SetUi32(b, mins[band * kSig_BandSize + i])
+      h = CrcUpdate(h, b, 4);
+    }
+    bandKeys[band] = CRC_GET_DIGEST(h);
+  }
+  return true;
+}
+
+
 struct CAnalysis
 {
-  CMyComPtr<IArchiveUpdateCallbackFile> Callback;
+  CMyComPtr<IArchiveUpdateCallbackFile> Callback; // for filter analysis
+  CMyComPtr<IArchiveUpdateCallbackFile> SigCallback; // for content signatures
   CByteBuffer Buffer;
+  size_t BufferDataSize;
+  int BufferIndex; // index of file that was read to (Buffer)
+  bool NeedSignature;
 
   bool ParseWav;
   bool ParseExe;
@@ -983,6 +1031,9 @@ struct CAnalysis
   */
 
   CAnalysis():
+      BufferDataSize(0),
+      BufferIndex(-1),
+      NeedSignature(false),
       ParseWav(false),
       ParseExe(false),
       ParseExeUnix(false),
@@ -994,11 +1045,69 @@ struct CAnalysis
       */
   {}
 
+  HRESULT ReadFileStart(IArchiveUpdateCallbackFile *callback, UInt32 index, bool &isOK);
   HRESULT GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMode &filterMode);
+  HRESULT GetSignature(UInt32 index, const CUpdateItem &ui, UInt32 *bandKeys, bool &isDefined);
 };
 
 static const size_t kAnalysisBufSize = 1 << 14;
 
+/* it reads the start of file to (Buffer).
+   The file is read only once, if both filter and signature analysis need it. */
+
+HRESULT CAnalysis::ReadFileStart(IArchiveUpdateCallbackFile *callback, UInt32 index, bool &isOK)
+{
+  isOK = false;
+  if (BufferIndex == (int)index)
+  {
+    isOK = true;
+    return S_OK;
+  }
+  BufferIndex = -1;
+  const size_t bufSize = NeedSignature ? kSig_BufSize : kAnalysisBufSize;
+  if (Buffer.Size() != bufSize)
+    Buffer.Alloc(bufSize);
+  CMyComPtr<ISequentialInStream> stream;
+  HRESULT result = callback->GetStream2(index, &stream, NUpdateNotifyOp::kAnalyze);
+  if (result == S_OK && stream)
+  {
+    /*
+    if (Need_ATime)
+    {
+      // access time could be changed in analysis pass
+      CMyComPtr<IStreamGetProps> getProps;
+      stream.QueryInterface(IID_IStreamGetProps, (void **)&getProps);
+      if (getProps)
+        if (getProps->GetProps(NULL, NULL, &ATime, NULL, NULL) == S_OK)
+          ATime_Defined = true;
+    }
+    */
+    size_t size = bufSize;
+    result = ReadStream(stream, Buffer, &size);
+    stream.Release();
+    // RINOK(Callback->SetOperationResult2(index, NUpdate::NOperationResult::kOK));
+    if (result == S_OK)
+    {
+      BufferDataSize = size;
+      BufferIndex = (int)index;
+      isOK = true;
+    }
+  }
+  return S_OK;
+}
+
+HRESULT CAnalysis::GetSignature(UInt32 index, const CUpdateItem &ui, UInt32 *bandKeys, bool &isDefined)
+{
+  isDefined = false;
+  if (!SigCallback || ui.Size < kSig_ShingleSize + kSig_NumBins)
+    return S_OK;
+  bool isOK;
+  RINOK(ReadFileStart(SigCallback, index, isOK))
+  if (isOK)
+    isDefined = GetContentSignature(Buffer, BufferDataSize, bandKeys);
+  return S_OK;
+}
+
 HRESULT CAnalysis::GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMode &filterMode)
 {
   filterMode.Id = 0;
@@ -1088,32 +1197,10 @@ HRESULT CAnalysis::GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMo
       BoolInt parseRes = false;
       if (Callback)
       {
-        if (Buffer.Size() != kAnalysisBufSize)
-          Buffer.Alloc(kAnalysisBufSize);
-        CMyComPtr<ISequentialInStream> stream;
-        HRESULT result = Callback->GetStream2(index, &stream, NUpdateNotifyOp::kAnalyze);
-        if (result == S_OK && stream)
-        {
-          /*
-          if (Need_ATime)
-          {
-            // access time could be changed in analysis pass
-            CMyComPtr<IStreamGetProps> getProps;
-            stream.QueryInterface(IID_IStreamGetProps, (void **)&getProps);
-            if (getProps)
-              if (getProps->GetProps(NULL, NULL, &ATime, NULL, NULL) == S_OK)
-                ATime_Defined = true;
-          }
-          */
-          size_t size = kAnalysisBufSize;
-          result = ReadStream(stream, Buffer, &size);
-          stream.Release();
-          // RINOK(Callback->SetOperationResult2(index, NUpdate::NOperationResult::kOK));
-          if (result == S_OK)
-          {
-            parseRes = ParseFile(Buffer, size, &filterModeTemp);
-          }
-        }
+        bool isOK;
+        RINOK(ReadFileStart(Callback, index, isOK))
+        if (isOK)
+          parseRes = ParseFile(Buffer, MyMin(BufferDataSize, kAnalysisBufSize), &filterModeTemp);
       } // Callback
       else if (probablyIsSameIsa)
       {
@@ -1166,6 +1253,95 @@ HRESULT CAnalysis::GetFilterGroup(UInt32 index, const CUpdateItem &ui, CFilterMo
   return S_OK;
 }
 
+
+struct CSigRef
+{
+  UInt32 Key;
+  unsigned Pos;
+
+  int Compare(const CSigRef &a) const
+  {
+    RINOZ_COMP(Key, a.Key)
+    return MyCompare(Pos, a.Pos);
+  }
+};
+
+static unsigned Sig_FindRoot(CUIntArr &parents, unsigned i)
+{
+  while (parents[i] != i)
+  {
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
+
+/*
+  SortRefItems_by_Content() joins the items with equal band keys to clusters.
+  The root of cluster is the first item of cluster in (refItems).
+  Then it moves the items of each cluster to the position of its first item.
+  The order of items inside cluster and the order of clusters are not changed.
+*/
+
+static void SortRefItems_by_Content(CRecordVector<CRefItem> &refItems,
+    const CRecordVector<UInt32> &sigKeys, const CBoolVector &sigDefined)
+{
+  const unsigned num = refItems.Size();
+  if (num < 2)
+    return;
+  CUIntArr parents(num);
+  unsigned i;
+  for (i = 0; i < num; i++)
+    parents[i] = i;
+
+  CRecordVector<CSigRef> refs;
+  refs.ClearAndReserve(num);
+
+  for (unsigned band = 0; band < kSig_NumBands; band++)
+  {
+    refs.Clear();
+    for (i = 0; i < num; i++)
+    {
+      const UInt32 index = refItems[i].Index;
+      if (!sigDefined[index])
+        continue;
+      CSigRef ref;
+      ref.Key = sigKeys[index * kSig_NumBands + band];
+      ref.Pos = i;
+      refs.AddInReserved(ref);
+    }
+    refs.Sort2();
+    for (i = 1; i < refs.Size(); i++)
+    {
+      if (refs[i].Key != refs[i - 1].Key)
+        continue;
+      const unsigned r1 = Sig_FindRoot(parents, refs[i - 1].Pos);
+      const unsigned r2 = Sig_FindRoot(parents, refs[i].Pos);
+      if (r1 < r2)
+        parents[r2] = r1;
+      else if (r2 < r1)
+        parents[r1] = r2;
+    }
+  }
+
+  refs.Clear();
+  for (i = 0; i < num; i++)
+  {
+    CSigRef ref;
+    ref.Key = Sig_FindRoot(parents, i);
+    ref.Pos = i;
+    refs.AddInReserved(ref);
+  }
+  refs.Sort2();
+  
+  CRecordVector<CRefItem> temp;
+  temp.ClearAndReserve(num);
+  for (i = 0; i < num; i++)
+    temp.AddInReserved(refItems[refs[i].Pos]);
+  refItems = temp;
+}
+
+
 static inline void GetMethodFull(UInt64 methodID, UInt32 numStreams, CMethodFull &m)
 {
   m.Id = methodID;
@@ -1789,6 +1965,563 @@ Z7_COM7F_IMF(CCryptoGetTextPassword::CryptoGetTextPassword(BSTR *password))
 #endif
 
 
+// ---------- Partial repack of LZMA2 solid block ----------
+
+/*
+  LZMA2 stream is a sequence of chunks. A chunk that resets the dictionary
+  (control byte 1 or LZMA chunk with control byte >= 0xE0) doesn't depend
+  on any previous chunk. Multithreaded LZMA2 encoder starts each block with
+  such chunk. So if a solid block uses only one LZMA2 coder, we can copy
+  the packed chunks between reset points as is, and we decode and encode
+  again only the segments that contain the data of removed files.
+  The new chunks also start with dictionary reset, so the result is
+  one correct LZMA2 stream, and the block is not split to new blocks.
+*/
+
+struct CLzma2ResetPoint
+{
+  UInt64 PackPos;   // offset of chunk in pack stream
+  UInt64 UnpackPos; // offset of chunk data in unpack stream
+};
+
+static const Byte kLzma2PropMax = 40;
+
+static UInt32 Lzma2_GetDicSize(Byte prop)
+{
+  return (prop == kLzma2PropMax) ? (UInt32)0xFFFFFFFF :
+      (UInt32)(2 | (prop & 1)) << (prop / 2 + 11);
+}
+
+static bool IsFolder_Lzma2_Simple(const CFolder &f)
+{
+  if (f.Coders.Size() != 1
+      || f.PackStreams.Size() != 1
+      || f.Bonds.Size() != 0)
+    return false;
+  const CCoderInfo &coder = f.Coders[0];
+  return coder.MethodID == k_LZMA2
+      && coder.IsSimpleCoder()
+      && coder.Props.Size() == 1
+      && coder.Props[0] <= kLzma2PropMax;
+}
+
+/*
+  it reads the headers of all chunks in LZMA2 stream.
+  (points) : the list of reset points and the final item that
+             points to end marker of stream.
+  it returns S_FALSE, if the stream is not supported.
+*/
+
+static HRESULT Lzma2_GetResetPoints(IInStream *inStream,
+    UInt64 startPos, UInt64 packSize, UInt64 unpackSize,
+    CRecordVector<CLzma2ResetPoint> &points)
+{
+  points.Clear();
+  UInt64 pos = 0;
+  UInt64 unpackPos = 0;
+
+  for (;;)
+  {
+    if (pos >= packSize)
+      return S_FALSE;
+    Byte h[6];
+    size_t rem = 6;
+    if (rem > packSize - pos)
+      rem = (size_t)(packSize - pos);
+    RINOK(InStream_SeekSet(inStream, startPos + pos))
+    RINOK(ReadStream_FALSE(inStream, h, rem))
+    
+    const unsigned c = h[0];
+    if (c == 0)
+    {
+      if (pos + 1 != packSize || unpackPos != unpackSize)
+        return S_FALSE;
+      CLzma2ResetPoint p;
+      p.PackPos = pos;
+      p.UnpackPos = unpackPos;
+      points.Add(p);
+      return S_OK;
+    }
+
+    UInt32 unpackChunk, packChunk;
+    unsigned headerSize;
+    bool reset;
+    
+    if (c < 0x80)
+    {
+      if (c > 2 || rem < 3)
+        return S_FALSE;
+      unpackChunk = (((UInt32)h[1] << 8) | h[2]) + 1;
+      packChunk = unpackChunk;
+      headerSize = 3;
+      reset = (c == 1);
+    }
+    else
+    {
+      headerSize = (c >= 0xC0) ? 6 : 5;
+      if (rem < headerSize)
+        return S_FALSE;
+      unpackChunk = (((UInt32)(c & 0x1F) << 16) | ((UInt32)h[1] << 8) | h[2]) + 1;
+      packChunk = (((UInt32)h[3] << 8) | h[4]) + 1;
+      reset = (c >= 0xE0);
+    }
+
+    if (reset)
+    {
+      CLzma2ResetPoint p;
+      p.PackPos = pos;
+      p.UnpackPos = unpackPos;
+      points.Add(p);
+    }
+    else if (points.IsEmpty())
+      return S_FALSE;
+
+    pos += headerSize + packChunk;
+    unpackPos += unpackChunk;
+  }
+}
+
+
+/* it writes all data to (Stream) except of last byte,
+   that can be end marker of LZMA2 stream */
+
+Z7_CLASS_IMP_NOQIB_1(
+  COutStreamWithoutLastByte
+  , ISequentialOutStream
+)
+  bool _wasHeld;
+  Byte _held;
+public:
+  CMyComPtr<ISequentialOutStream> Stream;
+  UInt64 Size; // the number of bytes written to (Stream)
+
+  void Init()
+  {
+    _wasHeld = false;
+    Size = 0;
+  }
+  bool GetLastByte(Byte &b) const
+  {
+    b = _held;
+    return _wasHeld;
+  }
+};
+
+Z7_COM7F_IMF(COutStreamWithoutLastByte::Write(const void *data, UInt32 size, UInt32 *processedSize))
+{
+  if (processedSize)
+    *processedSize = 0;
+  if (size == 0)
+    return S_OK;
+  if (_wasHeld)
+  {
+    RINOK(WriteStream(Stream, &_held, 1))
+    Size++;
+  }
+  const UInt32 cur = size - 1;
+  RINOK(WriteStream(Stream, data, cur))
+  Size += cur;
+  _held = ((const Byte *)data)[cur];
+  _wasHeld = true;
+  if (processedSize)
+    *processedSize = size;
+  return S_OK;
+}
+
+
+struct CRepackRange
+{
+  UInt64 Size;
+  UInt32 ArcIndex;
+  bool Keep;
+  bool CheckCrc; // the range contains full file with defined CRC
+};
+
+/* it reads the decoded data of one segment of folder
+   and returns only the data of files that must be kept */
+
+Z7_CLASS_IMP_NOQIB_1(
+  CRepackRangesInStream
+  , ISequentialInStream
+)
+  unsigned _rangeIndex;
+  UInt64 _rem;
+  UInt32 _crc;
+  Byte *_buf;
+public:
+  CMyComPtr<ISequentialInStream> Stream;
+  CMyComPtr<IArchiveExtractCallbackMessage2> ExtractCallback;
+  const CDbEx *Db;
+  CRecordVector<CRepackRange> Ranges;
+  bool DataError;
+  UInt64 KeepSize;
+
+  CRepackRangesInStream(): _buf(NULL) {}
+  ~CRepackRangesInStream() { delete []_buf; }
+
+  HRESULT Init()
+  {
+    if (!_buf)
+      _buf = new Byte[kTempBufSize];
+    _rangeIndex = 0;
+    _rem = Ranges.IsEmpty() ? 0 : Ranges[0].Size;
+    _crc = CRC_INIT_VAL;
+    DataError = false;
+    KeepSize = 0;
+    return S_OK;
+  }
+  bool WasFinished() const { return _rangeIndex == Ranges.Size(); }
+};
+
+Z7_COM7F_IMF(CRepackRangesInStream::Read(void *data, UInt32 size, UInt32 *processedSize))
+{
+  if (processedSize)
+    *processedSize = 0;
+
+  while (size != 0 && _rangeIndex < Ranges.Size())
+  {
+    const CRepackRange &r = Ranges[_rangeIndex];
+    if (_rem != 0)
+    {
+      UInt32 cur = (size < _rem ? size : (UInt32)_rem);
+      Byte *buf;
+      if (r.Keep)
+        buf = (Byte *)data;
+      else
+      {
+        buf = _buf;
+        if (cur > kTempBufSize)
+          cur = kTempBufSize;
+      }
+      RINOK(Stream->Read(buf, cur, &cur))
+      if (cur == 0)
+      {
+        DataError = true;
+        return S_FALSE;
+      }
+      if (r.CheckCrc)
+        _crc = CrcUpdate(_crc, buf, cur);
+      _rem -= cur;
+      if (r.Keep)
+      {
+        KeepSize += cur;
+        data = (Byte *)data + cur;
+        size -= cur;
+        if (processedSize)
+          *processedSize += cur;
+      }
+      if (_rem != 0)
+        continue;
+    }
+
+    if (r.CheckCrc && Db->Files[r.ArcIndex].Crc != CRC_GET_DIGEST(_crc))
+    {
+      if (ExtractCallback)
+      {
+        RINOK(ExtractCallback->ReportExtractResult(
+            NEventIndexType::kInArcIndex, r.ArcIndex,
+            NExtract::NOperationResult::kCRCError))
+      }
+      return k_My_HRESULT_CRC_ERROR;
+    }
+    _crc = CRC_INIT_VAL;
+    _rangeIndex++;
+    if (_rangeIndex < Ranges.Size())
+      _rem = Ranges[_rangeIndex].Size;
+  }
+  
+  return S_OK;
+}
+
+
+struct CLzma2PartialRepack
+{
+  const CDbEx *Db;
+  IInStream *InStream;
+  ISequentialOutStream *OutStream;
+  const CCompressionMethodMode *Method;
+  CLocalProgress *Lps;
+  IArchiveUpdateCallbackFile *OpCallback;
+  IArchiveExtractCallbackMessage2 *ExtractCallback;
+
+  // out:
+  UInt64 PackSize;
+  UInt64 UnpackSize;
+
+  HRESULT Repack(
+      DECL_EXTERNAL_CODECS_LOC_VARS
+      unsigned folderIndex, const CBoolVector &extractStatuses);
+};
+
+
+/*
+  it returns S_FALSE, if partial repack is not possible or useless.
+  In that case it doesn't write any data to (OutStream).
+*/
+
+HRESULT CLzma2PartialRepack::Repack(
+    DECL_EXTERNAL_CODECS_LOC_VARS
+    unsigned folderIndex, const CBoolVector &extractStatuses)
+{
+  PackSize = 0;
+  UnpackSize = 0;
+
+  /* the new folder keeps the coder of source folder.
+     So the update method must be plain LZMA2 without filters and encryption,
+     as the full repack would write it. */
+  if (Method->PasswordIsDefined
+      || Method->Methods.Size() != 1
+      || Method->Methods[0].Id != k_LZMA2)
+    return S_FALSE;
+
+  Byte prop;
+  {
+    CFolder f;
+    Db->ParseFolderInfo(folderIndex, f);
+    if (!IsFolder_Lzma2_Simple(f))
+      return S_FALSE;
+    prop = f.Coders[0].Props[0];
+  }
+
+  const UInt64 packSize = Db->GetFolderFullPackSize(folderIndex);
+  const UInt64 unpackSize = Db->GetFolderUnpackSize(folderIndex);
+  const UInt64 startPos = Db->GetFolderStreamPos(folderIndex, 0);
+
+  CRecordVector<CLzma2ResetPoint> points;
+  RINOK(Lzma2_GetResetPoints(InStream, startPos, packSize, unpackSize, points))
+  const unsigned numSegments = points.Size() - 1;
+  if (numSegments < 2)
+    return S_FALSE;
+
+  CBoolArr dirty(numSegments);
+  {
+    for (unsigned k = 0; k < numSegments; k++)
+      dirty[k] = false;
+    const UInt32 startIndex = Db->FolderStartFileIndex[folderIndex];
+    if (startIndex + extractStatuses.Size() > Db->Files.Size())
+      return S_FALSE;
+    {
+      // the sizes of files must cover the folder exactly,
+      // otherwise the walk below could go out of (points)
+      UInt64 sum = 0;
+      FOR_VECTOR (i, extractStatuses)
+      {
+        const CFileItem &file = Db->Files[startIndex + i];
+        if (!file.HasStream)
+          continue;
+        if (file.Size > unpackSize - sum)
+          return S_FALSE;
+        sum += file.Size;
+      }
+      if (sum != unpackSize)
+        return S_FALSE;
+    }
+    UInt64 pos = 0;
+    unsigned k = 0;
+    FOR_VECTOR (i, extractStatuses)
+    {
+      const CFileItem &file = Db->Files[startIndex + i];
+      if (!file.HasStream)
+        continue;
+      const UInt64 end = pos + file.Size;
+      if (!extractStatuses[i] && end != pos)
+      {
+        while (k + 1 < points.Size() && points[k + 1].UnpackPos <= pos)
+          k++;
+        if (k >= numSegments)
+          return S_FALSE;
+        for (unsigned k2 = k; k2 < numSegments && points[k2].UnpackPos < end; k2++)
+          dirty[k2] = true;
+      }
+      pos = end;
+    }
+    
+    unsigned numDirty = 0;
+    for (k = 0; k < numSegments; k++)
+      if (dirty[k])
+        numDirty++;
+    if (numDirty == 0 || numDirty == numSegments)
+      return S_FALSE;
+  }
+
+  CMethodProps props;
+  props.Props = Method->Methods[0].Props;
+  {
+    // new chunks must not use dictionary larger than dictionary from folder properties
+    const UInt32 dicSize = Lzma2_GetDicSize(prop);
+    UInt64 dicSize2;
+    if (!props.Get_DicSize(dicSize2) || dicSize2 > dicSize)
+    {
+      const int index = props.FindProp(NCoderPropID::kDictionarySize);
+      if (index >= 0)
+        props.Props.Delete((unsigned)index);
+      props.AddProp32(NCoderPropID::kDictionarySize, dicSize);
+    }
+  }
+
+  CMyComPtr<ICompressCoder> decoder;
+  CMyComPtr<ICompressCoder> encoder;
+  RINOK(CreateCoder_Id(EXTERNAL_CODECS_LOC_VARS k_LZMA2, false, decoder))
+  RINOK(CreateCoder_Id(EXTERNAL_CODECS_LOC_VARS k_LZMA2, true, encoder))
+  if (!decoder || !encoder)
+    return S_FALSE;
+
+  Z7_DECL_CMyComPtr_QI_FROM(ICompressSetDecoderProperties2, setDecProps, decoder)
+  Z7_DECL_CMyComPtr_QI_FROM(ICompressSetInStream, setInStream, decoder)
+  Z7_DECL_CMyComPtr_QI_FROM(ICompressSetOutStreamSize, setOutStreamSize, decoder)
+  Z7_DECL_CMyComPtr_QI_FROM(ISequentialInStream, decoderStream, decoder)
+  Z7_DECL_CMyComPtr_QI_FROM(ICompressSetCoderProperties, setEncProps, encoder)
+  if (!setDecProps || !setInStream || !setOutStreamSize || !decoderStream || !setEncProps)
+    return S_FALSE;
+  RINOK(setDecProps->SetDecoderProperties2(&prop, 1))
+
+  // ---------- now we write data ----------
+
+  CLimitedSequentialInStream *limitedSpec = new CLimitedSequentialInStream;
+  CMyComPtr<ISequentialInStream> limitedStream = limitedSpec;
+  limitedSpec->SetStream(InStream);
+
+  CRepackRangesInStream *rangesSpec = new CRepackRangesInStream;
+  CMyComPtr<ISequentialInStream> rangesStream = rangesSpec;
+  rangesSpec->Stream = decoderStream;
+  rangesSpec->ExtractCallback = ExtractCallback;
+  rangesSpec->Db = Db;
+
+  COutStreamWithoutLastByte *outSpec = new COutStreamWithoutLastByte;
+  CMyComPtr<ISequentialOutStream> outStream = outSpec;
+  outSpec->Stream = OutStream;
+
+  CMyComPtr<ICompressProgressInfo> progress = Lps;
+  // we restore (InSize) and (OutSize) of (Lps) at the end, the caller adds the final sizes
+  const UInt64 inSize0 = Lps->InSize;
+  const UInt64 outSize0 = Lps->OutSize;
+  
+  const UInt32 startIndex = Db->FolderStartFileIndex[folderIndex];
+  unsigned fileIndex = 0;
+  UInt64 filePos = 0;
+  
+  for (unsigned k = 0; k < numSegments;)
+  {
+    const bool isDirty = dirty[k];
+    unsigned k2 = k + 1;
+    while (k2 < numSegments && dirty[k2] == isDirty)
+      k2++;
+    
+    const UInt64 rangeStart = points[k].UnpackPos;
+    const UInt64 rangeEnd = points[k2].UnpackPos;
+    
+    rangesSpec->Ranges.Clear();
+    
+    for (; fileIndex < extractStatuses.Size(); fileIndex++)
+    {
+      const CFileItem &file = Db->Files[startIndex + fileIndex];
+      if (!file.HasStream)
+        continue;
+      const UInt64 fileEnd = filePos + file.Size;
+      if (filePos >= rangeEnd)
+        break;
+      
+      const UInt64 start = MyMax(filePos, rangeStart);
+      const UInt64 end = MyMin(fileEnd, rangeEnd);
+      const bool keep = extractStatuses[fileIndex];
+      
+      // we report file only once, when its first byte is processed
+      if (OpCallback && filePos >= rangeStart)
+      {
+        RINOK(OpCallback->ReportOperation(
+            NEventIndexType::kInArcIndex, startIndex + fileIndex,
+            !keep ? NUpdateNotifyOp::kSkip :
+            (!isDirty && fileEnd <= rangeEnd) ?
+              NUpdateNotifyOp::kReplicate :
+              NUpdateNotifyOp::kRepack))
+      }
+      
+      CRepackRange r;
+      r.Size = end - start;
+      r.ArcIndex = startIndex + fileIndex;
+      r.Keep = keep;
+      r.CheckCrc = (file.CrcDefined && start == filePos && end == fileEnd);
+      rangesSpec->Ranges.Add(r);
+      
+      if (fileEnd > rangeEnd)
+        break;
+      filePos = fileEnd;
+    }
+
+    const UInt64 segPackPos = points[k].PackPos;
+    const UInt64 segPackSize = points[k2].PackPos - segPackPos;
+
+    if (!isDirty)
+    {
+      RINOK(WriteRange(InStream, OutStream, startPos + segPackPos, segPackSize, progress))
+      const UInt64 size = rangeEnd - rangeStart;
+      PackSize += segPackSize;
+      UnpackSize += size;
+    }
+    else
+    {
+      UInt64 keepSize = 0;
+      FOR_VECTOR (i, rangesSpec->Ranges)
+        if (rangesSpec->Ranges[i].Keep)
+          keepSize += rangesSpec->Ranges[i].Size;
+
+      // if all files in segment are removed, we don't need to decode it
+      if (keepSize != 0)
+      {
+        RINOK(InStream_SeekSet(InStream, startPos + segPackPos))
+        limitedSpec->Init(segPackSize);
+        RINOK(setInStream->SetInStream(limitedStream))
+        const UInt64 segUnpackSize = rangeEnd - rangeStart;
+        RINOK(setOutStreamSize->SetOutStreamSize(&segUnpackSize))
+        RINOK(rangesSpec->Init())
+        RINOK(props.SetCoderProps(setEncProps, &keepSize))
+        outSpec->Init();
+        
+        const HRESULT res = encoder->Code(rangesStream, outStream, NULL, NULL, progress);
+        setInStream->ReleaseInStream();
+        
+        if (res == S_FALSE || rangesSpec->DataError)
+        {
+          if (ExtractCallback)
+          {
+            RINOK(ExtractCallback->ReportExtractResult(
+                NEventIndexType::kBlockIndex, (UInt32)folderIndex,
+                NExtract::NOperationResult::kDataError))
+          }
+          return E_FAIL;
+        }
+        if (res == k_My_HRESULT_CRC_ERROR)
+          return E_FAIL;
+        RINOK(res)
+        
+        Byte b;
+        if (!rangesSpec->WasFinished()
+            || rangesSpec->KeepSize != keepSize
+            || !outSpec->GetLastByte(b) || b != 0)
+          return E_FAIL;
+        
+        PackSize += outSpec->Size;
+        UnpackSize += keepSize;
+      }
+    }
+    
+    Lps->InSize = inSize0 + UnpackSize;
+    Lps->OutSize = outSize0 + PackSize;
+    RINOK(Lps->SetCur())
+    k = k2;
+  }
+
+  Lps->InSize = inSize0;
+  Lps->OutSize = outSize0;
+
+  // end marker of LZMA2 stream
+  const Byte endMarker = 0;
+  RINOK(WriteStream(OutStream, &endMarker, 1))
+  PackSize++;
+  return S_OK;
+}
+
+
 static void GetFile(const CDatabase &inDb, unsigned index, CFileItem &file, CFileItem2 &file2)
 {
   file = inDb.Files[index];
@@ -1801,6 +2534,133 @@ static void GetFile(const CDatabase &inDb, unsigned index, CFileItem &file, CFil
   // file2.IsAux = inDb.IsItemAux(index);
 }
 
+/* the paths of merged items must differ from the paths of other items.
+   Files are copied in whole solid blocks, so we can't skip one file.
+   So duplicated file is error, and duplicated directory is skipped. */
+
+struct CMergeName
+{
+  unsigned NameIndex;
+  unsigned ArcIndex; // (0) : items of update, (i + 1) : merged archive (i)
+  unsigned Index;
+  bool IsDir;
+};
+
+static int CompareMergeNames(const CMergeName *p1, const CMergeName *p2, void *param)
+{
+  const UStringVector &names = *(const UStringVector *)param;
+  RINOZ(CompareFileNames(names[p1->NameIndex], names[p2->NameIndex]))
+  RINOZ_COMP(p1->ArcIndex, p2->ArcIndex)
+  return MyCompare(p1->Index, p2->Index);
+}
+
+static HRESULT CheckMergeNames(const CObjectVector<CUpdateItem> &updateItems,
+    const CObjectVector<CMergeArc> &mergeArcs, CObjectVector<CBoolVector> &skipItems)
+{
+  UStringVector names;
+  CRecordVector<CMergeName> items;
+  unsigned i;
+  
+  FOR_VECTOR (k, updateItems)
+  {
+    CMergeName item;
+    item.NameIndex = names.Add(updateItems[k].Name);
+    item.ArcIndex = 0;
+    item.Index = k;
+    item.IsDir = updateItems[k].IsDir;
+    items.Add(item);
+  }
+  
+  for (i = 0; i < mergeArcs.Size(); i++)
+  {
+    const CDbEx &db = mergeArcs[i].Db;
+    CBoolVector &skip = skipItems.AddNew();
+    skip.ClearAndSetSize(db.Files.Size());
+    FOR_VECTOR (k, db.Files)
+    {
+      skip[k] = false;
+      CMergeName item;
+      item.NameIndex = names.Add(UString());
+      db.GetPath(k, names.Back());
+      item.ArcIndex = i + 1;
+      item.Index = k;
+      item.IsDir = db.Files[k].IsDir;
+      items.Add(item);
+    }
+  }
+
+  items.Sort(CompareMergeNames, (void *)&names);
+
+  for (i = 0; i < items.Size();)
+  {
+    const CMergeName &first = items[i];
+    for (i++; i < items.Size(); i++)
+    {
+      const CMergeName &item = items[i];
+      if (CompareFileNames(names[first.NameIndex], names[item.NameIndex]) != 0)
+        break;
+      // the duplicates inside one source are allowed as before
+      if (item.ArcIndex == first.ArcIndex)
+        continue;
+      if (!item.IsDir || !first.IsDir)
+        return HRESULT_FROM_WIN32(ERROR_FILE_EXISTS);
+      skipItems[item.ArcIndex - 1][item.Index] = true;
+    }
+  }
+  
+  return S_OK;
+}
+
+/* CopyArchive() copies all solid blocks of (db) without recompression
+   and adds the items of (db) to the end of (newDatabase),
+   except of items marked in (skipItems). */
+
+static HRESULT CopyArchive(IInStream *inStream, const CDbEx &db,
+    const CBoolVector &skipItems,
+    ISequentialOutStream *outStream, CArchiveDatabaseOut &newDatabase,
+    CLocalProgress *lps, ICompressProgressInfo *progress)
+{
+  for (CNum folderIndex = 0; folderIndex < db.NumFolders; folderIndex++)
+  {
+    const UInt64 packSize = db.GetFolderFullPackSize(folderIndex);
+    RINOK(WriteRange(inStream, outStream,
+        db.GetFolderStreamPos(folderIndex, 0), packSize, progress))
+    lps->ProgressOffset += packSize;
+
+    const unsigned folderIndex_New = newDatabase.Folders.Size();
+    CFolder &folder = newDatabase.Folders.AddNew();
+    if (db.FolderCRCs.ValidAndDefined(folderIndex))
+      newDatabase.FolderUnpackCRCs.SetItem(folderIndex_New,
+          true, db.FolderCRCs.Vals[folderIndex]);
+
+    db.ParseFolderInfo(folderIndex, folder);
+    const CNum startIndex = db.FoStartPackStreamIndex[folderIndex];
+    FOR_VECTOR (j, folder.PackStreams)
+      newDatabase.PackSizes.Add(db.GetStreamPackSize(startIndex + j));
+
+    size_t indexStart = db.FoToCoderUnpackSizes[folderIndex];
+    const size_t indexEnd = db.FoToCoderUnpackSizes[folderIndex + 1];
+    for (; indexStart < indexEnd; indexStart++)
+      newDatabase.CoderUnpackSizes.Add(db.CoderUnpackSizes[indexStart]);
+
+    newDatabase.NumUnpackStreamsVector.Add(db.NumUnpackStreamsVector[folderIndex]);
+  }
+
+  // the order of items with streams must be same as order of solid blocks
+  FOR_VECTOR (i, db.Files)
+  {
+    if (skipItems[i])
+      continue;
+    CFileItem file;
+    CFileItem2 file2;
+    UString name;
+    GetFile(db, i, file, file2);
+    db.GetPath(i, name);
+    newDatabase.AddFile(file, file2, name);
+  }
+  return S_OK;
+}
+
 HRESULT Update(
     DECL_EXTERNAL_CODECS_LOC_VARS
     IInStream *inStream,
@@ -1867,6 +2727,10 @@ HRESULT Update(
 
   CRecordVector<CFilterMode2> filters;
   CObjectVector<CSolidGroup> groups;
+
+  // content signatures of new files for UseContentSorting mode
+  CRecordVector<UInt32> sigKeys;
+  CBoolVector sigDefined;
   
   #ifndef Z7_ST
   bool thereAreRepacks = false;
@@ -1989,6 +2853,18 @@ HRESULT Update(
   if (inSizeForReduce < inSizeForReduce2)
     inSizeForReduce = inSizeForReduce2;
 
+  CObjectVector<CBoolVector> mergeSkipItems;
+  if (options.MergeArcs)
+  {
+    RINOK(CheckMergeNames(updateItems, *options.MergeArcs, mergeSkipItems))
+    FOR_VECTOR (i, *options.MergeArcs)
+    {
+      const CDbEx &mergeDb = (*options.MergeArcs)[i].Db;
+      for (CNum k = 0; k < mergeDb.NumFolders; k++)
+        complexity += mergeDb.GetFolderFullPackSize(k);
+    }
+  }
+
   RINOK(updateCallback->SetTotal(complexity))
 
   CLocalProgress *lps = new CLocalProgress;
@@ -2028,6 +2904,15 @@ HRESULT Update(
     // (analysisLevel < 0) means default level (5)
     if (analysisLevel < 0)
       analysisLevel = 5;
+    if (options.UseContentSorting)
+    {
+      analysis.SigCallback = opCallback;
+      analysis.NeedSignature = true;
+      sigKeys.ClearAndSetSize(updateItems.Size() * kSig_NumBands);
+      sigDefined.ClearAndSetSize(updateItems.Size());
+      FOR_VECTOR (i, sigDefined)
+        sigDefined[i] = false;
+    }
     if (analysisLevel != 0)
     {
       analysis.Callback = opCallback;
@@ -2071,6 +2956,13 @@ HRESULT Update(
       }
       fm.Encrypted = method.PasswordIsDefined;
 
+      if (options.UseContentSorting)
+      {
+        bool isDefined;
+        RINOK(analysis.GetSignature(i, ui, &sigKeys[i * kSig_NumBands], isDefined))
+        sigDefined[i] = isDefined;
+      }
+
       const unsigned groupIndex = GetGroup(filters, fm);
       while (groupIndex >= groups.Size())
         groups.AddNew();
@@ -2340,7 +3232,9 @@ HRESULT Update(
 
         /* We could reduce data size of decoded folder, if we don't need to repack
            last files in folder. But the gain in speed is small in most cases.
-           So we unpack full folder. */
+           So we unpack full folder.
+           But if folder is LZMA2 stream with dictionary reset points,
+           CLzma2PartialRepack copies the unchanged segments of folder as is. */
            
         UInt64 sizeToEncode = 0;
   
@@ -2379,6 +3273,32 @@ HRESULT Update(
 
         unsigned startPackIndex = newDatabase.PackSizes.Size();
         UInt64 curUnpackSize;
+
+        CLzma2PartialRepack partialRepack;
+        partialRepack.Db = db;
+        partialRepack.InStream = inStream;
+        partialRepack.OutStream = archive.SeqStream;
+        partialRepack.Method = &method;
+        partialRepack.Lps = lps;
+        partialRepack.OpCallback = opCallback;
+        partialRepack.ExtractCallback = extractCallback;
+        const HRESULT partialRes = partialRepack.Repack(
+            EXTERNAL_CODECS_LOC_VARS
+            folderIndex, extractStatuses);
+        
+        if (partialRes == S_OK)
+        {
+          curUnpackSize = partialRepack.UnpackSize;
+          if (curUnpackSize != sizeToEncode)
+            return E_FAIL;
+          // the new folder uses same LZMA2 coder and properties
+          db->ParseFolderInfo(folderIndex, newDatabase.Folders.AddNew());
+          newDatabase.PackSizes.Add(partialRepack.PackSize);
+          newDatabase.CoderUnpackSizes.Add(curUnpackSize);
+        }
+        else if (partialRes != S_FALSE)
+          return partialRes;
+        else
         {
           CMyComPtr<ISequentialInStream> sbInStream;
           CRepackStreamBase *repackBase;
@@ -2618,6 +3538,8 @@ HRESULT Update(
     // sortParam.TreeFolders = &treeFolders;
     sortParam.SortByType = sortByType;
     refItems.Sort(CompareUpdateItems, (void *)&sortParam);
+    if (options.UseContentSorting)
+      SortRefItems_by_Content(refItems, sigKeys, sigDefined);
     
     CObjArray<UInt32> indices(numFiles);
 
@@ -2691,7 +3613,11 @@ HRESULT Update(
       inStreamSpec->Need_Attrib = options.Need_Attrib;
       // inStreamSpec->Need_Crc = options.Need_Crc;
 
-      inStreamSpec->Init(updateCallback, &indices[i], numSubFiles);
+      #ifndef Z7_ST
+      inStreamSpec->NumReadAheadFiles = options.NumReadAheadFiles;
+      #endif
+
+      RINOK(inStreamSpec->Init(updateCallback, &indices[i], numSubFiles))
       
       unsigned startPackIndex = newDatabase.PackSizes.Size();
       // UInt64 curFolderUnpackSize = totalSize;
@@ -2934,6 +3860,16 @@ HRESULT Update(
     }
   }
 
+  // ---------- Copy solid blocks of merged archives ----------
+
+  if (options.MergeArcs)
+    FOR_VECTOR (i, *options.MergeArcs)
+    {
+      const CMergeArc &mergeArc = (*options.MergeArcs)[i];
+      RINOK(CopyArchive(mergeArc.Stream, mergeArc.Db, mergeSkipItems[i],
+          archive.SeqStream, newDatabase, lps, progress))
+    }
+
   RINOK(lps->SetCur())
 
   /*
@@ -2980,7 +3916,7 @@ HRESULT Update(
     RINOK(opCallback->ReportOperation(NEventIndexType::kNoIndex, (UInt32)(Int32)-1, NUpdateNotifyOp::kHeader))
 
   RINOK(archive.WriteDatabase(EXTERNAL_CODECS_LOC_VARS
-      newDatabase, options.HeaderMethod, options.HeaderOptions))
+      newDatabase, options.HeaderMethod, options.HeaderMethodMt, options.HeaderOptions))
 
   if (v_StreamSetRestriction)
     RINOK(v_StreamSetRestriction->SetRestriction(0, 0))
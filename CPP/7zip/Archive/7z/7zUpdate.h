@@ -86,10 +86,21 @@ struct CUpdateItem
   // UString GetExtension() const;
 };
 
+/* CMergeArc is the source archive for merge operation.
+   All solid blocks of such archive are copied without recompression. */
+
+struct CMergeArc
+{
+  CMyComPtr<IInStream> Stream;
+  CDbEx Db;
+};
+
 struct CUpdateOptions
 {
   const CCompressionMethodMode *Method;
   const CCompressionMethodMode *HeaderMethod;
+  const CCompressionMethodMode *HeaderMethodMt; // for big headers
+  const CObjectVector<CMergeArc> *MergeArcs;
   bool UseFilters; // use additional filters for some files
   bool MaxFilter;  // use BCJ2 filter instead of BCJ
   int AnalysisLevel;
@@ -99,9 +110,11 @@ struct CUpdateOptions
   bool SolidExtension;
   
   bool UseTypeSorting;
+  bool UseContentSorting;
   
   bool RemoveSfxBlock;
   bool MultiThreadMixer;
+  UInt32 NumReadAheadFiles;
 
   bool Need_CTime;
   bool Need_ATime;
@@ -114,6 +127,8 @@ struct CUpdateOptions
   CUpdateOptions():
       Method(NULL),
       HeaderMethod(NULL),
+      HeaderMethodMt(NULL),
+      MergeArcs(NULL),
       UseFilters(false),
       MaxFilter(false),
       AnalysisLevel(-1),
@@ -121,8 +136,10 @@ struct CUpdateOptions
       NumSolidBytes((UInt64)(Int64)(-1)),
       SolidExtension(false),
       UseTypeSorting(true),
+      UseContentSorting(false),
       RemoveSfxBlock(false),
       MultiThreadMixer(true),
+      NumReadAheadFiles(0),
       Need_CTime(false),
       Need_ATime(false),
       Need_MTime(false),
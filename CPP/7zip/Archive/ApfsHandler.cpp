@@ -32,6 +32,7 @@
 
 #include "../Compress/CopyCoder.h"
 
+#include "Common/HandlerOut.h"
 #include "Common/ItemNameUtils.h"
 
 #include "HfsHandler.h"
@@ -1917,9 +1918,26 @@ struct CObjectMap
 {
   CRecordVector<UInt64> Keys;
   CRecordVector<omap_val> Vals;
+  mutable unsigned LastIndex;
 
+  CObjectMap(): LastIndex(0) {}
   bool Parse(const CObjectVector<CKeyValPair> &pairs);
-  int FindKey(UInt64 id) const { return Keys.FindInSorted(id); }
+  
+  int FindKey(UInt64 id) const
+  {
+    /* child nodes of B-tree usually have ascending virtual ids,
+       so we check the item after previous found item before binary search */
+    const unsigned next = LastIndex + 1;
+    if (next < Keys.Size() && Keys[next] == id)
+    {
+      LastIndex = next;
+      return (int)next;
+    }
+    const int index = Keys.FindInSorted(id);
+    if (index >= 0)
+      LastIndex = (unsigned)index;
+    return index;
+  }
 };
 
 bool CObjectMap::Parse(const CObjectVector<CKeyValPair> &pairs)
@@ -1976,6 +1994,14 @@ struct CMap
 
 
 
+struct CNodeRef
+{
+  UInt64 paddr;
+  const Byte *hash;
+  bool noHeader;
+};
+
+
 struct CDatabase
 {
   CRecordVector<CRef2> Refs2;
@@ -1995,6 +2021,13 @@ struct CDatabase
   UInt64 ProgressVal_NumFilesTotal;
   CObjectVector<CByteBuffer> Buffers;
 
+  /* the cache of prefetched B-tree nodes (sorted by physical block).
+     Each node is read only once in full scan of tree,
+     so the block is removed from cache, when it's used. */
+  CRecordVector<UInt64> CacheBlocks;
+  CObjectVector<CByteBuffer> CacheData;
+  size_t CacheSize;
+
   UInt32 MethodsMask;
   UInt64 GetSize(const UInt32 index) const;
 
@@ -2014,9 +2047,18 @@ struct CDatabase
     Vols.Clear();
     Refs2.Clear();
     Buffers.Clear();
+    ClearNodeCache();
+  }
+
+  void ClearNodeCache()
+  {
+    CacheBlocks.Clear();
+    CacheData.Clear();
+    CacheSize = 0;
   }
 
   HRESULT SeekReadBlock_FALSE(UInt64 oid, void *data);
+  HRESULT PrefetchNodes(const CRecordVector<CNodeRef> &nodes);
   void GetItemPath(unsigned index, const CNode *inode, NWindows::NCOM::CPropVariant &path) const;
   HRESULT ReadMap(UInt64 oid, bool noHeader, CVol *vol, const Byte *hash,
       CMap &map, unsigned recurseLevel);
@@ -2050,11 +2092,87 @@ HRESULT CDatabase::SeekReadBlock_FALSE(UInt64 oid, void *data)
   }
   if (oid == 0 || oid >= sb.block_count)
     return S_FALSE;
+  {
+    const int index = CacheBlocks.FindInSorted(oid);
+    if (index >= 0)
+    {
+      memcpy(data, CacheData[(unsigned)index], sb.block_size);
+      CacheBlocks.Delete((unsigned)index);
+      CacheData.Delete((unsigned)index);
+      CacheSize -= sb.block_size;
+      return S_OK;
+    }
+  }
   RINOK(InStream_SeekSet(OpenInStream, oid << sb.block_size_Log))
   return ReadStream_FALSE(OpenInStream, data, sb.block_size);
 }
 
 
+static int CompareBlocks(const UInt64 *p1, const UInt64 *p2, void *)
+{
+  return MyCompare(*p1, *p2);
+}
+
+static const size_t kNodeCacheSizeMax = (size_t)1 << 24;
+static const size_t kPrefetchReadSizeMax = (size_t)1 << 20;
+
+/* it reads the child nodes of B-tree node before recursive parsing of these nodes.
+   Adjacent blocks are read with one big read call.
+   Then SeekReadBlock_FALSE() gets these nodes from cache instead of small reads. */
+
+HRESULT CDatabase::PrefetchNodes(const CRecordVector<CNodeRef> &nodes)
+{
+  if (nodes.Size() < 2)
+    return S_OK;
+  const size_t blockSize = sb.block_size;
+  CRecordVector<UInt64> blocks;
+  blocks.ClearAndReserve(nodes.Size());
+  FOR_VECTOR (i, nodes)
+  {
+    const UInt64 paddr = nodes[i].paddr;
+    if (paddr != 0 && paddr < sb.block_count && CacheBlocks.FindInSorted(paddr) < 0)
+      blocks.AddInReserved(paddr);
+  }
+  blocks.Sort(CompareBlocks, NULL);
+  {
+    unsigned k = 0;
+    FOR_VECTOR (i, blocks)
+      if (k == 0 || blocks[i] != blocks[k - 1])
+        blocks[k++] = blocks[i];
+    blocks.DeleteFrom(k);
+  }
+
+  CByteBuffer buf;
+  for (unsigned i = 0; i < blocks.Size();)
+  {
+    const UInt64 start = blocks[i];
+    unsigned num = 1;
+    while (i + num < blocks.Size()
+        && blocks[i + num] == start + num
+        && (num + 1) * blockSize <= kPrefetchReadSizeMax)
+      num++;
+    if (CacheSize + num * blockSize > kNodeCacheSizeMax)
+      break;
+    const size_t size = num * blockSize;
+    if (buf.Size() < size)
+      buf.Alloc(size);
+    RINOK(InStream_SeekSet(OpenInStream, start << sb.block_size_Log))
+    const HRESULT res = ReadStream_FALSE(OpenInStream, buf, size);
+    if (res == S_FALSE)
+      break;
+    RINOK(res)
+    for (unsigned k = 0; k < num; k++)
+    {
+      const unsigned index = CacheBlocks.AddToUniqueSorted(start + k);
+      CacheData.InsertNew(index).CopyFrom(buf + k * blockSize, blockSize);
+    }
+    CacheSize += size;
+    i += num;
+  }
+  return S_OK;
+}
+
+
 
 API_FUNC_static_IsArc IsArc_APFS(const Byte *p, size_t size)
 {
@@ -2191,6 +2309,9 @@ HRESULT CDatabase::ReadMap(UInt64 oid, bool noHeader,
   if (bt.table_space.len / tocEntrySize < bt.nkeys)
     return S_FALSE;
 
+  // we parse child nodes after prefetch of all child nodes of this node
+  CRecordVector<CNodeRef> children;
+
   for (unsigned i = 0; i < bt.nkeys; i++)
   {
     const Byte *p = buf + k_Toc_offset + bt.table_space.off + i * tocEntrySize;
@@ -2226,9 +2347,11 @@ HRESULT CDatabase::ReadMap(UInt64 oid, bool noHeader,
           const oid_t oidNext = Get64(p2);
           if (map.bti.Is_PHYSICAL())
           {
-            RINOK(ReadMap(oidNext, noHeader, vol,
-                NULL, /* hash */
-                map, recurseLevel + 1))
+            CNodeRef ref;
+            ref.paddr = oidNext;
+            ref.hash = NULL;
+            ref.noHeader = noHeader;
+            children.Add(ref);
             continue;
           }
           else
@@ -2320,8 +2443,11 @@ HRESULT CDatabase::ReadMap(UInt64 oid, bool noHeader,
             const omap_val &ov = map.Omap.Vals[(unsigned)index];
             if (ov.size != blockSize) // change it : it must be multiple of
               return S_FALSE;
-            RINOK(ReadMap(ov.paddr, ov.IsFlag_NoHeader(), vol, hashNew,
-                map, recurseLevel + 1))
+            CNodeRef ref;
+            ref.paddr = ov.paddr;
+            ref.hash = hashNew; // it points to (Buffers[recurseLevel]) that is not changed in recursion
+            ref.noHeader = ov.IsFlag_NoHeader();
+            children.Add(ref);
             continue;
           }
         }
@@ -2329,6 +2455,17 @@ HRESULT CDatabase::ReadMap(UInt64 oid, bool noHeader,
     }
   }
 
+  if (!children.IsEmpty())
+  {
+    RINOK(PrefetchNodes(children))
+    FOR_VECTOR (i, children)
+    {
+      const CNodeRef &ref = children[i];
+      RINOK(ReadMap(ref.paddr, ref.noHeader, vol, ref.hash,
+          map, recurseLevel + 1))
+    }
+  }
+
   if (recurseLevel == 0)
     if (!map.CheckAtFinish())
       return S_FALSE;
@@ -2393,6 +2530,8 @@ HRESULT CDatabase::Open2()
     }
   }
 
+  ClearNodeCache();
+
   const bool needVolumePrefix = (Vols.Size() > 1);
   // const bool needVolumePrefix = true; // for debug
   {
@@ -3440,15 +3579,18 @@ Z7_class_CHandler_final:
   public IInArchive,
   public IArchiveGetRawProps,
   public IInArchiveGetStream,
+  public ISetProperties,
   public CMyUnknownImp,
   public CDatabase
 {
-  Z7_IFACES_IMP_UNK_3(
+  Z7_IFACES_IMP_UNK_4(
       IInArchive,
       IArchiveGetRawProps,
-      IInArchiveGetStream)
+      IInArchiveGetStream,
+      ISetProperties)
 
   CMyComPtr<IInStream> _stream;
+  CCommonMethodProps _props;
   int FindHashIndex_for_Item(UInt32 index);
 };
 
@@ -4115,6 +4257,9 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ICompressCoder> copyCoder = copyCoderSpec;
 
   NHfs::CDecoder decoder;
+ #ifndef Z7_ST
+  decoder.NumThreads = _props._numThreads;
+ #endif
 
   for (i = 0;; i++, currentTotalSize += currentItemSize)
   {
@@ -4472,6 +4617,22 @@ HRESULT CDatabase::GetStream2(
 }
 
 
+Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
+{
+  _props = CCommonMethodProps();
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    HRESULT hres;
+    if (!_props.SetCommonProperty(name, values[i], hres))
+      return E_INVALIDARG;
+    RINOK(hres)
+  }
+  return S_OK;
+}
+
+
 REGISTER_ARC_I(
   "APFS", "apfs img", NULL, 0xc3,
   k_Signature,
@@ -837,7 +837,7 @@ REGISTER_ARC_I(
   "Ar", "ar a deb udeb lib", NULL, 0xEC,
   kSignature,
   0,
-  0,
+  NArcInfoFlags::kIndependentItems,
   NULL)
 
 }}
@@ -1003,7 +1003,7 @@ REGISTER_ARC_I(
   "Arj", "arj", NULL, 4,
   k_Signature,
   0,
-  0,
+  NArcInfoFlags::kIndependentItems,
   IsArc_Arj)
 
 }}
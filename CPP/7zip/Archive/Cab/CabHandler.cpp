@@ -15,7 +15,9 @@
 #include "../../../Windows/TimeUtils.h"
 
 #include "../../Common/ProgressUtils.h"
+#include "../../Common/StreamObjects.h"
 #include "../../Common/StreamUtils.h"
+#include "../../Common/SlotRing.h"
 
 #include "../../Compress/CopyCoder.h"
 #include "../../Compress/DeflateDecoder.h"
@@ -894,6 +896,395 @@ HRESULT CFolderOutStream::Unsupported()
 }
 
 
+class CFolderDecoder
+{
+  NCompress::CCopyCoder *copyCoderSpec;
+  CMyComPtr<ICompressCoder> copyCoder;
+
+  NCompress::NDeflate::NDecoder::CCOMCoder *deflateDecoderSpec;
+  CMyComPtr<ICompressCoder> deflateDecoder;
+
+  NCompress::NLzx::CDecoder *lzxDecoderSpec;
+  CMyComPtr<IUnknown> lzxDecoder;
+
+  NCompress::NQuantum::CDecoder *quantumDecoderSpec;
+  CMyComPtr<IUnknown> quantumDecoder;
+public:
+  CFolderDecoder();
+  // it returns E_INVALIDARG for unsupported method
+  HRESULT SetMethod(const CFolder &folder);
+  HRESULT Code(unsigned method,
+      ISequentialInStream *inStream, const Byte *data, UInt32 packSize,
+      UInt32 unpackSize, bool keepHistory, ISequentialOutStream *outStream);
+};
+
+
+CFolderDecoder::CFolderDecoder():
+    deflateDecoderSpec(NULL),
+    lzxDecoderSpec(NULL),
+    quantumDecoderSpec(NULL)
+{
+  copyCoderSpec = new NCompress::CCopyCoder;
+  copyCoder = copyCoderSpec;
+}
+
+
+HRESULT CFolderDecoder::SetMethod(const CFolder &folder)
+{
+  switch (folder.GetMethod())
+  {
+    case NHeader::NMethod::kNone:
+      return S_OK;
+    
+    case NHeader::NMethod::kMSZip:
+      if (!deflateDecoder)
+      {
+        deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder;
+        deflateDecoder = deflateDecoderSpec;
+      }
+      return S_OK;
+    
+    case NHeader::NMethod::kLZX:
+      if (!lzxDecoder)
+      {
+        lzxDecoderSpec = new NCompress::NLzx::CDecoder;
+        lzxDecoder = lzxDecoderSpec;
+      }
+      return lzxDecoderSpec->SetParams_and_Alloc(folder.MethodMinor);
+
+    case NHeader::NMethod::kQuantum:
+      if (!quantumDecoder)
+      {
+        quantumDecoderSpec = new NCompress::NQuantum::CDecoder;
+        quantumDecoder = quantumDecoderSpec;
+      }
+      return quantumDecoderSpec->SetParams(folder.MethodMinor);
+  }
+  return E_INVALIDARG;
+}
+
+
+HRESULT CFolderDecoder::Code(unsigned method,
+    ISequentialInStream *inStream, const Byte *data, UInt32 packSize,
+    UInt32 unpackSize, bool keepHistory, ISequentialOutStream *outStream)
+{
+  UInt64 unpackSize64 = unpackSize;
+
+  switch (method)
+  {
+    case NHeader::NMethod::kNone:
+      return copyCoder->Code(inStream, outStream, NULL, &unpackSize64, NULL);
+    
+    case NHeader::NMethod::kMSZip:
+      deflateDecoderSpec->Set_KeepHistory(keepHistory);
+      /* v9.31: now we follow MSZIP specification that requires to finish deflate stream at the end of each block.
+         But PyCabArc can create CAB archives that doesn't have finish marker at the end of block.
+         Cabarc probably ignores such errors in cab archives.
+         Maybe we also should ignore that error?
+         Or we should extract full file and show the warning? */
+      deflateDecoderSpec->Set_NeedFinishInput(true);
+      RINOK(deflateDecoder->Code(inStream, outStream, NULL, &unpackSize64, NULL))
+      if (!deflateDecoderSpec->IsFinished())
+        return S_FALSE;
+      if (!deflateDecoderSpec->IsFinalBlock())
+        return S_FALSE;
+      return S_OK;
+
+    case NHeader::NMethod::kLZX:
+      lzxDecoderSpec->SetKeepHistory(keepHistory);
+      lzxDecoderSpec->KeepHistoryForNext = true;
+      RINOK(lzxDecoderSpec->Code(data, packSize, unpackSize))
+      return WriteStream(outStream,
+          lzxDecoderSpec->GetUnpackData(),
+          lzxDecoderSpec->GetUnpackSize());
+    
+    case NHeader::NMethod::kQuantum:
+      return quantumDecoderSpec->Code(data, packSize, outStream, unpackSize, keepHistory);
+  }
+  return S_OK;
+}
+
+
+/* CFolderReader reads the data blocks of folder that can continue in next volumes.
+   ReadChunk() returns S_FALSE for data error or for end of data. */
+
+class CFolderReader
+{
+  const CMvDatabaseEx *_database;
+  CCabBlockInStream *_blockStream;
+  unsigned _volIndex;
+  int _locFolderIndex;
+  UInt32 _bl;
+  bool _keepInputBuffer;
+  bool _thereWasNotAlignedChunk;
+public:
+  void Init(const CMvDatabaseEx *database, CCabBlockInStream *blockStream,
+      unsigned volIndex, int locFolderIndex)
+  {
+    _database = database;
+    _blockStream = blockStream;
+    _volIndex = volIndex;
+    _locFolderIndex = locFolderIndex;
+    _bl = 0;
+    _keepInputBuffer = false;
+    _thereWasNotAlignedChunk = false;
+  }
+  
+  HRESULT ReadChunk(unsigned &method, UInt32 &packSize, UInt32 &unpackSize);
+};
+
+
+HRESULT CFolderReader::ReadChunk(unsigned &method, UInt32 &packSize, UInt32 &unpackSize)
+{
+  for (;;)
+  {
+    if (_volIndex >= _database->Volumes.Size())
+      return S_FALSE;
+
+    const CDatabaseEx &db2 = _database->Volumes[_volIndex];
+    if (_locFolderIndex < 0)
+      return E_FAIL;
+    const CFolder &folder2 = db2.Folders[(unsigned)_locFolderIndex];
+    
+    if (_bl == 0)
+    {
+      _blockStream->ReservedSize = db2.ArcInfo.GetDataBlockReserveSize();
+      RINOK(InStream_SeekSet(db2.Stream, db2.StartPosition + folder2.DataStart))
+    }
+    
+    if (_bl == folder2.NumDataBlocks)
+    {
+      /*
+        CFolder::NumDataBlocks (CFFOLDER::cCFData in CAB specification) is 16-bit.
+        But there are some big CAB archives from MS that contain more
+        than (0xFFFF) CFDATA blocks in folder.
+        Old cab extracting software can show error (or ask next volume)
+        but cab extracting library in new Windows ignores this error.
+        15.00 : We also try to ignore such error, if archive is not multi-volume.
+      */
+      if (_database->Volumes.Size() > 1)
+      {
+        _volIndex++;
+        _locFolderIndex = 0;
+        _bl = 0;
+        continue;
+      }
+    }
+    
+    _bl++;
+
+    if (!_keepInputBuffer)
+      _blockStream->InitForNewBlock();
+
+    RINOK(_blockStream->PreRead(db2.Stream, packSize, unpackSize))
+    _keepInputBuffer = (unpackSize == 0);
+    if (_keepInputBuffer)
+      continue;
+
+    const UInt32 kBlockSizeMax = (1 << 15);
+
+    /* We don't try to reduce last block.
+       Note that LZX converts data with x86 filter.
+       and filter needs larger input data than reduced size.
+       It's simpler to decompress full chunk here.
+       also we need full block for quantum for more integrity checks */
+
+    if (unpackSize > kBlockSizeMax)
+      return S_FALSE;
+
+    if (unpackSize != kBlockSizeMax)
+    {
+      if (_thereWasNotAlignedChunk)
+        return S_FALSE;
+      _thereWasNotAlignedChunk = true;
+    }
+
+    method = folder2.GetMethod();
+    return S_OK;
+  }
+}
+
+
+/* Folders are independent compression units.
+   So we can read the packed data of folder to memory in main thread
+   and decode that folder in separate thread to memory buffer.
+   The decoded data is written to CFolderOutStream in main thread
+   in original order of folders, so the order of callback calls is not changed. */
+
+struct CPackChunk
+{
+  size_t Offset;
+  UInt32 PackSize;
+  UInt32 UnpackSize;
+  unsigned Method;
+};
+
+struct CFolderSlot
+{
+  CFolderDecoder Decoder;
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+  CDynBufSeqOutStream *PackBufSpec;
+  CMyComPtr<ISequentialOutStream> PackBuf;
+  CDynBufSeqOutStream *OutBufSpec;
+  CMyComPtr<ISequentialOutStream> OutBuf;
+
+  CRecordVector<CPackChunk> Chunks;
+  CRecordVector<bool> ExtractStatuses;
+  unsigned StartIndex;
+  unsigned FolderIndex;
+  UInt64 FolderSize;
+  UInt64 PackSize;
+  HRESULT ReadRes;
+  HRESULT Res;
+
+  CFolderSlot();
+  // it returns S_FALSE, if packed data is larger than (packSizeMax)
+  HRESULT ReadFolder(CFolderReader &reader, const CCabBlockInStream *blockStream, UInt64 packSizeMax);
+  HRESULT Decode2();
+  void Run()
+  {
+    try { Res = Decode2(); }
+    catch(...) { Res = E_OUTOFMEMORY; }
+  }
+};
+
+CFolderSlot::CFolderSlot()
+{
+  InStreamSpec = new CBufInStream;
+  InStream = InStreamSpec;
+  PackBufSpec = new CDynBufSeqOutStream;
+  PackBuf = PackBufSpec;
+  OutBufSpec = new CDynBufSeqOutStream;
+  OutBuf = OutBufSpec;
+}
+
+
+HRESULT CFolderSlot::ReadFolder(CFolderReader &reader, const CCabBlockInStream *blockStream, UInt64 packSizeMax)
+{
+  Chunks.Clear();
+  PackBufSpec->Init();
+  PackSize = 0;
+  ReadRes = S_OK;
+  
+  for (UInt64 unpackTotal = 0; unpackTotal < FolderSize;)
+  {
+    unsigned method;
+    UInt32 packSize, unpackSize;
+    const HRESULT res = reader.ReadChunk(method, packSize, unpackSize);
+    if (res != S_OK)
+    {
+      // the error will be reported after decoding of previous chunks
+      ReadRes = res;
+      break;
+    }
+    PackSize += packSize;
+    
+    const UInt32 size = blockStream->GetPackSizeAvail();
+    CPackChunk chunk;
+    chunk.Offset = PackBufSpec->GetSize();
+    chunk.PackSize = size;
+    chunk.UnpackSize = unpackSize;
+    chunk.Method = method;
+    Chunks.Add(chunk);
+    Byte *dest = PackBufSpec->GetBufPtrForWriting(size);
+    if (!dest)
+      return E_OUTOFMEMORY;
+    memcpy(dest, blockStream->GetData(), size);
+    PackBufSpec->UpdateSize(size);
+    
+    if (PackBufSpec->GetSize() > packSizeMax)
+      return S_FALSE;
+    unpackTotal += unpackSize;
+  }
+  return S_OK;
+}
+
+
+HRESULT CFolderSlot::Decode2()
+{
+  OutBufSpec->Init();
+  if (!OutBufSpec->GetBufPtrForWriting((size_t)FolderSize))
+    return E_OUTOFMEMORY;
+  
+  bool keepHistory = false;
+  
+  FOR_VECTOR (i, Chunks)
+  {
+    if (OutBufSpec->GetSize() >= FolderSize)
+      return S_OK;
+    const CPackChunk &chunk = Chunks[i];
+    const Byte *data = PackBufSpec->GetBuffer() + chunk.Offset;
+    InStreamSpec->Init(data, chunk.PackSize);
+    RINOK(Decoder.Code(chunk.Method, InStream, data, chunk.PackSize,
+        chunk.UnpackSize, keepHistory, OutBuf))
+    keepHistory = true;
+  }
+  
+  if (OutBufSpec->GetSize() >= FolderSize)
+    return S_OK;
+  return ReadRes;
+}
+
+
+class CFolderQueue
+{
+public:
+  CSlotRing<CFolderSlot> Ring;
+  UInt64 FolderSizeMax;
+
+  const CMvDatabaseEx *Database;
+  IArchiveExtractCallback *ExtractCallback;
+  bool TestMode;
+  CLocalProgress *Lps;
+  UInt64 TotalUnPacked;
+  UInt64 TotalPacked;
+
+  CFolderQueue(): FolderSizeMax(0), TotalUnPacked(0), TotalPacked(0) {}
+  
+  HRESULT WriteNext();
+  HRESULT Flush()
+  {
+    while (!Ring.IsEmpty())
+    {
+      RINOK(WriteNext())
+    }
+    return S_OK;
+  }
+};
+
+
+HRESULT CFolderQueue::WriteNext()
+{
+  CFolderSlot &slot = Ring.FinishNext();
+  
+  const HRESULT res = slot.Res;
+  if (res != S_OK && res != S_FALSE)
+    return res;
+
+  CFolderOutStream *cabFolderOutStream = new CFolderOutStream;
+  CMyComPtr<ISequentialOutStream> outStream(cabFolderOutStream);
+  cabFolderOutStream->Init(Database, &slot.ExtractStatuses, slot.StartIndex,
+      slot.FolderSize, ExtractCallback, TestMode);
+  
+  RINOK(WriteStream(outStream, slot.OutBufSpec->GetBuffer(), slot.OutBufSpec->GetSize()))
+  if (res == S_OK)
+  {
+    RINOK(cabFolderOutStream->WriteEmptyFiles())
+  }
+  if (res != S_OK || cabFolderOutStream->NeedMoreWrite())
+  {
+    RINOK(cabFolderOutStream->FlushCorrupted(slot.FolderIndex))
+  }
+  
+  TotalUnPacked += slot.FolderSize;
+  TotalPacked += slot.PackSize;
+  Lps->OutSize = TotalUnPacked;
+  Lps->InSize = TotalPacked;
+  return Lps->SetCur();
+}
+
+
 Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testModeSpec, IArchiveExtractCallback *extractCallback))
 {
@@ -909,6 +1300,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   UInt32 i;
   int lastFolder = -2;
   UInt64 lastFolderSize = 0;
+  unsigned numFolders = 0;
   
   for (i = 0; i < numItems; i++)
   {
@@ -919,7 +1311,10 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       continue;
     int folderIndex = m_Database.GetFolderIndex(&mvItem);
     if (folderIndex != lastFolder)
+    {
       totalUnPacked += lastFolderSize;
+      numFolders++;
+    }
     lastFolder = folderIndex;
     lastFolderSize = item.GetEndOffset();
   }
@@ -928,37 +1323,46 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
   extractCallback->SetTotal(totalUnPacked);
 
-  totalUnPacked = 0;
-
-  UInt64 totalPacked = 0;
-
   CLocalProgress *lps = new CLocalProgress;
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
-  NCompress::CCopyCoder *copyCoderSpec = new NCompress::CCopyCoder;
-  CMyComPtr<ICompressCoder> copyCoder = copyCoderSpec;
-
-  NCompress::NDeflate::NDecoder::CCOMCoder *deflateDecoderSpec = NULL;
-  CMyComPtr<ICompressCoder> deflateDecoder;
-
-  NCompress::NLzx::CDecoder *lzxDecoderSpec = NULL;
-  CMyComPtr<IUnknown> lzxDecoder;
-
-  NCompress::NQuantum::CDecoder *quantumDecoderSpec = NULL;
-  CMyComPtr<IUnknown> quantumDecoder;
+  CFolderDecoder decoder;
 
   CCabBlockInStream *cabBlockInStreamSpec = new CCabBlockInStream();
   CMyComPtr<ISequentialInStream> cabBlockInStream = cabBlockInStreamSpec;
   if (!cabBlockInStreamSpec->Create())
     return E_OUTOFMEMORY;
 
+  CFolderReader reader;
+
+  CFolderQueue queue;
+  queue.Database = &m_Database;
+  queue.ExtractCallback = extractCallback;
+  queue.TestMode = testMode;
+  queue.Lps = lps;
+ #ifndef Z7_ST
+  {
+    UInt32 numThreads = _props._numThreads;
+    if (numThreads > k_SlotRing_NumThreads_Max)
+      numThreads = k_SlotRing_NumThreads_Max;
+    if (numThreads > numFolders)
+      numThreads = numFolders;
+    if (numThreads > 1)
+    {
+      queue.Ring.Create(numThreads);
+      // the slot stores packed data and unpacked data of folder
+      queue.FolderSizeMax = _props._memUsage_Decompress / numThreads / 2;
+    }
+  }
+ #endif
+
   CRecordVector<bool> extractStatuses;
   
   for (i = 0;;)
   {
-    lps->OutSize = totalUnPacked;
-    lps->InSize = totalPacked;
+    lps->OutSize = queue.TotalUnPacked;
+    lps->InSize = queue.TotalPacked;
     RINOK(lps->SetCur())
 
     if (i >= numItems)
@@ -974,6 +1378,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     i++;
     if (item.IsDir())
     {
+      RINOK(queue.Flush())
       const Int32 askMode = testMode ?
           NExtract::NAskMode::kTest :
           NExtract::NAskMode::kExtract;
@@ -989,6 +1394,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     
     if (folderIndex < 0)
     {
+      RINOK(queue.Flush())
       // If we need previous archive
       const Int32 askMode= testMode ?
           NExtract::NAskMode::kTest :
@@ -1028,199 +1434,83 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       curUnpack = item2.GetEndOffset();
     }
 
-    CFolderOutStream *cabFolderOutStream = new CFolderOutStream;
-    CMyComPtr<ISequentialOutStream> outStream(cabFolderOutStream);
-
     const int folderIndex2 = item.GetFolderIndex(db.Folders.Size());
     if (folderIndex2 < 0)
       return E_FAIL;
     const CFolder &folder = db.Folders[(unsigned)folderIndex2];
 
-    cabFolderOutStream->Init(&m_Database, &extractStatuses, startIndex2,
-        curUnpack, extractCallback, testMode);
+    cabBlockInStreamSpec->MsZip = (folder.GetMethod() == NHeader::NMethod::kMSZip);
 
-    cabBlockInStreamSpec->MsZip = false;
-    HRESULT res = S_OK;
-    
-    switch (folder.GetMethod())
+    if (queue.Ring.NumSlots() > 1 && curUnpack <= queue.FolderSizeMax)
     {
-      case NHeader::NMethod::kNone:
-        break;
-      
-      case NHeader::NMethod::kMSZip:
-        if (!deflateDecoder)
-        {
-          deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder;
-          deflateDecoder = deflateDecoderSpec;
-        }
-        cabBlockInStreamSpec->MsZip = true;
-        break;
-      
-      case NHeader::NMethod::kLZX:
-        if (!lzxDecoder)
-        {
-          lzxDecoderSpec = new NCompress::NLzx::CDecoder;
-          lzxDecoder = lzxDecoderSpec;
-        }
-        res = lzxDecoderSpec->SetParams_and_Alloc(folder.MethodMinor);
-        break;
-
-      case NHeader::NMethod::kQuantum:
-        if (!quantumDecoder)
+      if (queue.Ring.IsFull())
+      {
+        RINOK(queue.WriteNext())
+      }
+      CFolderSlot &slot = queue.Ring.GetFreeSlot();
+      HRESULT res = slot.Decoder.SetMethod(folder);
+      if (res != E_INVALIDARG)
+      {
+        RINOK(res)
+        slot.ExtractStatuses = extractStatuses;
+        slot.StartIndex = startIndex2;
+        slot.FolderIndex = (unsigned)folderIndex2;
+        slot.FolderSize = curUnpack;
+        reader.Init(&m_Database, cabBlockInStreamSpec, mvItem.VolumeIndex, folderIndex2);
+        res = slot.ReadFolder(reader, cabBlockInStreamSpec, queue.FolderSizeMax);
+        if (res == S_OK)
         {
-          quantumDecoderSpec = new NCompress::NQuantum::CDecoder;
-          quantumDecoder = quantumDecoderSpec;
+          RINOK(queue.Ring.StartSlot())
+          continue;
         }
-        res = quantumDecoderSpec->SetParams(folder.MethodMinor);
-        break;
-      
-      default:
-        res = E_INVALIDARG;
-        break;
+        if (res != S_FALSE)
+          return res;
+        // the folder is too big for memory buffers. So we decode it without buffering
+      }
     }
 
+    RINOK(queue.Flush())
+
+    CFolderOutStream *cabFolderOutStream = new CFolderOutStream;
+    CMyComPtr<ISequentialOutStream> outStream(cabFolderOutStream);
+
+    cabFolderOutStream->Init(&m_Database, &extractStatuses, startIndex2,
+        curUnpack, extractCallback, testMode);
+
+    HRESULT res = decoder.SetMethod(folder);
+
     if (res == E_INVALIDARG)
     {
       RINOK(cabFolderOutStream->Unsupported())
-      totalUnPacked += curUnpack;
+      queue.TotalUnPacked += curUnpack;
       continue;
     }
     RINOK(res)
 
     {
-      unsigned volIndex = mvItem.VolumeIndex;
-      int locFolderIndex = item.GetFolderIndex(db.Folders.Size());
+      reader.Init(&m_Database, cabBlockInStreamSpec, mvItem.VolumeIndex, folderIndex2);
       bool keepHistory = false;
-      bool keepInputBuffer = false;
-      bool thereWasNotAlignedChunk = false;
       
-      for (UInt32 bl = 0; cabFolderOutStream->NeedMoreWrite();)
+      while (cabFolderOutStream->NeedMoreWrite())
       {
-        if (volIndex >= m_Database.Volumes.Size())
-        {
-          res = S_FALSE;
-          break;
-        }
-
-        const CDatabaseEx &db2 = m_Database.Volumes[volIndex];
-        if (locFolderIndex < 0)
-          return E_FAIL;
-        const CFolder &folder2 = db2.Folders[(unsigned)locFolderIndex];
-        
-        if (bl == 0)
-        {
-          cabBlockInStreamSpec->ReservedSize = db2.ArcInfo.GetDataBlockReserveSize();
-          RINOK(InStream_SeekSet(db2.Stream, db2.StartPosition + folder2.DataStart))
-        }
-        
-        if (bl == folder2.NumDataBlocks)
-        {
-          /*
-            CFolder::NumDataBlocks (CFFOLDER::cCFData in CAB specification) is 16-bit.
-            But there are some big CAB archives from MS that contain more
-            than (0xFFFF) CFDATA blocks in folder.
-            Old cab extracting software can show error (or ask next volume)
-            but cab extracting library in new Windows ignores this error.
-            15.00 : We also try to ignore such error, if archive is not multi-volume.
-          */
-          if (m_Database.Volumes.Size() > 1)
-          {
-            volIndex++;
-            locFolderIndex = 0;
-            bl = 0;
-            continue;
-          }
-        }
-        
-        bl++;
-
-        if (!keepInputBuffer)
-          cabBlockInStreamSpec->InitForNewBlock();
-
+        unsigned method;
         UInt32 packSize, unpackSize;
-        res = cabBlockInStreamSpec->PreRead(db2.Stream, packSize, unpackSize);
+        res = reader.ReadChunk(method, packSize, unpackSize);
         if (res == S_FALSE)
           break;
         RINOK(res)
-        keepInputBuffer = (unpackSize == 0);
-        if (keepInputBuffer)
-          continue;
 
-        UInt64 totalUnPacked2 = totalUnPacked + cabFolderOutStream->GetPosInFolder();
-        totalPacked += packSize;
+        UInt64 totalUnPacked2 = queue.TotalUnPacked + cabFolderOutStream->GetPosInFolder();
+        queue.TotalPacked += packSize;
 
         lps->OutSize = totalUnPacked2;
-        lps->InSize = totalPacked;
+        lps->InSize = queue.TotalPacked;
         RINOK(lps->SetCur())
 
-        const UInt32 kBlockSizeMax = (1 << 15);
-
-        /* We don't try to reduce last block.
-           Note that LZX converts data with x86 filter.
-           and filter needs larger input data than reduced size.
-           It's simpler to decompress full chunk here.
-           also we need full block for quantum for more integrity checks */
-
-        if (unpackSize > kBlockSizeMax)
-        {
-          res = S_FALSE;
-          break;
-        }
-
-        if (unpackSize != kBlockSizeMax)
-        {
-          if (thereWasNotAlignedChunk)
-          {
-            res = S_FALSE;
-            break;
-          }
-          thereWasNotAlignedChunk = true;
-        }
-
-        UInt64 unpackSize64 = unpackSize;
-        UInt32 packSizeChunk = cabBlockInStreamSpec->GetPackSizeAvail();
-
-        switch (folder2.GetMethod())
-        {
-          case NHeader::NMethod::kNone:
-            res = copyCoder->Code(cabBlockInStream, outStream, NULL, &unpackSize64, NULL);
-            break;
-          
-          case NHeader::NMethod::kMSZip:
-            deflateDecoderSpec->Set_KeepHistory(keepHistory);
-            /* v9.31: now we follow MSZIP specification that requires to finish deflate stream at the end of each block.
-               But PyCabArc can create CAB archives that doesn't have finish marker at the end of block.
-               Cabarc probably ignores such errors in cab archives.
-               Maybe we also should ignore that error?
-               Or we should extract full file and show the warning? */
-            deflateDecoderSpec->Set_NeedFinishInput(true);
-            res = deflateDecoder->Code(cabBlockInStream, outStream, NULL, &unpackSize64, NULL);
-            if (res == S_OK)
-            {
-              if (!deflateDecoderSpec->IsFinished())
-                res = S_FALSE;
-              if (!deflateDecoderSpec->IsFinalBlock())
-                res = S_FALSE;
-            }
-            break;
-
-          case NHeader::NMethod::kLZX:
-            lzxDecoderSpec->SetKeepHistory(keepHistory);
-            lzxDecoderSpec->KeepHistoryForNext = true;
-            
-            res = lzxDecoderSpec->Code(cabBlockInStreamSpec->GetData(), packSizeChunk, unpackSize);
-
-            if (res == S_OK)
-              res = WriteStream(outStream,
-                  lzxDecoderSpec->GetUnpackData(),
-                  lzxDecoderSpec->GetUnpackSize());
-            break;
-          
-          case NHeader::NMethod::kQuantum:
-            res = quantumDecoderSpec->Code(cabBlockInStreamSpec->GetData(),
-                packSizeChunk, outStream, unpackSize, keepHistory);
-            break;
-        }
+        res = decoder.Code(method, cabBlockInStream,
+            cabBlockInStreamSpec->GetData(),
+            cabBlockInStreamSpec->GetPackSizeAvail(),
+            unpackSize, keepHistory, outStream);
       
         if (res != S_OK)
         {
@@ -1243,15 +1533,31 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       RINOK(cabFolderOutStream->FlushCorrupted((unsigned)folderIndex2))
     }
 
-    totalUnPacked += curUnpack;
+    queue.TotalUnPacked += curUnpack;
   }
 
-  return S_OK;
+  return queue.Flush();
 
   COM_TRY_END
 }
 
 
+Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
+{
+  _props = CCommonMethodProps();
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    HRESULT hres;
+    if (!_props.SetCommonProperty(name, values[i], hres))
+      return E_INVALIDARG;
+    RINOK(hres)
+  }
+  return S_OK;
+}
+
+
 Z7_COM7F_IMF(CHandler::GetNumberOfItems(UInt32 *numItems))
 {
   *numItems = m_Database.Items.Size();
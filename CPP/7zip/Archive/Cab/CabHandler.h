@@ -7,12 +7,16 @@
 
 #include "../IArchive.h"
 
+#include "../Common/HandlerOut.h"
+
 #include "CabIn.h"
 
 namespace NArchive {
 namespace NCab {
 
-Z7_CLASS_IMP_CHandler_IInArchive_0
+Z7_CLASS_IMP_CHandler_IInArchive_1(
+  ISetProperties
+)
 
   CMvDatabaseEx m_Database;
   UString _errorMessage;
@@ -22,6 +26,7 @@ Z7_CLASS_IMP_CHandler_IInArchive_0
   // int _mainVolIndex;
   UInt32 _phySize;
   UInt64 _offset;
+  CCommonMethodProps _props;
 };
 
 }}
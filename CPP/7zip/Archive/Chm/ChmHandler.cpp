@@ -13,6 +13,7 @@
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/StreamUtils.h"
 #include "../../Common/RegisterArc.h"
+#include "../../Common/SlotRing.h"
 
 #include "../../Compress/CopyCoder.h"
 #include "../../Compress/LzxDecoder.h"
@@ -401,6 +402,177 @@ HRESULT CChmFolderOutStream::FlushCorrupted(UInt64 maxSize)
 }
 
 
+/* LZX decoder is reset at the start of each folder (reset interval).
+   So the folders can be decoded independently.
+   CFolderPrefetcher reads the packed data of next folders from the extraction plan
+   in main thread and decodes these folders in worker threads to memory buffers.
+   The decoded blocks are written to CChmFolderOutStream in main thread
+   in original order, so the order of callback calls is not changed. */
+
+struct CFolderRef
+{
+  UInt64 Section;
+  UInt64 Folder;
+
+  bool IsEqualTo(const CFolderRef &a) const { return Section == a.Section && Folder == a.Folder; }
+};
+
+struct CFolderSlot
+{
+  NCompress::NLzx::CDecoder *LzxDecoderSpec;
+  CMyComPtr<IUnknown> LzxDecoder;
+  CByteBuffer PackBuf;
+  CByteBuffer OutBuf;
+  CRecordVector<UInt32> PackSizes;
+  CRecordVector<UInt32> UnpackSizes; // for blocks that were decoded without error
+  bool IsValid; // (false), if the folder was not prefetched
+  HRESULT Res;  // result for block (UnpackSizes.Size())
+
+  CFolderSlot();
+  HRESULT Decode2();
+  void Run()
+  {
+    if (!IsValid)
+      return;
+    try { Res = Decode2(); }
+    catch(...) { Res = S_FALSE; }
+  }
+};
+
+CFolderSlot::CFolderSlot():
+    IsValid(false),
+    Res(S_OK)
+{
+  LzxDecoderSpec = new NCompress::NLzx::CDecoder;
+  LzxDecoder = LzxDecoderSpec;
+}
+
+HRESULT CFolderSlot::Decode2()
+{
+  UnpackSizes.Clear();
+  const Byte *pack = PackBuf;
+  FOR_VECTOR (b, PackSizes)
+  {
+    LzxDecoderSpec->SetKeepHistory(b > 0);
+    LzxDecoderSpec->KeepHistoryForNext = true;
+    const UInt32 packSize = PackSizes[b];
+    RINOK(LzxDecoderSpec->Code(pack, packSize, kBlockSize))
+    pack += packSize;
+    const UInt32 size = LzxDecoderSpec->GetUnpackSize();
+    if (size > kBlockSize)
+      return S_FALSE;
+    memcpy(OutBuf + (size_t)b * kBlockSize, LzxDecoderSpec->GetUnpackData(), size);
+    UnpackSizes.Add(size);
+  }
+  return S_OK;
+}
+
+
+/* The folders of plan are started in slots of ring in plan order.
+   The folder that can't be prefetched also gets the slot with (IsValid == false),
+   so the order of slots in ring is same as order of folders in plan. */
+
+class CFolderPrefetcher
+{
+  unsigned _head; // plan index of first started folder
+  unsigned _tail; // plan index of next folder for start
+  
+  HRESULT PrepareFolder(CFolderSlot &slot, const CFolderRef &ref);
+public:
+  CSlotRing<CFolderSlot> Ring;
+  CRecordVector<CFolderRef> Plan;
+  const CFilesDatabase *Database;
+  IInStream *Stream;
+
+  CFolderPrefetcher(): _head(0), _tail(0) {}
+  
+  bool IsEnabled() const { return Ring.NumSlots() > 1; }
+  void AddToPlan(const CFolderRef &ref)
+  {
+    if (Plan.IsEmpty() || !Plan.Back().IsEqualTo(ref))
+      Plan.Add(ref);
+  }
+  HRESULT Fill();
+  /* it returns NULL, if the folder was not prefetched.
+     Returned slot is available until next Fill() call. */
+  CFolderSlot *GetFolder(const CFolderRef &ref);
+};
+
+
+HRESULT CFolderPrefetcher::PrepareFolder(CFolderSlot &slot, const CFolderRef &ref)
+{
+  slot.IsValid = false;
+  const CSectionInfo &section = Database->Sections[(unsigned)ref.Section];
+  const CLzxInfo &lzxInfo = section.Methods[0].LzxInfo;
+  const CResetTable &rt = lzxInfo.ResetTable;
+  const UInt64 startBlock = lzxInfo.GetBlockIndexFromFolderIndex(ref.Folder);
+  if (startBlock >= rt.ResetOffsets.Size())
+    return S_OK;
+  UInt64 numBlocks = rt.ResetOffsets.Size() - startBlock;
+  const UInt32 numBlocksMax = (UInt32)1 << lzxInfo.ResetIntervalBits;
+  if (numBlocks > numBlocksMax)
+    numBlocks = numBlocksMax;
+  
+  slot.PackSizes.Clear();
+  UInt64 packSize = 0;
+  for (UInt32 b = 0; b < (UInt32)numBlocks; b++)
+  {
+    UInt64 size;
+    if (!rt.GetCompressedSizeOfBlock(startBlock + b, size))
+      return S_OK;
+    // we don't prefetch unexpected big blocks. Such blocks will be checked in main thread
+    if (size > kBlockSize * 2)
+      return S_OK;
+    slot.PackSizes.Add((UInt32)size);
+    packSize += size;
+  }
+
+  if (slot.LzxDecoderSpec->SetParams_and_Alloc(lzxInfo.GetNumDictBits()) != S_OK)
+    return S_OK;
+  slot.PackBuf.AllocAtLeast((size_t)packSize);
+  slot.OutBuf.AllocAtLeast((size_t)numBlocks * kBlockSize);
+  
+  RINOK(InStream_SeekSet(Stream, Database->ContentOffset + section.Offset + rt.ResetOffsets[(unsigned)startBlock]))
+  const HRESULT res = ReadStream_FALSE(Stream, slot.PackBuf, (size_t)packSize);
+  if (res == S_FALSE)
+    return S_OK;
+  RINOK(res)
+  
+  slot.IsValid = true;
+  return S_OK;
+}
+
+
+HRESULT CFolderPrefetcher::Fill()
+{
+  while (_tail < Plan.Size() && !Ring.IsFull())
+  {
+    RINOK(PrepareFolder(Ring.GetFreeSlot(), Plan[_tail]))
+    RINOK(Ring.StartSlot())
+    _tail++;
+  }
+  return S_OK;
+}
+
+
+CFolderSlot *CFolderPrefetcher::GetFolder(const CFolderRef &ref)
+{
+  unsigned i;
+  for (i = _head; i < _tail; i++)
+    if (Plan[i].IsEqualTo(ref))
+      break;
+  if (i == _tail)
+    return NULL;
+  for (;;)
+  {
+    CFolderSlot &slot = Ring.FinishNext();
+    if (_head++ == i)
+      return slot.IsValid ? &slot : NULL;
+    // the folder from plan was skipped in extraction order
+  }
+}
+
+
 Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testModeSpec, IArchiveExtractCallback *extractCallback))
 {
@@ -504,6 +676,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   }
   
   UInt64 lastFolderIndex = ((UInt64)0 - 1);
+  CFolderPrefetcher prefetcher;
   
   for (i = 0; i < numItems; i++)
   {
@@ -530,12 +703,49 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
         folderIndex++;
       lastFolderIndex = m_Database.GetLastFolder(index);
       for (; folderIndex <= lastFolderIndex; folderIndex++)
+      {
         currentTotalSize += lzxInfo.GetFolderSize();
+        CFolderRef ref;
+        ref.Section = sectionIndex;
+        ref.Folder = folderIndex;
+        prefetcher.AddToPlan(ref);
+      }
     }
   }
 
   RINOK(extractCallback->SetTotal(currentTotalSize))
 
+ #ifndef Z7_ST
+  {
+    UInt64 folderSizeMax = 0;
+    FOR_VECTOR (k, m_Database.Sections)
+    {
+      const CSectionInfo &section = m_Database.Sections[k];
+      if (section.IsLzx())
+      {
+        const UInt64 folderSize = section.Methods[0].LzxInfo.GetFolderSize();
+        if (folderSizeMax < folderSize)
+          folderSizeMax = folderSize;
+      }
+    }
+    UInt32 numThreads = _props._numThreads;
+    if (numThreads > k_SlotRing_NumThreads_Max)
+      numThreads = k_SlotRing_NumThreads_Max;
+    if (numThreads > prefetcher.Plan.Size())
+      numThreads = prefetcher.Plan.Size();
+    // the slot stores packed data and unpacked data of folder
+    while (numThreads > 1 && numThreads * folderSizeMax * 2 > _props._memUsage_Decompress)
+      numThreads--;
+    if (numThreads > 1)
+    {
+      prefetcher.Ring.Create(numThreads);
+      prefetcher.Database = &m_Database;
+      prefetcher.Stream = m_Stream;
+      RINOK(prefetcher.Fill())
+    }
+  }
+ #endif
+
   NCompress::NLzx::CDecoder *lzxDecoderSpec = NULL;
   CMyComPtr<IUnknown> lzxDecoder;
   CChmFolderOutStream *chmFolderOutStream = NULL;
@@ -695,6 +905,15 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       chmFolderOutStream->m_NumFiles = extractStatuses.Size();
       chmFolderOutStream->m_CurrentIndex = 0;
       
+      CFolderSlot *slot = NULL;
+      if (prefetcher.IsEnabled())
+      {
+        CFolderRef ref;
+        ref.Section = sectionIndex;
+        ref.Folder = folderIndex;
+        slot = prefetcher.GetFolder(ref);
+      }
+      
       try
       {
         UInt64 startBlock = lzxInfo.GetBlockIndexFromFolderIndex(folderIndex);
@@ -708,6 +927,23 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
           UInt64 bCur = startBlock + b;
           if (bCur >= rt.ResetOffsets.Size())
             return E_FAIL;
+
+          if (slot)
+          {
+            HRESULT res = slot->Res;
+            if (b < slot->UnpackSizes.Size())
+              res = WriteStream(chmFolderOutStream,
+                  slot->OutBuf + (size_t)b * kBlockSize,
+                  slot->UnpackSizes[b]);
+            if (res != S_OK)
+            {
+              if (res != S_FALSE)
+                return res;
+              throw 1;
+            }
+            continue;
+          }
+
           UInt64 offset = rt.ResetOffsets[(unsigned)bCur];
           UInt64 compressedSize;
           rt.GetCompressedSizeOfBlock(bCur, compressedSize);
@@ -749,6 +985,11 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       {
         RINOK(chmFolderOutStream->FlushCorrupted(unPackSize))
       }
+
+      if (prefetcher.IsEnabled())
+      {
+        RINOK(prefetcher.Fill())
+      }
       
       currentTotalSize += folderSize;
       if (folderIndex == lastFolderIndex)
@@ -760,6 +1001,21 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   COM_TRY_END
 }
 
+Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
+{
+  _props = CCommonMethodProps();
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    HRESULT hres;
+    if (!_props.SetCommonProperty(name, values[i], hres))
+      return E_INVALIDARG;
+    RINOK(hres)
+  }
+  return S_OK;
+}
+
 Z7_COM7F_IMF(CHandler::GetNumberOfItems(UInt32 *numItems))
 {
   *numItems = m_Database.NewFormat ? 1:
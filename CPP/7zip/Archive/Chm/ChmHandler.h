@@ -7,17 +7,22 @@
 
 #include "../IArchive.h"
 
+#include "../Common/HandlerOut.h"
+
 #include "ChmIn.h"
 
 namespace NArchive {
 namespace NChm {
 
-Z7_CLASS_IMP_CHandler_IInArchive_0
+Z7_CLASS_IMP_CHandler_IInArchive_1(
+  ISetProperties
+)
 
   CFilesDatabase m_Database;
   CMyComPtr<IInStream> m_Stream;
   bool _help2;
   UInt32 m_ErrorFlags;
+  CCommonMethodProps _props;
 public:
   CHandler(bool help2): _help2(help2) {}
 };
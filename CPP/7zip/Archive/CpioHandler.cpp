@@ -1093,7 +1093,8 @@ REGISTER_ARC_I(
   "Cpio", "cpio", NULL, 0xED,
   k_Signature,
   0,
-  NArcInfoFlags::kMultiSignature,
+    NArcInfoFlags::kMultiSignature
+  | NArcInfoFlags::kIndependentItems,
   IsArc_Cpio)
 
 }}
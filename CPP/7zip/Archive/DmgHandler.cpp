@@ -11,6 +11,10 @@
 
 #include "../../Windows/PropVariant.h"
 
+#ifndef Z7_ST
+#include "../Common/SlotRing.h"
+#endif
+
 #include "../Common/LimitedStreams.h"
 #include "../Common/ProgressUtils.h"
 #include "../Common/RegisterArc.h"
@@ -22,6 +26,7 @@
 #include "../Compress/LzfseDecoder.h"
 #include "../Compress/ZlibDecoder.h"
 
+#include "Common/HandlerOut.h"
 #include "Common/OutStreamWithCRC.h"
 
 // #define DMG_SHOW_RAW
@@ -132,8 +137,9 @@ struct CForkPair
 };
 
 
-Z7_CLASS_IMP_CHandler_IInArchive_1(
-  IInArchiveGetStream
+Z7_CLASS_IMP_CHandler_IInArchive_2(
+    IInArchiveGetStream
+  , ISetProperties
 )
   CMyComPtr<IInStream> _inStream;
   CObjectVector<CFile> _files;
@@ -145,6 +151,8 @@ Z7_CLASS_IMP_CHandler_IInArchive_1(
   UInt64 _phySize;
 
   AString _name;
+
+  CCommonMethodProps _props;
   
   #ifdef DMG_SHOW_RAW
   CObjectVector<CExtraFile> _extras;
@@ -1228,10 +1236,221 @@ Z7_COM7F_IMF(CAdcDecoder::Code(ISequentialInStream *inStream,
 }
 
 
+/* CChunkDecoder unpacks one block (chunk) of file from (PackBuf) to (UnpackBuf).
+   The packed data is read by main thread, so Decode() can be called from another thread. */
 
+class CChunkDecoder
+{
+  NCompress::NBZip2::CDecoder *_bzip2CoderSpec;
+  CMyComPtr<ICompressCoder> _bzip2Coder;
+  NCompress::NZlib::CDecoder *_zlibCoderSpec;
+  CMyComPtr<ICompressCoder> _zlibCoder;
+  CAdcDecoder *_adcCoderSpec;
+  CMyComPtr<ICompressCoder> _adcCoder;
+  NCompress::NLzfse::CDecoder *_lzfseCoderSpec;
+  CMyComPtr<ICompressCoder> _lzfseCoder;
+
+  CBufInStream *_inStreamSpec;
+  CMyComPtr<ISequentialInStream> _inStream;
+  CBufPtrSeqOutStream *_outStreamSpec;
+  CMyComPtr<ISequentialOutStream> _outStream;
+
+  HRESULT Decode2();
+public:
+  CByteBuffer PackBuf;
+  CByteBuffer UnpackBuf;
+  CBlock Block;
+  size_t OutSize;
+  HRESULT Res;
+
+  CChunkDecoder():
+      _bzip2CoderSpec(NULL),
+      _zlibCoderSpec(NULL),
+      _adcCoderSpec(NULL),
+      _lzfseCoderSpec(NULL),
+      OutSize(0),
+      Res(S_OK)
+  {
+    _inStreamSpec = new CBufInStream;
+    _inStream = _inStreamSpec;
+    _outStreamSpec = new CBufPtrSeqOutStream;
+    _outStream = _outStreamSpec;
+  }
 
+  static bool IsSupportedMethod(UInt32 type)
+  {
+    return type == METHOD_ADC
+        || type == METHOD_ZLIB
+        || type == METHOD_BZIP2
+        || type == METHOD_LZFSE;
+  }
+  
+  // it's called from main thread before Decode()
+  HRESULT Prepare(IInStream *stream, UInt64 pos, const CBlock &block);
+  void Decode() { Res = Decode2(); }
+};
 
 
+HRESULT CChunkDecoder::Prepare(IInStream *stream, UInt64 pos, const CBlock &block)
+{
+  Block = block;
+  OutSize = 0;
+  Res = S_OK;
+  const size_t packSize = (size_t)block.PackSize;
+  const size_t unpSize = (size_t)block.UnpSize;
+  if (PackBuf.Size() < packSize)
+  {
+    PackBuf.Free();
+    PackBuf.Alloc(packSize);
+  }
+  if (UnpackBuf.Size() < unpSize)
+  {
+    UnpackBuf.Free();
+    UnpackBuf.Alloc(unpSize);
+  }
+  RINOK(InStream_SeekSet(stream, pos))
+  size_t processed = packSize;
+  RINOK(ReadStream(stream, PackBuf, &processed))
+  if (processed != packSize)
+    Res = S_FALSE;
+  return S_OK;
+}
+
+
+HRESULT CChunkDecoder::Decode2()
+{
+  if (Res != S_OK)
+    return Res;
+
+  _inStreamSpec->Init(PackBuf, (size_t)Block.PackSize);
+  _outStreamSpec->Init(UnpackBuf, (size_t)Block.UnpSize);
+  HRESULT res;
+
+  switch (Block.Type)
+  {
+    case METHOD_ADC:
+      if (!_adcCoder)
+      {
+        _adcCoderSpec = new CAdcDecoder();
+        _adcCoder = _adcCoderSpec;
+      }
+      res = _adcCoder->Code(_inStream, _outStream, &Block.PackSize, &Block.UnpSize, NULL);
+      break;
+
+    case METHOD_ZLIB:
+      if (!_zlibCoder)
+      {
+        _zlibCoderSpec = new NCompress::NZlib::CDecoder();
+        _zlibCoder = _zlibCoderSpec;
+      }
+      res = _zlibCoder->Code(_inStream, _outStream, NULL, NULL, NULL);
+      if (res == S_OK && _zlibCoderSpec->GetInputProcessedSize() != Block.PackSize)
+        res = S_FALSE;
+      break;
+
+    case METHOD_BZIP2:
+      if (!_bzip2Coder)
+      {
+        _bzip2CoderSpec = new NCompress::NBZip2::CDecoder();
+        _bzip2Coder = _bzip2CoderSpec;
+      }
+      res = _bzip2Coder->Code(_inStream, _outStream, NULL, NULL, NULL);
+      if (res == S_OK && _bzip2CoderSpec->GetInputProcessedSize() != Block.PackSize)
+        res = S_FALSE;
+      break;
+
+    case METHOD_LZFSE:
+      if (!_lzfseCoder)
+      {
+        _lzfseCoderSpec = new NCompress::NLzfse::CDecoder();
+        _lzfseCoder = _lzfseCoderSpec;
+      }
+      res = _lzfseCoder->Code(_inStream, _outStream, &Block.PackSize, &Block.UnpSize, NULL);
+      break;
+
+    default:
+      return E_NOTIMPL;
+  }
+
+  OutSize = _outStreamSpec->GetPos();
+  return res;
+}
+
+
+#ifndef Z7_ST
+
+struct CChunkSlot
+{
+  CChunkDecoder Decoder;
+  unsigned BlockIndex;
+  CChunkSlot(): BlockIndex(0) {}
+  void Run() { Decoder.Decode(); }
+};
+
+
+/* CChunkPipe decodes the compressed blocks of one file in worker threads.
+   The blocks are started in order of block list and the main thread
+   takes the results in same order. */
+
+class CChunkPipe
+{
+  CSlotRing<CChunkSlot> _slots;
+  unsigned _nextBlock;  // next block that can be started
+  const CFile *_file;
+public:
+  CChunkPipe(): _nextBlock(0), _file(NULL) {}
+
+  unsigned GetNumSlots() const { return _slots.NumSlots(); }
+  void Create(unsigned numSlots) { _slots.Create(numSlots); }
+  void Start(const CFile &file)
+  {
+    _file = &file;
+    _nextBlock = 0;
+  }
+  void Stop() { _slots.WaitAll(); }
+
+  static bool CanBeStarted(const CBlock &block, UInt64 chunkSizeMax)
+  {
+    return CChunkDecoder::IsSupportedMethod(block.Type)
+        && block.PackSize <= chunkSizeMax
+        && block.UnpSize <= chunkSizeMax;
+  }
+
+  HRESULT Fill(IInStream *stream, UInt64 startPos, UInt64 chunkSizeMax);
+  CChunkDecoder *GetDecoded(unsigned blockIndex);
+};
+
+
+HRESULT CChunkPipe::Fill(IInStream *stream, UInt64 startPos, UInt64 chunkSizeMax)
+{
+  const CRecordVector<CBlock> &blocks = _file->Blocks;
+  for (; !_slots.IsFull() && _nextBlock < blocks.Size(); _nextBlock++)
+  {
+    const CBlock &block = blocks[_nextBlock];
+    if (!CanBeStarted(block, chunkSizeMax))
+      continue;
+    CChunkSlot &slot = _slots.GetFreeSlot();
+    slot.BlockIndex = _nextBlock;
+    RINOK(slot.Decoder.Prepare(stream, startPos + block.PackPos, block))
+    RINOK(_slots.StartSlot())
+  }
+  return S_OK;
+}
+
+
+// it returns NULL, if the block was not started in pipe
+
+CChunkDecoder *CChunkPipe::GetDecoded(unsigned blockIndex)
+{
+  if (_slots.IsEmpty() || _slots.GetFirstStarted().BlockIndex != blockIndex)
+    return NULL;
+  return &_slots.FinishNext().Decoder;
+}
+
+#endif
+
+
+static const UInt64 kChunkSizeMax = (UInt64)1 << 26;
 
 Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback))
@@ -1243,6 +1462,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   if (numItems == 0)
     return S_OK;
   UInt64 totalSize = 0;
+  UInt64 chunkSize = 0; // the maximum size of packed and unpacked chunk
   UInt32 i;
   
   for (i = 0; i < numItems; i++)
@@ -1253,10 +1473,43 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
       totalSize += _extras[index - _files.Size()].Data.Size();
     else
     #endif
-      totalSize += _files[index].Size;
+    {
+      const CFile &file = _files[index];
+      totalSize += file.Size;
+      FOR_VECTOR (j, file.Blocks)
+      {
+        const CBlock &block = file.Blocks[j];
+        if (CChunkDecoder::IsSupportedMethod(block.Type)
+            && block.PackSize <= kChunkSizeMax
+            && block.UnpSize <= kChunkSizeMax)
+        {
+          const UInt64 size = block.PackSize + block.UnpSize;
+          if (chunkSize < size)
+            chunkSize = size;
+        }
+      }
+    }
   }
   extractCallback->SetTotal(totalSize);
 
+ #ifndef Z7_ST
+  // each slot contains packed and unpacked data of one chunk
+  CChunkPipe pipe;
+  {
+    UInt32 numSlots = _props._numThreads;
+    if (numSlots > k_SlotRing_NumThreads_Max)
+      numSlots = k_SlotRing_NumThreads_Max;
+    if (chunkSize != 0)
+    {
+      const UInt64 numSlotsMax = _props._memUsage_Decompress / chunkSize;
+      if (numSlots > numSlotsMax)
+        numSlots = (UInt32)numSlotsMax;
+    }
+    if (numSlots > 1)
+      pipe.Create(numSlots);
+  }
+ #endif
+
   UInt64 currentPackTotal = 0;
   UInt64 currentUnpTotal = 0;
   UInt64 currentPackSize = 0;
@@ -1340,6 +1593,16 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
       UInt64 unpPos = 0;
       UInt64 packPos = 0;
+      const UInt64 itemStartPos = _startPos + _dataStartOffset + item.StartPos;
+
+     #ifndef Z7_ST
+      const bool usePipe = (pipe.GetNumSlots() > 1);
+      if (usePipe)
+      {
+        pipe.Start(item);
+        RINOK(pipe.Fill(_inStream, itemStartPos, kChunkSizeMax))
+      }
+     #endif
       {
         FOR_VECTOR (j, item.Blocks)
         {
@@ -1358,66 +1621,84 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
             break;
           }
 
-          RINOK(InStream_SeekSet(_inStream, _startPos + _dataStartOffset + item.StartPos + block.PackPos))
-          streamSpec->Init(block.PackSize);
           bool realMethod = true;
           outStreamSpec->Init(block.UnpSize);
           HRESULT res = S_OK;
 
           outCrcStreamSpec->EnableCalc(needCrc);
 
-          switch (block.Type)
+         #ifndef Z7_ST
+          CChunkDecoder *decoder = NULL;
+          if (usePipe)
+            decoder = pipe.GetDecoded(j);
+          if (decoder)
           {
-            case METHOD_ZERO_0:
-            case METHOD_ZERO_2:
-              realMethod = false;
-              if (block.PackSize != 0)
-                opRes = NExtract::NOperationResult::kUnsupportedMethod;
-              outCrcStreamSpec->EnableCalc(block.Type == METHOD_ZERO_0);
-              break;
+            // the CRC of file is calculated here, while worker threads decode next chunks
+            res = decoder->Res;
+            const HRESULT res2 = WriteStream(outStream, decoder->UnpackBuf, decoder->OutSize);
+            if (res == S_OK)
+              res = res2;
+            RINOK(pipe.Fill(_inStream, itemStartPos, kChunkSizeMax))
+          }
+          else
+         #endif
+          {
+            RINOK(InStream_SeekSet(_inStream, itemStartPos + block.PackPos))
+            streamSpec->Init(block.PackSize);
+
+            switch (block.Type)
+            {
+              case METHOD_ZERO_0:
+              case METHOD_ZERO_2:
+                realMethod = false;
+                if (block.PackSize != 0)
+                  opRes = NExtract::NOperationResult::kUnsupportedMethod;
+                outCrcStreamSpec->EnableCalc(block.Type == METHOD_ZERO_0);
+                break;
 
-            case METHOD_COPY:
-              if (block.UnpSize != block.PackSize)
+              case METHOD_COPY:
+                if (block.UnpSize != block.PackSize)
+                {
+                  opRes = NExtract::NOperationResult::kUnsupportedMethod;
+                  break;
+                }
+                res = copyCoder->Code(inStream, outStream, NULL, NULL, progress);
+                break;
+            
+              case METHOD_ADC:
               {
-                opRes = NExtract::NOperationResult::kUnsupportedMethod;
+                res = adcCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, progress);
                 break;
               }
-              res = copyCoder->Code(inStream, outStream, NULL, NULL, progress);
-              break;
-            
-            case METHOD_ADC:
-            {
-              res = adcCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, progress);
-              break;
-            }
             
-            case METHOD_ZLIB:
-            {
-              res = zlibCoder->Code(inStream, outStream, NULL, NULL, progress);
-              if (res == S_OK)
-                if (zlibCoderSpec->GetInputProcessedSize() != block.PackSize)
-                  opRes = NExtract::NOperationResult::kDataError;
-              break;
-            }
+              case METHOD_ZLIB:
+              {
+                res = zlibCoder->Code(inStream, outStream, NULL, NULL, progress);
+                if (res == S_OK)
+                  if (zlibCoderSpec->GetInputProcessedSize() != block.PackSize)
+                    opRes = NExtract::NOperationResult::kDataError;
+                break;
+              }
 
-            case METHOD_BZIP2:
-            {
-              res = bzip2Coder->Code(inStream, outStream, NULL, NULL, progress);
-              if (res == S_OK)
-                if (bzip2CoderSpec->GetInputProcessedSize() != block.PackSize)
-                  opRes = NExtract::NOperationResult::kDataError;
-              break;
-            }
+              case METHOD_BZIP2:
+              {
+                res = bzip2Coder->Code(inStream, outStream, NULL, NULL, progress);
+                if (res == S_OK)
+                  if (bzip2CoderSpec->GetInputProcessedSize() != block.PackSize)
+                    opRes = NExtract::NOperationResult::kDataError;
+                break;
+              }
 
-            case METHOD_LZFSE:
-            {
-              res = lzfseCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, progress);
-              break;
-            }
+              case METHOD_LZFSE:
+              {
+                res = lzfseCoder->Code(inStream, outStream, &block.PackSize, &block.UnpSize, progress);
+                break;
+              }
             
-            default:
-              opRes = NExtract::NOperationResult::kUnsupportedMethod;
-              break;
+              default:
+                opRes = NExtract::NOperationResult::kUnsupportedMethod;
+                break;
+            }
           }
 
           if (res != S_OK)
@@ -1444,6 +1725,10 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
           }
         }
       }
+     #ifndef Z7_ST
+      if (usePipe)
+        pipe.Stop();
+     #endif
   
       if (needCrc && opRes == NExtract::NOperationResult::kOK)
       {
@@ -1760,6 +2045,24 @@ Z7_COM7F_IMF(CHandler::GetStream(UInt32 index, ISequentialInStream **stream))
   COM_TRY_END
 }
 
+Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
+{
+  _props = CCommonMethodProps();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+    HRESULT hres;
+    if (!_props.SetCommonProperty(name, values[i], hres))
+      return E_INVALIDARG;
+    RINOK(hres)
+  }
+  return S_OK;
+}
+
 REGISTER_ARC_I(
   "Dmg", "dmg", NULL, 0xE4,
   k_Signature,
@@ -34,6 +34,8 @@
 
 #include "../Compress/CopyCoder.h"
 
+#include "HandlerCont.h"
+
 using namespace NWindows;
 
 UInt32 LzhCrc16Update(UInt32 crc, const void *data, size_t size);
@@ -868,6 +870,7 @@ Z7_CLASS_IMP_CHandler_IInArchive_2(
 
   void GetPath(unsigned index, AString &s) const;
   bool GetPackSize(unsigned index, UInt64 &res) const;
+  UInt64 GetPhyPos(unsigned index) const;
 };
 
 
@@ -1683,6 +1686,47 @@ void CHandler::GetPath(unsigned index, AString &s) const
 }
 
 
+// it returns the offset of first data block of file, or 0, if file has no data blocks
+
+UInt64 CHandler::GetPhyPos(unsigned index) const
+{
+  if (index >= _items.Size())
+    return 0;
+  const CItem &item = _items[index];
+  const CNode &node = _nodes[_refs[item.Node]];
+  if (node.IsDir())
+    return 0;
+  UInt64 block;
+  if (node.IsFlags_EXTENTS())
+  {
+    CExtentTreeHeader eth;
+    if (!eth.Parse(node.Block) || eth.NumEntries == 0)
+      return 0;
+    if (eth.Depth == 0)
+    {
+      CExtent e;
+      e.Parse(node.Block + 12);
+      block = e.PhyStart;
+    }
+    else
+    {
+      CExtentIndexNode e;
+      e.Parse(node.Block + 12);
+      block = e.PhyLeaf;
+    }
+  }
+  else
+  {
+    if (node.NumBlocks == 0 && node.FileSize < kNodeBlockFieldSize)
+      return 0;
+    block = Get32(node.Block);
+  }
+  if (block >= _h.NumBlocks)
+    return 0;
+  return block << _h.BlockBits;
+}
+
+
 bool CHandler::GetPackSize(unsigned index, UInt64 &totalPack) const
 {
   if (index >= _items.Size())
@@ -2718,9 +2762,13 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   UInt64 totalSize = 0;
   UInt32 i;
 
+  CPhyOrder order(_stream);
+  order.Reserve(numItems);
+
   for (i = 0; i < numItems; i++)
   {
     const UInt32 index = allFilesMode ? i : indices[i];
+    order.Add(index, GetPhyPos(index));
     if (index >= _items.Size())
       continue;
     const CItem &item = _items[index];
@@ -2728,6 +2776,9 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     if (!node.IsDir())
       totalSize += node.FileSize;
   }
+
+  RINOK(order.Sort(extractCallback))
+  RINOK(order.SetReadCache())
   
   extractCallback->SetTotal(totalSize);
 
@@ -2755,7 +2806,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
         NExtract::NAskMode::kTest :
         NExtract::NAskMode::kExtract;
     
-    const UInt32 index = allFilesMode ? i : indices[i];
+    const UInt32 index = order.GetIndex(i);
     
     RINOK(extractCallback->GetStream(index, &outStream, askMode))
 
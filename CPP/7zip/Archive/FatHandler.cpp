@@ -24,6 +24,8 @@
 
 #include "Common/DummyOutStream.h"
 
+#include "HandlerCont.h"
+
 #define Get16(p) GetUi16(p)
 #define Get32(p) GetUi32(p)
 
@@ -976,14 +978,26 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     return S_OK;
   UInt32 i;
   UInt64 totalSize = 0;
+  CPhyOrder order(InStream);
+  order.Reserve(numItems);
   for (i = 0; i < numItems; i++)
   {
-    const CItem &item = Items[allFilesMode ? i : indices[i]];
+    const UInt32 index = allFilesMode ? i : indices[i];
+    const CItem &item = Items[index];
+    UInt64 pos = 0;
     if (!item.IsDir())
+    {
       totalSize += item.Size;
+      if (item.Size != 0 && Header.IsValidCluster(item.Cluster))
+        pos = ((UInt64)Header.ClusterToSector(item.Cluster) << Header.SectorSizeLog);
+    }
+    order.Add(index, pos);
   }
   RINOK(extractCallback->SetTotal(totalSize))
 
+  RINOK(order.Sort(extractCallback))
+  RINOK(order.SetReadCache())
+
   UInt64 totalPackSize;
   totalSize = totalPackSize = 0;
   
@@ -1008,7 +1022,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     const Int32 askMode = testMode ?
         NExtract::NAskMode::kTest :
         NExtract::NAskMode::kExtract;
-    const UInt32 index = allFilesMode ? i : indices[i];
+    const UInt32 index = order.GetIndex(i);
     const CItem &item = Items[index];
     RINOK(extractCallback->GetStream(index, &realOutStream, askMode))
 
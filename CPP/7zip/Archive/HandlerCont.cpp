@@ -3,6 +3,7 @@
 #include "StdAfx.h"
 
 #include "../../Common/ComTry.h"
+#include "../../Common/Defs.h"
 
 #include "../Common/LimitedStreams.h"
 #include "../Common/ProgressUtils.h"
@@ -10,6 +11,10 @@
 
 #include "../Compress/CopyCoder.h"
 
+#ifndef Z7_ST
+#include "../Common/VirtThread.h"
+#endif
+
 #include "HandlerCont.h"
 
 namespace NArchive {
@@ -215,6 +220,24 @@ Z7_COM7F_IMF(CHandlerImg::GetNumberOfItems(UInt32 *numItems))
   return S_OK;
 }
 
+Z7_COM7F_IMF(CHandlerImg::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
+{
+  _props = CCommonMethodProps();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+    HRESULT hres;
+    if (!_props.SetCommonProperty(name, values[i], hres))
+      return E_INVALIDARG;
+    RINOK(hres)
+  }
+  return S_OK;
+}
+
 
 Z7_CLASS_IMP_NOQIB_1(
   CHandlerImgProgress
@@ -318,6 +341,381 @@ Z7_COM7F_IMF(CHandlerImg::Extract(const UInt32 *indices, UInt32 numItems,
 }
 
 
+#ifndef Z7_ST
+
+class CClusterThread Z7_final: public CVirtThread
+{
+public:
+  CClusterSlot *Slot;
+  void Execute() Z7_override;
+  ~CClusterThread() Z7_DESTRUCTOR_override
+  {
+    // we need WaitThreadFinish() call before destructors of this class members
+    CVirtThread::WaitThreadFinish();
+  }
+};
+
+#endif
+
+struct CClusterSlot
+{
+  CClusterUnpacker *Unpacker;
+  CByteBuffer PackBuf;
+  size_t PackSize;
+  Byte *Dest;
+  size_t DestSize;
+  HRESULT Res;
+  unsigned EntryIndex;
+  UInt64 StartIndex;
+  bool Busy;
+ #ifndef Z7_ST
+  CClusterThread Thread;
+ #endif
+
+  CClusterSlot():
+      Unpacker(NULL),
+      PackSize(0),
+      Dest(NULL),
+      DestSize(0),
+      Res(S_OK),
+      EntryIndex(0),
+      StartIndex(0),
+      Busy(false)
+  {
+   #ifndef Z7_ST
+    Thread.Slot = this;
+   #endif
+  }
+  ~CClusterSlot() { delete Unpacker; }
+
+  void Unpack()
+  {
+    try
+    {
+      Res = Unpacker->Unpack(PackBuf, PackSize, Dest, DestSize);
+    }
+    catch(...) { Res = E_FAIL; }
+  }
+};
+
+#ifndef Z7_ST
+void CClusterThread::Execute() { Slot->Unpack(); }
+#endif
+
+
+static const unsigned kNumClusterThreads_Max = 64;
+// the number of unpacked clusters that are kept for random access, in addition to read-ahead clusters
+static const unsigned kNumCachedClusters = 8;
+
+CClusterCache::CClusterCache():
+    _useCounter(0),
+    _clusterSizeMax(0),
+    _numSlots(0)
+    {}
+
+CClusterCache::~CClusterCache()
+{
+  Clear();
+}
+
+void CClusterCache::Clear()
+{
+  for (unsigned i = 0; i < _numSlots; i++)
+    if (_slots[i].Busy)
+      FinishSlot(i);
+  FOR_VECTOR (i, _entries)
+  {
+    CEntry &e = _entries[i];
+    e.Pos = (UInt64)(Int64)-1;
+    e.LastUse = 0;
+  }
+}
+
+HRESULT CClusterCache::Create(size_t clusterSizeMax, UInt32 numThreads, UInt64 memUsage)
+{
+  Clear();
+
+  UInt32 numSlots = 1;
+ #ifndef Z7_ST
+  numSlots = numThreads;
+  if (numSlots > kNumClusterThreads_Max)
+    numSlots = kNumClusterThreads_Max;
+  {
+    // each slot needs packed buffer and two unpacked clusters (current and read-ahead)
+    const UInt64 numSlotsMax = memUsage / ((UInt64)clusterSizeMax * 4);
+    if (numSlots > numSlotsMax)
+      numSlots = (UInt32)numSlotsMax;
+  }
+  if (numSlots == 0)
+    numSlots = 1;
+ #else
+  UNUSED_VAR(numThreads)
+  UNUSED_VAR(memUsage)
+ #endif
+
+  _clusterSizeMax = clusterSizeMax;
+  _numSlots = numSlots;
+  while (_slots.Size() < numSlots)
+  {
+    CClusterSlot &slot = _slots.AddNew();
+    slot.Unpacker = CreateUnpacker();
+  }
+
+  const unsigned numEntries = numSlots * 2 + kNumCachedClusters;
+  while (_entries.Size() > numEntries)
+    _entries.DeleteBack();
+  while (_entries.Size() < numEntries)
+  {
+    CEntry &e = _entries.AddNew();
+    e.Pos = (UInt64)(Int64)-1;
+    e.LastUse = 0;
+    e.Size = 0;
+    e.Res = S_OK;
+    e.Slot = -1;
+  }
+  return S_OK;
+}
+
+int CClusterCache::FindEntry(UInt64 pos) const
+{
+  FOR_VECTOR (i, _entries)
+    if (_entries[i].Pos == pos)
+      return (int)i;
+  return -1;
+}
+
+unsigned CClusterCache::GetFreeEntry() const
+{
+  // the number of entries is larger than the number of slots,
+  // so there is always some entry that is not used by slot
+  unsigned best = 0;
+  UInt64 bestUse = (UInt64)(Int64)-1;
+  FOR_VECTOR (i, _entries)
+  {
+    const CEntry &e = _entries[i];
+    if (e.Slot < 0 && e.LastUse <= bestUse)
+    {
+      best = i;
+      bestUse = e.LastUse;
+    }
+  }
+  return best;
+}
+
+void CClusterCache::FinishSlot(unsigned slotIndex)
+{
+  CClusterSlot &slot = _slots[slotIndex];
+ #ifndef Z7_ST
+  if (_numSlots > 1)
+    slot.Thread.WaitExecuteFinish();
+ #endif
+  CEntry &e = _entries[slot.EntryIndex];
+  e.Res = slot.Res;
+  e.Slot = -1;
+  slot.Busy = false;
+}
+
+// it returns S_FALSE, if all slots are busy and (wait == false)
+
+HRESULT CClusterCache::GetFreeSlot(unsigned &slotIndex, bool wait)
+{
+  unsigned oldest = 0;
+  for (unsigned i = 0; i < _numSlots; i++)
+  {
+    const CClusterSlot &slot = _slots[i];
+    if (!slot.Busy)
+    {
+      slotIndex = i;
+      return S_OK;
+    }
+    if (slot.StartIndex < _slots[oldest].StartIndex)
+      oldest = i;
+  }
+  if (!wait)
+    return S_FALSE;
+  FinishSlot(oldest);
+  slotIndex = oldest;
+  return S_OK;
+}
+
+/* Fill() starts unpacking of cluster at (pos), if (isFirst), and
+   then it starts unpacking of next clusters in free slots. */
+
+HRESULT CClusterCache::Fill(UInt64 pos, bool isFirst)
+{
+  for (unsigned k = 0; k < _numSlots; k++)
+  {
+    const bool isRequired = (isFirst && k == 0);
+    size_t unpackSize;
+    const int entryIndex = FindEntry(pos);
+    if (entryIndex >= 0)
+      unpackSize = _entries[entryIndex].Size;
+    else
+    {
+      unsigned slotIndex;
+      {
+        const HRESULT res = GetFreeSlot(slotIndex, isRequired);
+        if (res == S_FALSE)
+          break;
+        RINOK(res)
+      }
+      CClusterSlot &slot = _slots[slotIndex];
+      size_t packSize = 0;
+      unpackSize = 0;
+      {
+        const HRESULT res = ReadPacked(pos, slot.PackBuf, packSize, unpackSize);
+        if (res != S_OK)
+        {
+          if (isRequired)
+            return res;
+          // the error will be reported later, if that cluster will be requested
+          break;
+        }
+      }
+      if (unpackSize > _clusterSizeMax)
+        return E_FAIL;
+      if (packSize != 0)
+      {
+        if (unpackSize == 0)
+          return E_FAIL;
+        const unsigned newIndex = GetFreeEntry();
+        CEntry &e = _entries[newIndex];
+        e.Data.AllocAtLeast(_clusterSizeMax);
+        e.Pos = pos;
+        e.Size = unpackSize;
+        e.LastUse = ++_useCounter;
+        e.Res = S_OK;
+        e.Slot = (int)slotIndex;
+        slot.PackSize = packSize;
+        slot.Dest = e.Data;
+        slot.DestSize = unpackSize;
+        slot.EntryIndex = newIndex;
+        slot.StartIndex = _useCounter;
+        slot.Busy = true;
+       #ifndef Z7_ST
+        if (_numSlots > 1)
+        {
+          WRes wres = slot.Thread.Create();
+          if (wres == 0)
+            wres = slot.Thread.Start();
+          if (wres != 0)
+          {
+            slot.Busy = false;
+            e.Slot = -1;
+            e.Pos = (UInt64)(Int64)-1;
+            return HRESULT_FROM_WIN32(wres);
+          }
+        }
+        else
+       #endif
+        {
+          slot.Unpack();
+          FinishSlot(slotIndex);
+        }
+      }
+      else if (isRequired)
+        return E_FAIL;
+    }
+    if (unpackSize == 0)
+      break;
+    pos += unpackSize;
+  }
+  return S_OK;
+}
+
+HRESULT CClusterCache::Get(UInt64 pos, const Byte *&data, size_t &size)
+{
+  data = NULL;
+  size = 0;
+  int entryIndex = FindEntry(pos);
+  if (entryIndex < 0)
+  {
+    RINOK(Fill(pos, true))
+    entryIndex = FindEntry(pos);
+    if (entryIndex < 0)
+      return E_FAIL;
+  }
+  else
+  {
+    _entries[entryIndex].LastUse = ++_useCounter;
+    if (_numSlots > 1)
+    {
+      RINOK(Fill(pos, false))
+    }
+  }
+  CEntry &e = _entries[entryIndex];
+  if (e.Slot >= 0)
+    FinishSlot((unsigned)e.Slot);
+  e.LastUse = ++_useCounter;
+  data = e.Data;
+  size = e.Size;
+  return e.Res;
+}
+
+
+// the cache of 16 blocks of 256 KiB
+static const unsigned kImageReadCache_BlockSizeLog = 18;
+static const unsigned kImageReadCache_NumBlocksLog = 4;
+
+HRESULT CImageReadCache::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
+{
+  RINOK(InStream_SeekSet(Stream, blockIndex << kImageReadCache_BlockSizeLog))
+  return ReadStream_FALSE(Stream, dest, blockSize);
+}
+
+
+static int ComparePhyOrderItems(const CPhyOrderItem *p1, const CPhyOrderItem *p2, void *)
+{
+  if (p1->Pos != p2->Pos)
+    return p1->Pos < p2->Pos ? -1 : 1;
+  return MyCompare(p1->Index, p2->Index);
+}
+
+HRESULT CPhyOrder::Sort(IArchiveExtractCallback *callback)
+{
+  Z7_DECL_CMyComPtr_QI_FROM(
+      IArchiveExtractCallbackOrder,
+      callbackOrder, callback)
+  if (!callbackOrder)
+    return S_OK;
+  Int32 anyOrder = 0;
+  RINOK(callbackOrder->GetAnyOrder(&anyOrder))
+  if (anyOrder)
+    _items.Sort(ComparePhyOrderItems, NULL);
+  return S_OK;
+}
+
+HRESULT CPhyOrder::SetReadCache()
+{
+  RestoreStream();
+  if (_items.Size() < 2 || !_stream)
+    return S_OK;
+  UInt64 size;
+  RINOK(InStream_GetSize_SeekToEnd(_stream, size))
+  CImageReadCache *cacheSpec = new CImageReadCache;
+  CMyComPtr<IInStream> cache = cacheSpec;
+  // if there is no memory for cache, we just use original stream
+  if (!cacheSpec->Alloc(kImageReadCache_BlockSizeLog, kImageReadCache_NumBlocksLog))
+    return S_OK;
+  cacheSpec->Init(size);
+  cacheSpec->Stream = _stream;
+  _origStream = _stream;
+  _stream = cache;
+  _cacheMode = true;
+  return S_OK;
+}
+
+void CPhyOrder::RestoreStream()
+{
+  if (_cacheMode)
+  {
+    _stream = _origStream;
+    _origStream.Release();
+    _cacheMode = false;
+  }
+}
+
+
 HRESULT ReadZeroTail(ISequentialInStream *stream, bool &areThereNonZeros, UInt64 &numZeros, UInt64 maxSize)
 {
   areThereNonZeros = false;
@@ -3,8 +3,13 @@
 #ifndef ZIP7_INC_HANDLER_CONT_H
 #define ZIP7_INC_HANDLER_CONT_H
 
+#include "../../Common/MyBuffer.h"
 #include "../../Common/MyCom.h"
 
+#include "../Common/StreamObjects.h"
+
+#include "Common/HandlerOut.h"
+
 #include "IArchive.h"
 
 namespace NArchive {
@@ -62,24 +67,147 @@ protected:
   x(GetArchivePropertyInfo(UInt32 index, BSTR *name, PROPID *propID, VARTYPE *varType)) \
 
 
+class CClusterUnpacker
+{
+public:
+  /* it's called from worker thread.
+     it returns S_FALSE for data error. */
+  virtual HRESULT Unpack(const Byte *src, size_t srcSize, Byte *dest, size_t destSize) = 0;
+  virtual ~CClusterUnpacker() {}
+};
+
+struct CClusterSlot;
+
+/*
+  CClusterCache keeps the unpacked data of compressed clusters of disk image.
+  The clusters are identified by virtual offset of cluster start.
+  Child class reads packed data of cluster in main thread,
+  and the cache unpacks it in worker threads.
+  If the cache misses some cluster, it also starts unpacking
+  of next clusters (read-ahead) for sequential reading.
+*/
+
+class CClusterCache
+{
+  struct CEntry
+  {
+    UInt64 Pos;
+    UInt64 LastUse;
+    size_t Size;
+    HRESULT Res;
+    int Slot;   // the index of slot that unpacks data to entry, or (-1)
+    CByteBuffer Data;
+  };
+
+  CObjectVector<CEntry> _entries;
+  CObjectVector<CClusterSlot> _slots;
+  UInt64 _useCounter;
+  size_t _clusterSizeMax;
+  unsigned _numSlots;
+
+  int FindEntry(UInt64 pos) const;
+  unsigned GetFreeEntry() const;
+  void FinishSlot(unsigned slotIndex);
+  HRESULT GetFreeSlot(unsigned &slotIndex, bool wait);
+  HRESULT Fill(UInt64 pos, bool isFirst);
+protected:
+  /* it's called from main thread.
+     it returns (packSize == 0), if (pos) is not start of compressed cluster.
+     (unpackSize) is the distance to next cluster, or 0 at the end of image.
+     it returns S_FALSE for data error. */
+  virtual HRESULT ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize) = 0;
+  virtual CClusterUnpacker *CreateUnpacker() = 0;
+public:
+  CClusterCache();
+  virtual ~CClusterCache();
+
+  HRESULT Create(size_t clusterSizeMax, UInt32 numThreads, UInt64 memUsage);
+  void Clear(); // it waits the finish of worker threads and removes all clusters
+
+  /* it returns unpacked data of compressed cluster that starts at (pos).
+     (data) is available until next call of Get(). */
+  HRESULT Get(UInt64 pos, const Byte *&data, size_t &size);
+};
+
+
+/*
+  CPhyOrder is used in Extract() of file system image handlers.
+  It sorts the requested items by physical offset of first data extent,
+  so the extraction of many files reads the image in ascending order.
+  The items are sorted only if the extract callback allows any order
+  (IArchiveExtractCallbackOrder). For example, the items that are written
+  to one stream (stdout) must go in order of indices.
+  Also it can replace the image stream of handler by read cache stream,
+  that joins the small reads of adjacent files into big reads.
+  The callback still gets the results for each item.
+*/
+
+class CImageReadCache: public CCachedInStream
+{
+  HRESULT ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize) Z7_override;
+public:
+  CMyComPtr<IInStream> Stream;
+};
+
+struct CPhyOrderItem
+{
+  UInt64 Pos;   // physical offset of data in image, or 0 for items without data
+  UInt32 Index;
+};
+
+class CPhyOrder
+{
+  CRecordVector<CPhyOrderItem> _items;
+  CMyComPtr<IInStream> &_stream;
+  CMyComPtr<IInStream> _origStream;
+  bool _cacheMode;
+public:
+  // (stream) is the image stream variable of handler
+  CPhyOrder(CMyComPtr<IInStream> &stream): _stream(stream), _cacheMode(false) {}
+  ~CPhyOrder() { RestoreStream(); }
+
+  void Reserve(unsigned num) { _items.ClearAndReserve(num); }
+  void Add(UInt32 index, UInt64 pos)
+  {
+    CPhyOrderItem item;
+    item.Pos = pos;
+    item.Index = index;
+    _items.AddInReserved(item);
+  }
+  // it sorts the items, if (callback) allows any order of items
+  HRESULT Sort(IArchiveExtractCallback *callback);
+  unsigned Size() const { return _items.Size(); }
+  UInt32 GetIndex(unsigned i) const { return _items[i].Index; }
+
+  /* it replaces image stream by read cache stream over original stream, if there are many items.
+     Original stream is restored by RestoreStream() or by destructor. */
+  HRESULT SetReadCache();
+  void RestoreStream();
+};
+
+
 class CHandlerImg:
   public IInArchive,
   public IInArchiveGetStream,
   public IInStream,
+  public ISetProperties,
   public CMyUnknownImp
 {
-  Z7_COM_UNKNOWN_IMP_3(
+  Z7_COM_UNKNOWN_IMP_4(
       IInArchive,
       IInArchiveGetStream,
-      IInStream)
+      IInStream,
+      ISetProperties)
 
   Z7_COM7F_IMP(Open(IInStream *stream, const UInt64 *maxCheckStartPosition, IArchiveOpenCallback *openCallback))
   Z7_COM7F_IMP(GetNumberOfItems(UInt32 *numItems))
   Z7_COM7F_IMP(Extract(const UInt32 *indices, UInt32 numItems, Int32 testMode, IArchiveExtractCallback *extractCallback))
   Z7_IFACE_COM7_IMP(IInStream)
+  Z7_IFACE_COM7_IMP(ISetProperties)
   // Z7_IFACEM_IInArchive_Img(Z7_COM7F_PUREO)
 
 protected:
+  CCommonMethodProps _props;
   UInt64 _virtPos;
   UInt64 _posInArc;
   UInt64 _size;
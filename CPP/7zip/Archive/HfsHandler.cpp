@@ -14,6 +14,8 @@
 #include "../Common/StreamObjects.h"
 #include "../Common/StreamUtils.h"
 
+#include "Common/HandlerOut.h"
+
 #include "HfsHandler.h"
 
 /* if HFS_SHOW_ALT_STREAMS is defined, the handler will show attribute files
@@ -1525,15 +1527,18 @@ Z7_class_CHandler_final:
   public IInArchive,
   public IArchiveGetRawProps,
   public IInArchiveGetStream,
+  public ISetProperties,
   public CMyUnknownImp,
   public CDatabase
 {
-  Z7_IFACES_IMP_UNK_3(
+  Z7_IFACES_IMP_UNK_4(
       IInArchive,
       IArchiveGetRawProps,
-      IInArchiveGetStream)
+      IInArchiveGetStream,
+      ISetProperties)
 
   CMyComPtr<IInStream> _stream;
+  CCommonMethodProps _props;
   HRESULT GetForkStream(const CFork &fork, ISequentialInStream **stream);
 };
 
@@ -1794,8 +1799,194 @@ CDecoder::CDecoder()
   _lzfseDecoderSpec = new NCompress::NLzfse::CDecoder();
   _lzfseDecoder = _lzfseDecoderSpec;
   _lzfseDecoderSpec->LzvnMode = true;
+
+  NumThreads = 1;
+}
+
+
+struct CBlockSlot
+{
+  NCompress::NZlib::CDecoder *ZlibDecoderSpec;
+  CMyComPtr<ICompressCoder> ZlibDecoder;
+  NCompress::NLzfse::CDecoder *LzfseDecoderSpec;
+  CMyComPtr<ICompressCoder> LzfseDecoder;
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+  CBufPtrSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+
+  CByteBuffer PackBuf;
+  CByteBuffer OutBuf;
+  UInt32 PackSize;
+  UInt32 UnpackSize;
+  bool ZlibMode;
+  HRESULT Res;
+
+  CBlockSlot();
+  HRESULT Unpack2();
+  void Run()
+  {
+    try { Res = Unpack2(); }
+    catch(...) { Res = E_FAIL; }
+  }
+};
+
+CBlockSlot::CBlockSlot():
+    PackSize(0),
+    UnpackSize(0),
+    ZlibMode(true),
+    Res(S_OK)
+{
+  ZlibDecoderSpec = new NCompress::NZlib::CDecoder();
+  ZlibDecoder = ZlibDecoderSpec;
+  LzfseDecoderSpec = new NCompress::NLzfse::CDecoder();
+  LzfseDecoder = LzfseDecoderSpec;
+  LzfseDecoderSpec->LzvnMode = true;
+  InStreamSpec = new CBufInStream;
+  InStream = InStreamSpec;
+  OutStreamSpec = new CBufPtrSeqOutStream;
+  OutStream = OutStreamSpec;
+  PackBuf.Alloc(kCompressionBlockSize + 0x10); // we need 1 additional bytes for uncompressed chunk header
+  OutBuf.Alloc(kCompressionBlockSize);
 }
 
+// the block is decoded to (OutBuf) as whole buffer, and it can be called from worker thread
+
+HRESULT CBlockSlot::Unpack2()
+{
+  const Byte *buf = PackBuf;
+  const UInt32 size = PackSize;
+  const UInt32 blockSize = UnpackSize;
+
+  if (ZlibMode ?
+      (buf[0] & 0xF) == 0xF :
+      buf[0] == k_LZVN_Uncompressed_Marker)
+  {
+    // (buf[0] = 0xff) is marker of uncompressed block in APFS
+    // that code was not tested in HFS
+    if (size - 1 != blockSize)
+      return S_FALSE;
+    memcpy(OutBuf, buf + 1, blockSize);
+    return S_OK;
+  }
+
+  const UInt64 blockSize64 = blockSize;
+  InStreamSpec->Init(buf, size);
+  OutStreamSpec->Init(OutBuf, blockSize);
+  
+  if (!ZlibMode)
+  {
+    const UInt64 packSize64 = size;
+    RINOK(LzfseDecoder->Code(InStream, OutStream, &packSize64, &blockSize64, NULL))
+    // in/out sizes were checked in Code()
+    return S_OK;
+  }
+  
+  RINOK(ZlibDecoder->Code(InStream, OutStream, NULL, &blockSize64, NULL))
+  if (ZlibDecoderSpec->GetOutputProcessedSize() != blockSize
+      || OutStreamSpec->GetPos() != blockSize)
+    return S_FALSE;
+  const UInt64 inSize = ZlibDecoderSpec->GetInputProcessedSize();
+  // apfs file can contain junk (non-zeros) after data block.
+  if (inSize > size)
+    return S_FALSE;
+  return S_OK;
+}
+
+
+CDecoder::~CDecoder() {}
+
+HRESULT CDecoder::DecodeBlocks(
+    ISequentialInStream *inStream, ISequentialOutStream *outStream,
+    UInt64 unpackSize, bool zlibMode,
+    UInt64 progressStart, IArchiveExtractCallback *extractCallback)
+{
+  const unsigned numBlocks = _packSizes.Size();
+  unsigned numSlots = 1;
+ #ifndef Z7_ST
+  numSlots = NumThreads;
+  if (numSlots > numBlocks)
+    numSlots = numBlocks;
+ #endif
+  _slots.Create(numSlots);
+
+  // the blocks in range [iWrite, iRead) are started in slots
+  unsigned iRead = 0;
+  unsigned iWrite = 0;
+  UInt64 readPos = 0;
+  UInt64 outPos = 0;
+  HRESULT res = S_OK;
+  /* if reading of packed data fails, we stop reading,
+     but we still write the blocks [iWrite, iRead) that were started before that error */
+  HRESULT readRes = S_OK;
+
+  for (;;)
+  {
+    if (readRes == S_OK && iRead < numBlocks && !_slots.IsFull())
+    {
+      const UInt64 rem = unpackSize - readPos;
+      if (rem == 0)
+      {
+        readRes = S_FALSE;
+        continue;
+      }
+      UInt32 blockSize = kCompressionBlockSize;
+      if (rem < kCompressionBlockSize)
+        blockSize = (UInt32)rem;
+      const UInt32 size = _packSizes[iRead];
+      if (size > kCompressionBlockSize + 1)
+      {
+        readRes = S_FALSE;
+        continue;
+      }
+      CBlockSlot &slot = _slots.GetFreeSlot();
+      readRes = ReadStream_FALSE(inStream, slot.PackBuf, size);
+      if (readRes != S_OK)
+        continue;
+      slot.PackSize = size;
+      slot.UnpackSize = blockSize;
+      slot.ZlibMode = zlibMode;
+      readPos += blockSize;
+      readRes = _slots.StartSlot();
+      if (readRes == S_OK)
+        iRead++;
+      continue;
+    }
+
+    if (_slots.IsEmpty())
+      break;
+    const CBlockSlot &slot = _slots.FinishNext();
+    iWrite++;
+    res = slot.Res;
+    if (res != S_OK)
+      break;
+    if (outStream)
+    {
+      res = WriteStream(outStream, slot.OutBuf, slot.UnpackSize);
+      if (res != S_OK)
+        break;
+    }
+    outPos += slot.UnpackSize;
+    if (((iWrite - 1) & 0xFF) == 0)
+    {
+      const UInt64 progressPos = progressStart + outPos;
+      res = extractCallback->SetCompleted(&progressPos);
+      if (res != S_OK)
+        break;
+    }
+  }
+
+  // we wait for the threads that were started before write error
+  _slots.WaitAll();
+
+  RINOK(res)
+  RINOK(readRes)
+  if (outPos != unpackSize)
+    return S_FALSE;
+  return S_OK;
+}
+
+
 HRESULT CDecoder::ExtractResourceFork_ZLIB(
     ISequentialInStream *inStream, ISequentialOutStream *outStream,
     UInt64 forkSize, UInt64 unpackSize,
@@ -1862,82 +2053,13 @@ HRESULT CDecoder::ExtractResourceFork_ZLIB(
   if (prev != dataSize2)
     return S_FALSE;
 
-  CBufInStream *bufInStreamSpec = new CBufInStream;
-  CMyComPtr<ISequentialInStream> bufInStream = bufInStreamSpec;
-
-  // bool padError = false;
-  UInt64 outPos = 0;
-
+  _packSizes.ClearAndReserve(numBlocks);
   for (i = 0; i < numBlocks; i++)
-  {
-    const UInt64 rem = unpackSize - outPos;
-    if (rem == 0)
-      return S_FALSE;
-    UInt32 blockSize = kCompressionBlockSize;
-    if (rem < kCompressionBlockSize)
-      blockSize = (UInt32)rem;
-
-    const UInt32 size = GetUi32(tableBuf + i * 8 + 4);
+    _packSizes.AddInReserved(GetUi32(tableBuf + i * 8 + 4));
 
-    if (size > kCompressionBlockSize + 1)
-      return S_FALSE;
-
-    RINOK(ReadStream_FALSE(inStream, buf, size))
-
-    if ((buf[0] & 0xF) == 0xF)
-    {
-      // (buf[0] = 0xff) is marker of uncompressed block in APFS
-      // that code was not tested in HFS
-      if (size - 1 != blockSize)
-        return S_FALSE;
-
-      if (outStream)
-      {
-        RINOK(WriteStream(outStream, buf + 1, blockSize))
-      }
-    }
-    else
-    {
-      const UInt64 blockSize64 = blockSize;
-      bufInStreamSpec->Init(buf, size);
-      RINOK(_zlibDecoder->Code(bufInStream, outStream, NULL, &blockSize64, NULL))
-      if (_zlibDecoderSpec->GetOutputProcessedSize() != blockSize)
-        return S_FALSE;
-      const UInt64 inSize = _zlibDecoderSpec->GetInputProcessedSize();
-      if (inSize != size)
-      {
-        if (inSize > size)
-          return S_FALSE;
-        // apfs file can contain junk (non-zeros) after data block.
-        /*
-        if (!padError)
-        {
-          const Byte *p = buf + (UInt32)inSize;
-          const Byte *e = p + (size - (UInt32)inSize);
-          do
-          {
-            if (*p != 0)
-            {
-              padError = true;
-              break;
-            }
-          }
-          while (++p != e);
-        }
-        */
-      }
-    }
-    
-    outPos += blockSize;
-    if ((i & 0xFF) == 0)
-    {
-      const UInt64 progressPos = progressStart + outPos;
-      RINOK(extractCallback->SetCompleted(&progressPos))
-    }
-  }
-
-  if (outPos != unpackSize)
-    return S_FALSE;
+  RINOK(DecodeBlocks(inStream, outStream, unpackSize,
+      true, // zlibMode
+      progressStart, extractCallback))
 
   // if (padError) return S_FALSE;
 
@@ -2002,60 +2124,15 @@ HRESULT CDecoder::ExtractResourceFork_LZFSE(
       return S_FALSE;
   }
 
-  const size_t kBufSize = kCompressionBlockSize;
-  _buf.Alloc(kBufSize + 0x10); // we need 1 additional bytes for uncompressed chunk header
-
-  CBufInStream *bufInStreamSpec = new CBufInStream;
-  CMyComPtr<ISequentialInStream> bufInStream = bufInStreamSpec;
-
-  UInt64 outPos = 0;
-
+  _packSizes.ClearAndReserve(numBlocks);
   for (UInt32 i = 0; i < numBlocks; i++)
-  {
-    const UInt64 rem = unpackSize - outPos;
-    if (rem == 0)
-      return S_FALSE;
-    UInt32 blockSize = kCompressionBlockSize;
-    if (rem < kCompressionBlockSize)
-      blockSize = (UInt32)rem;
-
-    const UInt32 size =
+    _packSizes.AddInReserved(
         GetUi32(tableBuf + i * 4 + 4) -
-        GetUi32(tableBuf + i * 4);
-
-    if (size > kCompressionBlockSize + 1)
-      return S_FALSE;
-
-    RINOK(ReadStream_FALSE(inStream, _buf, size))
-    const Byte *buf = _buf;
-
-    if (buf[0] == k_LZVN_Uncompressed_Marker)
-    {
-      if (size - 1 != blockSize)
-        return S_FALSE;
-      if (outStream)
-      {
-        RINOK(WriteStream(outStream, buf + 1, blockSize))
-      }
-    }
-    else
-    {
-      const UInt64 blockSize64 = blockSize;
-      const UInt64 packSize64 = size;
-      bufInStreamSpec->Init(buf, size);
-      RINOK(_lzfseDecoder->Code(bufInStream, outStream, &packSize64, &blockSize64, NULL))
-      // in/out sizes were checked in Code()
-    }
-    
-    outPos += blockSize;
-    if ((i & 0xFF) == 0)
-    {
-      const UInt64 progressPos = progressStart + outPos;
-      RINOK(extractCallback->SetCompleted(&progressPos))
-    }
-  }
+        GetUi32(tableBuf + i * 4));
 
-  return S_OK;
+  return DecodeBlocks(inStream, outStream, unpackSize,
+      false, // zlibMode
+      progressStart, extractCallback);
 }
 
 
@@ -2351,6 +2428,9 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CByteBuffer buf(kBufSize + 0x10); // we need 1 additional bytes for uncompressed chunk header
 
   CDecoder decoder;
+ #ifndef Z7_ST
+  decoder.NumThreads = _props._numThreads;
+ #endif
 
   for (i = 0;; i++, currentTotalSize += currentItemSize)
   {
@@ -2575,6 +2655,21 @@ Z7_COM7F_IMF(CHandler::GetStream(UInt32 index, ISequentialInStream **stream))
   return GetForkStream(*fork, stream);
 }
 
+Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
+{
+  _props = CCommonMethodProps();
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    HRESULT hres;
+    if (!_props.SetCommonProperty(name, values[i], hres))
+      return E_INVALIDARG;
+    RINOK(hres)
+  }
+  return S_OK;
+}
+
 static const Byte k_Signature[] = {
     2, 'B', 'D',
     4, 'H', '+', 0, 4,
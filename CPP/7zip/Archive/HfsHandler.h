@@ -5,6 +5,8 @@
 
 #include "../../Windows/PropVariant.h"
 
+#include "../Common/SlotRing.h"
+
 #include "../Compress/LzfseDecoder.h"
 #include "../Compress/ZlibDecoder.h"
 
@@ -45,6 +47,7 @@ struct CCompressHeader
 
 void MethodsMaskToProp(UInt32 methodsMask, NWindows::NCOM::CPropVariant &prop);
 
+struct CBlockSlot;
 
 class CDecoder
 {
@@ -57,6 +60,17 @@ class CDecoder
   CByteBuffer _tableBuf;
   CByteBuffer _buf;
 
+  CRecordVector<UInt32> _packSizes;
+  CSlotRing<CBlockSlot> _slots;
+
+  /* it decodes the blocks of resource fork, that have sizes from (_packSizes).
+     Blocks are independent, so they can be decoded in parallel threads.
+     Output data is written in original order of blocks. */
+  HRESULT DecodeBlocks(
+      ISequentialInStream *inStream, ISequentialOutStream *outStream,
+      UInt64 unpackSize, bool zlibMode,
+      UInt64 progressStart, IArchiveExtractCallback *extractCallback);
+
   HRESULT ExtractResourceFork_ZLIB(
       ISequentialInStream *inStream, ISequentialOutStream *realOutStream,
       UInt64 forkSize, UInt64 unpackSize,
@@ -82,7 +96,10 @@ public:
       UInt64 progressStart, IArchiveExtractCallback *extractCallback,
       int &opRes);
 
+  UInt32 NumThreads;
+
   CDecoder();
+  ~CDecoder();
 };
 
 }}
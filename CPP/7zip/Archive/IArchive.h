@@ -77,6 +77,7 @@ namespace NArcInfoFlags
   const UInt32 kMTime_Default   = 1 << 19;
   // const UInt32 kTTime_Reserved         = 1 << 20;
   // const UInt32 kTTime_Reserved_Default = 1 << 21;
+  const UInt32 kIndependentItems = 1 << 22; // items can be extracted in parallel by several handler objects
 }
 
 namespace NArcInfoTimeFlags
@@ -259,6 +260,22 @@ Z7_IFACE_CONSTR_ARCHIVE_SUB(IArchiveExtractCallbackMessage, IProgress, 0x21)
   x(ReportExtractResult(UInt32 indexType, UInt32 index, Int32 opRes))
 Z7_IFACE_CONSTR_ARCHIVE(IArchiveExtractCallbackMessage2, 0x22)
 
+
+/*
+IArchiveExtractCallbackOrder can be requested from IArchiveExtractCallback object
+  by Extract() function of handler that can extract items in another order
+  than order of (indices), for example, in order of data in archive.
+GetAnyOrder()
+  *anyOrder = 1 : each item is written to separate stream (file),
+                  so GetStream() can be called for items in any order.
+  *anyOrder = 0 : callee expects items in order of (indices).
+                  For example, all items are written to one stream (stdout).
+  If the interface is not supported, handler must use order of (indices).
+*/
+#define Z7_IFACEM_IArchiveExtractCallbackOrder(x) \
+  x(GetAnyOrder(Int32 *anyOrder))
+Z7_IFACE_CONSTR_ARCHIVE(IArchiveExtractCallbackOrder, 0x23)
+
 #define Z7_IFACEM_IArchiveOpenVolumeCallback(x) \
   x(GetProperty(PROPID propID, PROPVARIANT *value)) \
   x(GetStream(const wchar_t *name, IInStream **inStream))
@@ -14,6 +14,8 @@
 
 #include "../Common/ItemNameUtils.h"
 
+#include "../HandlerCont.h"
+
 #include "IsoHandler.h"
 
 using namespace NWindows;
@@ -315,21 +317,35 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     return S_OK;
   UInt64 totalSize = 0;
   UInt32 i;
+  CPhyOrder order(_stream);
+  order.Reserve(numItems);
   for (i = 0; i < numItems; i++)
   {
     UInt32 index = (allFilesMode ? i : indices[i]);
+    UInt64 pos = 0;
     if (index < (UInt32)_archive.Refs.Size())
     {
       const CRef &ref = _archive.Refs[index];
       const CDir &item = ref.Dir->_subItems[ref.Index];
       if (!item.IsDir())
+      {
         totalSize += ref.TotalSize;
+        pos = (UInt64)item.ExtentLocation * kBlockSize;
+      }
     }
     else
-      totalSize += _archive.GetBootItemSize(index - _archive.Refs.Size());
+    {
+      const unsigned bootIndex = index - _archive.Refs.Size();
+      totalSize += _archive.GetBootItemSize(bootIndex);
+      pos = (UInt64)_archive.BootEntries[bootIndex].LoadRBA * kBlockSize;
+    }
+    order.Add(index, pos);
   }
   extractCallback->SetTotal(totalSize);
 
+  RINOK(order.Sort(extractCallback))
+  RINOK(order.SetReadCache())
+
   UInt64 currentTotalSize = 0;
   UInt64 currentItemSize;
   
@@ -353,7 +369,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     const Int32 askMode = testMode ?
         NExtract::NAskMode::kTest :
         NExtract::NAskMode::kExtract;
-    const UInt32 index = allFilesMode ? i : indices[i];
+    const UInt32 index = order.GetIndex(i);
     
     RINOK(extractCallback->GetStream(index, &realOutStream, askMode))
 
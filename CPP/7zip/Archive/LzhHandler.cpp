@@ -727,7 +727,7 @@ REGISTER_ARC_I(
   "Lzh", "lzh lha", NULL, 6,
   k_Signature,
   2,
-  0,
+  NArcInfoFlags::kIndependentItems,
   IsArc_Lzh)
 
 }}
@@ -32,6 +32,8 @@ UInt64 CDecoder::GetInputProcessedSize() const
 HRESULT CDecoder::Init(ISequentialInStream *inStream, bool &useFilter)
 {
   useFilter = false;
+  _unpackPos = 0;
+  _readError = false;
 
   if (_decoderInStream)
     if (Method != _curMethod)
@@ -118,6 +120,47 @@ HRESULT CDecoder::Init(ISequentialInStream *inStream, bool &useFilter)
 }
 
 
+HRESULT CDecoder::Read(void *data, size_t *processedSize)
+{
+  if (!UseCache)
+    return ReadStream(_decoderInStream, data, processedSize);
+  
+  size_t size = *processedSize;
+  *processedSize = 0;
+  
+  while (size != 0)
+  {
+    const UInt64 pos = StreamPos + *processedSize;
+    size_t cur = size;
+    if (pos < Cache.Size)
+    {
+      if (cur > Cache.Size - pos)
+        cur = (size_t)(Cache.Size - pos);
+      RINOK(Cache.Read(pos, data, cur))
+    }
+    else
+    {
+      if (pos != _unpackPos)
+        return E_FAIL;
+      const HRESULT res = ReadStream(_decoderInStream, data, &cur);
+      _unpackPos += cur;
+      *processedSize += cur;
+      if (res != S_OK)
+      {
+        _readError = true;
+        return res;
+      }
+      Cache.Append(data, cur);
+      break;
+    }
+    data = (Byte *)data + cur;
+    size -= cur;
+    *processedSize += cur;
+  }
+  return S_OK;
+}
+
+
 static const UInt32 kMask_IsCompressed = (UInt32)1 << 31;
 
 
@@ -125,6 +168,8 @@ HRESULT CDecoder::SetToPos(UInt64 pos, ICompressProgressInfo *progress)
 {
   if (StreamPos > pos)
     return E_FAIL;
+  if (UseCache && StreamPos < Cache.Size)
+    StreamPos = MyMin(pos, Cache.Size);
   const UInt64 inSizeStart = GetInputProcessedSize();
   UInt64 offset = 0;
   while (StreamPos < pos)
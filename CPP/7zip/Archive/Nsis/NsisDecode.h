@@ -6,6 +6,7 @@
 #include "../../../Common/MyBuffer.h"
 
 #include "../../Common/FilterCoder.h"
+#include "../../Common/SolidCache.h"
 #include "../../Common/StreamUtils.h"
 
 #include "../../Compress/BZip2Decoder.h"
@@ -26,6 +27,7 @@ namespace NMethodType
   };
 }
 
+
 /* 7-Zip installers 4.38 - 9.08 used modified version of NSIS that
    supported BCJ filter for better compression ratio.
    We support such modified NSIS archives. */
@@ -43,6 +45,9 @@ class CDecoder
   NCompress::NDeflate::NDecoder::CCOMCoder *_deflateDecoder;
   NCompress::NLzma::CDecoder *_lzmaDecoder;
 
+  UInt64 _unpackPos; // the number of bytes that were read from (_decoderInStream) after Init()
+  bool _readError;
+
 public:
   CMyComPtr<IInStream> InputStream; // for non-solid
   UInt64 StreamPos; // the pos in unpacked for solid, the pos in Packed for non-solid
@@ -54,10 +59,16 @@ public:
   
   CByteBuffer Buffer; // temp buf
 
+  bool UseCache; // for solid
+  CSolidCache Cache;
+
   CDecoder():
+      _unpackPos(0),
+      _readError(false),
       FilterFlag(false),
       Solid(true),
-      IsNsisDeflate(true)
+      IsNsisDeflate(true),
+      UseCache(false)
   {
     _bzDecoder = NULL;
     _deflateDecoder = NULL;
@@ -80,11 +91,21 @@ public:
   
   HRESULT Init(ISequentialInStream *inStream, bool &useFilter);
 
-  HRESULT Read(void *data, size_t *processedSize)
+  /* if (Cache_CanContinue()), the caller can set (StreamPos = 0) and
+     continue to read solid stream without new Init() call */
+  bool Cache_CanContinue() const
   {
-    return ReadStream(_decoderInStream, data, processedSize);
+    return UseCache && !_readError && !Cache.IsLimited() && Cache.Size == _unpackPos;
   }
 
+  void Cache_Free()
+  {
+    UseCache = false;
+    Cache.Free();
+  }
+
+  HRESULT Read(void *data, size_t *processedSize);
+
 
   HRESULT SetToPos(UInt64 pos, ICompressProgressInfo *progress); // for solid
   HRESULT Decode(CByteBuffer *outBuf, bool unpackSizeDefined, UInt32 unpackSize,
@@ -433,8 +433,17 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 
   if (_archive.IsSolid)
   {
-    RINOK(_archive.SeekTo_DataStreamOffset())
-    RINOK(_archive.InitDecoder())
+    /* If the caller extracts only some items, we keep unpacked data in cache.
+       Then next Extract() call reads previous data from cache and
+       continues decoding from current position of decoder. */
+    const bool useCache = (numItems < _archive.Items.Size());
+    if (!useCache || !_archive.Decoder.Cache_CanContinue())
+    {
+      _archive.Decoder.Cache_Free();
+      RINOK(_archive.SeekTo_DataStreamOffset())
+      RINOK(_archive.InitDecoder())
+      _archive.Decoder.UseCache = useCache;
+    }
     _archive.Decoder.StreamPos = 0;
   }
 
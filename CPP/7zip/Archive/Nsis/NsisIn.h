@@ -399,6 +399,7 @@ public:
   void Release()
   {
     Decoder.Release();
+    Decoder.Cache_Free();
   }
 
   bool IsTruncated() const { return (_fileSize - StartOffset < FirstHeader.ArcSize); }
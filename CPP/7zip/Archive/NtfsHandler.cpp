@@ -28,6 +28,9 @@
 #include "../Compress/CopyCoder.h"
 
 #include "Common/DummyOutStream.h"
+#include "Common/HandlerOut.h"
+
+#include "HandlerCont.h"
 
 #ifdef SHOW_DEBUG_INFO
 #define PRF(x) x
@@ -611,8 +614,26 @@ bool CAttr::ParseExtents(CRecordVector<CExtent> &extents, UInt64 numClustersMax,
 
 static const UInt64 kEmptyTag = (UInt64)(Int64)-1;
 
-static const unsigned kNumCacheChunksLog = 1;
-static const size_t kNumCacheChunks = (size_t)1 << kNumCacheChunksLog;
+class CInStream;
+
+/* CUnitUnpacker decodes one compression unit.
+   The units are independent, so the units can be decoded in parallel. */
+
+class CUnitUnpacker Z7_final: public CClusterUnpacker
+{
+public:
+  size_t OutBufLim;
+  bool InUse;
+  HRESULT Unpack(const Byte *src, size_t srcSize, Byte *dest, size_t destSize) Z7_override;
+};
+
+class CUnitCache Z7_final: public CClusterCache
+{
+  HRESULT ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize) Z7_override;
+  CClusterUnpacker *CreateUnpacker() Z7_override;
+public:
+  CInStream *Stream;
+};
 
 Z7_CLASS_IMP_COM_1(
   CInStream
@@ -627,34 +648,34 @@ Z7_CLASS_IMP_COM_1(
 public:
   bool InUse;
 private:
-  unsigned _chunkSizeLog;
-  CByteBuffer _inBuf;
-  CByteBuffer _outBuf;
+  CUnitCache _cache;
 public:
   UInt64 Size;
   UInt64 InitializedSize;
   unsigned BlockSizeLog;
   unsigned CompressionUnit;
+  UInt32 NumThreads;
+  UInt64 MemUsage;
   CRecordVector<CExtent> Extents;
   CMyComPtr<IInStream> Stream;
 private:
-  UInt64 _tags[kNumCacheChunks];
-
   HRESULT SeekToPhys() { return InStream_SeekSet(Stream, _physPos); }
-  UInt32 GetCuSize() const { return (UInt32)1 << (BlockSizeLog + CompressionUnit); }
+  unsigned FindExtent(UInt64 virtBlock) const;
 public:
+  UInt32 GetCuSize() const { return (UInt32)1 << (BlockSizeLog + CompressionUnit); }
+  HRESULT ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize);
+
+  CInStream(): NumThreads(1), MemUsage(0) { _cache.Stream = this; }
+
   HRESULT InitAndSeek(unsigned compressionUnit)
   {
     CompressionUnit = compressionUnit;
-    _chunkSizeLog = BlockSizeLog + CompressionUnit;
     if (compressionUnit != 0)
     {
-      UInt32 cuSize = GetCuSize();
-      _inBuf.Alloc(cuSize);
-      _outBuf.Alloc(kNumCacheChunks << _chunkSizeLog);
+      const UInt32 cuSize = GetCuSize();
+      // we don't need read-ahead threads for file that contains only one unit
+      RINOK(_cache.Create(cuSize, Size > cuSize ? NumThreads : 1, MemUsage))
     }
-    for (size_t i = 0; i < kNumCacheChunks; i++)
-      _tags[i] = kEmptyTag;
 
     _sparseMode = false;
     _curRem = 0;
@@ -752,6 +773,124 @@ static size_t Lznt1Dec(Byte *dest, size_t outBufLim, size_t destLen, const Byte
   return destSize;
 }
 
+HRESULT CUnitUnpacker::Unpack(const Byte *src, size_t srcSize, Byte *dest, size_t destSize)
+{
+  const size_t destSizeRes = Lznt1Dec(dest, OutBufLim, destSize, src, srcSize);
+  // some files in Vista have destSize > destLen
+  if (destSizeRes < destSize)
+  {
+    memset(dest, 0, OutBufLim);
+    if (InUse)
+      return S_FALSE;
+  }
+  return S_OK;
+}
+
+CClusterUnpacker *CUnitCache::CreateUnpacker()
+{
+  CUnitUnpacker *unpacker = new CUnitUnpacker;
+  unpacker->OutBufLim = Stream->GetCuSize();
+  unpacker->InUse = Stream->InUse;
+  return unpacker;
+}
+
+HRESULT CUnitCache::ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize)
+{
+  return Stream->ReadPacked(pos, packBuf, packSize, unpackSize);
+}
+
+unsigned CInStream::FindExtent(UInt64 virtBlock) const
+{
+  unsigned left = 0, right = Extents.Size();
+  for (;;)
+  {
+    unsigned mid = (left + right) / 2;
+    if (mid == left)
+      return left;
+    if (virtBlock < Extents[mid].Virt)
+      right = mid;
+    else
+      left = mid;
+  }
+}
+
+// it reads packed data of compression unit that starts at (pos)
+
+HRESULT CInStream::ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize)
+{
+  packSize = 0;
+  unpackSize = 0;
+  if (pos >= InitializedSize)
+    return S_OK;
+  
+  const size_t destLenMax = GetCuSize();
+  {
+    const size_t lowBits = (size_t)pos & (destLenMax - 1);
+    unpackSize = destLenMax - lowBits;
+    if (lowBits != 0)
+      return S_OK;
+  }
+
+  const UInt32 comprUnitSize = (UInt32)1 << CompressionUnit;
+  const UInt64 virtBlock2 = pos >> BlockSizeLog;
+  const UInt64 virtBlock2End = virtBlock2 + comprUnitSize;
+  const unsigned left = FindExtent(virtBlock2);
+  
+  bool isCompressed = false;
+  bool thereArePhy = false;
+  unsigned i;
+  
+  for (i = left; i < Extents.Size(); i++)
+  {
+    const CExtent &e = Extents[i];
+    if (e.Virt >= virtBlock2End)
+      break;
+    if (e.IsEmpty())
+      isCompressed = true;
+    else
+      thereArePhy = true;
+  }
+  
+  if (!isCompressed || !thereArePhy)
+    return S_OK;
+  
+  packBuf.AllocAtLeast(destLenMax);
+  size_t offs = 0;
+  UInt64 curVirt = virtBlock2;
+  
+  for (i = left; i < Extents.Size(); i++)
+  {
+    const CExtent &e = Extents[i];
+    if (e.IsEmpty())
+      break;
+    if (e.Virt >= virtBlock2End)
+      return S_FALSE;
+    const UInt64 newPos = (e.Phy + (curVirt - e.Virt)) << BlockSizeLog;
+    if (newPos != _physPos)
+    {
+      _physPos = newPos;
+      RINOK(SeekToPhys())
+    }
+    UInt64 numChunks = Extents[i + 1].Virt - curVirt;
+    if (curVirt + numChunks > virtBlock2End)
+      numChunks = virtBlock2End - curVirt;
+    const size_t compressed = (size_t)numChunks << BlockSizeLog;
+    RINOK(ReadStream_FALSE(Stream, packBuf + offs, compressed))
+    curVirt += numChunks;
+    _physPos += compressed;
+    offs += compressed;
+  }
+  
+  size_t destLen = destLenMax;
+  const UInt64 rem = Size - pos;
+  if (destLen > rem)
+    destLen = (size_t)rem;
+  
+  packSize = offs;
+  unpackSize = destLen;
+  return S_OK;
+}
+
 Z7_COM7F_IMF(CInStream::Read(void *data, UInt32 size, UInt32 *processedSize))
 {
   if (processedSize)
@@ -782,39 +921,13 @@ Z7_COM7F_IMF(CInStream::Read(void *data, UInt32 size, UInt32 *processedSize))
 
   while (_curRem == 0)
   {
-    const UInt64 cacheTag = _virtPos >> _chunkSizeLog;
-    const size_t cacheIndex = (size_t)cacheTag & (kNumCacheChunks - 1);
-    
-    if (_tags[cacheIndex] == cacheTag)
-    {
-      const size_t chunkSize = (size_t)1 << _chunkSizeLog;
-      const size_t offset = (size_t)_virtPos & (chunkSize - 1);
-      size_t cur = chunkSize - offset;
-      if (cur > size)
-        cur = size;
-      memcpy(data, _outBuf + (cacheIndex << _chunkSizeLog) + offset, cur);
-      *processedSize = (UInt32)cur;
-      _virtPos += cur;
-      return S_OK;
-    }
-
     PRF2(printf("\nVirtPos = %6d", _virtPos));
     
     const UInt32 comprUnitSize = (UInt32)1 << CompressionUnit;
     const UInt64 virtBlock = _virtPos >> BlockSizeLog;
     const UInt64 virtBlock2 = virtBlock & ~((UInt64)comprUnitSize - 1);
     
-    unsigned left = 0, right = Extents.Size();
-    for (;;)
-    {
-      unsigned mid = (left + right) / 2;
-      if (mid == left)
-        break;
-      if (virtBlock2 < Extents[mid].Virt)
-        right = mid;
-      else
-        left = mid;
-    }
+    const unsigned left = FindExtent(virtBlock2);
     
     bool isCompressed = false;
     const UInt64 virtBlock2End = virtBlock2 + comprUnitSize;
@@ -875,49 +988,21 @@ Z7_COM7F_IMF(CInStream::Read(void *data, UInt32 size, UInt32 *processedSize))
       break;
     }
     
-    size_t offs = 0;
-    UInt64 curVirt = virtBlock2;
-    
-    for (i = left; i < Extents.Size(); i++)
-    {
-      const CExtent &e = Extents[i];
-      if (e.IsEmpty())
-        break;
-      if (e.Virt >= virtBlock2End)
-        return S_FALSE;
-      const UInt64 newPos = (e.Phy + (curVirt - e.Virt)) << BlockSizeLog;
-      if (newPos != _physPos)
-      {
-        _physPos = newPos;
-        RINOK(SeekToPhys())
-      }
-      UInt64 numChunks = Extents[i + 1].Virt - curVirt;
-      if (curVirt + numChunks > virtBlock2End)
-        numChunks = virtBlock2End - curVirt;
-      const size_t compressed = (size_t)numChunks << BlockSizeLog;
-      RINOK(ReadStream_FALSE(Stream, _inBuf + offs, compressed))
-      curVirt += numChunks;
-      _physPos += compressed;
-      offs += compressed;
-    }
-    
-    const size_t destLenMax = GetCuSize();
-    size_t destLen = destLenMax;
-    const UInt64 rem = Size - (virtBlock2 << BlockSizeLog);
-    if (destLen > rem)
-      destLen = (size_t)rem;
-
-    Byte *dest = _outBuf + (cacheIndex << _chunkSizeLog);
-    const size_t destSizeRes = Lznt1Dec(dest, destLenMax, destLen, _inBuf, offs);
-    _tags[cacheIndex] = cacheTag;
-
-    // some files in Vista have destSize > destLen
-    if (destSizeRes < destLen)
-    {
-      memset(dest, 0, destLenMax);
-      if (InUse)
-        return S_FALSE;
-    }
+    const UInt64 unitPos = virtBlock2 << BlockSizeLog;
+    const Byte *cache;
+    size_t cacheSize;
+    RINOK(_cache.Get(unitPos, cache, cacheSize))
+    const size_t offset = (size_t)(_virtPos - unitPos);
+    if (offset >= cacheSize)
+      return E_FAIL;
+    size_t cur = cacheSize - offset;
+    if (cur > size)
+      cur = size;
+    memcpy(data, cache + offset, cur);
+    if (processedSize)
+      *processedSize = (UInt32)cur;
+    _virtPos += cur;
+    return S_OK;
   }
   
   if (size > _curRem)
@@ -1127,7 +1212,8 @@ struct CMftRec
 
   void ParseDataNames();
   HRESULT GetStream(IInStream *mainStream, int dataIndex,
-      unsigned clusterSizeLog, UInt64 numPhysClusters, IInStream **stream) const;
+      unsigned clusterSizeLog, UInt64 numPhysClusters,
+      UInt32 numThreads, UInt64 memUsage, IInStream **stream) const;
   unsigned GetNumExtents(int dataIndex, unsigned clusterSizeLog, UInt64 numPhysClusters) const;
 
   UInt64 GetSize(unsigned dataIndex) const { return DataAttrs[DataRefs[dataIndex].Start].GetSize(); }
@@ -1157,7 +1243,8 @@ void CMftRec::ParseDataNames()
 }
 
 HRESULT CMftRec::GetStream(IInStream *mainStream, int dataIndex,
-    unsigned clusterSizeLog, UInt64 numPhysClusters, IInStream **destStream) const
+    unsigned clusterSizeLog, UInt64 numPhysClusters,
+    UInt32 numThreads, UInt64 memUsage, IInStream **destStream) const
 {
   *destStream = NULL;
   CBufferInStream *streamSpec = new CBufferInStream;
@@ -1187,6 +1274,8 @@ HRESULT CMftRec::GetStream(IInStream *mainStream, int dataIndex,
       ss->Stream = mainStream;
       ss->BlockSizeLog = clusterSizeLog;
       ss->InUse = InUse();
+      ss->NumThreads = numThreads;
+      ss->MemUsage = memUsage;
       RINOK(ss->InitAndSeek(attr0.CompressionUnit))
       *destStream = streamTemp2.Detach();
       return S_OK;
@@ -1419,6 +1508,7 @@ struct CDatabase
 
   bool _showSystemFiles;
   bool _showDeletedFiles;
+  CCommonMethodProps _props;
   CObjectVector<UString2> VirtFolderNames;
   UString EmptyString;
 
@@ -1436,6 +1526,7 @@ struct CDatabase
     // we show SystemFiles by default since it's difficult to track $Extend\* system files
     // it must be fixed later
     _showDeletedFiles = false;
+    _props = CCommonMethodProps();
   }
 
   CDatabase() { InitProps(); }
@@ -1800,7 +1891,7 @@ HRESULT CDatabase::Open()
     mftRec.ParseDataNames();
     if (mftRec.DataRefs.IsEmpty())
       return S_FALSE;
-    RINOK(mftRec.GetStream(InStream, 0, Header.ClusterSizeLog, Header.NumClusters, &mftStream))
+    RINOK(mftRec.GetStream(InStream, 0, Header.ClusterSizeLog, Header.NumClusters, 1, 0, &mftStream))
     if (!mftStream)
       return S_FALSE;
   }
@@ -2081,7 +2172,7 @@ HRESULT CDatabase::Open()
       if (attr.Name == L"$SDS")
       {
         CMyComPtr<IInStream> sdsStream;
-        RINOK(rec.GetStream(InStream, (int)di, Header.ClusterSizeLog, Header.NumClusters, &sdsStream))
+        RINOK(rec.GetStream(InStream, (int)di, Header.ClusterSizeLog, Header.NumClusters, 1, 0, &sdsStream))
         if (sdsStream)
         {
           const UInt64 size64 = attr.GetSize();
@@ -2294,7 +2385,8 @@ Z7_COM7F_IMF(CHandler::GetStream(UInt32 index, ISequentialInStream **stream))
   IInStream *stream2;
   const CItem &item = Items[index];
   const CMftRec &rec = Recs[item.RecIndex];
-  HRESULT res = rec.GetStream(InStream, item.DataIndex, Header.ClusterSizeLog, Header.NumClusters, &stream2);
+  HRESULT res = rec.GetStream(InStream, item.DataIndex, Header.ClusterSizeLog, Header.NumClusters,
+      _props._numThreads, _props._memUsage_Decompress, &stream2);
   *stream = (ISequentialInStream *)stream2;
   return res;
   COM_TRY_END
@@ -2789,7 +2881,8 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     int res = NExtract::NOperationResult::kDataError;
     {
       CMyComPtr<IInStream> inStream;
-      HRESULT hres = rec.GetStream(InStream, item.DataIndex, Header.ClusterSizeLog, Header.NumClusters, &inStream);
+      HRESULT hres = rec.GetStream(InStream, item.DataIndex, Header.ClusterSizeLog, Header.NumClusters,
+          _props._numThreads, _props._memUsage_Decompress, &inStream);
       if (hres == S_FALSE)
         res = NExtract::NOperationResult::kUnsupportedMethod;
       else
@@ -2844,7 +2937,14 @@ Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
       RINOK(PROPVARIANT_to_bool(prop, _showSystemFiles))
     }
     else
-      return E_INVALIDARG;
+    {
+      UString name2 = name;
+      name2.MakeLower_Ascii();
+      HRESULT hres;
+      if (!_props.SetCommonProperty(name2, prop, hres))
+        return E_INVALIDARG;
+      RINOK(hres)
+    }
   }
   return S_OK;
 }
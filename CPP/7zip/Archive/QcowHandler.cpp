@@ -37,6 +37,56 @@ VA to PA maps:
   low bits       : _clusterBits
 */
 
+class CUnpacker Z7_final: public CClusterUnpacker
+{
+  CBufInStream *_bufInStreamSpec;
+  CMyComPtr<ISequentialInStream> _bufInStream;
+
+  CBufPtrSeqOutStream *_bufOutStreamSpec;
+  CMyComPtr<ISequentialOutStream> _bufOutStream;
+
+  NCompress::NDeflate::NDecoder::CCOMCoder *_deflateDecoderSpec;
+  CMyComPtr<ICompressCoder> _deflateDecoder;
+public:
+  CUnpacker()
+  {
+    _bufInStreamSpec = new CBufInStream;
+    _bufInStream = _bufInStreamSpec;
+    _bufOutStreamSpec = new CBufPtrSeqOutStream();
+    _bufOutStream = _bufOutStreamSpec;
+    _deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder();
+    _deflateDecoder = _deflateDecoderSpec;
+    _deflateDecoderSpec->Set_NeedFinishInput(true);
+  }
+  HRESULT Unpack(const Byte *src, size_t srcSize, Byte *dest, size_t destSize) Z7_override;
+};
+
+HRESULT CUnpacker::Unpack(const Byte *src, size_t srcSize, Byte *dest, size_t destSize)
+{
+  _bufInStreamSpec->Init(src, srcSize);
+  _bufOutStreamSpec->Init(dest, destSize);
+  // Do we need to use smaller block than clusterSize for last cluster?
+  const UInt64 blockSize64 = destSize;
+  HRESULT res = _deflateDecoder->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
+  if (res == S_OK)
+    if (!_deflateDecoderSpec->IsFinished()
+        || _bufOutStreamSpec->GetPos() != destSize)
+      res = S_FALSE;
+  return res;
+}
+
+
+class CHandler;
+
+class CCache Z7_final: public CClusterCache
+{
+  HRESULT ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize) Z7_override;
+  CClusterUnpacker *CreateUnpacker() Z7_override { return new CUnpacker; }
+public:
+  CHandler *Handler;
+};
+
+
 Z7_class_CHandler_final: public CHandlerImg
 {
   Z7_IFACE_COM7_IMP(IInArchive_Img)
@@ -49,8 +99,7 @@ Z7_class_CHandler_final: public CHandlerImg
 
   CObjArray2<UInt32> _dir;
   CAlignedBuffer _table;
-  UInt64 _cacheCluster;
-  CByteBuffer _cache;
+  CCache _cache;
   CByteBuffer _cacheCompressed;
 
   UInt64 _comprPos;
@@ -58,15 +107,6 @@ Z7_class_CHandler_final: public CHandlerImg
 
   UInt64 _phySize;
 
-  CBufInStream *_bufInStreamSpec;
-  CMyComPtr<ISequentialInStream> _bufInStream;
-
-  CBufPtrSeqOutStream *_bufOutStreamSpec;
-  CMyComPtr<ISequentialOutStream> _bufOutStream;
-
-  NCompress::NDeflate::NDecoder::CCOMCoder *_deflateDecoderSpec;
-  CMyComPtr<ICompressCoder> _deflateDecoder;
-
   bool _needDeflate;
   bool _isArc;
   bool _unsupported;
@@ -86,12 +126,116 @@ Z7_class_CHandler_final: public CHandlerImg
     return Seek2(0);
   }
 
+  UInt64 GetClusterRecord(UInt64 cluster) const;
   HRESULT Open2(IInStream *stream, IArchiveOpenCallback *openCallback) Z7_override;
+public:
+  CHandler() { _cache.Handler = this; }
+  HRESULT ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize);
 };
 
 
 static const UInt32 kEmptyDirItem = (UInt32)0 - 1;
 
+HRESULT CCache::ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize)
+{
+  return Handler->ReadPacked(pos, packBuf, packSize, unpackSize);
+}
+
+UInt64 CHandler::GetClusterRecord(UInt64 cluster) const
+{
+  const UInt64 high = cluster >> _numMidBits;
+  if (high < _dir.Size())
+  {
+    const UInt32 tabl = _dir[(unsigned)high];
+    if (tabl != kEmptyDirItem)
+    {
+      const Byte *buffer = _table + ((size_t)tabl << (_numMidBits + 3));
+      const size_t midBits = (size_t)cluster & (((size_t)1 << _numMidBits) - 1);
+      return Get64(buffer + (midBits << 3));
+    }
+  }
+  return 0;
+}
+
+
+HRESULT CHandler::ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize)
+{
+  packSize = 0;
+  unpackSize = 0;
+  if (pos >= _size)
+    return S_OK;
+  const size_t clusterSize = (size_t)1 << _clusterBits;
+  const size_t lowBits = (size_t)pos & (clusterSize - 1);
+  unpackSize = clusterSize - lowBits;
+  if (lowBits != 0)
+    return S_OK;
+  const UInt64 v = GetClusterRecord(pos >> _clusterBits);
+  if ((v & _compressedFlag) == 0 || _version <= 1)
+    return S_OK;
+
+  /*
+  the example of table record for 12-bit clusters (4KB uncompressed).
+   2 bits : isCompressed status
+   4 bits : num_sectors_minus1; packSize = (num_sectors_minus1 + 1) * 512;
+            it uses one additional bit over unpacked cluster_bits
+  49 bits : offset of 512-sector
+   9 bits : offset in 512-sector
+  */
+
+  const unsigned numOffsetBits = (62 - (_clusterBits - 9 + 1));
+  const UInt64 offset = v & (((UInt64)1 << 62) - 1);
+  const size_t dataSize = ((size_t)(offset >> numOffsetBits) + 1) << 9;
+  UInt64 sectorOffset = offset & (((UInt64)1 << numOffsetBits) - (1 << 9));
+  const UInt64 offset2inCache = sectorOffset - _comprPos;
+  
+  // _comprPos is aligned for 512-bytes
+  // we try to use previous _cacheCompressed that contains compressed data
+  // that was read for previous unpacking
+
+  if (sectorOffset >= _comprPos && offset2inCache < _comprSize)
+  {
+    if (offset2inCache != 0)
+    {
+      _comprSize -= (size_t)offset2inCache;
+      memmove(_cacheCompressed, _cacheCompressed + (size_t)offset2inCache, _comprSize);
+      _comprPos = sectorOffset;
+    }
+    sectorOffset += _comprSize;
+  }
+  else
+  {
+    _comprPos = sectorOffset;
+    _comprSize = 0;
+  }
+  
+  if (dataSize > _comprSize)
+  {
+    if (sectorOffset != _posInArc)
+    {
+      // printf("\nDeflate-Seek %12I64x %12I64x\n", sectorOffset, sectorOffset - _posInArc);
+      RINOK(Seek2(sectorOffset))
+    }
+    if (_cacheCompressed.Size() < dataSize)
+      return E_FAIL;
+    const size_t dataSize3 = dataSize - _comprSize;
+    size_t dataSize2 = dataSize3;
+    // printf("\n\n=======\nReadStream = %6d _comprPos = %6d \n", (UInt32)dataSize2, (UInt32)_comprPos);
+    RINOK(ReadStream(Stream, _cacheCompressed + _comprSize, &dataSize2))
+    _posInArc += dataSize2;
+    if (dataSize2 != dataSize3)
+      return E_FAIL;
+    _comprSize += dataSize2;
+  }
+  
+  const size_t kSectorMask = (1 << 9) - 1;
+  const size_t offsetInSector = ((size_t)offset & kSectorMask);
+  packSize = dataSize - offsetInSector;
+  packBuf.AllocAtLeast(packSize);
+  memcpy(packBuf, _cacheCompressed + offsetInSector, packSize);
+  return S_OK;
+}
+
+
 Z7_COM7F_IMF(CHandler::Read(void *data, UInt32 size, UInt32 *processedSize))
 {
   if (processedSize)
@@ -109,7 +253,6 @@ Z7_COM7F_IMF(CHandler::Read(void *data, UInt32 size, UInt32 *processedSize))
       return S_OK;
   }
  
-  for (;;)
   {
     const UInt64 cluster = _virtPos >> _clusterBits;
     const size_t clusterSize = (size_t)1 << _clusterBits;
@@ -120,142 +263,43 @@ Z7_COM7F_IMF(CHandler::Read(void *data, UInt32 size, UInt32 *processedSize))
         size = (UInt32)rem;
     }
 
-    if (cluster == _cacheCluster)
-    {
-      memcpy(data, _cache + lowBits, size);
-      break;
-    }
+    UInt64 v = GetClusterRecord(cluster);
     
-    const UInt64 high = cluster >> _numMidBits;
- 
-    if (high < _dir.Size())
+    if (v != 0)
     {
-      const UInt32 tabl = _dir[(unsigned)high];
-    
-      if (tabl != kEmptyDirItem)
+      if ((v & _compressedFlag) != 0)
+      {
+        if (_version <= 1)
+          return E_FAIL;
+        const Byte *cache;
+        size_t cacheSize;
+        RINOK(_cache.Get(cluster << _clusterBits, cache, cacheSize))
+        if (cacheSize != clusterSize)
+          return E_FAIL;
+        memcpy(data, cache + lowBits, size);
+      }
+      // version 3 support zero clusters
+      else if (((UInt32)v & 511) != 1)
       {
-        const Byte *buffer = _table + ((size_t)tabl << (_numMidBits + 3));
-        const size_t midBits = (size_t)cluster & (((size_t)1 << _numMidBits) - 1);
-        const Byte *p = (const Byte *)buffer + (midBits << 3);
-        UInt64 v = Get64(p);
-        
-        if (v != 0)
+        v &= (_compressedFlag - 1);
+        v += lowBits;
+        if (v != _posInArc)
         {
-          if ((v & _compressedFlag) != 0)
-          {
-            if (_version <= 1)
-              return E_FAIL;
-
-            /*
-            the example of table record for 12-bit clusters (4KB uncompressed).
-             2 bits : isCompressed status
-             4 bits : num_sectors_minus1; packSize = (num_sectors_minus1 + 1) * 512;
-                      it uses one additional bit over unpacked cluster_bits
-            49 bits : offset of 512-sector
-             9 bits : offset in 512-sector
-            */
-
-            const unsigned numOffsetBits = (62 - (_clusterBits - 9 + 1));
-            const UInt64 offset = v & (((UInt64)1 << 62) - 1);
-            const size_t dataSize = ((size_t)(offset >> numOffsetBits) + 1) << 9;
-            UInt64 sectorOffset = offset & (((UInt64)1 << numOffsetBits) - (1 << 9));
-            const UInt64 offset2inCache = sectorOffset - _comprPos;
-            
-            // _comprPos is aligned for 512-bytes
-            // we try to use previous _cacheCompressed that contains compressed data
-            // that was read for previous unpacking
-
-            if (sectorOffset >= _comprPos && offset2inCache < _comprSize)
-            {
-              if (offset2inCache != 0)
-              {
-                _comprSize -= (size_t)offset2inCache;
-                memmove(_cacheCompressed, _cacheCompressed + (size_t)offset2inCache, _comprSize);
-                _comprPos = sectorOffset;
-              }
-              sectorOffset += _comprSize;
-            }
-            else
-            {
-              _comprPos = sectorOffset;
-              _comprSize = 0;
-            }
-            
-            if (dataSize > _comprSize)
-            {
-              if (sectorOffset != _posInArc)
-              {
-                // printf("\nDeflate-Seek %12I64x %12I64x\n", sectorOffset, sectorOffset - _posInArc);
-                RINOK(Seek2(sectorOffset))
-              }
-              if (_cacheCompressed.Size() < dataSize)
-                return E_FAIL;
-              const size_t dataSize3 = dataSize - _comprSize;
-              size_t dataSize2 = dataSize3;
-              // printf("\n\n=======\nReadStream = %6d _comprPos = %6d \n", (UInt32)dataSize2, (UInt32)_comprPos);
-              RINOK(ReadStream(Stream, _cacheCompressed + _comprSize, &dataSize2))
-              _posInArc += dataSize2;
-              if (dataSize2 != dataSize3)
-                return E_FAIL;
-              _comprSize += dataSize2;
-            }
-            
-            const size_t kSectorMask = (1 << 9) - 1;
-            const size_t offsetInSector = ((size_t)offset & kSectorMask);
-            _bufInStreamSpec->Init(_cacheCompressed + offsetInSector, dataSize - offsetInSector);
-            
-            _cacheCluster = (UInt64)(Int64)-1;
-            if (_cache.Size() < clusterSize)
-              return E_FAIL;
-            _bufOutStreamSpec->Init(_cache, clusterSize);
-            
-            // Do we need to use smaller block than clusterSize for last cluster?
-            const UInt64 blockSize64 = clusterSize;
-            HRESULT res = _deflateDecoder->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
-
-            /*
-            if (_bufOutStreamSpec->GetPos() != clusterSize)
-              memset(_cache + _bufOutStreamSpec->GetPos(), 0, clusterSize - _bufOutStreamSpec->GetPos());
-            */
-
-            if (res == S_OK)
-              if (!_deflateDecoderSpec->IsFinished()
-                  || _bufOutStreamSpec->GetPos() != clusterSize)
-                res = S_FALSE;
-
-            RINOK(res)
-            _cacheCluster = cluster;
-            
-            continue;
-            /*
-            memcpy(data, _cache + lowBits, size);
-            break;
-            */
-          }
-
-          // version 3 support zero clusters
-          if (((UInt32)v & 511) != 1)
-          {
-            v &= (_compressedFlag - 1);
-            v += lowBits;
-            if (v != _posInArc)
-            {
-              // printf("\n%12I64x\n", v - _posInArc);
-              RINOK(Seek2(v))
-            }
-            HRESULT res = Stream->Read(data, size, &size);
-            _posInArc += size;
-            _virtPos += size;
-            if (processedSize)
-              *processedSize = size;
-            return res;
-          }
+          // printf("\n%12I64x\n", v - _posInArc);
+          RINOK(Seek2(v))
         }
+        HRESULT res = Stream->Read(data, size, &size);
+        _posInArc += size;
+        _virtPos += size;
+        if (processedSize)
+          *processedSize = size;
+        return res;
       }
+      else
+        memset(data, 0, size);
     }
-    
-    memset(data, 0, size);
-    break;
+    else
+      memset(data, 0, size);
   }
 
   _virtPos += size;
@@ -598,7 +642,7 @@ Z7_COM7F_IMF(CHandler::Close())
   _dir.Free();
   _phySize = 0;
 
-  _cacheCluster = (UInt64)(Int64)-1;
+  _cache.Clear();
   _comprPos = 0;
   _comprSize = 0;
   _needDeflate = false;
@@ -626,28 +670,11 @@ Z7_COM7F_IMF(CHandler::GetStream(UInt32 /* index */, ISequentialInStream **strea
     if (_version <= 1)
       return S_FALSE;
 
-    if (!_bufInStream)
-    {
-      _bufInStreamSpec = new CBufInStream;
-      _bufInStream = _bufInStreamSpec;
-    }
-    
-    if (!_bufOutStream)
-    {
-      _bufOutStreamSpec = new CBufPtrSeqOutStream();
-      _bufOutStream = _bufOutStreamSpec;
-    }
-
-    if (!_deflateDecoder)
-    {
-      _deflateDecoderSpec = new NCompress::NDeflate::NDecoder::CCOMCoder();
-      _deflateDecoder = _deflateDecoderSpec;
-      _deflateDecoderSpec->Set_NeedFinishInput(true);
-    }
-    
     const size_t clusterSize = (size_t)1 << _clusterBits;
-    _cache.AllocAtLeast(clusterSize);
+    RINOK(_cache.Create(clusterSize, _props._numThreads, _props._memUsage_Decompress))
     _cacheCompressed.AllocAtLeast(clusterSize * 2);
+    _comprPos = 0;
+    _comprSize = 0;
   }
     
   CMyComPtr<ISequentialInStream> streamTemp = this;
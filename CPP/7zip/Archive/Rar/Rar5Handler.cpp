@@ -21,6 +21,7 @@
 #include "../../Common/RegisterArc.h"
 #include "../../Common/StreamObjects.h"
 #include "../../Common/StreamUtils.h"
+#include "../../Common/SlotRing.h"
 
 #include "../../Common/RegisterCodec.h"
 
@@ -2519,6 +2520,150 @@ static HRESULT CopyData_with_Progress(const Byte *data, size_t size,
 }
 
 
+/* Non-solid files are independent.
+   So we can read the packed data of file (from all volumes) to memory in main thread,
+   and decode and check the hash of that file in separate thread to memory buffer.
+   The main thread writes the decoded files in original order,
+   so the order of callback calls is not changed.
+   The main thread reads the packed data of next files (and next volumes)
+   while the threads decode previous files. */
+
+struct CItemSlot
+{
+  CUnpacker Unpacker;
+  CBufInStream *InStreamSpec;
+  CMyComPtr<ISequentialInStream> InStream;
+  CBufPtrSeqOutStream *OutStreamSpec;
+  CMyComPtr<ISequentialOutStream> OutStream;
+  CByteBuffer PackBuf;
+  CByteBuffer OutBuf;
+
+  const CItem *Item;
+  const CItem *LastItem;
+  unsigned Index;
+  UInt64 PackSize;      // total size of packed data in all volumes
+  size_t PackSize_Read; // it can be smaller than (PackSize), if archive is truncated
+  bool PackCrcOK;
+  bool CrcOK;
+  HRESULT Res;
+
+  CItemSlot();
+  HRESULT ReadItem(ISequentialInStream *inStream);
+  HRESULT Decode2();
+  void Run()
+  {
+    try { Res = Decode2(); }
+    catch(...) { Res = E_OUTOFMEMORY; }
+  }
+};
+
+CItemSlot::CItemSlot()
+{
+  InStreamSpec = new CBufInStream;
+  InStream = InStreamSpec;
+  OutStreamSpec = new CBufPtrSeqOutStream;
+  OutStream = OutStreamSpec;
+}
+
+
+HRESULT CItemSlot::ReadItem(ISequentialInStream *inStream)
+{
+  PackSize_Read = (size_t)PackSize;
+  PackBuf.AllocAtLeast(PackSize_Read);
+  return ReadStream(inStream, PackBuf, &PackSize_Read);
+}
+
+
+HRESULT CItemSlot::Decode2()
+{
+  CrcOK = true;
+  const size_t size = (size_t)LastItem->Size;
+  OutBuf.AllocAtLeast(size);
+  OutStreamSpec->Init(OutBuf, size);
+  InStreamSpec->Init(PackBuf, PackSize_Read);
+  // COutStreamWithHash in (Unpacker) calculates the hash in this thread
+  return Unpacker.Code(*Item, *LastItem, PackSize, InStream, OutStream, NULL, CrcOK);
+}
+
+
+class CItemQueue
+{
+public:
+  CSlotRing<CItemSlot> Ring;
+  UInt64 SlotSizeMax;   // for packed data, unpacked data and dictionary
+
+  IArchiveExtractCallback *ExtractCallback;
+  bool TestMode;
+  CLocalProgress *Lps;
+  UInt64 TotalUnpacked;
+  UInt64 TotalPacked;
+
+  CItemQueue(): SlotSizeMax(0), TotalUnpacked(0), TotalPacked(0) {}
+
+  HRESULT WriteNext();
+  HRESULT Flush()
+  {
+    while (!Ring.IsEmpty())
+    {
+      RINOK(WriteNext())
+    }
+    return S_OK;
+  }
+};
+
+
+HRESULT CItemQueue::WriteNext()
+{
+  CItemSlot &slot = Ring.FinishNext();
+
+  TotalUnpacked += slot.LastItem->Size;
+  TotalPacked += slot.PackSize;
+
+  const Int32 askMode = TestMode ?
+      NExtract::NAskMode::kTest :
+      NExtract::NAskMode::kExtract;
+
+  CMyComPtr<ISequentialOutStream> realOutStream;
+  RINOK(ExtractCallback->GetStream(slot.Index, &realOutStream, askMode))
+
+  // the callbacks are the same as in main loop of CHandler::Extract() for non-solid file
+  if (realOutStream || TestMode)
+  {
+    RINOK(ExtractCallback->PrepareOperation(askMode))
+    if (realOutStream)
+    {
+      RINOK(WriteStream(realOutStream, slot.OutBuf, slot.OutStreamSpec->GetPos()))
+      realOutStream.Release();
+    }
+
+    HRESULT result = slot.Res;
+    bool crcOK = slot.CrcOK;
+    if (!slot.PackCrcOK)
+      crcOK = false;
+
+    int opRes = crcOK ?
+        NExtract::NOperationResult::kOK:
+        NExtract::NOperationResult::kCRCError;
+
+    if (result != S_OK)
+    {
+      if (result == S_FALSE)
+        opRes = NExtract::NOperationResult::kDataError;
+      else if (result == E_NOTIMPL)
+        opRes = NExtract::NOperationResult::kUnsupportedMethod;
+      else
+        return result;
+    }
+
+    RINOK(ExtractCallback->SetOperationResult(opRes))
+  }
+
+  Lps->OutSize = TotalUnpacked;
+  Lps->InSize = TotalPacked;
+  return Lps->SetCur();
+}
+
+
 Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback))
 {
@@ -2711,8 +2856,6 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   }
 
 
-  UInt64 totalUnpacked = 0;
-  UInt64 totalPacked = 0;
   UInt64 curUnpackSize = 0;
   UInt64 curPackSize = 0;
 
@@ -2725,6 +2868,39 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(extractCallback, false);
 
+  CItemQueue queue;
+  queue.ExtractCallback = extractCallback;
+  queue.TestMode = (testMode != 0);
+  queue.Lps = lps;
+ #ifndef Z7_ST
+  {
+    UInt32 numThreads = _props._numThreads;
+    if (numThreads > k_SlotRing_NumThreads_Max)
+      numThreads = k_SlotRing_NumThreads_Max;
+    if (numThreads > numItems)
+      numThreads = numItems;
+    if (numThreads > 1)
+    {
+      // the decoder state of solid file is used by next file.
+      // So we use threads only if there are no solid files in archive.
+      FOR_VECTOR (k, _refs)
+      {
+        const CItem &item = _items[_refs[k].Item];
+        if (item.IsSolid() && !item.IsService())
+        {
+          numThreads = 1;
+          break;
+        }
+      }
+    }
+    if (numThreads > 1)
+    {
+      queue.Ring.Create(numThreads);
+      queue.SlotSizeMax = _props._memUsage_Decompress / numThreads;
+    }
+  }
+ #endif
+
   // bool needClearSolid = true;
 
   FOR_VECTOR (i, _refs)
@@ -2732,10 +2908,68 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     if (extractStatuses[i] == 0)
       continue;
 
-    totalUnpacked += curUnpackSize;
-    totalPacked += curPackSize;
-    lps->InSize = totalPacked;
-    lps->OutSize = totalUnpacked;
+    queue.TotalUnpacked += curUnpackSize;
+    queue.TotalPacked += curPackSize;
+    curUnpackSize = 0;
+    curPackSize = 0;
+
+    if (queue.Ring.NumSlots() > 1)
+    {
+      const CRefItem &ref = _refs[i];
+      const CItem &item = _items[ref.Item];
+      const CItem &lastItem = _items[ref.Last];
+      
+      if (extractStatuses[i] == kStatus_Extract
+          && ref.Link < 0
+          && !item.IsDir()
+          && !item.IsSolid()
+          && !item.NeedUse_as_CopyLink_or_HardLink()
+          && !lastItem.Is_UnknownSize())
+      {
+        const UInt64 packSize = GetPackSize(i);
+        UInt64 slotSize = packSize + lastItem.Size;
+        if (item.GetMethod() != 0)
+          slotSize += (UInt64)1 << (17 + item.GetDictSize());
+        
+        if (slotSize <= queue.SlotSizeMax)
+        {
+          if (queue.Ring.IsFull())
+          {
+            RINOK(queue.WriteNext())
+          }
+          CItemSlot &slot = queue.Ring.GetFreeSlot();
+          
+          if (item.IsEncrypted())
+          {
+            if (!unpacker.getTextPassword)
+              extractCallback->QueryInterface(IID_ICryptoGetTextPassword, (void **)&unpacker.getTextPassword);
+            slot.Unpacker.getTextPassword = unpacker.getTextPassword;
+          }
+          
+          bool wrongPassword;
+          const HRESULT res = slot.Unpacker.Create(EXTERNAL_CODECS_VARS item, false, wrongPassword);
+          
+          // the errors of Create() are reported in main loop below
+          if (res == S_OK && !wrongPassword)
+          {
+            slot.Item = &item;
+            slot.LastItem = &lastItem;
+            slot.Index = i;
+            slot.PackSize = packSize;
+            volsInStreamSpec->Init(&_arcs, &_items, ref.Item);
+            RINOK(slot.ReadItem(volsInStream))
+            slot.PackCrcOK = volsInStreamSpec->CrcIsOK;
+            RINOK(queue.Ring.StartSlot())
+            continue;
+          }
+        }
+      }
+    }
+
+    RINOK(queue.Flush())
+
+    lps->InSize = queue.TotalPacked;
+    lps->OutSize = queue.TotalUnpacked;
     RINOK(lps->SetCur())
     
     CMyComPtr<ISequentialOutStream> realOutStream;
@@ -2949,6 +3183,8 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     RINOK(extractCallback->SetOperationResult(opRes))
   }
 
+  RINOK(queue.Flush())
+
   {
     FOR_VECTOR (i, linkFiles)
       if (linkFiles[i].NumLinks != 0)
@@ -2961,6 +3197,22 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
 }
 
 
+Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
+{
+  _props = CCommonMethodProps();
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    HRESULT hres;
+    if (!_props.SetCommonProperty(name, values[i], hres))
+      return E_INVALIDARG;
+    RINOK(hres)
+  }
+  return S_OK;
+}
+
+
 IMPL_ISetCompressCodecsInfo
 
 REGISTER_ARC_I(
@@ -13,6 +13,8 @@
 
 #include "../IArchive.h"
 
+#include "../Common/HandlerOut.h"
+
 namespace NArchive {
 namespace NRar5 {
 
@@ -377,17 +379,20 @@ struct CArc
 class CHandler Z7_final:
   public IInArchive,
   public IArchiveGetRawProps,
+  public ISetProperties,
   Z7_PUBLIC_ISetCompressCodecsInfo_IFEC
   public CMyUnknownImp
 {
   Z7_COM_QI_BEGIN2(IInArchive)
   Z7_COM_QI_ENTRY(IArchiveGetRawProps)
+  Z7_COM_QI_ENTRY(ISetProperties)
   Z7_COM_QI_ENTRY_ISetCompressCodecsInfo_IFEC
   Z7_COM_QI_END
   Z7_COM_ADDREF_RELEASE
   
   Z7_IFACE_COM7_IMP(IInArchive)
   Z7_IFACE_COM7_IMP(IArchiveGetRawProps)
+  Z7_IFACE_COM7_IMP(ISetProperties)
   DECL_ISetCompressCodecsInfo
 
 public:
@@ -402,6 +407,7 @@ private:
   bool _isArc;
   CByteBuffer _comment;
   UString _missingVolName;
+  CCommonMethodProps _props;
 
   DECL_EXTERNAL_CODECS_VARS
 
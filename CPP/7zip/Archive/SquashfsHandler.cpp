@@ -5,6 +5,8 @@
 #include "../../../C/Alloc.h"
 #include "../../../C/CpuArch.h"
 #include "../../../C/LzmaDec.h"
+#include "../../../C/LzmaEnc.h"
+#include "../../../C/Sha256.h"
 #include "../../../C/Xz.h"
 
 #include "../../Common/ComTry.h"
@@ -13,9 +15,12 @@
 #include "../../Common/StringConvert.h"
 #include "../../Common/UTFConvert.h"
 
+#include "../../Windows/PropVariant.h"
 #include "../../Windows/PropVariantUtils.h"
 #include "../../Windows/TimeUtils.h"
 
+#include "../Common/SlotRing.h"
+
 #include "../Common/CWrappers.h"
 #include "../Common/LimitedStreams.h"
 #include "../Common/ProgressUtils.h"
@@ -24,9 +29,14 @@
 #include "../Common/StreamUtils.h"
 
 #include "../Compress/CopyCoder.h"
+#include "../Compress/XzEncoder.h"
 #include "../Compress/ZlibDecoder.h"
+#include "../Compress/ZlibEncoder.h"
 // #include "../Compress/LzmaDecoder.h"
 
+#include "Common/HandlerOut.h"
+#include "Common/ItemNameUtils.h"
+
 namespace NArchive {
 namespace NSquashfs {
 
@@ -108,7 +118,11 @@ enum
   kFlag_NO_FRAGS,
   kFlag_ALWAYS_FRAG,
   kFlag_DUPLICATE,
-  kFlag_EXPORT
+  kFlag_EXPORT,
+  kFlag_UNC_XATTRS,
+  kFlag_NO_XATTRS,
+  kFlag_COMP_OPTS,
+  kFlag_UNC_IDS
 };
 
 static const char * const k_Flags[] =
@@ -136,7 +150,7 @@ static const UInt32 kNotCompressedBit32 = (1 << 24);
 // static const UInt32 kHeaderSize1 = 0x33;
 // static const UInt32 kHeaderSize2 = 0x3F;
 static const UInt32 kHeaderSize3 = 0x77;
-// static const UInt32 kHeaderSize4 = 0x60;
+static const UInt32 kHeaderSize4 = 0x60;
 
 struct CHeader
 {
@@ -832,8 +846,69 @@ struct CFrag
 };
 
 
-Z7_CLASS_IMP_CHandler_IInArchive_1(
-  IInArchiveGetStream
+// decompressed data block or fragment block
+
+struct CCacheBlock
+{
+  UInt64 Offset;
+  UInt32 PackSize;   // (PackSize == 0) for unused block
+  UInt32 UnpackSize;
+  UInt64 LastUse;
+  HRESULT Res;
+  bool InSlot;       // the block is unpacked by started decoder slot now
+  CByteBuffer Data;
+
+  CCacheBlock(): Offset(0), PackSize(0), UnpackSize(0), LastUse(0), Res(S_FALSE), InSlot(false) {}
+};
+
+
+/* CBlockDecoder unpacks the block from (PackBuf) to (Block->Data).
+   The packed data is read by main thread, so Decode() can be called from another thread. */
+
+class CBlockDecoder
+{
+  NCompress::NZlib::CDecoder *_zlibDecoderSpec;
+  CMyComPtr<ICompressCoder> _zlibDecoder;
+  CBufInStream *_inStreamSpec;
+  CMyComPtr<ISequentialInStream> _inStream;
+  CBufPtrSeqOutStream *_outStreamSpec;
+  CMyComPtr<ISequentialOutStream> _outStream;
+  CXzUnpacker _xz;
+
+  HRESULT Decode2();
+public:
+  CByteBuffer PackBuf;
+  UInt32 PackSize;
+  UInt32 Method;
+  bool NoPropsLZMA;
+  UInt32 BlockSize;
+  CCacheBlock *Block;
+
+  CBlockDecoder();
+  ~CBlockDecoder() { XzUnpacker_Free(&_xz); }
+  void Prepare();
+  void Decode() { Block->Res = Decode2(); }
+};
+
+
+struct CDecoderSlot
+{
+  CBlockDecoder Decoder;
+  void Run() { Decoder.Decode(); }
+};
+
+
+static const unsigned kNumCacheBlocks_Default = 32;
+
+static const unsigned kBlockSizeLog_Default = 17;
+static const unsigned kBlockSizeLog_Min = 12;
+static const unsigned kBlockSizeLog_Max = 20;
+
+
+Z7_CLASS_IMP_CHandler_IInArchive_3(
+    IInArchiveGetStream
+  , ISetProperties
+  , IOutArchive
 )
   CRecordVector<CItem> _items;
   CRecordVector<CNode> _nodes;
@@ -859,17 +934,22 @@ Z7_CLASS_IMP_CHandler_IInArchive_1(
   CRecordVector<bool> _blockCompressed;
   CRecordVector<UInt64> _blockOffsets;
   
-  CByteBuffer _cachedBlock;
-  UInt64 _cachedBlockStartPos;
-  UInt32 _cachedPackBlockSize;
-  UInt32 _cachedUnpackBlockSize;
+  // LRU cache of unpacked blocks that is shared by data blocks and fragment blocks
+  CObjectVector<CCacheBlock> _cache;
+  unsigned _numCacheBlocksMax; // (0) means that the cache and slots are not initialized
+  UInt64 _cacheUseCounter;
+  // the slots must be destroyed before the cache, because threads write to cache blocks
+  CSlotRing<CDecoderSlot> _slots;
+  CCommonMethodProps _props;
+
+  // properties for update
+  UInt32 _method;
+  UInt32 _level;
+  unsigned _blockSizeLog;
 
   CLimitedSequentialInStream *_limitedInStreamSpec;
   CMyComPtr<ISequentialInStream> _limitedInStream;
 
-  CBufPtrSeqOutStream *_outStreamSpec;
-  CMyComPtr<ISequentialOutStream> _outStream;
-
   // NCompress::NLzma::CDecoder *_lzmaDecoderSpec;
   // CMyComPtr<ICompressCoder> _lzmaDecoder;
 
@@ -883,12 +963,13 @@ Z7_CLASS_IMP_CHandler_IInArchive_1(
   CDynBufSeqOutStream *_dynOutStreamSpec;
   CMyComPtr<ISequentialOutStream> _dynOutStream;
 
-  void ClearCache()
-  {
-    _cachedBlockStartPos = 0;
-    _cachedPackBlockSize = 0;
-    _cachedUnpackBlockSize = 0;
-  }
+  void InitCache();
+  void ClearCache();
+  void Slot_FinishNext();
+  CCacheBlock *Cache_Find(UInt64 offset, UInt32 packSize);
+  CCacheBlock *Cache_Alloc();
+  HRESULT Cache_StartBlock(UInt64 offset, UInt32 packSize, bool compressed, bool readAhead);
+  HRESULT GetBlockPos(UInt64 blockIndex, UInt64 &offset, UInt32 &packSize, UInt32 &offsetInBlock, bool &compressed) const;
 
   HRESULT Seek2(UInt64 offset)
   {
@@ -908,10 +989,24 @@ Z7_CLASS_IMP_CHandler_IInArchive_1(
   AString GetPath(unsigned index) const;
   bool GetPackSize(unsigned index, UInt64 &res, bool fillOffsets);
 
+  HRESULT GetUpdateProp(IArchiveUpdateCallback *callback, UInt32 index, PROPID propID, PROPVARIANT *value)
+  {
+    if (callback)
+      return callback->GetProperty(index, propID, value);
+    return GetProperty(index, propID, value);
+  }
+  void InitUpdateProps()
+  {
+    _method = kMethod_ZLIB;
+    _level = 5;
+    _blockSizeLog = kBlockSizeLog_Default;
+  }
+
 public:
   CHandler();
   ~CHandler()
   {
+    ClearCache();
     XzUnpacker_Free(&_xz);
   }
 
@@ -923,12 +1018,13 @@ CHandler::CHandler()
 {
   XzUnpacker_Construct(&_xz, &g_Alloc);
 
+  _numCacheBlocksMax = 0;
+  _cacheUseCounter = 0;
+  InitUpdateProps();
+
   _limitedInStreamSpec = new CLimitedSequentialInStream;
   _limitedInStream = _limitedInStreamSpec;
 
-  _outStreamSpec = new CBufPtrSeqOutStream();
-  _outStream = _outStreamSpec;
-
   _dynOutStreamSpec = new CDynBufSeqOutStream;
   _dynOutStream = _dynOutStreamSpec;
 }
@@ -1122,6 +1218,118 @@ static HRESULT LzoDecode(Byte *dest, SizeT *destLen, const Byte *src, SizeT *src
   }
 }
 
+
+static HRESULT DecodeBuf(UInt32 method, bool noPropsLZMA, UInt32 blockSize, CXzUnpacker *xz,
+    const Byte *src, UInt32 inSize, Byte *dest, SizeT &destLen)
+{
+  const SizeT outSizeMax = destLen;
+  SizeT srcLen = inSize;
+
+  if (method == kMethod_LZO)
+  {
+    RINOK(LzoDecode(dest, &destLen, src, &srcLen))
+  }
+  else if (method == kMethod_LZMA)
+  {
+    Byte props[5];
+
+    if (noPropsLZMA)
+    {
+      props[0] = 0x5D;
+      SetUi32(&props[1], blockSize)
+    }
+    else
+    {
+      const UInt32 kPropsSize = LZMA_PROPS_SIZE + 8;
+      if (inSize < kPropsSize)
+        return S_FALSE;
+      memcpy(props, src, LZMA_PROPS_SIZE);
+      UInt64 outSize = GetUi64(src + LZMA_PROPS_SIZE);
+      if (outSize > outSizeMax)
+        return S_FALSE;
+      destLen = (SizeT)outSize;
+      src += kPropsSize;
+      inSize -= kPropsSize;
+      srcLen = inSize;
+    }
+
+    ELzmaStatus status;
+    SRes res = LzmaDecode(dest, &destLen,
+        src, &srcLen,
+        props, LZMA_PROPS_SIZE,
+        LZMA_FINISH_END,
+        &status, &g_Alloc);
+    if (res != 0)
+      return SResToHRESULT(res);
+    if (status != LZMA_STATUS_FINISHED_WITH_MARK
+        && status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
+      return S_FALSE;
+  }
+  else
+  {
+    ECoderStatus status;
+    SRes res = XzUnpacker_CodeFull(xz,
+        dest, &destLen,
+        src, &srcLen,
+        CODER_FINISH_END, &status);
+    if (res != 0)
+      return SResToHRESULT(res);
+    if (status != CODER_STATUS_NEEDS_MORE_INPUT || !XzUnpacker_IsStreamWasFinished(xz))
+      return S_FALSE;
+  }
+  
+  if (inSize != srcLen)
+    return S_FALSE;
+  return S_OK;
+}
+
+
+CBlockDecoder::CBlockDecoder():
+    _zlibDecoderSpec(NULL),
+    PackSize(0),
+    Method(0),
+    NoPropsLZMA(false),
+    BlockSize(0),
+    Block(NULL)
+{
+  XzUnpacker_Construct(&_xz, &g_Alloc);
+  _inStreamSpec = new CBufInStream;
+  _inStream = _inStreamSpec;
+  _outStreamSpec = new CBufPtrSeqOutStream;
+  _outStream = _outStreamSpec;
+}
+
+// it's called from main thread before Decode()
+void CBlockDecoder::Prepare()
+{
+  if (Method == kMethod_ZLIB && !_zlibDecoder)
+  {
+    _zlibDecoderSpec = new NCompress::NZlib::CDecoder();
+    _zlibDecoder = _zlibDecoderSpec;
+  }
+}
+
+HRESULT CBlockDecoder::Decode2()
+{
+  CCacheBlock &b = *Block;
+  b.UnpackSize = 0;
+  if (Method == kMethod_ZLIB)
+  {
+    _inStreamSpec->Init(PackBuf, PackSize);
+    _outStreamSpec->Init(b.Data, BlockSize);
+    RINOK(_zlibDecoder->Code(_inStream, _outStream, NULL, NULL, NULL))
+    if (PackSize != _zlibDecoderSpec->GetInputProcessedSize())
+      return S_FALSE;
+    b.UnpackSize = (UInt32)_outStreamSpec->GetPos();
+    return S_OK;
+  }
+  SizeT destLen = BlockSize;
+  RINOK(DecodeBuf(Method, NoPropsLZMA, BlockSize, &_xz, PackBuf, PackSize, b.Data, destLen))
+  b.UnpackSize = (UInt32)destLen;
+  return S_OK;
+}
+
+
 HRESULT CHandler::Decompress(ISequentialOutStream *outStream, Byte *outBuf, bool *outBufWasWritten, UInt32 *outBufWasWrittenSize, UInt32 inSize, UInt32 outSizeMax)
 {
   if (outBuf)
@@ -1210,64 +1418,9 @@ HRESULT CHandler::Decompress(ISequentialOutStream *outStream, Byte *outBuf, bool
         return E_OUTOFMEMORY;
     }
     
-    SizeT destLen = outSizeMax, srcLen = inSize;
-
-    if (method == kMethod_LZO)
-    {
-      RINOK(LzoDecode(dest, &destLen, _inputBuffer, &srcLen))
-    }
-    else if (method == kMethod_LZMA)
-    {
-      Byte props[5];
-      const Byte *src = _inputBuffer;
-
-      if (_noPropsLZMA)
-      {
-        props[0] = 0x5D;
-        SetUi32(&props[1], _h.BlockSize)
-      }
-      else
-      {
-        const UInt32 kPropsSize = LZMA_PROPS_SIZE + 8;
-        if (inSize < kPropsSize)
-          return S_FALSE;
-        memcpy(props, src, LZMA_PROPS_SIZE);
-        UInt64 outSize = GetUi64(src + LZMA_PROPS_SIZE);
-        if (outSize > outSizeMax)
-          return S_FALSE;
-        destLen = (SizeT)outSize;
-        src += kPropsSize;
-        inSize -= kPropsSize;
-        srcLen = inSize;
-      }
+    SizeT destLen = outSizeMax;
+    RINOK(DecodeBuf(method, _noPropsLZMA, _h.BlockSize, &_xz, _inputBuffer, inSize, dest, destLen))
 
-      ELzmaStatus status;
-      SRes res = LzmaDecode(dest, &destLen,
-          src, &srcLen,
-          props, LZMA_PROPS_SIZE,
-          LZMA_FINISH_END,
-          &status, &g_Alloc);
-      if (res != 0)
-        return SResToHRESULT(res);
-      if (status != LZMA_STATUS_FINISHED_WITH_MARK
-          && status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK)
-        return S_FALSE;
-    }
-    else
-    {
-      ECoderStatus status;
-      SRes res = XzUnpacker_CodeFull(&_xz,
-          dest, &destLen,
-          _inputBuffer, &srcLen,
-          CODER_FINISH_END, &status);
-      if (res != 0)
-        return SResToHRESULT(res);
-      if (status != CODER_STATUS_NEEDS_MORE_INPUT || !XzUnpacker_IsStreamWasFinished(&_xz))
-        return S_FALSE;
-    }
-    
-    if (inSize != srcLen)
-      return S_FALSE;
     if (outBuf)
     {
       *outBufWasWritten = true;
@@ -1800,7 +1953,6 @@ Z7_COM7F_IMF(CHandler::Close())
   _uids.Free();
   _gids.Free();
 
-  _cachedBlock.Free();
   ClearCache();
 
   return S_OK;
@@ -2089,13 +2241,164 @@ HRESULT CSquashfsInStream::ReadBlock(UInt64 blockIndex, Byte *dest, size_t block
   return Handler->ReadBlock(blockIndex, dest, blockSize);
 }
 
-HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
+void CHandler::InitCache()
+{
+  if (_numCacheBlocksMax != 0)
+    return;
+  unsigned numSlots = 1;
+ #ifndef Z7_ST
+  numSlots = _props._numThreads;
+  if (numSlots > k_SlotRing_NumThreads_Max)
+    numSlots = k_SlotRing_NumThreads_Max;
+  if (numSlots < 1)
+    numSlots = 1;
+ #endif
+  // each cache block and each slot contains one block of data
+  UInt64 numBlocksMax = _props._memUsage_Decompress >> _h.BlockSizeLog;
+  if (numSlots > 1 && (UInt64)numSlots * 3 > numBlocksMax)
+  {
+    numSlots = (unsigned)(numBlocksMax / 3);
+    if (numSlots < 1)
+      numSlots = 1;
+  }
+  unsigned numCacheBlocks = kNumCacheBlocks_Default;
+  if (numCacheBlocks > numBlocksMax)
+    numCacheBlocks = (unsigned)numBlocksMax;
+  // the blocks that are unpacked by slots and the block that is read now can't be released
+  if (numCacheBlocks < numSlots * 2 + 2)
+    numCacheBlocks = numSlots * 2 + 2;
+  _slots.Create(numSlots);
+  _numCacheBlocksMax = numCacheBlocks;
+}
+
+
+// it waits for the oldest started slot
+
+void CHandler::Slot_FinishNext()
+{
+  _slots.FinishNext().Decoder.Block->InSlot = false;
+}
+
+
+void CHandler::ClearCache()
+{
+  _slots.WaitAll();
+  _cache.Clear();
+  _numCacheBlocksMax = 0;
+}
+
+
+CCacheBlock *CHandler::Cache_Find(UInt64 offset, UInt32 packSize)
+{
+  FOR_VECTOR (i, _cache)
+  {
+    CCacheBlock &b = _cache[i];
+    if (b.Offset == offset && b.PackSize == packSize)
+    {
+      b.LastUse = ++_cacheUseCounter;
+      return &b;
+    }
+  }
+  return NULL;
+}
+
+
+CCacheBlock *CHandler::Cache_Alloc()
+{
+  if (_cache.Size() < _numCacheBlocksMax)
+  {
+    CCacheBlock &b = _cache.AddNew();
+    b.Data.Alloc(_h.BlockSize);
+    return &b;
+  }
+  CCacheBlock *best = NULL;
+  FOR_VECTOR (i, _cache)
+  {
+    CCacheBlock &b = _cache[i];
+    if (!b.InSlot && (!best || b.LastUse < best->LastUse))
+      best = &b;
+  }
+  // (best != NULL) here, because (_numCacheBlocksMax > _slots.NumSlots())
+  return best;
+}
+
+
+/* Cache_StartBlock() reads the block and starts unpacking in free slot.
+   If there is no free slot, it waits for the oldest slot,
+   or it returns S_FALSE, if (readAhead). */
+
+HRESULT CHandler::Cache_StartBlock(UInt64 offset, UInt32 packSize, bool compressed, bool readAhead)
+{
+  if (Cache_Find(offset, packSize))
+    return S_OK;
+
+  if (compressed)
+  {
+    if (_slots.IsFull())
+    {
+      if (readAhead)
+        return S_FALSE;
+      Slot_FinishNext();
+    }
+  }
+  else if (packSize > _h.BlockSize)
+    return S_FALSE;
+  
+  CCacheBlock *b = Cache_Alloc();
+  b->PackSize = 0;
+  b->LastUse = ++_cacheUseCounter;
+  b->Res = S_FALSE;
+  b->UnpackSize = 0;
+
+  RINOK(Seek2(offset))
+
+  if (!compressed)
+  {
+    RINOK(ReadStream_FALSE(_stream, b->Data, packSize))
+    b->Res = S_OK;
+    b->UnpackSize = packSize;
+    b->Offset = offset;
+    b->PackSize = packSize;
+    return S_OK;
+  }
+
+  CBlockDecoder &dec = _slots.GetFreeSlot().Decoder;
+  dec.PackBuf.AllocAtLeast(packSize);
+  RINOK(ReadStream_FALSE(_stream, dec.PackBuf, packSize))
+  
+  UInt32 method = _h.Method;
+  if (_h.SeveralMethods)
+    method = (dec.PackBuf[0] == 0x5D ? kMethod_LZMA : kMethod_ZLIB);
+  if (method == kMethod_ZLIB && _needCheckLzma)
+  {
+    if (dec.PackBuf[0] == 0)
+    {
+      _noPropsLZMA = true;
+      method = _h.Method = kMethod_LZMA;
+    }
+    _needCheckLzma = false;
+  }
+
+  b->Offset = offset;
+  b->PackSize = packSize;
+  dec.PackSize = packSize;
+  dec.Method = method;
+  dec.NoPropsLZMA = _noPropsLZMA;
+  dec.BlockSize = _h.BlockSize;
+  dec.Block = b;
+  dec.Prepare();
+
+  RINOK(_slots.StartSlot())
+  b->InSlot = true;
+  return S_OK;
+}
+
+
+HRESULT CHandler::GetBlockPos(UInt64 blockIndex, UInt64 &blockOffset, UInt32 &packBlockSize,
+    UInt32 &offsetInBlock, bool &compressed) const
 {
   const CNode &node = _nodes[_nodeIndex];
-  UInt64 blockOffset;
-  UInt32 packBlockSize;
-  UInt32 offsetInBlock = 0;
-  bool compressed;
+  offsetInBlock = 0;
   if (blockIndex < _blockCompressed.Size())
   {
     compressed = _blockCompressed[(unsigned)blockIndex];
@@ -2113,6 +2416,17 @@ HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
     packBlockSize = GET_COMPRESSED_BLOCK_SIZE(frag.Size);
     compressed = IS_COMPRESSED_BLOCK(frag.Size);
   }
+  return S_OK;
+}
+
+
+HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
+{
+  UInt64 blockOffset;
+  UInt32 packBlockSize;
+  UInt32 offsetInBlock;
+  bool compressed;
+  RINOK(GetBlockPos(blockIndex, blockOffset, packBlockSize, offsetInBlock, compressed))
 
   if (packBlockSize == 0)
   {
@@ -2121,42 +2435,53 @@ HRESULT CHandler::ReadBlock(UInt64 blockIndex, Byte *dest, size_t blockSize)
     return S_OK;
   }
 
-  if (blockOffset != _cachedBlockStartPos ||
-      packBlockSize != _cachedPackBlockSize)
+  RINOK(Cache_StartBlock(blockOffset, packBlockSize, compressed, false))
+
+  if (_slots.NumSlots() > 1)
   {
-    ClearCache();
-    RINOK(Seek2(blockOffset))
-    _limitedInStreamSpec->Init(packBlockSize);
-    
-    if (compressed)
+    // we start the unpacking of next blocks of file in free slots
+    const UInt64 numBlocks = _blockCompressed.Size() + (_nodes[_nodeIndex].ThereAreFrags() ? 1 : 0);
+    for (UInt64 k = blockIndex + 1; k < numBlocks && k <= blockIndex + _slots.NumSlots(); k++)
     {
-      _outStreamSpec->Init((Byte *)_cachedBlock, _h.BlockSize);
-      bool outBufWasWritten;
-      UInt32 outBufWasWrittenSize;
-      HRESULT res = Decompress(_outStream, _cachedBlock, &outBufWasWritten, &outBufWasWrittenSize, packBlockSize, _h.BlockSize);
+      UInt64 offset2;
+      UInt32 packSize2, offsetInBlock2;
+      bool compressed2;
+      if (GetBlockPos(k, offset2, packSize2, offsetInBlock2, compressed2) != S_OK)
+        break;
+      if (packSize2 == 0 || !compressed2)
+        continue;
+      const HRESULT res = Cache_StartBlock(offset2, packSize2, true, true);
+      if (res == S_FALSE)
+        break;
       RINOK(res)
-      if (outBufWasWritten)
-        _cachedUnpackBlockSize = outBufWasWrittenSize;
-      else
-        _cachedUnpackBlockSize = (UInt32)_outStreamSpec->GetPos();
-    }
-    else
-    {
-      if (packBlockSize > _h.BlockSize)
-        return S_FALSE;
-      RINOK(ReadStream_FALSE(_limitedInStream, _cachedBlock, packBlockSize))
-      _cachedUnpackBlockSize = packBlockSize;
     }
-    _cachedBlockStartPos = blockOffset;
-    _cachedPackBlockSize = packBlockSize;
   }
-  if (offsetInBlock + blockSize > _cachedUnpackBlockSize)
+
+  CCacheBlock *b = Cache_Find(blockOffset, packBlockSize);
+  if (!b)
+    return E_FAIL;
+  // the slots are finished in order of start, so we also finish the slots that were started before
+  while (b->InSlot)
+    Slot_FinishNext();
+  RINOK(b->Res)
+  if (offsetInBlock + blockSize > b->UnpackSize)
     return S_FALSE;
   if (blockSize != 0)
-    memcpy(dest, _cachedBlock + offsetInBlock, blockSize);
+    memcpy(dest, b->Data + offsetInBlock, blockSize);
   return S_OK;
 }
 
+
+static int CompareItemsByNode(const unsigned *p1, const unsigned *p2, void *param)
+{
+  const CRecordVector<CItem> &items = *(const CRecordVector<CItem> *)param;
+  const int n1 = items[*p1].Node;
+  const int n2 = items[*p2].Node;
+  if (n1 != n2)
+    return MyCompare(n1, n2);
+  return MyCompare(*p1, *p2);
+}
+
 Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback))
 {
@@ -2176,6 +2501,14 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   }
   extractCallback->SetTotal(totalSize);
 
+  // we extract the files in order of inodes, so the files that share
+  // the fragment block usually are extracted one after another
+  CUIntVector sortedIndices;
+  sortedIndices.ClearAndSetSize(numItems);
+  for (i = 0; i < numItems; i++)
+    sortedIndices[i] = allFilesMode ? i : indices[i];
+  sortedIndices.Sort(CompareItemsByNode, (void *)&_items);
+
   UInt64 totalPackSize;
   totalSize = totalPackSize = 0;
   
@@ -2195,7 +2528,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     const Int32 askMode = testMode ?
         NExtract::NAskMode::kTest :
         NExtract::NAskMode::kExtract;
-    const UInt32 index = allFilesMode ? i : indices[i];
+    const UInt32 index = sortedIndices[i];
     const CItem &item = _items[index];
     const CNode &node = _nodes[item.Node];
     RINOK(extractCallback->GetStream(index, &outStream, askMode))
@@ -2287,12 +2620,7 @@ Z7_COM7F_IMF(CHandler::GetStream(UInt32 index, ISequentialInStream **stream))
 
   _nodeIndex = item.Node;
 
-  size_t cacheSize = _h.BlockSize;
-  if (_cachedBlock.Size() != cacheSize)
-  {
-    ClearCache();
-    _cachedBlock.Alloc(cacheSize);
-  }
+  InitCache();
 
   CSquashfsInStream *streamSpec = new CSquashfsInStream;
   CMyComPtr<IInStream> streamTemp = streamSpec;
@@ -2310,17 +2638,1243 @@ Z7_COM7F_IMF(CHandler::GetStream(UInt32 index, ISequentialInStream **stream))
   COM_TRY_END
 }
 
+
+static const unsigned kNumDirEntriesInHeaderMax = 256;
+static const unsigned kNameSizeMax = 256;
+static const UInt32 kNumIdsMax = 1 << 16;
+
+/* CBlockEncoder compresses one data block, fragment block or metadata block.
+   (OutSize >= InSize) means that the block must be stored without compression. */
+
+class CBlockEncoder
+{
+  NCompress::NZlib::CEncoder *_zlibEncoderSpec;
+  NCompress::NXz::CEncoder *_xzEncoderSpec;
+  CMyComPtr<ICompressCoder> _encoder;
+  CBufInStream *_inStreamSpec;
+  CMyComPtr<ISequentialInStream> _inStream;
+  CBufPtrSeqOutStream *_outStreamSpec;
+  CMyComPtr<ISequentialOutStream> _outStream;
+  UInt32 _method;
+  UInt32 _level;
+  UInt32 _blockSize;
+
+  HRESULT Encode2();
+public:
+  CByteBuffer InBuf;
+  size_t InSize;
+  CByteBuffer OutBuf;
+  size_t OutSize;
+  HRESULT Res;
+  // the destination of block: (Node < 0) for fragment block
+  int Node;
+  unsigned Index;
+
+  CBlockEncoder():
+      _zlibEncoderSpec(NULL),
+      _xzEncoderSpec(NULL),
+      InSize(0),
+      OutSize(0),
+      Res(S_OK),
+      Node(-1),
+      Index(0)
+      {}
+  HRESULT Create(UInt32 method, UInt32 level, UInt32 blockSize);
+  void Encode() { Res = Encode2(); }
+  bool IsPacked() const { return OutSize < InSize; }
+};
+
+
+HRESULT CBlockEncoder::Create(UInt32 method, UInt32 level, UInt32 blockSize)
+{
+  _method = method;
+  _level = level;
+  _blockSize = blockSize;
+  InBuf.Alloc(blockSize);
+  OutBuf.Alloc((size_t)blockSize * 2 + (1 << 12));
+
+  _inStreamSpec = new CBufInStream;
+  _inStream = _inStreamSpec;
+  _outStreamSpec = new CBufPtrSeqOutStream;
+  _outStream = _outStreamSpec;
+
+  if (method == kMethod_ZLIB)
+  {
+    _zlibEncoderSpec = new NCompress::NZlib::CEncoder;
+    _encoder = _zlibEncoderSpec;
+    _zlibEncoderSpec->Create();
+    const PROPID propID = NCoderPropID::kLevel;
+    NWindows::NCOM::CPropVariant prop ((UInt32)level);
+    ICompressSetCoderProperties *setProps = _zlibEncoderSpec->DeflateEncoderSpec;
+    RINOK(setProps->SetCoderProperties(&propID, &prop, 1))
+  }
+  else if (method == kMethod_XZ)
+  {
+    _xzEncoderSpec = new NCompress::NXz::CEncoder;
+    _encoder = _xzEncoderSpec;
+    CXzProps &p = _xzEncoderSpec->xzProps;
+    XzProps_Init(&p);
+    p.checkId = XZ_CHECK_CRC32;
+    p.numTotalThreads = 1;
+    p.blockSize = XZ_PROPS_BLOCK_SIZE_SOLID;
+    p.reduceSize = blockSize;
+    p.lzma2Props.lzmaProps.level = (int)level;
+    p.lzma2Props.lzmaProps.dictSize = blockSize;
+  }
+  else if (method != kMethod_LZMA)
+    return E_NOTIMPL;
+  return S_OK;
+}
+
+
+HRESULT CBlockEncoder::Encode2()
+{
+  OutSize = InSize;
+  if (InSize == 0)
+    return S_OK;
+
+  if (_method == kMethod_LZMA)
+  {
+    // squashfs-lzma block: lzma properties, unpack size, lzma stream without end marker
+    const unsigned kHeaderSize = LZMA_PROPS_SIZE + 8;
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    props.level = (int)_level;
+    props.dictSize = _blockSize;
+    props.reduceSize = InSize;
+    props.numThreads = 1;
+    SizeT propsSize = LZMA_PROPS_SIZE;
+    SizeT destLen = OutBuf.Size() - kHeaderSize;
+    const SRes res = LzmaEncode(OutBuf + kHeaderSize, &destLen, InBuf, InSize,
+        &props, OutBuf, &propsSize, 0, NULL, &g_Alloc, &g_BigAlloc);
+    if (res == SZ_ERROR_OUTPUT_EOF)
+      return S_OK;
+    if (res != SZ_OK)
+      return SResToHRESULT(res);
+    SetUi64(OutBuf + LZMA_PROPS_SIZE, InSize)
+    OutSize = kHeaderSize + destLen;
+    return S_OK;
+  }
+
+  _inStreamSpec->Init(InBuf, InSize);
+  _outStreamSpec->Init(OutBuf, OutBuf.Size());
+  RINOK(_encoder->Code(_inStream, _outStream, NULL, NULL, NULL))
+  OutSize = _outStreamSpec->GetPos();
+  return S_OK;
+}
+
+
+struct CEncoderSlot
+{
+  CBlockEncoder Encoder;
+  void Run() { Encoder.Encode(); }
+};
+
+
+// it writes inode table or directory table as the sequence of metadata blocks
+
+class CMetaWriter
+{
+  CBlockEncoder *_encoder;
+  Byte _buf[kMetadataBlockSize];
+  unsigned _pos;
+public:
+  CByteDynBuffer Data;
+  size_t Size;
+  CRecordVector<UInt32> BlockStarts;
+
+  CMetaWriter(): _encoder(NULL), _pos(0), Size(0) {}
+  void SetEncoder(CBlockEncoder *encoder) { _encoder = encoder; }
+  UInt64 GetRef() const { return ((UInt64)Size << 16) | _pos; }
+  HRESULT Write(const void *data, size_t size);
+  HRESULT Flush();
+};
+
+
+HRESULT CMetaWriter::Flush()
+{
+  if (_pos == 0)
+    return S_OK;
+  CBlockEncoder &enc = *_encoder;
+  memcpy(enc.InBuf, _buf, _pos);
+  enc.InSize = _pos;
+  enc.Encode();
+  RINOK(enc.Res)
+  const bool packed = enc.IsPacked();
+  const size_t size = packed ? enc.OutSize : _pos;
+  if (!Data.EnsureCapacity(Size + 2 + size))
+    return E_OUTOFMEMORY;
+  Byte *p = (Byte *)Data + Size;
+  SetUi16(p, (UInt16)(packed ? size : (size | kNotCompressedBit16)))
+  memcpy(p + 2, packed ? (const Byte *)enc.OutBuf : _buf, size);
+  BlockStarts.Add((UInt32)Size);
+  Size += 2 + size;
+  _pos = 0;
+  return S_OK;
+}
+
+
+HRESULT CMetaWriter::Write(const void *data, size_t size)
+{
+  while (size != 0)
+  {
+    size_t cur = kMetadataBlockSize - _pos;
+    if (cur > size)
+      cur = size;
+    memcpy(_buf + _pos, data, cur);
+    _pos += (unsigned)cur;
+    data = (const Byte *)data + cur;
+    size -= cur;
+    if (_pos == kMetadataBlockSize)
+    {
+      RINOK(Flush())
+    }
+  }
+  return S_OK;
+}
+
+
+struct COutNode
+{
+  AString Name;
+  int Parent;
+  int UpdateIndex;   // (-1) for directory that is not in update list
+  unsigned Type;
+  UInt32 Mode;
+  UInt32 MTime;
+  UInt32 Uid;
+  UInt32 Gid;
+  UInt32 InodeNumber;
+  UInt64 InodeRef;
+  CUIntVector Children; // sorted by name
+  UInt32 NumSubDirs;
+
+  // directory
+  UInt64 DirRef;
+  UInt32 DirSize;
+
+  // file
+  UInt64 FileSize;
+  UInt64 StartBlock;
+  bool StartBlock_Defined;
+  CRecordVector<UInt32> BlockSizes;
+  UInt32 Frag;
+  UInt32 FragOffset;
+
+  AString SymLink;
+
+  bool IsDir() const { return Type == kType_DIR; }
+
+  COutNode():
+      Parent(-1),
+      UpdateIndex(-1),
+      Type(kType_DIR),
+      Mode(0755),
+      MTime(0),
+      Uid(0),
+      Gid(0),
+      InodeNumber(0),
+      InodeRef(0),
+      NumSubDirs(0),
+      DirRef(0),
+      DirSize(3),
+      FileSize(0),
+      StartBlock(0),
+      StartBlock_Defined(false),
+      Frag((UInt32)(Int32)-1),
+      FragOffset(0)
+      {}
+};
+
+
+struct CFileHash
+{
+  UInt64 Size;
+  Byte Digest[SHA256_DIGEST_SIZE];
+  unsigned Node;
+
+  int Compare(const CFileHash &a) const
+  {
+    if (Size != a.Size)
+      return MyCompare(Size, a.Size);
+    const int res = memcmp(Digest, a.Digest, SHA256_DIGEST_SIZE);
+    return res < 0 ? -1 : (res > 0 ? 1 : 0);
+  }
+};
+
+
+/*
+  CImageWriter writes squashfs 4.0 image:
+    superblock, data and fragment blocks, inode table, directory table,
+    fragment table, id table.
+  The blocks are compressed by the slots in worker threads and they are
+  written in order of reading. The files with same content (size and SHA-256)
+  share the data blocks and the fragment of first file.
+*/
+
+class CImageWriter
+{
+  IOutStream *_stream;
+  UInt64 _pos;
+  UInt32 _blockSize;
+  unsigned _blockSizeLog;
+  UInt32 _method;
+
+  // the threads can work after errors. So the ring waits them in destructor
+  CSlotRing<CEncoderSlot> _slots;
+
+  CBlockEncoder _metaEncoder;
+  CMetaWriter _inodes;
+  CMetaWriter _dirs;
+
+  CByteBuffer _fragBuf;
+  size_t _fragSize;
+  CRecordVector<CFrag> _frags;
+  CByteBuffer _tail;
+
+  CRecordVector<CFileHash> _hashes;
+  CRecordVector<UInt32> _ids;
+  UInt32 _numInodes;
+
+  HRESULT WriteOldest();
+  HRESULT Drain();
+  HRESULT GetFreeEncoder(CBlockEncoder *&enc);
+  HRESULT StartEncoder(int node, unsigned index);
+  HRESULT FlushFragment();
+  HRESULT AddFragment(const Byte *data, size_t size, UInt32 &frag, UInt32 &offset);
+  HRESULT GetIdIndex(UInt32 id, UInt16 &index);
+  void NumberInodes(unsigned dirIndex);
+  HRESULT WriteInode(COutNode &node);
+  HRESULT WriteDir(unsigned dirIndex);
+  HRESULT WriteTable(CMetaWriter &meta, UInt64 &tableStart);
+public:
+  CObjectVector<COutNode> Nodes;
+  UInt32 MTime;
+  UInt32 NumDuplicates;
+
+  CImageWriter(): _stream(NULL), MTime(0), NumDuplicates(0) {}
+
+  HRESULT Create(IOutStream *stream, UInt32 method, UInt32 level,
+      unsigned blockSizeLog, UInt32 numThreads, UInt64 memUsage);
+  HRESULT AddNode(const AString &path, int updateIndex, unsigned &nodeIndex);
+  void GetFiles(unsigned dirIndex, CUIntVector &files) const;
+  HRESULT WriteFile(unsigned nodeIndex, ISequentialInStream *stream, UInt64 &processed,
+      IArchiveUpdateCallback *callback, UInt64 completed);
+  HRESULT Finish();
+};
+
+
+HRESULT CImageWriter::Create(IOutStream *stream, UInt32 method, UInt32 level,
+    unsigned blockSizeLog, UInt32 numThreads, UInt64 memUsage)
+{
+  _stream = stream;
+  _pos = 0;
+  _method = method;
+  _blockSizeLog = blockSizeLog;
+  _blockSize = (UInt32)1 << blockSizeLog;
+  _fragSize = 0;
+  _numInodes = 0;
+
+  unsigned numSlots = 1;
+ #ifndef Z7_ST
+  numSlots = numThreads;
+  if (numSlots > k_SlotRing_NumThreads_Max)
+    numSlots = k_SlotRing_NumThreads_Max;
+  if (numSlots < 1)
+    numSlots = 1;
+  // each slot contains input buffer and output buffer of double size.
+  // The xz and lzma encoders use additional memory about (10 * dictSize).
+  const UInt64 slotSize = (UInt64)_blockSize * (method == kMethod_ZLIB ? 4 : 16);
+  const UInt64 numSlotsMax = memUsage / slotSize;
+  if (numSlots > numSlotsMax)
+    numSlots = (numSlotsMax == 0 ? 1 : (unsigned)numSlotsMax);
+ #else
+  UNUSED_VAR(numThreads)
+  UNUSED_VAR(memUsage)
+ #endif
+  _slots.Create(numSlots);
+  for (unsigned i = 0; i < numSlots; i++)
+  {
+    RINOK(_slots.GetSlot(i).Encoder.Create(method, level, _blockSize))
+  }
+  RINOK(_metaEncoder.Create(method, level, _blockSize))
+  _inodes.SetEncoder(&_metaEncoder);
+  _dirs.SetEncoder(&_metaEncoder);
+  _fragBuf.Alloc(_blockSize);
+  _tail.Alloc(_blockSize);
+
+  // root directory
+  Nodes.AddNew().MTime = MTime;
+
+  // we write superblock at the end
+  Byte sb[kHeaderSize4];
+  memset(sb, 0, kHeaderSize4);
+  RINOK(WriteStream(_stream, sb, kHeaderSize4))
+  _pos = kHeaderSize4;
+  return S_OK;
+}
+
+
+static int CompareNames(const AString &s1, const AString &s2)
+{
+  const int res = strcmp(s1, s2);
+  return res < 0 ? -1 : (res > 0 ? 1 : 0);
+}
+
+
+HRESULT CImageWriter::AddNode(const AString &path, int updateIndex, unsigned &nodeIndex)
+{
+  unsigned parent = 0;
+  unsigned level = 0;
+  unsigned pos = 0;
+
+  for (;;)
+  {
+    int slash = path.Find('/', pos);
+    if (slash < 0)
+      slash = (int)path.Len();
+    const AString name (path.Mid(pos, (unsigned)slash - pos));
+    pos = (unsigned)slash + 1;
+    const bool isLast = (pos > path.Len());
+
+    if (!name.IsEmpty() && !name.IsEqualTo("."))
+    {
+      if (name.IsEqualTo("..") || name.Len() > kNameSizeMax)
+        return E_INVALIDARG;
+      if (++level > kNumDirLevelsMax)
+        return E_INVALIDARG;
+
+      // binary search in sorted list of children
+      const CUIntVector &children = Nodes[parent].Children;
+      unsigned left = 0, right = children.Size();
+      int found = -1;
+      while (left != right)
+      {
+        const unsigned mid = (left + right) / 2;
+        const int comp = CompareNames(name, Nodes[children[mid]].Name);
+        if (comp == 0)
+        {
+          found = (int)children[mid];
+          break;
+        }
+        if (comp < 0)
+          right = mid;
+        else
+          left = mid + 1;
+      }
+
+      if (found < 0)
+      {
+        COutNode &node = Nodes.AddNew();
+        node.Name = name;
+        node.Parent = (int)parent;
+        node.MTime = MTime;
+        found = (int)Nodes.Size() - 1;
+        Nodes[parent].Children.Insert(left, (unsigned)found);
+      }
+      else if (!Nodes[(unsigned)found].IsDir() || (isLast && Nodes[(unsigned)found].UpdateIndex >= 0))
+        return E_INVALIDARG;
+      parent = (unsigned)found;
+    }
+
+    if (isLast)
+      break;
+  }
+
+  COutNode &node = Nodes[parent];
+  if (parent == 0 && node.UpdateIndex >= 0)
+    return E_INVALIDARG;
+  node.UpdateIndex = updateIndex;
+  nodeIndex = parent;
+  return S_OK;
+}
+
+
+void CImageWriter::GetFiles(unsigned dirIndex, CUIntVector &files) const
+{
+  const CUIntVector &children = Nodes[dirIndex].Children;
+  FOR_VECTOR (i, children)
+  {
+    const unsigned index = children[i];
+    const COutNode &node = Nodes[index];
+    if (node.IsDir())
+      GetFiles(index, files);
+    else if (node.Type == kType_FILE)
+      files.Add(index);
+  }
+}
+
+
+HRESULT CImageWriter::WriteOldest()
+{
+  const CBlockEncoder &enc = _slots.FinishNext().Encoder;
+  RINOK(enc.Res)
+  const bool packed = enc.IsPacked();
+  const size_t size = packed ? enc.OutSize : enc.InSize;
+  RINOK(WriteStream(_stream, packed ? enc.OutBuf : enc.InBuf, size))
+  const UInt32 sizeField = (UInt32)size | (packed ? 0 : kNotCompressedBit32);
+
+  if (enc.Node >= 0)
+  {
+    COutNode &node = Nodes[(unsigned)enc.Node];
+    // the blocks of file are written without gaps, so StartBlock is the offset of first written block
+    if (!node.StartBlock_Defined)
+    {
+      node.StartBlock = _pos;
+      node.StartBlock_Defined = true;
+    }
+    node.BlockSizes[enc.Index] = sizeField;
+  }
+  else
+  {
+    CFrag &frag = _frags[enc.Index];
+    frag.StartBlock = _pos;
+    frag.Size = sizeField;
+  }
+  _pos += size;
+  return S_OK;
+}
+
+
+HRESULT CImageWriter::Drain()
+{
+  while (!_slots.IsEmpty())
+  {
+    RINOK(WriteOldest())
+  }
+  return S_OK;
+}
+
+
+HRESULT CImageWriter::GetFreeEncoder(CBlockEncoder *&enc)
+{
+  if (_slots.IsFull())
+  {
+    RINOK(WriteOldest())
+  }
+  enc = &_slots.GetFreeSlot().Encoder;
+  return S_OK;
+}
+
+
+HRESULT CImageWriter::StartEncoder(int node, unsigned index)
+{
+  CBlockEncoder &enc = _slots.GetFreeSlot().Encoder;
+  enc.Node = node;
+  enc.Index = index;
+  return _slots.StartSlot();
+}
+
+
+HRESULT CImageWriter::FlushFragment()
+{
+  if (_fragSize == 0)
+    return S_OK;
+  CBlockEncoder *enc;
+  RINOK(GetFreeEncoder(enc))
+  memcpy(enc->InBuf, _fragBuf, _fragSize);
+  enc->InSize = _fragSize;
+  _fragSize = 0;
+  CFrag frag;
+  frag.StartBlock = 0;
+  frag.Size = 0;
+  return StartEncoder(-1, _frags.Add(frag));
+}
+
+
+HRESULT CImageWriter::AddFragment(const Byte *data, size_t size, UInt32 &frag, UInt32 &offset)
+{
+  if (_fragSize + size > _blockSize)
+  {
+    RINOK(FlushFragment())
+  }
+  // the index of fragment block will be assigned in FlushFragment()
+  frag = _frags.Size();
+  offset = (UInt32)_fragSize;
+  memcpy(_fragBuf + _fragSize, data, size);
+  _fragSize += size;
+  return S_OK;
+}
+
+
+static bool IsZeroBlock(const Byte *p, size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+    if (p[i] != 0)
+      return false;
+  return true;
+}
+
+
+HRESULT CImageWriter::WriteFile(unsigned nodeIndex, ISequentialInStream *stream, UInt64 &processed,
+    IArchiveUpdateCallback *callback, UInt64 completed)
+{
+  COutNode &node = Nodes[nodeIndex];
+  node.BlockSizes.Clear();
+  node.StartBlock = 0;
+  node.StartBlock_Defined = false;
+
+  CSha256 sha;
+  Sha256_Init(&sha);
+  UInt64 size = 0;
+  size_t tailSize = 0;
+
+  for (;;)
+  {
+    CBlockEncoder *enc;
+    RINOK(GetFreeEncoder(enc))
+    size_t cur = _blockSize;
+    RINOK(ReadStream(stream, enc->InBuf, &cur))
+    if (cur == 0)
+      break;
+    Sha256_Update(&sha, enc->InBuf, cur);
+    size += cur;
+    if (cur != _blockSize)
+    {
+      // tail of file will be packed to fragment block
+      memcpy(_tail, enc->InBuf, cur);
+      tailSize = cur;
+      break;
+    }
+    const unsigned blockIndex = node.BlockSizes.Add(0);
+    if (IsZeroBlock(enc->InBuf, cur))
+      continue; // sparse block
+    enc->InSize = cur;
+    RINOK(StartEncoder((int)nodeIndex, blockIndex))
+    if (callback)
+    {
+      const UInt64 completed2 = completed + size;
+      RINOK(callback->SetCompleted(&completed2))
+    }
+  }
+
+  processed = size;
+  node.FileSize = size;
+  if (size == 0)
+    return S_OK;
+
+  CFileHash hash;
+  hash.Size = size;
+  hash.Node = nodeIndex;
+  Sha256_Final(&sha, hash.Digest);
+
+  const int dup = _hashes.FindInSorted2(hash);
+  if (dup >= 0)
+  {
+    // we remove the blocks of this file and we use the blocks of previous file
+    RINOK(Drain())
+    if (node.StartBlock_Defined)
+    {
+      _pos = node.StartBlock;
+      RINOK(_stream->Seek((Int64)_pos, STREAM_SEEK_SET, NULL))
+    }
+    const COutNode &src = Nodes[_hashes[(unsigned)dup].Node];
+    node.StartBlock = src.StartBlock;
+    node.StartBlock_Defined = src.StartBlock_Defined;
+    node.BlockSizes = src.BlockSizes;
+    node.Frag = src.Frag;
+    node.FragOffset = src.FragOffset;
+    NumDuplicates++;
+    return S_OK;
+  }
+  _hashes.AddToUniqueSorted2(hash);
+
+  if (tailSize != 0)
+    return AddFragment(_tail, tailSize, node.Frag, node.FragOffset);
+  return S_OK;
+}
+
+
+HRESULT CImageWriter::GetIdIndex(UInt32 id, UInt16 &index)
+{
+  // usually there are only few ids, so we use linear search
+  unsigned i;
+  for (i = 0; i < _ids.Size(); i++)
+    if (_ids[i] == id)
+      break;
+  if (i == _ids.Size())
+  {
+    if (i >= kNumIdsMax)
+      return E_INVALIDARG;
+    _ids.Add(id);
+  }
+  index = (UInt16)i;
+  return S_OK;
+}
+
+
+// the inodes are numbered in the order of writing: children before parent directory
+
+void CImageWriter::NumberInodes(unsigned dirIndex)
+{
+  COutNode &dir = Nodes[dirIndex];
+  FOR_VECTOR (i, dir.Children)
+  {
+    const unsigned index = dir.Children[i];
+    COutNode &node = Nodes[index];
+    if (node.IsDir())
+    {
+      dir.NumSubDirs++;
+      NumberInodes(index);
+    }
+    else
+      node.InodeNumber = ++_numInodes;
+  }
+  dir.InodeNumber = ++_numInodes;
+}
+
+
+HRESULT CImageWriter::WriteInode(COutNode &node)
+{
+  node.InodeRef = _inodes.GetRef();
+
+  UInt16 uid, gid;
+  RINOK(GetIdIndex(node.Uid, uid))
+  RINOK(GetIdIndex(node.Gid, gid))
+
+  Byte p[64];
+  unsigned type = node.Type;
+  unsigned size;
+
+  if (node.IsDir())
+  {
+    const UInt32 parentNumber = (node.Parent < 0) ?
+        _numInodes + 1 :
+        Nodes[(unsigned)node.Parent].InodeNumber;
+    const UInt32 dirBlock = (UInt32)(node.DirRef >> 16);
+    const UInt32 dirOffset = (UInt32)(node.DirRef & 0xFFFF);
+    if (node.DirSize <= 0xFFFF && (node.DirRef >> 48) == 0)
+    {
+      SetUi32(p + 16, dirBlock)
+      SetUi32(p + 20, 2 + node.NumSubDirs)
+      SetUi16(p + 24, (UInt16)node.DirSize)
+      SetUi16(p + 26, (UInt16)dirOffset)
+      SetUi32(p + 28, parentNumber)
+      size = 32;
+    }
+    else
+    {
+      type += 7;
+      SetUi32(p + 16, 2 + node.NumSubDirs)
+      SetUi32(p + 20, node.DirSize)
+      SetUi32(p + 24, dirBlock)
+      SetUi32(p + 28, parentNumber)
+      SetUi16(p + 32, 0) // index count
+      SetUi16(p + 34, (UInt16)dirOffset)
+      SetUi32(p + 36, (UInt32)(Int32)-1) // xattr
+      size = 40;
+    }
+  }
+  else if (node.Type == kType_LNK)
+  {
+    SetUi32(p + 16, 1)
+    SetUi32(p + 20, node.SymLink.Len())
+    size = 24;
+  }
+  else
+  {
+    if (node.FileSize <= 0xFFFFFFFF && node.StartBlock <= 0xFFFFFFFF)
+    {
+      SetUi32(p + 16, (UInt32)node.StartBlock)
+      SetUi32(p + 20, node.Frag)
+      SetUi32(p + 24, node.FragOffset)
+      SetUi32(p + 28, (UInt32)node.FileSize)
+      size = 32;
+    }
+    else
+    {
+      type += 7;
+      SetUi64(p + 16, node.StartBlock)
+      SetUi64(p + 24, node.FileSize)
+      SetUi64(p + 32, 0) // sparse
+      SetUi32(p + 40, 1)
+      SetUi32(p + 44, node.Frag)
+      SetUi32(p + 48, node.FragOffset)
+      SetUi32(p + 52, (UInt32)(Int32)-1) // xattr
+      size = 56;
+    }
+  }
+
+  SetUi16(p, (UInt16)type)
+  SetUi16(p + 2, (UInt16)(node.Mode & 0xFFF))
+  SetUi16(p + 4, uid)
+  SetUi16(p + 6, gid)
+  SetUi32(p + 8, node.MTime)
+  SetUi32(p + 12, node.InodeNumber)
+  RINOK(_inodes.Write(p, size))
+
+  if (node.Type == kType_LNK)
+    return _inodes.Write(node.SymLink.Ptr(), node.SymLink.Len());
+  if (node.Type == kType_FILE)
+  {
+    FOR_VECTOR (i, node.BlockSizes)
+    {
+      SetUi32(p, node.BlockSizes[i])
+      RINOK(_inodes.Write(p, 4))
+    }
+  }
+  return S_OK;
+}
+
+
+HRESULT CImageWriter::WriteDir(unsigned dirIndex)
+{
+  COutNode &dir = Nodes[dirIndex];
+  const CUIntVector &children = dir.Children;
+  unsigned i;
+
+  for (i = 0; i < children.Size(); i++)
+  {
+    const unsigned index = children[i];
+    if (Nodes[index].IsDir())
+    {
+      RINOK(WriteDir(index))
+    }
+    else
+    {
+      RINOK(WriteInode(Nodes[index]))
+    }
+  }
+
+  dir.DirRef = _dirs.GetRef();
+  UInt32 dirSize = 3;
+
+  for (i = 0; i < children.Size();)
+  {
+    const COutNode &first = Nodes[children[i]];
+    const UInt64 block = first.InodeRef >> 16;
+    const UInt32 base = first.InodeNumber;
+    unsigned num = 1;
+    for (; i + num < children.Size() && num < kNumDirEntriesInHeaderMax; num++)
+    {
+      const COutNode &node = Nodes[children[i + num]];
+      const Int64 delta = (Int64)node.InodeNumber - (Int64)base;
+      if ((node.InodeRef >> 16) != block || delta < -0x8000 || delta > 0x7FFF)
+        break;
+    }
+
+    Byte p[12];
+    SetUi32(p, (UInt32)(num - 1))
+    SetUi32(p + 4, (UInt32)block)
+    SetUi32(p + 8, base)
+    RINOK(_dirs.Write(p, 12))
+    dirSize += 12;
+
+    for (unsigned k = 0; k < num; k++, i++)
+    {
+      const COutNode &node = Nodes[children[i]];
+      SetUi16(p, (UInt16)(node.InodeRef & 0xFFFF))
+      SetUi16(p + 2, (UInt16)(Int16)((Int32)node.InodeNumber - (Int32)base))
+      SetUi16(p + 4, (UInt16)node.Type)
+      SetUi16(p + 6, (UInt16)(node.Name.Len() - 1))
+      RINOK(_dirs.Write(p, 8))
+      RINOK(_dirs.Write(node.Name.Ptr(), node.Name.Len()))
+      dirSize += 8 + node.Name.Len();
+    }
+  }
+
+  dir.DirSize = dirSize;
+  return WriteInode(dir);
+}
+
+
+HRESULT CImageWriter::WriteTable(CMetaWriter &meta, UInt64 &tableStart)
+{
+  RINOK(meta.Flush())
+  const UInt64 metaStart = _pos;
+  RINOK(WriteStream(_stream, (const Byte *)meta.Data, meta.Size))
+  _pos += meta.Size;
+  tableStart = _pos;
+  FOR_VECTOR (i, meta.BlockStarts)
+  {
+    Byte p[8];
+    SetUi64(p, metaStart + meta.BlockStarts[i])
+    RINOK(WriteStream(_stream, p, 8))
+    _pos += 8;
+  }
+  return S_OK;
+}
+
+
+HRESULT CImageWriter::Finish()
+{
+  RINOK(FlushFragment())
+  RINOK(Drain())
+
+  _numInodes = 0;
+  NumberInodes(0);
+
+  RINOK(WriteDir(0))
+  const UInt64 rootRef = Nodes[0].InodeRef;
+  RINOK(_inodes.Flush())
+  RINOK(_dirs.Flush())
+
+  const UInt64 inodeTable = _pos;
+  RINOK(WriteStream(_stream, (const Byte *)_inodes.Data, _inodes.Size))
+  _pos += _inodes.Size;
+  const UInt64 dirTable = _pos;
+  RINOK(WriteStream(_stream, (const Byte *)_dirs.Data, _dirs.Size))
+  _pos += _dirs.Size;
+
+  UInt64 fragTable;
+  {
+    CMetaWriter meta;
+    meta.SetEncoder(&_metaEncoder);
+    FOR_VECTOR (i, _frags)
+    {
+      const CFrag &frag = _frags[i];
+      Byte p[16];
+      SetUi64(p, frag.StartBlock)
+      SetUi32(p + 8, frag.Size)
+      SetUi32(p + 12, 0)
+      RINOK(meta.Write(p, 16))
+    }
+    RINOK(WriteTable(meta, fragTable))
+  }
+
+  UInt64 idTable;
+  {
+    CMetaWriter meta;
+    meta.SetEncoder(&_metaEncoder);
+    FOR_VECTOR (i, _ids)
+    {
+      Byte p[4];
+      SetUi32(p, _ids[i])
+      RINOK(meta.Write(p, 4))
+    }
+    RINOK(WriteTable(meta, idTable))
+  }
+
+  const UInt64 bytesUsed = _pos;
+
+  // the size of image is aligned for 4 KiB, as in mksquashfs
+  {
+    const unsigned kAlign = 1 << 12;
+    Byte zeros[kAlign];
+    memset(zeros, 0, kAlign);
+    const size_t pad = (size_t)((kAlign - ((unsigned)_pos & (kAlign - 1))) & (kAlign - 1));
+    RINOK(WriteStream(_stream, zeros, pad))
+    _pos += pad;
+  }
+  RINOK(_stream->SetSize(_pos))
+
+  Byte p[kHeaderSize4];
+  memset(p, 0, kHeaderSize4);
+  SetUi32(p, kSignature32_LE)
+  SetUi32(p + 0x04, _numInodes)
+  SetUi32(p + 0x08, MTime)
+  SetUi32(p + 0x0C, _blockSize)
+  SetUi32(p + 0x10, _frags.Size())
+  SetUi16(p + 0x14, (UInt16)_method)
+  SetUi16(p + 0x16, (UInt16)_blockSizeLog)
+  SetUi16(p + 0x18, (UInt16)(
+        ((UInt32)1 << kFlag_NO_XATTRS)
+      | (NumDuplicates != 0 ? ((UInt32)1 << kFlag_DUPLICATE) : 0)))
+  SetUi16(p + 0x1A, (UInt16)_ids.Size())
+  SetUi16(p + 0x1C, 4)
+  SetUi16(p + 0x1E, 0)
+  SetUi64(p + 0x20, rootRef)
+  SetUi64(p + 0x28, bytesUsed)
+  SetUi64(p + 0x30, idTable)
+  SetUi64(p + 0x38, (UInt64)(Int64)-1) // xattr table
+  SetUi64(p + 0x40, inodeTable)
+  SetUi64(p + 0x48, dirTable)
+  SetUi64(p + 0x50, fragTable)
+  SetUi64(p + 0x58, (UInt64)(Int64)-1) // export table
+  RINOK(_stream->Seek(0, STREAM_SEEK_SET, NULL))
+  return WriteStream(_stream, p, kHeaderSize4);
+}
+
+
+Z7_COM7F_IMF(CHandler::GetFileTimeType(UInt32 *timeType))
+{
+  *timeType = NFileTimeType::kUnix;
+  return S_OK;
+}
+
+
+static HRESULT GetPathUtf8(IArchiveUpdateCallback *callback, UInt32 index, AString &res)
+{
+  res.Empty();
+  NWindows::NCOM::CPropVariant prop;
+  RINOK(callback->GetProperty(index, kpidPath, &prop))
+  if (prop.vt == VT_BSTR)
+  {
+    UString s = prop.bstrVal;
+    NItemName::ReplaceSlashes_OsToUnix(s);
+    ConvertUnicodeToUTF8(s, res);
+  }
+  else if (prop.vt != VT_EMPTY)
+    return E_INVALIDARG;
+  return S_OK;
+}
+
+
+struct CUpdateItem
+{
+  int IndexInArc;
+  bool NewData;
+  unsigned Node;
+};
+
+
+Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numItems,
+    IArchiveUpdateCallback *callback))
+{
+  COM_TRY_BEGIN
+
+  CMyComPtr<IOutStream> outSeekStream;
+  outStream->QueryInterface(IID_IOutStream, (void **)&outSeekStream);
+  if (!outSeekStream)
+    return E_NOTIMPL;
+
+  CImageWriter writer;
+  {
+    FILETIME ft;
+    NWindows::NTime::GetCurUtcFileTime(ft);
+    NWindows::NTime::FileTime_To_UnixTime(ft, writer.MTime);
+  }
+
+  UInt32 numThreads = 1;
+ #ifndef Z7_ST
+  numThreads = _props._numThreads;
+ #endif
+  RINOK(writer.Create(outSeekStream, _method, _level, _blockSizeLog,
+      numThreads, _props._memUsage_Compress))
+
+  CRecordVector<CUpdateItem> updateItems;
+  UInt64 totalSize = 0;
+
+  for (UInt32 i = 0; i < numItems; i++)
+  {
+    Int32 newData, newProps;
+    UInt32 indexInArc;
+    RINOK(callback->GetUpdateItemInfo(i, &newData, &newProps, &indexInArc))
+
+    CUpdateItem ui;
+    ui.IndexInArc = (int)indexInArc;
+    ui.NewData = IntToBool(newData);
+
+    // the properties of old items are taken from this handler
+    IArchiveUpdateCallback *propCallback = NULL;
+    UInt32 propIndex = i;
+    if (!IntToBool(newProps))
+    {
+      if (ui.IndexInArc < 0 || (unsigned)ui.IndexInArc >= _items.Size())
+        return E_INVALIDARG;
+      propIndex = indexInArc;
+    }
+    else
+      propCallback = callback;
+
+    AString path;
+    if (propCallback)
+    {
+      RINOK(GetPathUtf8(callback, i, path))
+    }
+    else
+      path = GetPath(propIndex);
+
+    bool isDir = false;
+    {
+      NWindows::NCOM::CPropVariant prop;
+      RINOK(GetUpdateProp(propCallback, propIndex, kpidIsDir, &prop))
+      if (prop.vt == VT_BOOL)
+        isDir = (prop.boolVal != VARIANT_FALSE);
+      else if (prop.vt != VT_EMPTY)
+        return E_INVALIDARG;
+    }
+
+    RINOK(writer.AddNode(path, (int)updateItems.Size(), ui.Node))
+    COutNode &node = writer.Nodes[ui.Node];
+    node.Type = isDir ? kType_DIR : kType_FILE;
+    {
+      NWindows::NCOM::CPropVariant prop;
+      RINOK(GetUpdateProp(propCallback, propIndex, kpidPosixAttrib, &prop))
+      if (prop.vt == VT_UI4)
+        node.Mode = prop.ulVal;
+      else if (prop.vt == VT_EMPTY)
+        node.Mode = isDir ? 0755 : 0644;
+      else
+        return E_INVALIDARG;
+    }
+    {
+      NWindows::NCOM::CPropVariant prop;
+      RINOK(GetUpdateProp(propCallback, propIndex, kpidMTime, &prop))
+      node.MTime = writer.MTime;
+      if (prop.vt == VT_FILETIME)
+        NWindows::NTime::FileTime_To_UnixTime(prop.filetime, node.MTime);
+      else if (prop.vt != VT_EMPTY)
+        return E_INVALIDARG;
+    }
+    {
+      NWindows::NCOM::CPropVariant prop;
+      RINOK(GetUpdateProp(propCallback, propIndex, kpidUserId, &prop))
+      if (prop.vt == VT_UI4)
+        node.Uid = prop.ulVal;
+    }
+    {
+      NWindows::NCOM::CPropVariant prop;
+      RINOK(GetUpdateProp(propCallback, propIndex, kpidGroupId, &prop))
+      if (prop.vt == VT_UI4)
+        node.Gid = prop.ulVal;
+    }
+
+    if (!isDir)
+    {
+      if (ui.NewData)
+      {
+        NWindows::NCOM::CPropVariant prop;
+        RINOK(callback->GetProperty(i, kpidSymLink, &prop))
+        if (prop.vt == VT_BSTR && prop.bstrVal[0] != 0)
+        {
+          node.Type = kType_LNK;
+          ConvertUnicodeToUTF8(UString(prop.bstrVal), node.SymLink);
+        }
+        else
+        {
+          RINOK(callback->GetProperty(i, kpidSize, &prop))
+          if (prop.vt == VT_UI8)
+            totalSize += prop.uhVal.QuadPart;
+        }
+      }
+      else
+      {
+        const CNode &oldNode = _nodes[_items[(unsigned)ui.IndexInArc].Node];
+        if (oldNode.IsLink())
+        {
+          node.Type = kType_LNK;
+          node.SymLink.SetFrom_CalcLen(
+              (const char *)(_inodesData.Data + _nodesPos[_items[(unsigned)ui.IndexInArc].Node] + _h.GetSymLinkOffset()),
+              (unsigned)oldNode.FileSize);
+        }
+        else
+          totalSize += oldNode.GetSize();
+      }
+    }
+    updateItems.Add(ui);
+  }
+
+  RINOK(callback->SetTotal(totalSize))
+
+  // we write the files in order of directory tree to keep the data of one directory together
+  CUIntVector files;
+  writer.GetFiles(0, files);
+
+  UInt64 completed = 0;
+
+  FOR_VECTOR (k, files)
+  {
+    const unsigned nodeIndex = files[k];
+    const CUpdateItem &ui = updateItems[(unsigned)writer.Nodes[nodeIndex].UpdateIndex];
+    const UInt32 index = (UInt32)writer.Nodes[nodeIndex].UpdateIndex;
+
+    CMyComPtr<ISequentialInStream> fileInStream;
+    if (ui.NewData)
+    {
+      const HRESULT res = callback->GetStream(index, &fileInStream);
+      if (res == S_FALSE)
+        continue;
+      RINOK(res)
+    }
+    else
+    {
+      RINOK(GetStream((UInt32)ui.IndexInArc, &fileInStream))
+    }
+
+    UInt64 processed = 0;
+    RINOK(writer.WriteFile(nodeIndex, fileInStream, processed, callback, completed))
+    completed += processed;
+    RINOK(callback->SetCompleted(&completed))
+    if (ui.NewData)
+    {
+      RINOK(callback->SetOperationResult(NUpdate::NOperationResult::kOK))
+    }
+  }
+
+  return writer.Finish();
+
+  COM_TRY_END
+}
+
+
+Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
+{
+  ClearCache();
+  _props = CCommonMethodProps();
+  InitUpdateProps();
+
+  for (UInt32 i = 0; i < numProps; i++)
+  {
+    UString name = names[i];
+    name.MakeLower_Ascii();
+    if (name.IsEmpty())
+      return E_INVALIDARG;
+    const PROPVARIANT &prop = values[i];
+    if (name[0] == L'x')
+    {
+      UInt32 level = 5;
+      RINOK(ParsePropToUInt32(name.Ptr(1), prop, level))
+      _level = level;
+    }
+    else if (name.IsEqualTo("m") || name.IsEqualTo("0"))
+    {
+      if (prop.vt != VT_BSTR)
+        return E_INVALIDARG;
+      const UString s = prop.bstrVal;
+      if (s.IsEqualTo_Ascii_NoCase("gzip") ||
+          s.IsEqualTo_Ascii_NoCase("zlib") ||
+          s.IsEqualTo_Ascii_NoCase("deflate"))
+        _method = kMethod_ZLIB;
+      else if (s.IsEqualTo_Ascii_NoCase("xz") ||
+          s.IsEqualTo_Ascii_NoCase("lzma2"))
+        _method = kMethod_XZ;
+      else if (s.IsEqualTo_Ascii_NoCase("lzma"))
+        _method = kMethod_LZMA;
+      else
+        return E_INVALIDARG;
+    }
+    else if (name.IsPrefixedBy_Ascii_NoCase("bs"))
+    {
+      UInt64 v;
+      if (!ParseSizeString(name.Ptr(2), prop, 0, v))
+        return E_INVALIDARG;
+      unsigned i2;
+      for (i2 = kBlockSizeLog_Min; i2 <= kBlockSizeLog_Max; i2++)
+        if (v == ((UInt64)1 << i2))
+          break;
+      if (i2 > kBlockSizeLog_Max)
+        return E_INVALIDARG;
+      _blockSizeLog = i2;
+    }
+    else
+    {
+      HRESULT hres;
+      if (!_props.SetCommonProperty(name, prop, hres))
+        return E_INVALIDARG;
+      RINOK(hres)
+    }
+  }
+  return S_OK;
+}
+
+
 static const Byte k_Signature[] = {
     4, 'h', 's', 'q', 's',
     4, 's', 'q', 's', 'h',
     4, 's', 'h', 's', 'q',
     4, 'q', 's', 'h', 's' };
 
-REGISTER_ARC_I(
+REGISTER_ARC_IO(
   "SquashFS", "squashfs", NULL, 0xD2,
   k_Signature,
   0,
-  NArcInfoFlags::kMultiSignature,
-  NULL)
+    NArcInfoFlags::kMultiSignature
+  | NArcInfoFlags::kSymLinks
+  | NArcInfoFlags::kMTime
+  | NArcInfoFlags::kMTime_Default
+  , TIME_PREC_TO_ARC_FLAGS_MASK (NFileTimeType::kUnix)
+  | TIME_PREC_TO_ARC_FLAGS_TIME_DEFAULT (NFileTimeType::kUnix)
+  , NULL)
 
 }}
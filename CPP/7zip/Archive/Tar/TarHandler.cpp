@@ -2,6 +2,9 @@
 
 #include "StdAfx.h"
 
+#include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
+
 #include "../../../Common/ComTry.h"
 #include "../../../Common/IntToString.h"
 #include "../../../Common/StringConvert.h"
@@ -204,14 +207,141 @@ AString CEncodingCharacts::GetCharactsString() const
 }
 
 
+/* ReadIndex() reads member index that is written by 7-Zip after end of archive.
+   It reads only index and doesn't scan headers of members in archive.
+   If there is no index or if index is not consistent,
+   it returns (indexWasRead = false) and the caller scans archive as usual. */
+
+HRESULT CHandler::ReadIndex(IInStream *stream, UInt64 endPos, bool &indexWasRead)
+{
+  indexWasRead = false;
+  const unsigned kFooterSize = NIndex::kFooterSize;
+  if (endPos < kFooterSize * 3 || (endPos & (NFileHeader::kRecordSize - 1)) != 0)
+    return S_OK;
+  
+  Byte footer[kFooterSize];
+  {
+    RINOK(InStream_SeekSet(stream, endPos - kFooterSize))
+    size_t processed = kFooterSize;
+    RINOK(ReadStream(stream, footer, &processed))
+    if (processed != kFooterSize)
+      return S_OK;
+  }
+  if (memcmp(footer, NIndex::kSignature, NIndex::kSignatureSize) != 0
+      || GetUi32(footer + NIndex::kFooter_FooterCrc) != CrcCalc(footer, NIndex::kFooter_FooterCrc)
+      || GetUi32(footer + NIndex::kFooter_Version) != NIndex::kVersion)
+    return S_OK;
+
+  const UInt32 numItems = GetUi32(footer + NIndex::kFooter_NumItems);
+  const UInt64 indexPos = GetUi64(footer + NIndex::kFooter_IndexPos);
+  const UInt64 indexSize = GetUi64(footer + NIndex::kFooter_IndexSize);
+  const UInt64 indexEnd = endPos - kFooterSize;
+  const size_t kIndexSizeMax = (size_t)1 << (sizeof(size_t) > 4 ? 32 : 28);
+  if (indexPos > indexEnd
+      || indexSize > indexEnd - indexPos
+      || indexSize > kIndexSizeMax
+      || indexSize / NIndex::kRecordHeaderSize < numItems
+      || ((indexPos + indexSize + NFileHeader::kRecordSize - 1) & ~(UInt64)(NFileHeader::kRecordSize - 1)) != indexEnd)
+    return S_OK;
+
+  CByteBuffer index((size_t)indexSize);
+  RINOK(InStream_SeekSet(stream, indexPos))
+  {
+    size_t processed = (size_t)indexSize;
+    RINOK(ReadStream(stream, index, &processed))
+    if (processed != indexSize)
+      return S_OK;
+  }
+  if (GetUi32(footer + NIndex::kFooter_IndexCrc) != CrcCalc(index, (size_t)indexSize))
+    return S_OK;
+
+  CBufInStream *bufStreamSpec = new CBufInStream;
+  CMyComPtr<ISequentialInStream> bufStream = bufStreamSpec;
+  // (_arc) streams must not point to (bufStream) after return
+  ISequentialInStream * const seqStreamPrev = _arc.SeqStream;
+  IInStream * const inStreamPrev = _arc.InStream;
+  _arc.SeqStream = bufStream;
+  _arc.InStream = NULL;
+
+  const Byte *p = index;
+  size_t rem = (size_t)indexSize;
+  CItemEx item;
+  HRESULT res = S_OK;
+  UInt32 i;
+  for (i = 0; i < numItems; i++)
+  {
+    if (rem < NIndex::kRecordHeaderSize)
+      break;
+    const UInt64 headerPos = GetUi64(p);
+    const UInt32 headerSize = GetUi32(p + 8);
+    p += NIndex::kRecordHeaderSize;
+    rem -= NIndex::kRecordHeaderSize;
+    if (headerSize > rem || headerPos > indexPos)
+      break;
+    bufStreamSpec->Init(p, headerSize);
+    _arc.NumFiles = _items.Size();
+    _arc._phySize = headerPos;
+    res = _arc.ReadItem(item);
+    if (res != S_OK)
+      break;
+    if (!_arc.filled
+        || _arc._error != k_ErrorType_OK
+        || item.HeaderPos != headerPos
+        || item.HeaderSize != headerSize
+        || item.Get_DataPos() > indexPos
+        // (PackSize) check protects Get_PackSize_Aligned() from overflow
+        || item.PackSize > indexPos - item.Get_DataPos()
+        || item.Get_PackSize_Aligned() > indexPos - item.Get_DataPos())
+      break;
+    p += headerSize;
+    rem -= headerSize;
+    item.EncodingCharacts.Check(item.Name);
+    _encodingCharacts.Update(item.EncodingCharacts);
+    _items.Add(item);
+  }
+
+  _arc.SeqStream = seqStreamPrev;
+  _arc.InStream = inStreamPrev;
+  RINOK(res)
+
+  if (i != numItems || rem != 0)
+  {
+    // we clear the state changed by ReadItem() calls
+    _arc.Clear();
+    _encodingCharacts.Clear();
+    _items.Clear();
+    return S_OK;
+  }
+  
+  // index and the end of archive zero records are part of archive
+  _arc._phySize = endPos;
+  indexWasRead = true;
+  return S_OK;
+}
+
+
 HRESULT CHandler::Open2(IInStream *stream, IArchiveOpenCallback *callback)
 {
   UInt64 endPos;
   {
-    RINOK(InStream_AtBegin_GetSize(stream, endPos))
+    RINOK(InStream_GetSize_SeekToEnd(stream, endPos))
   }
   
   _arc._phySize_Defined = true;
+  _arc.OpenCallback = callback;
+
+  {
+    bool indexWasRead;
+    RINOK(ReadIndex(stream, endPos, indexWasRead))
+    if (indexWasRead)
+    {
+      _isArc = true;
+      _openCodePage = _curCodePage;
+      return S_OK;
+    }
+    _arc._phySize_Defined = true;
+  }
+  RINOK(InStream_SeekToBegin(stream))
   
   // bool utf8_OK = true;
 
@@ -753,11 +883,28 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     }
     RINOK(extractCallback->PrepareOperation(askMode))
 
+    Int32 opRes = NExtract::NOperationResult::kOK;
+
+    if (!seqMode && realOutStream
+        && !item->Is_Sparse()
+        && !item->Is_SymLink()
+        && unpackSize <= item->Get_PackSize_Aligned())
+    {
+      /* we copy the data from (_stream) to (realOutStream) without stream wrappers.
+         So output file stream can copy data without buffers (copy_file_range()) */
+      RINOK(InStream_SeekSet(_stream, item->Get_DataPos()))
+      RINOK(copyCoder->Code(_stream, realOutStream, NULL, &unpackSize, progress))
+      // the copy is short only if the input stream is truncated
+      if (copyCoderSpec->TotalSize != unpackSize)
+        opRes = NExtract::NOperationResult::kUnexpectedEnd;
+      realOutStream.Release();
+      RINOK(extractCallback->SetOperationResult(opRes))
+      continue;
+    }
+
     outStreamSpec->SetStream(realOutStream);
     realOutStream.Release();
     outStreamSpec->Init(skipMode ? 0 : unpackSize, true);
-
-    Int32 opRes = NExtract::NOperationResult::kOK;
     CMyComPtr<ISequentialInStream> inStream2;
     if (!item->Is_Sparse())
       inStream2 = inStream;
@@ -955,6 +1102,10 @@ void CHandler::Init()
   // TimeOptions.Clear();
   _handlerTimeOptions.Init();
   // _handlerTimeOptions.Write_MTime.Val = true; // it's default already
+  _chainMethod = k_Chain_None;
+  _indexMode = false;
+  _level = (UInt32)(Int32)-1;
+  _commonProps = CCommonMethodProps();
 }
 
 
@@ -974,8 +1125,10 @@ Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
     if (name[0] == L'x')
     {
       // some clients write 'x' property. So we support it
-      UInt32 level = 0;
+      // it's used as level of chain compression method
+      UInt32 level = 9;
       RINOK(ParsePropToUInt32(name.Ptr(1), prop, level))
+      _level = level;
     }
     else if (name.IsEqualTo("cp"))
     {
@@ -984,11 +1137,32 @@ Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
       _forceCodePage = true;
       _curCodePage = _specifiedCodePage = cp;
     }
-    else if (name.IsPrefixedBy_Ascii_NoCase("mt"))
+    else if (name.IsPrefixedBy_Ascii_NoCase("mt")
+        || name.IsPrefixedBy_Ascii_NoCase("memuse"))
     {
+      HRESULT hres;
+      _commonProps.SetCommonProperty(name, prop, hres);
+      RINOK(hres)
+    }
+    else if (name.IsEqualTo("cm"))
+    {
+      if (prop.vt != VT_BSTR)
+        return E_INVALIDARG;
+      const UString s = prop.bstrVal;
+      if (s.IsEqualTo_Ascii_NoCase("gzip") ||
+          s.IsEqualTo_Ascii_NoCase("gz"))
+        _chainMethod = k_Chain_GZip;
+      else if (s.IsEqualTo_Ascii_NoCase("bzip2") ||
+          s.IsEqualTo_Ascii_NoCase("bz2"))
+        _chainMethod = k_Chain_BZip2;
+      else if (s.IsEqualTo_Ascii_NoCase("xz"))
+        _chainMethod = k_Chain_Xz;
+      else
+        return E_INVALIDARG;
     }
-    else if (name.IsPrefixedBy_Ascii_NoCase("memuse"))
+    else if (name.IsEqualTo("ix"))
     {
+      RINOK(PROPVARIANT_to_bool(prop, _indexMode))
     }
     else if (name.IsEqualTo("m"))
     {
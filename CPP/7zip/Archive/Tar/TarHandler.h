@@ -10,10 +10,20 @@
 #include "../Common/HandlerOut.h"
 
 #include "TarIn.h"
+#include "TarUpdate.h"
 
 namespace NArchive {
 namespace NTar {
 
+// compression of output tar stream in same pass
+enum EChainMethod
+{
+  k_Chain_None,
+  k_Chain_GZip,
+  k_Chain_BZip2,
+  k_Chain_Xz
+};
+
 Z7_CLASS_IMP_CHandler_IInArchive_4(
     IArchiveOpenSeq
   , IInArchiveGetStream
@@ -36,6 +46,11 @@ private:
   CHandlerTimeOptions _handlerTimeOptions;
   CEncodingCharacts _encodingCharacts;
 
+  EChainMethod _chainMethod;
+  bool _indexMode; // write member index
+  UInt32 _level;
+  CCommonMethodProps _commonProps; // "mt" and "memuse" for chain encoder
+
   UInt32 _curIndex;
   bool _latestIsRead;
   CItemEx _latestItem;
@@ -45,8 +60,13 @@ private:
   NCompress::CCopyCoder *copyCoderSpec;
   CMyComPtr<ICompressCoder> copyCoder;
 
+  HRESULT ReadIndex(IInStream *stream, UInt64 endPos, bool &indexWasRead);
   HRESULT Open2(IInStream *stream, IArchiveOpenCallback *callback);
   HRESULT SkipTo(UInt32 index);
+  HRESULT UpdateChained(ISequentialOutStream *outStream,
+      const CObjectVector<CUpdateItem> &updateItems,
+      const CUpdateOptions &options,
+      IArchiveUpdateCallback *callback);
   void TarStringToUnicode(const AString &s, NWindows::NCOM::CPropVariant &prop, bool toOs = false) const;
 public:
   void Init();
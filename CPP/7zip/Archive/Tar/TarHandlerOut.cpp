@@ -4,13 +4,28 @@
 
 // #include <stdio.h>
 
+#include "../../../../C/CpuArch.h"
+
 #include "../../../Common/ComTry.h"
+#include "../../../Common/MyCom.h"
 #include "../../../Common/MyLinux.h"
 #include "../../../Common/StringConvert.h"
 
 #include "../../../Windows/TimeUtils.h"
 
+#include "../../Common/StreamUtils.h"
+
+#ifndef Z7_ST
+#include "../../Common/StreamBinder.h"
+#include "../../Common/VirtThread.h"
+#endif
+
+#include "../../Compress/BZip2Encoder.h"
+#include "../../Compress/DeflateEncoder.h"
+#include "../../Compress/XzEncoder.h"
+
 #include "../Common/ItemNameUtils.h"
+#include "../Common/OutStreamWithCRC.h"
 
 #include "TarHandler.h"
 #include "TarUpdate.h"
@@ -180,6 +195,203 @@ static HRESULT GetUser(IArchiveUpdateCallback *callback, UInt32 i,
 }
 
 
+#ifndef Z7_ST
+
+class CChainEncoderThread Z7_final: public CVirtThread
+{
+public:
+  CMyComPtr<ICompressCoder> Encoder;
+  CMyComPtr<ISequentialInStream> InStream;
+  CMyComPtr<ISequentialOutStream> OutStream;
+  HRESULT Result;
+
+  ~CChainEncoderThread() Z7_DESTRUCTOR_override
+  {
+    /* WaitThreadFinish() will be called in ~CVirtThread().
+       But we need WaitThreadFinish() call before
+       destructors of this class members.
+    */
+    CVirtThread::WaitThreadFinish();
+  }
+private:
+  virtual void Execute() Z7_override
+  {
+    Result = Encoder->Code(InStream, OutStream, NULL, NULL, NULL);
+    // it unlocks the writer thread, if encoder has stopped before end of stream
+    InStream.Release();
+  }
+};
+
+
+/* it reduces the number of xz block threads, if
+   the memory usage is larger than (memUsageLimit) */
+
+static UInt32 Xz_ReduceNumThreads(const CMethodProps &props, UInt32 numThreads, UInt64 memUsageLimit)
+{
+  const UInt64 cs = props.Get_Xz_BlockSize();
+  const UInt32 lzmaThreads = props.Get_Lzma_NumThreads();
+  UInt32 numBlockThreads = numThreads / lzmaThreads;
+  if (numBlockThreads <= 1)
+    return numThreads;
+  const UInt64 lzmaMemUsage = props.Get_Lzma_MemUsage(false);
+  for (; numBlockThreads > 1; numBlockThreads--)
+  {
+    // same estimation as in xz handler
+    UInt64 size = numBlockThreads * (lzmaMemUsage + cs);
+    UInt32 numPackChunks = numBlockThreads + (numBlockThreads / 8) + 1;
+    if (cs < ((UInt32)1 << 26)) numPackChunks++;
+    if (cs < ((UInt32)1 << 24)) numPackChunks++;
+    if (cs < ((UInt32)1 << 22)) numPackChunks++;
+    size += numPackChunks * cs;
+    if (size <= memUsageLimit)
+      break;
+  }
+  return numBlockThreads * lzmaThreads;
+}
+
+#endif
+
+
+HRESULT CHandler::UpdateChained(ISequentialOutStream *outStream,
+    const CObjectVector<CUpdateItem> &updateItems,
+    const CUpdateOptions &options,
+    IArchiveUpdateCallback *callback)
+{
+  #ifdef Z7_ST
+
+  UNUSED_VAR(outStream)
+  UNUSED_VAR(updateItems)
+  UNUSED_VAR(options)
+  UNUSED_VAR(callback)
+  return E_NOTIMPL;
+
+  #else
+
+  CMethodProps props;
+  if (_level != (UInt32)(Int32)-1)
+    props.AddProp_Level(_level);
+
+  CMyComPtr<ICompressCoder> encoder;
+  CMyComPtr<ICompressSetCoderProperties> setProps;
+  
+  if (_chainMethod == k_Chain_GZip)
+  {
+    NCompress::NDeflate::NEncoder::CCOMCoder *encoderSpec = new NCompress::NDeflate::NEncoder::CCOMCoder;
+    encoder = encoderSpec;
+    setProps = encoderSpec;
+  }
+  else
+  {
+    UInt32 numThreads = _commonProps._numThreads;
+    if (_chainMethod == k_Chain_BZip2)
+    {
+      NCompress::NBZip2::CEncoder *encoderSpec = new NCompress::NBZip2::CEncoder;
+      encoder = encoderSpec;
+      setProps = encoderSpec;
+    }
+    else
+    {
+      NCompress::NXz::CEncoder *encoderSpec = new NCompress::NXz::CEncoder;
+      encoder = encoderSpec;
+      setProps = encoderSpec;
+      if (options.IndexMode)
+      {
+        /* single-thread xz encoder writes solid stream by default.
+           But member index is useful only, if xz stream consists of
+           blocks that can be decoded independently. */
+        props.AddProp_BlockSize2(props.Get_Xz_BlockSize());
+      }
+      if (!_commonProps._numThreads_WasForced && _commonProps._memUsage_WasSet)
+        numThreads = Xz_ReduceNumThreads(props, numThreads, _commonProps._memUsage_Compress);
+    }
+    props.AddProp_NumThreads(numThreads);
+  }
+  RINOK(props.SetCoderProps(setProps, NULL))
+
+  COutStreamWithCRC *crcStreamSpec = NULL;
+  CMyComPtr<ISequentialOutStream> crcStream;
+
+  if (_chainMethod == k_Chain_GZip)
+  {
+    // gzip header without file name and time
+    Byte buf[10];
+    buf[0] = 0x1F;
+    buf[1] = 0x8B;
+    buf[2] = 8; // deflate
+    buf[3] = 0; // flags
+    SetUi32(buf + 4, 0)
+    buf[8] = (Byte)(props.GetLevel() >= 7 ? 2 : 4); // kMaximum : kFastest
+    buf[9] =
+      #ifdef _WIN32
+        0; // kFAT
+      #else
+        3; // kUnix
+      #endif
+    RINOK(WriteStream(outStream, buf, 10))
+  }
+
+  CStreamBinder sb;
+  RINOK(sb.Create_ReInit())
+  
+  CChainEncoderThread thread;
+  {
+    const WRes wres = thread.Create();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+
+  CMyComPtr<ISequentialOutStream> tarOutStream;
+  sb.CreateStreams2(thread.InStream, tarOutStream);
+  thread.Encoder = encoder;
+  thread.OutStream = outStream;
+  thread.Result = E_FAIL;
+
+  if (_chainMethod == k_Chain_GZip)
+  {
+    crcStreamSpec = new COutStreamWithCRC;
+    crcStream = crcStreamSpec;
+    crcStreamSpec->SetStream(tarOutStream);
+    crcStreamSpec->Init();
+    tarOutStream.Release();
+  }
+
+  {
+    const WRes wres = thread.Start();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+
+  HRESULT res = UpdateArchive(_stream, crcStream ? (ISequentialOutStream *)crcStream : (ISequentialOutStream *)tarOutStream,
+      _items, updateItems, options, callback);
+  
+  // CloseWrite() call: it sends end of stream to encoder thread
+  if (crcStreamSpec)
+    crcStreamSpec->ReleaseStream();
+  tarOutStream.Release();
+
+  {
+    const WRes wres = thread.WaitExecuteFinish();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  thread.OutStream.Release();
+
+  if (thread.Result != S_OK && (res == S_OK || res == k_My_HRESULT_WritingWasCut))
+    res = thread.Result;
+  RINOK(res)
+
+  if (crcStreamSpec)
+  {
+    Byte buf[8];
+    SetUi32(buf, crcStreamSpec->GetCRC())
+    SetUi32(buf + 4, (UInt32)crcStreamSpec->GetSize())
+    RINOK(WriteStream(outStream, buf, 8))
+  }
+  return S_OK;
+
+  #endif
+}
+
 
 Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numItems,
     IArchiveUpdateCallback *callback))
@@ -298,6 +510,7 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   options.CodePage = codePage;
   options.UtfFlags = utfFlags;
   options.PosixMode = _posixMode;
+  options.IndexMode = _indexMode;
   
   options.Write_MTime = _handlerTimeOptions.Write_MTime;
   options.Write_ATime = _handlerTimeOptions.Write_ATime;
@@ -323,6 +536,9 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
         // k_PaxTimeMode_RemoveZero_Always; // original pax code
   }
 
+  if (_chainMethod != k_Chain_None)
+    return UpdateChained(outStream, updateItems, options, callback);
+
   return UpdateArchive(_stream, outStream, _items, updateItems,
       options, callback);
   
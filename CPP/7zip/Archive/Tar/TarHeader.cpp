@@ -96,4 +96,10 @@ posix (pax) - POSIX.1-2001
       minor_t devminor = minor (st->stat.st_rdev); }
 */
 
-}}}
+}
+
+namespace NIndex {
+  const Byte kSignature[kSignatureSize] = { '7', 'z', 'T', 'a', 'r', 'I', 'd', 'x' };
+}
+
+}}
@@ -85,6 +85,36 @@ namespace NFileHeader
   }
 }
 
+/*
+  optional member index of 7-Zip (-mix=on).
+  It's written after end-of-archive zero records, so tar readers ignore it.
+  The index allows to open archive without scanning of all headers.
+  It's useful, if tar is stored in compressed stream that supports seeking (multi-block xz).
+    records[NumItems]:
+      UInt64 HeaderPos  : offset of first header record of member
+      UInt32 HeaderSize : size of all header records of member (including long name and pax records)
+      Byte[HeaderSize]  : copy of header records
+    zero padding to kRecordSize
+    footer : last kRecordSize bytes of stream (kFooter_* offsets)
+*/
+
+namespace NIndex
+{
+  const unsigned kSignatureSize = 8;
+  extern const Byte kSignature[kSignatureSize];
+
+  const UInt32 kVersion = 1;
+  const unsigned kRecordHeaderSize = 8 + 4;
+  const unsigned kFooterSize = NFileHeader::kRecordSize;
+
+  const unsigned kFooter_Version   = 8;   // UInt32
+  const unsigned kFooter_NumItems  = 12;  // UInt32
+  const unsigned kFooter_IndexPos  = 16;  // UInt64 : offset of records
+  const unsigned kFooter_IndexSize = 24;  // UInt64 : size of records without padding
+  const unsigned kFooter_IndexCrc  = 32;  // UInt32 : CRC of records
+  const unsigned kFooter_FooterCrc = kFooterSize - 4; // UInt32 : CRC of previous bytes of footer
+}
+
 }}
 
 #endif
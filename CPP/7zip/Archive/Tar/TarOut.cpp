@@ -3,6 +3,7 @@
 #include "StdAfx.h"
 
 #include "../../../../C/7zCrc.h"
+#include "../../../../C/CpuArch.h"
 
 #include "../../../Common/IntToString.h"
 
@@ -324,6 +325,62 @@ static const unsigned kNameSize_Max =
 
 
 HRESULT COutArchive::WriteHeader(const CItem &item)
+{
+  if (!IndexMode)
+    return WriteHeader2(item);
+
+  if (_numIndexItems != 0 && _lastRecordPos == Pos)
+  {
+    // header of same member is rewritten after data size was changed
+    _indexSize = _lastRecordStart;
+    _numIndexItems--;
+  }
+  _lastRecordStart = _indexSize;
+  _lastRecordPos = Pos;
+  Byte rec[NIndex::kRecordHeaderSize];
+  SetUi64(rec, Pos)
+  SetUi32(rec + 8, 0)
+  if (!Index_AddData(rec, sizeof(rec)))
+    return E_OUTOFMEMORY;
+  _numIndexItems++;
+
+  _indexCapture = true;
+  const HRESULT res = WriteHeader2(item);
+  _indexCapture = false;
+  SetUi32((Byte *)_index + _lastRecordStart + 8, (UInt32)(_indexSize - _lastRecordStart - NIndex::kRecordHeaderSize))
+  return res;
+}
+
+
+HRESULT COutArchive::Index_AddHeaders(const Byte *data, UInt32 size)
+{
+  if (!IndexMode)
+    return S_OK;
+  _lastRecordStart = _indexSize;
+  _lastRecordPos = Pos;
+  Byte rec[NIndex::kRecordHeaderSize];
+  SetUi64(rec, Pos)
+  SetUi32(rec + 8, size)
+  if (!Index_AddData(rec, sizeof(rec))
+      || !Index_AddData(data, size))
+    return E_OUTOFMEMORY;
+  _numIndexItems++;
+  return S_OK;
+}
+
+
+bool COutArchive::Index_AddData(const void *data, size_t size)
+{
+  const size_t newSize = _indexSize + size;
+  if (newSize < size || !_index.EnsureCapacity(newSize))
+    return false;
+  memcpy((Byte *)_index + _indexSize, data, size);
+  _indexSize = newSize;
+  return true;
+}
+
+
+HRESULT COutArchive::WriteHeader2(const CItem &item)
 {
   Glob_Name.Empty();
   Prefix.Empty();
@@ -597,6 +654,9 @@ HRESULT COutArchive::WriteHeader(const CItem &item)
 
 HRESULT COutArchive::Write_Data(const void *data, unsigned size)
 {
+  if (_indexCapture)
+    if (!Index_AddData(data, size))
+      return E_OUTOFMEMORY;
   Pos += size;
   return WriteStream(Stream, data, size);
 }
@@ -638,7 +698,35 @@ HRESULT COutArchive::WriteFinishHeader()
   {
     RINOK(Write_Data(record, kRecordSize))
   }
+  if (IndexMode)
+    return WriteIndex();
   return S_OK;
 }
 
+
+HRESULT COutArchive::WriteIndex()
+{
+  const UInt64 indexPos = Pos;
+  RINOK(WriteStream(Stream, (const Byte *)_index, _indexSize))
+  Pos += _indexSize;
+
+  Byte footer[NIndex::kFooterSize];
+  memset(footer, 0, sizeof(footer));
+  {
+    const unsigned rem = (unsigned)_indexSize & (kRecordSize - 1);
+    if (rem != 0)
+    {
+      RINOK(Write_Data(footer, kRecordSize - rem))
+    }
+  }
+  memcpy(footer, NIndex::kSignature, NIndex::kSignatureSize);
+  SetUi32(footer + NIndex::kFooter_Version, NIndex::kVersion)
+  SetUi32(footer + NIndex::kFooter_NumItems, _numIndexItems)
+  SetUi64(footer + NIndex::kFooter_IndexPos, indexPos)
+  SetUi64(footer + NIndex::kFooter_IndexSize, _indexSize)
+  SetUi32(footer + NIndex::kFooter_IndexCrc, CrcCalc((const Byte *)_index, _indexSize))
+  SetUi32(footer + NIndex::kFooter_FooterCrc, CrcCalc(footer, NIndex::kFooter_FooterCrc))
+  return Write_Data(footer, NIndex::kFooterSize);
+}
+
 }}
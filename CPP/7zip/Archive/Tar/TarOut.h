@@ -5,6 +5,8 @@
 
 #include "../../../Common/MyCom.h"
 
+#include "../../Common/StreamObjects.h"
+
 #include "../../IStream.h"
 
 #include "TarItem.h"
@@ -19,6 +21,7 @@ class COutArchive
   AString Glob_Name;
   AString Prefix;
 
+  HRESULT WriteHeader2(const CItem &item);
   HRESULT WriteHeaderReal(const CItem &item, bool isPax = false
       // , bool zero_PackSize = false
       // , bool zero_MTime = false
@@ -27,9 +30,21 @@ class COutArchive
   HRESULT Write_Data(const void *data, unsigned size);
   HRESULT Write_Data_And_Residual(const void *data, unsigned size);
 
+  // member index records (if IndexMode)
+  CByteDynBuffer _index;
+  size_t _indexSize;
+  size_t _lastRecordStart;
+  UInt64 _lastRecordPos;
+  UInt32 _numIndexItems;
+  bool _indexCapture;
+
+  bool Index_AddData(const void *data, size_t size);
+  HRESULT WriteIndex();
+
 public:
   UInt64 Pos;
   bool IsPosixMode;
+  bool IndexMode;
   // bool IsPrefixAllowed; // it's used only if (IsPosixMode == true)
   CTimeOptions TimeOptions;
 
@@ -38,12 +53,20 @@ public:
     Stream = outStream;
   }
   HRESULT WriteHeader(const CItem &item);
+  // adds index record for header records that were copied from another archive
+  HRESULT Index_AddHeaders(const Byte *data, UInt32 size);
   HRESULT Write_AfterDataResidual(UInt64 dataSize);
   HRESULT WriteFinishHeader();
 
   COutArchive():
+      _indexSize(0),
+      _lastRecordStart(0),
+      _lastRecordPos(0),
+      _numIndexItems(0),
+      _indexCapture(false),
       Pos(0),
-      IsPosixMode(false)
+      IsPosixMode(false),
+      IndexMode(false)
       // , IsPrefixAllowed(true)
       {}
 };
@@ -6,7 +6,6 @@
 
 #include "../../../Windows/TimeUtils.h"
 
-#include "../../Common/LimitedStreams.h"
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/StreamUtils.h"
 
@@ -157,6 +156,7 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
   outArchive.Create(outStream);
   outArchive.Pos = 0;
   outArchive.IsPosixMode = options.PosixMode;
+  outArchive.IndexMode = options.IndexMode;
   outArchive.TimeOptions = options.TimeOptions;
 
   Z7_DECL_CMyComPtr_QI_FROM(IOutStream, outSeekStream, outStream)
@@ -198,10 +198,6 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
   CMyComPtr<ICompressProgressInfo> progress = lps;
   lps->Init(updateCallback, true);
 
-  CLimitedSequentialInStream *streamSpec = new CLimitedSequentialInStream;
-  CMyComPtr<ISequentialInStream> inStreamLimited(streamSpec);
-  streamSpec->SetStream(inStream);
-
   complexity = 0;
 
   // const int kNumReduceDigits = -1; // for debug
@@ -532,16 +528,26 @@ HRESULT UpdateArchive(IInStream *inStream, ISequentialOutStream *outStream,
       {
         size = existItem.Get_FullSize_Aligned();
         pos = existItem.HeaderPos;
+        if (options.IndexMode)
+        {
+          // header records are limited by reader, so (UInt32) is enough here
+          const UInt32 headerSize = (UInt32)existItem.HeaderSize;
+          CByteBuffer headers(headerSize);
+          RINOK(InStream_SeekSet(inStream, pos))
+          RINOK(ReadStream_FALSE(inStream, headers, headerSize))
+          RINOK(outArchive.Index_AddHeaders(headers, headerSize))
+        }
       }
 
       if (size != 0)
       {
         RINOK(InStream_SeekSet(inStream, pos))
-        streamSpec->Init(size);
         if (outSeekStream && setRestriction)
           RINOK(setRestriction->SetRestriction(0, 0))
         // 22.00 : we copy Residual data from old archive to new archive instead of zeroing
-        RINOK(copyCoder->Code(inStreamLimited, outStream, NULL, NULL, progress))
+        /* we pass (inStream) without limited stream wrapper,
+           so (outStream) can copy data without buffers (copy_file_range()) */
+        RINOK(copyCoder->Code(inStream, outStream, NULL, &size, progress))
         if (copyCoderSpec->TotalSize != size)
           return E_FAIL;
         outArchive.Pos += size;
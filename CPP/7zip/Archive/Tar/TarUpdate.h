@@ -48,6 +48,7 @@ struct CUpdateOptions
   UINT CodePage;
   unsigned UtfFlags;
   bool PosixMode;
+  bool IndexMode; // write member index after end of archive
   CBoolPair Write_MTime;
   CBoolPair Write_ATime;
   CBoolPair Write_CTime;
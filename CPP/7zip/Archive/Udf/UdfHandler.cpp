@@ -14,6 +14,8 @@
 
 #include "../../Compress/CopyCoder.h"
 
+#include "../HandlerCont.h"
+
 #include "UdfHandler.h"
 
 namespace NArchive {
@@ -318,6 +320,34 @@ Z7_COM7F_IMF(CHandler::GetStream(UInt32 index, ISequentialInStream **stream))
   return S_OK;
 }
 
+// it returns the offset of first extent of file, or 0, if file has no data in extents
+
+UInt64 CHandler::GetPhyPos(UInt32 index) const
+{
+  const CRef2 &ref2 = _refs2[index];
+  const CLogVol &vol = _archive.LogVols[ref2.Vol];
+  const CRef &ref = vol.FileSets[ref2.Fs].Refs[ref2.Ref];
+  const CFile &file = _archive.Files[ref.FileIndex];
+  const CItem &item = _archive.Items[file.ItemIndex];
+  if (item.IsDir() || item.IsInline)
+    return 0;
+  FOR_VECTOR (extentIndex, item.Extents)
+  {
+    const CMyExtent &extent = item.Extents[extentIndex];
+    if (extent.GetLen() == 0)
+      continue;
+    if (extent.PartitionRef >= vol.PartitionMaps.Size())
+      return 0;
+    const unsigned partitionIndex = vol.PartitionMaps[extent.PartitionRef].PartitionIndex;
+    if (partitionIndex >= _archive.Partitions.Size())
+      return 0;
+    const CPartition &partition = _archive.Partitions[partitionIndex];
+    return ((UInt64)partition.Pos << _archive.SecLogSize) +
+        (UInt64)extent.Pos * vol.BlockSize;
+  }
+  return 0;
+}
+
 Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     Int32 testMode, IArchiveExtractCallback *extractCallback))
 {
@@ -330,6 +360,9 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   UInt64 totalSize = 0;
   UInt32 i;
 
+  CPhyOrder order(_inStream);
+  order.Reserve(numItems);
+
   for (i = 0; i < numItems; i++)
   {
     UInt32 index = (allFilesMode ? i : indices[i]);
@@ -339,9 +372,13 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     const CItem &item = _archive.Items[file.ItemIndex];
     if (!item.IsDir())
       totalSize += item.Size;
+    order.Add(index, GetPhyPos(index));
   }
   extractCallback->SetTotal(totalSize);
 
+  RINOK(order.Sort(extractCallback))
+  RINOK(order.SetReadCache())
+
   UInt64 currentTotalSize = 0;
   
   NCompress::CCopyCoder *copyCoderSpec = new NCompress::CCopyCoder();
@@ -362,7 +399,7 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     const Int32 askMode = testMode ?
         NExtract::NAskMode::kTest :
         NExtract::NAskMode::kExtract;
-    const UInt32 index = allFilesMode ? i : indices[i];
+    const UInt32 index = order.GetIndex(i);
     
     RINOK(extractCallback->GetStream(index, &realOutStream, askMode))
 
@@ -25,6 +25,8 @@ Z7_CLASS_IMP_CHandler_IInArchive_1(
   CRecordVector<CRef2> _refs2;
   CMyComPtr<IInStream> _inStream;
   CInArchive _archive;
+
+  UInt64 GetPhyPos(UInt32 index) const;
 };
 
 }}
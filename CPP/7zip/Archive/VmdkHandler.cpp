@@ -420,6 +420,64 @@ struct CExtent
 };
   
 
+class CUnpacker Z7_final: public CClusterUnpacker
+{
+  CBufInStream *_bufInStreamSpec;
+  CMyComPtr<ISequentialInStream> _bufInStream;
+
+  CBufPtrSeqOutStream *_bufOutStreamSpec;
+  CMyComPtr<ISequentialOutStream> _bufOutStream;
+
+  NCompress::NZlib::CDecoder *_zlibDecoderSpec;
+  CMyComPtr<ICompressCoder> _zlibDecoder;
+public:
+  CUnpacker()
+  {
+    _bufInStreamSpec = new CBufInStream;
+    _bufInStream = _bufInStreamSpec;
+    _bufOutStreamSpec = new CBufPtrSeqOutStream();
+    _bufOutStream = _bufOutStreamSpec;
+    _zlibDecoderSpec = new NCompress::NZlib::CDecoder;
+    _zlibDecoder = _zlibDecoderSpec;
+  }
+  HRESULT Unpack(const Byte *src, size_t srcSize, Byte *dest, size_t destSize) Z7_override;
+};
+
+// (src) contains the grain marker: 8 bytes LBA, 4 bytes (dataSize), and compressed data
+
+HRESULT CUnpacker::Unpack(const Byte *src, size_t srcSize, Byte *dest, size_t destSize)
+{
+  if (srcSize < 12)
+    return S_FALSE;
+  const UInt32 dataSize = Get32(src + 8);
+  if (dataSize > srcSize - 12)
+    return S_FALSE;
+  _bufInStreamSpec->Init(src + 12, dataSize);
+  _bufOutStreamSpec->Init(dest, destSize);
+  // Do we need to use smaller block than clusterSize for last cluster?
+  const UInt64 blockSize64 = destSize;
+  HRESULT res = _zlibDecoder->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
+  if (_bufOutStreamSpec->GetPos() != destSize
+      || _zlibDecoderSpec->GetInputProcessedSize() != dataSize)
+  {
+    if (res == S_OK)
+      res = S_FALSE;
+  }
+  return res;
+}
+
+
+class CHandler;
+
+class CCache Z7_final: public CClusterCache
+{
+  HRESULT ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize) Z7_override;
+  CClusterUnpacker *CreateUnpacker() Z7_override { return new CUnpacker; }
+public:
+  CHandler *Handler;
+};
+
+
 Z7_class_CHandler_final: public CHandlerImg
 {
   bool _isArc;
@@ -430,25 +488,13 @@ Z7_class_CHandler_final: public CHandlerImg
   bool _isMultiVol;
   bool _needDeflate;
 
-  UInt64 _cacheCluster;
-  unsigned _cacheExtent;
-  CByteBuffer _cache;
-  CByteBuffer _cacheCompressed;
+  CCache _cache;
   
   unsigned _clusterBitsMax;
   UInt64 _phySize;
 
   CObjectVector<CExtent> _extents;
 
-  CBufInStream *_bufInStreamSpec;
-  CMyComPtr<ISequentialInStream> _bufInStream;
-
-  CBufPtrSeqOutStream *_bufOutStreamSpec;
-  CMyComPtr<ISequentialOutStream> _bufOutStream;
-
-  NCompress::NZlib::CDecoder *_zlibDecoderSpec;
-  CMyComPtr<ICompressCoder> _zlibDecoder;
-
   CByteBuffer _descriptorBuf;
   CDescriptor _descriptor;
 
@@ -461,14 +507,120 @@ Z7_class_CHandler_final: public CHandlerImg
 
   virtual HRESULT Open2(IInStream *stream, IArchiveOpenCallback *openCallback) Z7_override;
   virtual void CloseAtError() Z7_override;
+  unsigned FindExtent(UInt64 pos) const;
 public:
   Z7_IFACE_COM7_IMP(IInArchive_Img)
 
   Z7_IFACE_COM7_IMP(IInArchiveGetStream)
   Z7_IFACE_COM7_IMP(ISequentialInStream)
+
+  CHandler() { _cache.Handler = this; }
+  HRESULT ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize);
 };
 
 
+HRESULT CCache::ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize)
+{
+  return Handler->ReadPacked(pos, packBuf, packSize, unpackSize);
+}
+
+
+unsigned CHandler::FindExtent(UInt64 pos) const
+{
+  unsigned left = 0, right = _extents.Size();
+  for (;;)
+  {
+    unsigned mid = (left + right) / 2;
+    if (mid == left)
+      return left;
+    if (pos < _extents[mid].StartOffset)
+      right = mid;
+    else
+      left = mid;
+  }
+}
+
+
+HRESULT CHandler::ReadPacked(UInt64 pos, CByteBuffer &packBuf, size_t &packSize, size_t &unpackSize)
+{
+  packSize = 0;
+  unpackSize = 0;
+  if (pos >= _size)
+    return S_OK;
+  
+  CExtent &extent = _extents[FindExtent(pos)];
+  const UInt64 vir = pos - extent.StartOffset;
+  if (vir >= extent.NumBytes || vir >= extent.VirtSize)
+    return S_OK;
+  const unsigned clusterBits = extent.ClusterBits;
+  const UInt64 cluster = vir >> clusterBits;
+  const size_t clusterSize = (size_t)1 << clusterBits;
+  const size_t lowBits = (size_t)vir & (clusterSize - 1);
+  unpackSize = clusterSize - lowBits;
+  if (lowBits != 0
+      || extent.IsZero || !extent.IsOK || !extent.Stream || extent.Unsupported
+      || extent.IsFlat || !extent.NeedDeflate)
+    return S_OK;
+
+  const UInt64 high = cluster >> k_NumMidBits;
+  if (high >= extent.Tables.Size())
+    return S_OK;
+  const CByteBuffer &table = extent.Tables[(unsigned)high];
+  if (table.Size() == 0)
+    return S_OK;
+  const size_t midBits = (size_t)cluster & ((1 << k_NumMidBits) - 1);
+  const UInt32 v = Get32((const Byte *)table + (midBits << 2));
+  if (v == 0 || v == extent.ZeroSector)
+    return S_OK;
+  
+  const UInt64 offset = (UInt64)v << 9;
+  if (offset != extent.PosInArc)
+  {
+    // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
+    RINOK(extent.Seek(offset))
+  }
+  
+  const size_t packSizeMax = (size_t)2 << _clusterBitsMax;
+  packBuf.AllocAtLeast(packSizeMax);
+
+  const size_t kStartSize = 1 << 9;
+  {
+    size_t curSize = kStartSize;
+    RINOK(extent.Read(packBuf, &curSize))
+    // _stream_PackSize += curSize;
+    if (curSize != kStartSize)
+      return S_FALSE;
+  }
+
+  if (Get64(packBuf) != (cluster << (clusterBits - 9)))
+    return S_FALSE;
+
+  const UInt32 dataSize = Get32(packBuf + 8);
+  if (dataSize > ((UInt32)1 << 31))
+    return S_FALSE;
+
+  size_t dataSize2 = (size_t)dataSize + 12;
+  
+  if (dataSize2 > kStartSize)
+  {
+    dataSize2 = (dataSize2 + 511) & ~(size_t)511;
+    if (dataSize2 > packSizeMax)
+      return S_FALSE;
+    size_t curSize = dataSize2 - kStartSize;
+    const size_t curSize2 = curSize;
+    RINOK(extent.Read(packBuf + kStartSize, &curSize))
+    // _stream_PackSize += curSize;
+    if (curSize != curSize2)
+      return S_FALSE;
+  }
+  else
+    dataSize2 = kStartSize;
+
+  packSize = dataSize2;
+  return S_OK;
+}
+
+
 Z7_COM7F_IMF(CHandler::Read(void *data, UInt32 size, UInt32 *processedSize))
 {
   if (processedSize)
@@ -483,23 +635,7 @@ Z7_COM7F_IMF(CHandler::Read(void *data, UInt32 size, UInt32 *processedSize))
       return S_OK;
   }
 
-  unsigned extentIndex;
-  {
-    unsigned left = 0, right = _extents.Size();
-    for (;;)
-    {
-      unsigned mid = (left + right) / 2;
-      if (mid == left)
-        break;
-      if (_virtPos < _extents[mid].StartOffset)
-        right = mid;
-      else
-        left = mid;
-    }
-    extentIndex = left;
-  }
-  
-  CExtent &extent = _extents[extentIndex];
+  CExtent &extent = _extents[FindExtent(_virtPos)];
 
   {
     const UInt64 vir = _virtPos - extent.StartOffset;
@@ -592,7 +728,6 @@ Z7_COM7F_IMF(CHandler::Read(void *data, UInt32 size, UInt32 *processedSize))
   }
 
   
-  for (;;)
   {
     const UInt64 vir = _virtPos - extent.StartOffset;
     const unsigned clusterBits = extent.ClusterBits;
@@ -605,15 +740,6 @@ Z7_COM7F_IMF(CHandler::Read(void *data, UInt32 size, UInt32 *processedSize))
         size = (UInt32)rem;
     }
 
-    if (extentIndex == _cacheExtent && cluster == _cacheCluster)
-    {
-      memcpy(data, _cache + lowBits, size);
-      _virtPos += size;
-      if (processedSize)
-        *processedSize = size;
-      return S_OK;
-    }
-    
     const UInt64 high = cluster >> k_NumMidBits;
  
     if (high < extent.Tables.Size())
@@ -628,91 +754,24 @@ Z7_COM7F_IMF(CHandler::Read(void *data, UInt32 size, UInt32 *processedSize))
         
         if (v != 0 && v != extent.ZeroSector)
         {
-          UInt64 offset = (UInt64)v << 9;
           if (extent.NeedDeflate)
           {
-            if (offset != extent.PosInArc)
-            {
-              // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
-              RINOK(extent.Seek(offset))
-            }
-            
-            const size_t kStartSize = 1 << 9;
-            {
-              size_t curSize = kStartSize;
-              RINOK(extent.Read(_cacheCompressed, &curSize))
-              // _stream_PackSize += curSize;
-              if (curSize != kStartSize)
-                return S_FALSE;
-            }
-
-            if (Get64(_cacheCompressed) != (cluster << (clusterBits - 9)))
-              return S_FALSE;
-
-            UInt32 dataSize = Get32(_cacheCompressed + 8);
-            if (dataSize > ((UInt32)1 << 31))
-              return S_FALSE;
-
-            size_t dataSize2 = (size_t)dataSize + 12;
-            
-            if (dataSize2 > kStartSize)
-            {
-              dataSize2 = (dataSize2 + 511) & ~(size_t)511;
-              if (dataSize2 > _cacheCompressed.Size())
-                return S_FALSE;
-              size_t curSize = dataSize2 - kStartSize;
-              const size_t curSize2 = curSize;
-              RINOK(extent.Read(_cacheCompressed + kStartSize, &curSize))
-              // _stream_PackSize += curSize;
-              if (curSize != curSize2)
-                return S_FALSE;
-            }
-
-            _bufInStreamSpec->Init(_cacheCompressed + 12, dataSize);
-            
-            _cacheCluster = (UInt64)(Int64)-1;
-            _cacheExtent = (unsigned)(int)-1;
-
-            if (_cache.Size() < clusterSize)
-              return E_FAIL;
-            _bufOutStreamSpec->Init(_cache, clusterSize);
-            
-            // Do we need to use smaller block than clusterSize for last cluster?
-            const UInt64 blockSize64 = clusterSize;
-            HRESULT res = _zlibDecoder->Code(_bufInStream, _bufOutStream, NULL, &blockSize64, NULL);
-
-            /*
-            if (_bufOutStreamSpec->GetPos() != clusterSize)
-            {
+            const Byte *cache;
+            size_t cacheSize;
+            const HRESULT res = _cache.Get(_virtPos - lowBits, cache, cacheSize);
+            if (res == S_FALSE)
               _stream_dataError = true;
-              memset(_cache + _bufOutStreamSpec->GetPos(), 0, clusterSize - _bufOutStreamSpec->GetPos());
-            }
-            */
-
-              if (_bufOutStreamSpec->GetPos() != clusterSize
-                  || _zlibDecoderSpec->GetInputProcessedSize() != dataSize)
-              {
-                _stream_dataError = true;
-                if (res == S_OK)
-                  res = S_FALSE;
-              }
-
             RINOK(res)
-            
-            _cacheCluster = cluster;
-            _cacheExtent = extentIndex;
-            
-            continue;
-            /*
-            memcpy(data, _cache + lowBits, size);
+            if (cacheSize != clusterSize)
+              return E_FAIL;
+            memcpy(data, cache + lowBits, size);
             _virtPos += size;
             if (processedSize)
               *processedSize = size;
             return S_OK;
-            */
           }
           {
-            offset += lowBits;
+            const UInt64 offset = ((UInt64)v << 9) + lowBits;
             if (offset != extent.PosInArc)
             {
               // printf("\n%12x %12x\n", (unsigned)offset, (unsigned)(offset - extent.PosInArc));
@@ -1441,8 +1500,7 @@ Z7_COM7F_IMF(CHandler::Close())
 {
   _phySize = 0;
   
-  _cacheCluster = (UInt64)(Int64)-1;
-  _cacheExtent = (unsigned)(int)-1;
+  _cache.Clear();
 
   _clusterBitsMax = 0;
 
@@ -1481,27 +1539,7 @@ Z7_COM7F_IMF(CHandler::GetStream(UInt32 /* index */, ISequentialInStream **strea
 
   if (_needDeflate)
   {
-    if (!_bufInStream)
-    {
-      _bufInStreamSpec = new CBufInStream;
-      _bufInStream = _bufInStreamSpec;
-    }
-    
-    if (!_bufOutStream)
-    {
-      _bufOutStreamSpec = new CBufPtrSeqOutStream();
-      _bufOutStream = _bufOutStreamSpec;
-    }
-
-    if (!_zlibDecoder)
-    {
-      _zlibDecoderSpec = new NCompress::NZlib::CDecoder;
-      _zlibDecoder = _zlibDecoderSpec;
-    }
-    
-    const size_t clusterSize = (size_t)1 << _clusterBitsMax;
-    _cache.AllocAtLeast(clusterSize);
-    _cacheCompressed.AllocAtLeast(clusterSize * 2);
+    RINOK(_cache.Create((size_t)1 << _clusterBitsMax, _props._numThreads, _props._memUsage_Decompress))
   }
 
   FOR_VECTOR (i, _extents)
@@ -1061,6 +1061,10 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   int prevSuccessStreamIndex = -1;
 
   CUnpacker unpacker;
+  #ifndef Z7_ST
+  unpacker.NumThreads = _commonProps._numThreads;
+  #endif
+  unpacker.MemUsage = _commonProps._memUsage_Decompress;
 
   CLocalProgress *lps = new CLocalProgress;
   CMyComPtr<ICompressProgressInfo> progress = lps;
@@ -1196,8 +1200,24 @@ Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
     if (name[0] == L'x')
     {
       // some clients write 'x' property. So we support it
-      UInt32 level = 0;
+      // it's used as level of chunk compression method
+      UInt32 level = 9;
       RINOK(ParsePropToUInt32(name.Ptr(1), prop, level))
+      _level = level;
+    }
+    else if (name.IsEqualTo("m"))
+    {
+      if (prop.vt != VT_BSTR)
+        return E_INVALIDARG;
+      const UString s = prop.bstrVal;
+      if (s.IsEqualTo_Ascii_NoCase("lzx"))
+        _method = NMethod::kLZX;
+      else if (s.IsEqualTo_Ascii_NoCase("xpress"))
+        _method = NMethod::kXPRESS;
+      else if (s.IsEqualTo_Ascii_NoCase("copy"))
+        _method = 0;
+      else
+        return E_INVALIDARG;
     }
     else if (name.IsEqualTo("is"))
     {
@@ -1210,11 +1230,12 @@ Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
       RINOK(ParsePropToUInt32(L"", prop, image))
       _defaultImageNumber = (int)image;
     }
-    else if (name.IsPrefixedBy_Ascii_NoCase("mt"))
-    {
-    }
-    else if (name.IsPrefixedBy_Ascii_NoCase("memuse"))
+    else if (name.IsPrefixedBy_Ascii_NoCase("mt")
+        || name.IsPrefixedBy_Ascii_NoCase("memuse"))
     {
+      HRESULT hres;
+      _commonProps.SetCommonProperty(name, prop, hres);
+      RINOK(hres)
     }
     else
     {
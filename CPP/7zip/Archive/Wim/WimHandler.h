@@ -51,12 +51,19 @@ Z7_CLASS_IMP_CHandler_IInArchive_5(
 
   CHandlerTimeOptions _timeOptions;
 
+  unsigned _method; // NMethod::kXPRESS or NMethod::kLZX for new streams, 0 : no compression
+  UInt32 _level;
+  CCommonMethodProps _commonProps; // "mt" for chunk encoders
+
   void InitDefaults()
   {
     _set_use_ShowImageNumber = false;
     _set_showImageNumber = false;
     _defaultImageNumber = -1;
     _timeOptions.Init();
+    _method = 0;
+    _level = 5;
+    _commonProps = CCommonMethodProps();
   }
 
   bool IsUpdateSupported() const
@@ -2,6 +2,10 @@
 
 #include "StdAfx.h"
 
+#ifndef Z7_ST
+#include "../../../../C/MtCoder.h"
+#endif
+
 #include "../../../Common/ComTry.h"
 #include "../../../Common/IntToString.h"
 #include "../../../Common/MyBuffer2.h"
@@ -12,11 +16,15 @@
 #include "../../../Windows/PropVariant.h"
 #include "../../../Windows/TimeUtils.h"
 
+#include "../../Common/CWrappers.h"
 #include "../../Common/LimitedStreams.h"
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/StreamUtils.h"
 #include "../../Common/UniqBlocks.h"
 
+#include "../../Compress/LzxEncoder.h"
+#include "../../Compress/XpressEncoder.h"
+
 #include "../../Crypto/RandGen.h"
 #include "../../Crypto/Sha1Cls.h"
 
@@ -691,17 +699,24 @@ static void AddTag_String_IfEmpty(CXmlItem &parentItem, const char *name, const
 }
 
 
-void CHeader::SetDefaultFields(bool useLZX)
+void CHeader::SetMethod(unsigned method)
 {
-  Version = k_Version_NonSolid;
-  Flags = NHeaderFlags::kReparsePointFixup;
+  Flags &= ~(NHeaderFlags::kCompression | NHeaderFlags::kMethodMask);
   ChunkSize = 0;
-  if (useLZX)
+  if (method != 0)
   {
-    Flags |= NHeaderFlags::kCompression | NHeaderFlags::kLZX;
+    Flags |= NHeaderFlags::kCompression |
+        (method == NMethod::kLZX ? NHeaderFlags::kLZX : NHeaderFlags::kXPRESS);
     ChunkSize = kChunkSize;
     ChunkSizeBits = kChunkSizeBits;
   }
+}
+
+void CHeader::SetDefaultFields(unsigned method)
+{
+  Version = k_Version_NonSolid;
+  Flags = NHeaderFlags::kReparsePointFixup;
+  SetMethod(method);
   MY_RAND_GEN(Guid, 16);
   PartNumber = 1;
   NumParts = 1;
@@ -714,6 +729,273 @@ void CHeader::SetDefaultFields(bool useLZX)
 }
 
 
+/*
+  CResourceEncoder writes new data stream as compressed resource:
+  the table of chunk offsets and then the chunks.
+  WIM chunks are independent, so we compress the blocks of chunks
+  in parallel threads with MtCoder.
+*/
+
+static const unsigned kNumChunksInBlock_Log = 5;
+static const unsigned kNumChunksInBlock = 1 << kNumChunksInBlock_Log;
+static const size_t kEncBlockSize = (size_t)kChunkSize << kNumChunksInBlock_Log;
+
+struct CChunkEncoder
+{
+  NCompress::NLzx::CEncoder Lzx;
+  NCompress::NXpress::CEncoder Xpress;
+  CMidBuffer PackBuf;
+};
+
+struct CEncBlock
+{
+  CMidBuffer Data;
+  size_t Size;
+  unsigned NumChunks;
+  UInt32 ChunkSizes[kNumChunksInBlock];
+};
+
+class CResourceEncoder
+{
+  Z7_CLASS_NO_COPY(CResourceEncoder)
+
+  CObjectVector<CChunkEncoder> _encoders;
+  CObjectVector<CEncBlock> _blocks;
+  CRecordVector<UInt32> _chunkSizes;
+  ISequentialOutStream *_outStream;
+  UInt64 _inProcessed;
+  UInt64 _outProcessed;
+  HRESULT _writeRes;
+ #ifndef Z7_ST
+  CMtCoder _mtCoder;
+  bool _mtCoderWasConstructed;
+ #endif
+public:
+  unsigned Method;
+  UInt32 Level;
+  UInt32 NumThreads;
+
+  CResourceEncoder(): Method(0), Level(5), NumThreads(1)
+  {
+   #ifndef Z7_ST
+    _mtCoderWasConstructed = false;
+   #endif
+  }
+  ~CResourceEncoder()
+  {
+   #ifndef Z7_ST
+    if (_mtCoderWasConstructed)
+      MtCoder_Destruct(&_mtCoder);
+   #endif
+  }
+
+  HRESULT EncodeBlock(unsigned coderIndex, unsigned blockIndex, const Byte *data, size_t size);
+  HRESULT WriteBlock(unsigned blockIndex);
+  size_t GetBlockPackSize(unsigned blockIndex) const { return _blocks[blockIndex].Size; }
+ #ifndef Z7_ST
+  SRes ProgressAdd(UInt64 inSize, UInt64 outSize)
+    { return MtProgress_ProgressAdd(&_mtCoder.mtProgress, inSize, outSize); }
+ #endif
+
+  HRESULT Encode(ISequentialInStream *inStream, UInt64 unpackSize,
+      IOutStream *outStream, ICompressProgressInfo *progress, UInt64 &packSize);
+};
+
+
+HRESULT CResourceEncoder::EncodeBlock(unsigned coderIndex, unsigned blockIndex, const Byte *data, size_t size)
+{
+  CChunkEncoder &enc = _encoders[coderIndex];
+  CEncBlock &block = _blocks[blockIndex];
+  block.Size = 0;
+  block.NumChunks = 0;
+  block.Data.AllocAtLeast(kEncBlockSize);
+  if (!block.Data.IsAllocated())
+    return E_OUTOFMEMORY;
+  const size_t packBufSize = NCompress::NLzx::CEncoder::GetPackBufSize(kChunkSize);
+  enc.PackBuf.AllocAtLeast(packBufSize);
+  if (!enc.PackBuf.IsAllocated())
+    return E_OUTOFMEMORY;
+
+  while (size != 0)
+  {
+    const size_t cur = MyMin(size, (size_t)kChunkSize);
+    size_t packSize;
+    if (Method == NMethod::kLZX)
+    {
+      enc.Lzx.SetLevel(Level);
+      RINOK(enc.Lzx.Encode(data, cur, enc.PackBuf, packSize))
+    }
+    else
+    {
+      enc.Xpress.SetLevel(Level);
+      RINOK(enc.Xpress.Encode(data, cur, enc.PackBuf, packSize))
+    }
+    // if (packSize == cur), the reader supposes that chunk is not compressed
+    const Byte *src = enc.PackBuf;
+    if (packSize >= cur)
+    {
+      src = data;
+      packSize = cur;
+    }
+    memcpy(block.Data + block.Size, src, packSize);
+    block.Size += packSize;
+    block.ChunkSizes[block.NumChunks++] = (UInt32)packSize;
+    data += cur;
+    size -= cur;
+  }
+  return S_OK;
+}
+
+
+HRESULT CResourceEncoder::WriteBlock(unsigned blockIndex)
+{
+  const CEncBlock &block = _blocks[blockIndex];
+  for (unsigned i = 0; i < block.NumChunks; i++)
+    _chunkSizes.Add(block.ChunkSizes[i]);
+  _outProcessed += block.Size;
+  return WriteStream(_outStream, block.Data, block.Size);
+}
+
+
+#ifndef Z7_ST
+
+static SRes ResourceEncoder_MtCallback_Code(void *pp, unsigned coderIndex, unsigned outBufIndex,
+    const Byte *src, size_t srcSize, int finished)
+{
+  CResourceEncoder *me = (CResourceEncoder *)pp;
+  UNUSED_VAR(finished)
+  const HRESULT res = me->EncodeBlock(coderIndex, outBufIndex, src, srcSize);
+  if (res != S_OK)
+    return HRESULT_To_SRes(res, SZ_ERROR_FAIL);
+  return me->ProgressAdd(srcSize, me->GetBlockPackSize(outBufIndex));
+}
+
+static SRes ResourceEncoder_MtCallback_Write(void *pp, unsigned outBufIndex)
+{
+  CResourceEncoder *me = (CResourceEncoder *)pp;
+  return HRESULT_To_SRes(me->WriteBlock(outBufIndex), SZ_ERROR_WRITE);
+}
+
+#endif
+
+
+HRESULT CResourceEncoder::Encode(ISequentialInStream *inStream, UInt64 unpackSize,
+    IOutStream *outStream, ICompressProgressInfo *progress, UInt64 &packSize)
+{
+  packSize = 0;
+  _outStream = outStream;
+  _inProcessed = 0;
+  _outProcessed = 0;
+  _chunkSizes.Clear();
+
+  const UInt64 numChunks = (unpackSize + kChunkSize - 1) >> kChunkSizeBits;
+  if (numChunks == 0)
+    return E_INVALIDARG;
+  const unsigned entrySizeShifts = (unpackSize < ((UInt64)1 << 32) ? 2 : 3);
+  const size_t tableSize = (size_t)((numChunks - 1) << entrySizeShifts);
+  if (tableSize != ((numChunks - 1) << entrySizeShifts))
+    return E_OUTOFMEMORY;
+
+  UInt64 startPos;
+  RINOK(outStream->Seek(0, STREAM_SEEK_CUR, &startPos))
+  CByteBuffer table(tableSize);
+  memset(table, 0, tableSize);
+  RINOK(WriteStream(outStream, table, tableSize))
+
+  UInt32 numThreads = NumThreads;
+  if (numThreads > MTCODER_THREADS_MAX)
+    numThreads = MTCODER_THREADS_MAX;
+  if (numThreads > 1 && unpackSize <= kEncBlockSize)
+    numThreads = 1;
+
+  while (_encoders.Size() < MyMax(numThreads, (UInt32)1))
+    _encoders.AddNew();
+  const unsigned numBlocks = (numThreads > 1 ? MTCODER_BLOCKS_MAX : 1);
+  while (_blocks.Size() < numBlocks)
+    _blocks.AddNew();
+
+ #ifndef Z7_ST
+  if (numThreads > 1)
+  {
+    if (!_mtCoderWasConstructed)
+    {
+      MtCoder_Construct(&_mtCoder);
+      _mtCoderWasConstructed = true;
+    }
+    CSeqInStreamWrap inWrap;
+    CCompressProgressWrap progressWrap;
+    inWrap.Init(inStream);
+    progressWrap.Init(progress);
+
+    IMtCoderCallback2 vt;
+    vt.Code = ResourceEncoder_MtCallback_Code;
+    vt.Write = ResourceEncoder_MtCallback_Write;
+
+    _mtCoder.allocBig = &g_BigAlloc;
+    _mtCoder.progress = progress ? &progressWrap.vt : NULL;
+    _mtCoder.inStream = &inWrap.vt;
+    _mtCoder.inData = NULL;
+    _mtCoder.inDataSize = 0;
+    _mtCoder.mtCallback = &vt;
+    _mtCoder.mtCallbackObject = this;
+    _mtCoder.blockSize = kEncBlockSize;
+    _mtCoder.numThreadsMax = (unsigned)numThreads;
+    _mtCoder.expectedDataSize = unpackSize;
+
+    const SRes res = MtCoder_Code(&_mtCoder);
+    if (inWrap.Res != S_OK)
+      return inWrap.Res;
+    if (progressWrap.Res != S_OK)
+      return progressWrap.Res;
+    RINOK(SResToHRESULT(res))
+    _inProcessed = inWrap.Processed;
+  }
+  else
+ #endif
+  {
+    CMidBuffer inBuf;
+    inBuf.Alloc(kEncBlockSize);
+    if (!inBuf.IsAllocated())
+      return E_OUTOFMEMORY;
+    for (;;)
+    {
+      size_t size = kEncBlockSize;
+      RINOK(ReadStream(inStream, inBuf, &size))
+      if (size == 0)
+        break;
+      RINOK(EncodeBlock(0, 0, inBuf, size))
+      RINOK(WriteBlock(0))
+      _inProcessed += size;
+      if (progress)
+      {
+        RINOK(progress->SetRatioInfo(&_inProcessed, &_outProcessed))
+      }
+      if (size != kEncBlockSize)
+        break;
+    }
+  }
+
+  // the size of stream must be same as in table size calculation
+  if (_inProcessed != unpackSize || _chunkSizes.Size() != numChunks)
+    return E_FAIL;
+
+  UInt64 offset = 0;
+  for (unsigned i = 0; i + 1 < _chunkSizes.Size(); i++)
+  {
+    offset += _chunkSizes[i];
+    if (entrySizeShifts == 2)
+      SetUi32(table + ((size_t)i << 2), (UInt32)offset)
+    else
+      SetUi64(table + ((size_t)i << 3), offset)
+  }
+
+  RINOK(outStream->Seek((Int64)startPos, STREAM_SEEK_SET, NULL))
+  RINOK(WriteStream(outStream, table, tableSize))
+  packSize = tableSize + _outProcessed;
+  return outStream->Seek((Int64)(startPos + packSize), STREAM_SEEK_SET, NULL);
+}
+
+
 static void AddTrees(CObjectVector<CDir> &trees, CObjectVector<CMetaItem> &metaItems, const CMetaItem &ri, int curTreeIndex)
 {
   while (curTreeIndex >= (int)trees.Size())
@@ -1391,11 +1673,12 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
 
   complexity = 0;
 
-  // bool useResourceCompression = false;
-  // use useResourceCompression only if CHeader::Flags compression is also set
+  // new data streams are compressed, if (method != 0).
+  // metadata, xml and lookup table resources are stored without compression.
+  unsigned method = (_level == 0 ? 0 : _method);
 
   CHeader header;
-  header.SetDefaultFields(false);
+  header.SetDefaultFields(method);
 
   if (isUpdate)
   {
@@ -1404,8 +1687,23 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
     header.Version = srcHeader.Version;
     header.ChunkSize = srcHeader.ChunkSize;
     header.ChunkSizeBits = srcHeader.ChunkSizeBits;
+    if (srcHeader.IsCompressed())
+    {
+      // all compressed resources in archive use the method from header
+      method = srcHeader.GetMethod();
+      if ((method != NMethod::kLZX && method != NMethod::kXPRESS)
+          || srcHeader.ChunkSizeBits != kChunkSizeBits)
+        method = 0;
+    }
+    else if (method != 0)
+      header.SetMethod(method);
   }
 
+  CResourceEncoder resourceEncoder;
+  resourceEncoder.Method = method;
+  resourceEncoder.Level = _level;
+  resourceEncoder.NumThreads = _commonProps._numThreads;
+
   CMyComPtr<IStreamSetRestriction> setRestriction;
   outSeqStream->QueryInterface(IID_IStreamSetRestriction, (void **)&setRestriction);
   if (setRestriction)
@@ -1691,19 +1989,8 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
         
         fileInStream.Release();
         inShaStreamSpec->Init();
-        UInt64 offsetBlockSize = 0;
-        /*
-        if (useResourceCompression)
-        {
-          for (UInt64 t = kChunkSize; t < size; t += kChunkSize)
-          {
-            Byte buf[8];
-            SetUi32(buf, (UInt32)t);
-            RINOK(WriteStream(outStream, buf, 4));
-            offsetBlockSize += 4;
-          }
-        }
-        */
+        UInt64 packSize = 0;
+        Byte resourceFlags = 0;
 
         // 22.02: we use additional read-only pass to calculate SHA-1
         bool needWritePass = true;
@@ -1736,8 +2023,23 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
         
         if (needWritePass)
         {
-          RINOK(copyCoder->Code(inShaStream, outStream, NULL, NULL, progress))
-          size = copyCoderSpec->TotalSize;
+          if (method != 0 && inSeekStream)
+          {
+            // (size) is known after SHA-1 pass, so we can reserve the table of chunks.
+            // The table is written after the chunks, so we must not flush that region.
+            if (setRestriction)
+              RINOK(setRestriction->SetRestriction(0, (UInt64)(Int64)-1))
+            RINOK(resourceEncoder.Encode(inShaStream, size, outStream, progress, packSize))
+            if (setRestriction)
+              RINOK(setRestriction->SetRestriction(0, kHeaderSizeMax))
+            resourceFlags = NResourceFlags::kCompressed;
+          }
+          else
+          {
+            RINOK(copyCoder->Code(inShaStream, outStream, NULL, NULL, progress))
+            size = copyCoderSpec->TotalSize;
+            packSize = size;
+          }
         }
        
         if (size != 0)
@@ -1745,7 +2047,6 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
           if (needWritePass)
           {
             Byte hash[kHashSize];
-            const UInt64 packSize = offsetBlockSize + size;
             inShaStreamSpec->Final(hash);
             
             index = AddUniqHash(&streams.Front(), sortedHashes, hash, (int)streams.Size());
@@ -1763,11 +2064,7 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outSeqStream, UInt32 nu
               s.Resource.PackSize = packSize;
               s.Resource.Offset = curPos;
               s.Resource.UnpackSize = size;
-              s.Resource.Flags = 0;
-              /*
-              if (useResourceCompression)
-              s.Resource.Flags = NResourceFlags::Compressed;
-              */
+              s.Resource.Flags = resourceFlags;
               s.PartNumber = 1;
               s.RefCount = 1;
               memcpy(s.Hash, hash, kHashSize);
@@ -43,19 +43,58 @@ static int inline GetLog(UInt32 num)
 }
 
 
-CUnpacker::~CUnpacker()
+HRESULT CChunkLocator::GetChunk(size_t index, UInt64 &offset, size_t &packSize, size_t &unpackSize) const
+{
+  UInt64 packSize64;
+  if (Solid)
+  {
+    offset = Solid->Chunks[index];
+    packSize64 = Solid->GetChunkPackSize(index);
+  }
+  else
+  {
+    offset = 0;
+    if (index != 0)
+    {
+      const Byte *p = Offsets + ((index - 1) << EntrySizeShifts);
+      offset = (EntrySizeShifts == 2) ? Get32(p): Get64(p);
+    }
+    UInt64 nextOffset = PackDataSize;
+    if (index + 1 < NumChunks)
+    {
+      const Byte *p = Offsets + (index << EntrySizeShifts);
+      nextOffset = (EntrySizeShifts == 2) ? Get32(p): Get64(p);
+    }
+    if (nextOffset < offset)
+      return S_FALSE;
+    packSize64 = nextOffset - offset;
+  }
+  packSize = (size_t)packSize64;
+  if (packSize != packSize64)
+    return S_FALSE;
+  unpackSize = (size_t)1 << ChunkSizeBits;
+  const UInt64 rem = UnpackSize - ((UInt64)index << ChunkSizeBits);
+  if (unpackSize > rem)
+    unpackSize = (size_t)rem;
+  return S_OK;
+}
+
+
+CChunkDecoder::~CChunkDecoder()
 {
   if (lzmsDecoder)
     delete lzmsDecoder;
 }
 
 
-HRESULT CUnpacker::UnpackChunk(
-    ISequentialInStream *inStream,
+HRESULT CChunkDecoder::Read(ISequentialInStream *inStream,
     unsigned method, unsigned chunkSizeBits,
-    size_t inSize, size_t outSize,
-    ISequentialOutStream *outStream)
+    size_t inSize, size_t outSize, UInt64 &totalPacked)
 {
+  Res = S_FALSE;
+  _needDecode = false;
+  OutSize = outSize;
+
   if (inSize == outSize)
   {
   }
@@ -84,14 +123,17 @@ HRESULT CUnpacker::UnpackChunk(
   if (!unpackBuf.Data)
     return E_OUTOFMEMORY;
   
-  HRESULT res = S_FALSE;
   size_t unpackedSize = 0;
   
   if (inSize == outSize)
   {
     unpackedSize = outSize;
-    res = ReadStream(inStream, unpackBuf.Data, &unpackedSize);
-    TotalPacked += unpackedSize;
+    const HRESULT res = ReadStream(inStream, unpackBuf.Data, &unpackedSize);
+    totalPacked += unpackedSize;
+    if (res != S_OK)
+      return res;
+    if (unpackedSize == outSize)
+      Res = S_OK;
   }
   else if (inSize < chunkSize)
   {
@@ -101,31 +143,57 @@ HRESULT CUnpacker::UnpackChunk(
     
     RINOK(ReadStream_FALSE(inStream, packBuf.Data, inSize))
 
-    TotalPacked += inSize;
+    totalPacked += inSize;
+
+    _method = method;
+    _chunkSizeBits = chunkSizeBits;
+    _inSize = inSize;
+    _needDecode = true;
+    Res = S_OK;
+    return S_OK;
+  }
+  
+  if (unpackedSize < outSize)
+    memset(unpackBuf.Data + unpackedSize, 0, outSize - unpackedSize);
+  return S_OK;
+}
+
+
+void CChunkDecoder::Decode()
+{
+  if (!_needDecode)
+    return;
+  _needDecode = false;
+
+  const size_t outSize = OutSize;
+  HRESULT res;
+  size_t unpackedSize = 0;
     
-    if (method == NMethod::kXPRESS)
-    {
-      res = NCompress::NXpress::Decode(packBuf.Data, inSize, unpackBuf.Data, outSize);
-      if (res == S_OK)
-        unpackedSize = outSize;
-    }
-    else if (method == NMethod::kLZX)
-    {
-      res = lzxDecoderSpec->SetExternalWindow(unpackBuf.Data, chunkSizeBits);
-      if (res != S_OK)
-        return E_NOTIMPL;
-      lzxDecoderSpec->KeepHistoryForNext = false;
-      lzxDecoderSpec->SetKeepHistory(false);
-      res = lzxDecoderSpec->Code(packBuf.Data, inSize, (UInt32)outSize);
-      unpackedSize = lzxDecoderSpec->GetUnpackSize();
-      if (res == S_OK && !lzxDecoderSpec->WasBlockFinished())
-        res = S_FALSE;
-    }
-    else
+  if (_method == NMethod::kXPRESS)
+  {
+    res = NCompress::NXpress::Decode(packBuf.Data, _inSize, unpackBuf.Data, outSize);
+    if (res == S_OK)
+      unpackedSize = outSize;
+  }
+  else if (_method == NMethod::kLZX)
+  {
+    res = lzxDecoderSpec->SetExternalWindow(unpackBuf.Data, _chunkSizeBits);
+    if (res != S_OK)
     {
-      res = lzmsDecoder->Code(packBuf.Data, inSize, unpackBuf.Data, outSize);
-      unpackedSize = lzmsDecoder->GetUnpackSize();
+      Res = E_NOTIMPL;
+      return;
     }
+    lzxDecoderSpec->KeepHistoryForNext = false;
+    lzxDecoderSpec->SetKeepHistory(false);
+    res = lzxDecoderSpec->Code(packBuf.Data, _inSize, (UInt32)outSize);
+    unpackedSize = lzxDecoderSpec->GetUnpackSize();
+    if (res == S_OK && !lzxDecoderSpec->WasBlockFinished())
+      res = S_FALSE;
+  }
+  else
+  {
+    res = lzmsDecoder->Code(packBuf.Data, _inSize, unpackBuf.Data, outSize);
+    unpackedSize = lzmsDecoder->GetUnpackSize();
   }
   
   if (unpackedSize != outSize)
@@ -138,13 +206,87 @@ HRESULT CUnpacker::UnpackChunk(
     else
       memset(unpackBuf.Data + unpackedSize, 0, outSize - unpackedSize);
   }
-  
-  if (outStream)
+
+  Res = res;
+}
+
+
+void CUnpacker::Pipe_Start(int solidIndex, size_t chunkIndex, unsigned chunkSizeBits)
+{
+  Pipe_Stop();
+  unsigned numSlots = 1;
+ #ifndef Z7_ST
+  if (NumThreads > 1)
   {
-    RINOK(WriteStream(outStream, unpackBuf.Data, outSize))
+    // one additional slot keeps the chunk that is being written
+    UInt64 numSlots64 = (UInt64)NumThreads + 1;
+    // each slot contains packBuf and unpackBuf of chunk size
+    const UInt64 numSlotsMax = MemUsage >> (chunkSizeBits + 1);
+    if (numSlots64 > numSlotsMax)
+      numSlots64 = numSlotsMax;
+    if (numSlots64 > 2)
+      numSlots = (unsigned)numSlots64;
   }
-  
-  return res;
+ #else
+  UNUSED_VAR(chunkSizeBits)
+ #endif
+  _slots.Create(numSlots);
+  _pipeSolidIndex = solidIndex;
+  _pipeFirst = chunkIndex;
+  _pipeNext = chunkIndex;
+}
+
+
+void CUnpacker::Pipe_Stop()
+{
+  _slots.WaitAll();
+  _pipeFirstDecoder = NULL;
+  _pipeSolidIndex = -1;
+  _pipeFirst = 0;
+  _pipeNext = 0;
+}
+
+
+// it removes the chunks before (chunkIndex) from pipeline
+
+void CUnpacker::Pipe_Release(size_t chunkIndex)
+{
+  for (; _pipeFirst < chunkIndex; _pipeFirst++)
+  {
+    if (_pipeFirstDecoder)
+      _pipeFirstDecoder = NULL;
+    else
+      _slots.FinishNext();
+  }
+}
+
+
+// it waits for the chunk (_pipeFirst). That chunk is kept in pipeline
+
+const CChunkDecoder &CUnpacker::Pipe_GetFirst()
+{
+  if (!_pipeFirstDecoder)
+    _pipeFirstDecoder = &_slots.FinishNext().Decoder;
+  return *_pipeFirstDecoder;
+}
+
+
+HRESULT CUnpacker::Pipe_Fill(IInStream *inStream, const CChunkLocator &loc)
+{
+  // the slot of finished chunk (_pipeFirst) is not reused, because
+  // the number of chunks in pipeline is limited by the number of slots
+  while (_pipeNext < loc.NumChunks && _pipeNext - _pipeFirst < _slots.NumSlots())
+  {
+    UInt64 offset;
+    size_t packSize, unpackSize;
+    RINOK(loc.GetChunk(_pipeNext, offset, packSize, unpackSize))
+    RINOK(InStream_SeekSet(inStream, loc.BaseOffset + offset))
+    CChunkSlot &slot = _slots.GetFreeSlot();
+    RINOK(slot.Decoder.Read(inStream, loc.Method, loc.ChunkSizeBits, packSize, unpackSize, TotalPacked))
+    RINOK(_slots.StartSlot())
+    _pipeNext++;
+  }
+  return S_OK;
 }
 
 
@@ -182,6 +324,8 @@ HRESULT CUnpacker::Unpack2(
     return res;
   }
   
+  CChunkLocator loc;
+
   if (resource.IsSolid())
   {
     if (!db || resource.SolidIndex < 0)
@@ -212,52 +356,58 @@ HRESULT CUnpacker::Unpack2(
       chunkIndex = (size_t)(offs >> chunkSizeBits);
       offsetInChunk = (size_t)offs & (chunkSize - 1);
     }
+
+    loc.BaseOffset = db->DataStreams[ss.StreamIndex].Resource.Offset + ss.HeadersSize;
+    loc.NumChunks = (size_t)((ss.UnpackSize + (chunkSize - 1)) >> chunkSizeBits);
+    loc.UnpackSize = ss.UnpackSize;
+    loc.ChunkSizeBits = chunkSizeBits;
+    loc.Method = (unsigned)ss.Method;
+    loc.Offsets = NULL;
+    loc.EntrySizeShifts = 0;
+    loc.PackDataSize = 0;
+    loc.Solid = &ss;
+
+    // we continue the pipeline, if required chunk is in slots or it's next chunk for reading
+    if (_pipeSolidIndex != resource.SolidIndex
+        || chunkIndex < _pipeFirst
+        || chunkIndex > _pipeNext)
+      Pipe_Start(resource.SolidIndex, chunkIndex, chunkSizeBits);
     
     UInt64 packProcessed = 0;
     UInt64 outProcessed = 0;
     
-    if (_solidIndex == resource.SolidIndex && _unpackedChunkIndex == chunkIndex)
-    {
-      size_t cur = chunkSize - offsetInChunk;
-      if (cur > rem)
-        cur = (size_t)rem;
-      RINOK(WriteStream(outStream, unpackBuf.Data + offsetInChunk, cur))
-      outProcessed += cur;
-      rem -= cur;
-      offsetInChunk = 0;
-      chunkIndex++;
-    }
-    
     for (;;)
     {
       if (rem == 0)
         return S_OK;
-    
-      const UInt64 offset = ss.Chunks[chunkIndex];
-      const UInt64 packSize = ss.GetChunkPackSize(chunkIndex);
-      const CResource &rs = db->DataStreams[ss.StreamIndex].Resource;
-      RINOK(InStream_SeekSet(inStream, rs.Offset + ss.HeadersSize + offset))
-      
-      size_t cur = chunkSize;
-      const UInt64 unpackRem = ss.UnpackSize - ((UInt64)chunkIndex << chunkSizeBits);
-      if (cur > unpackRem)
-        cur = (size_t)unpackRem;
-      
-      _solidIndex = -1;
-      _unpackedChunkIndex = 0;
+      if (chunkIndex >= loc.NumChunks)
+        return S_FALSE;
+
+      // the chunks before (chunkIndex) are not required anymore
+      Pipe_Release(chunkIndex);
+
+      HRESULT res = Pipe_Fill(inStream, loc);
+      if (res != S_OK)
+      {
+        Pipe_Stop();
+        return res;
+      }
       
-      const HRESULT res = UnpackChunk(inStream, (unsigned)ss.Method, chunkSizeBits, (size_t)packSize, cur, NULL);
+      const CChunkDecoder &dec = Pipe_GetFirst();
+      res = dec.Res;
       
       if (res != S_OK)
       {
         // We ignore data errors in solid stream. SHA will show what files are bad.
         if (res != S_FALSE)
+        {
+          Pipe_Stop();
           return res;
+        }
       }
       
-      _solidIndex = resource.SolidIndex;
-      _unpackedChunkIndex = chunkIndex;
-
+      size_t cur = dec.OutSize;
+      
       if (cur < offsetInChunk)
         return E_FAIL;
       
@@ -266,12 +416,12 @@ HRESULT CUnpacker::Unpack2(
       if (cur > rem)
         cur = (size_t)rem;
       
-      RINOK(WriteStream(outStream, unpackBuf.Data + offsetInChunk, cur))
+      RINOK(WriteStream(outStream, dec.unpackBuf.Data + offsetInChunk, cur))
       
       if (progress)
       {
         RINOK(progress->SetRatioInfo(&packProcessed, &outProcessed))
-        packProcessed += packSize;
+        packProcessed += ss.GetChunkPackSize(chunkIndex);
         outProcessed += cur;
       }
       
@@ -317,49 +467,56 @@ HRESULT CUnpacker::Unpack2(
     numChunks = (size_t)numChunks64;
   }
 
-  _solidIndex = -1;
-  _unpackedChunkIndex = 0;
+  loc.BaseOffset = baseOffset;
+  loc.NumChunks = numChunks;
+  loc.UnpackSize = unpackSize;
+  loc.ChunkSizeBits = chunkSizeBits;
+  loc.Method = header.GetMethod();
+  loc.Offsets = sizesBuf;
+  loc.EntrySizeShifts = entrySizeShifts;
+  loc.PackDataSize = packDataSize;
+  loc.Solid = NULL;
+
+  Pipe_Start(-1, 0, chunkSizeBits);
 
+  HRESULT res = S_OK;
   UInt64 outProcessed = 0;
-  UInt64 offset = 0;
   
   for (size_t i = 0; i < numChunks; i++)
   {
-    UInt64 nextOffset = packDataSize;
-    
-    if (i + 1 < numChunks)
-    {
-      const Byte *p = (const Byte *)sizesBuf + (i << entrySizeShifts);
-      nextOffset = (entrySizeShifts == 2) ? Get32(p): Get64(p);
-    }
-    
-    if (nextOffset < offset)
-      return S_FALSE;
-
-    UInt64 inSize64 = nextOffset - offset;
-    size_t inSize = (size_t)inSize64;
-    if (inSize != inSize64)
-      return S_FALSE;
-
-    RINOK(InStream_SeekSet(inStream, baseOffset + offset))
+    Pipe_Release(i);
+    res = Pipe_Fill(inStream, loc);
+    if (res != S_OK)
+      break;
 
     if (progress)
     {
-      RINOK(progress->SetRatioInfo(&offset, &outProcessed))
+      UInt64 offset;
+      size_t inSize, outSize;
+      res = loc.GetChunk(i, offset, inSize, outSize);
+      if (res == S_OK)
+        res = progress->SetRatioInfo(&offset, &outProcessed);
+      if (res != S_OK)
+        break;
     }
     
-    size_t outSize = (size_t)1 << chunkSizeBits;
-    const UInt64 rem = unpackSize - outProcessed;
-    if (outSize > rem)
-      outSize = (size_t)rem;
+    const CChunkDecoder &dec = Pipe_GetFirst();
 
-    RINOK(UnpackChunk(inStream, header.GetMethod(), chunkSizeBits, inSize, outSize, outStream))
+    if (outStream)
+    {
+      res = WriteStream(outStream, dec.unpackBuf.Data, dec.OutSize);
+      if (res != S_OK)
+        break;
+    }
+    res = dec.Res;
+    if (res != S_OK)
+      break;
 
-    outProcessed += outSize;
-    offset = nextOffset;
+    outProcessed += dec.OutSize;
   }
   
-  return S_OK;
+  Pipe_Stop();
+  return res;
 }
 
 
@@ -10,6 +10,8 @@
 
 #include "../../../Windows/PropVariant.h"
 
+#include "../../Common/SlotRing.h"
+
 #include "../../Compress/CopyCoder.h"
 #include "../../Compress/LzmsDecoder.h"
 #include "../../Compress/LzxDecoder.h"
@@ -266,7 +268,9 @@ struct CHeader
   CResource MetadataResource;
   CResource IntegrityResource;
 
-  void SetDefaultFields(bool useLZX);
+  // (method == 0) : no compression
+  void SetMethod(unsigned method);
+  void SetDefaultFields(unsigned method);
 
   void WriteTo(Byte *p) const;
   HRESULT Parse(const Byte *p, UInt64 &phySize);
@@ -595,30 +599,91 @@ struct CMidBuf
 };
 
 
-class CUnpacker
+// it describes the chunks of non-solid compressed resource or of solid resource
+
+struct CChunkLocator
 {
-  NCompress::CCopyCoder *copyCoderSpec;
-  CMyComPtr<ICompressCoder> copyCoder;
+  UInt64 BaseOffset;
+  size_t NumChunks;
+  UInt64 UnpackSize;
+  unsigned ChunkSizeBits;
+  unsigned Method;
 
-  NCompress::NLzx::CDecoder *lzxDecoderSpec;
-  CMyComPtr<IUnknown> lzxDecoder;
+  // non-solid resource
+  const Byte *Offsets; // [NumChunks - 1]
+  unsigned EntrySizeShifts;
+  UInt64 PackDataSize;
 
-  NCompress::NLzms::CDecoder *lzmsDecoder;
+  // solid resource
+  const CSolid *Solid;
 
-  CByteBuffer sizesBuf;
+  HRESULT GetChunk(size_t index, UInt64 &offset, size_t &packSize, size_t &unpackSize) const;
+};
 
+
+class CChunkDecoder
+{
+  NCompress::NLzx::CDecoder *lzxDecoderSpec;
+  CMyComPtr<IUnknown> lzxDecoder;
+  NCompress::NLzms::CDecoder *lzmsDecoder;
+  
   CMidBuf packBuf;
+  unsigned _method;
+  unsigned _chunkSizeBits;
+  size_t _inSize;
+  bool _needDecode;
+public:
   CMidBuf unpackBuf;
+  size_t OutSize;
+  HRESULT Res; // result of Decode()
 
-  // solid resource
-  int _solidIndex;
-  size_t _unpackedChunkIndex;
+  CChunkDecoder(): lzmsDecoder(NULL) {}
+  ~CChunkDecoder();
 
-  HRESULT UnpackChunk(
-      ISequentialInStream *inStream,
+  // Read() is called from main thread, and Decode() can be called from another thread
+  HRESULT Read(ISequentialInStream *inStream,
       unsigned method, unsigned chunkSizeBits,
-      size_t inSize, size_t outSize,
-      ISequentialOutStream *outStream);
+      size_t inSize, size_t outSize, UInt64 &totalPacked);
+  void Decode();
+};
+
+
+struct CChunkSlot
+{
+  CChunkDecoder Decoder;
+  void Run() { Decoder.Decode(); }
+};
+
+
+/*
+  CUnpacker decodes the chunks of resource in pipeline:
+  main thread reads packed chunks, and the slots decode the chunks
+  ahead in parallel threads. Then main thread writes the chunks in order.
+  The pipeline contains the chunks [_pipeFirst, _pipeNext).
+  The chunk (_pipeFirst) can be finished already (_pipeFirstDecoder != NULL),
+  and its slot is not reused while that chunk is in pipeline.
+  For solid resource the pipeline is kept between Unpack() calls,
+  because next stream usually starts in same or next chunks.
+*/
+
+class CUnpacker
+{
+  NCompress::CCopyCoder *copyCoderSpec;
+  CMyComPtr<ICompressCoder> copyCoder;
+
+  CByteBuffer sizesBuf;
+
+  CSlotRing<CChunkSlot> _slots;
+  int _pipeSolidIndex;  // solid index of chunks in pipeline, or -1 for non-solid resource
+  size_t _pipeFirst;    // first chunk in slots. It can be delivered already
+  size_t _pipeNext;     // next chunk for reading
+  const CChunkDecoder *_pipeFirstDecoder;
+
+  void Pipe_Start(int solidIndex, size_t chunkIndex, unsigned chunkSizeBits);
+  void Pipe_Stop();
+  void Pipe_Release(size_t chunkIndex);
+  const CChunkDecoder &Pipe_GetFirst();
+  HRESULT Pipe_Fill(IInStream *inStream, const CChunkLocator &loc);
 
   HRESULT Unpack2(
       IInStream *inStream,
@@ -630,14 +695,19 @@ class CUnpacker
 
 public:
   UInt64 TotalPacked;
+  UInt32 NumThreads;
+  UInt64 MemUsage;
 
   CUnpacker():
-      lzmsDecoder(NULL),
-      _solidIndex(-1),
-      _unpackedChunkIndex(0),
-      TotalPacked(0)
+      _pipeSolidIndex(-1),
+      _pipeFirst(0),
+      _pipeNext(0),
+      _pipeFirstDecoder(NULL),
+      TotalPacked(0),
+      NumThreads(1),
+      MemUsage((UInt64)1 << 30)
       {}
-  ~CUnpacker();
+  ~CUnpacker() { Pipe_Stop(); }
 
   HRESULT Unpack(
       IInStream *inStream,
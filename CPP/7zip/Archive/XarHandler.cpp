@@ -724,7 +724,7 @@ REGISTER_ARC_I(
   "Xar", "xar pkg xip", NULL, 0xE1,
   k_Signature,
   0,
-  0,
+  NArcInfoFlags::kIndependentItems,
   NULL)
 
 }}
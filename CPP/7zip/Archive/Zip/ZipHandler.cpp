@@ -209,11 +209,30 @@ static const Byte kArcProps[] =
   kpidNumVolumes
 };
 
-CHandler::CHandler()
+CHandler::CHandler():
+    _lazyItemIndex(-1)
 {
   InitMethodProps();
 }
 
+
+HRESULT CHandler::GetItem(UInt32 index, const CItemEx *&item)
+{
+  if (!m_Archive.IsLazyCd)
+  {
+    item = &m_Items[index];
+    return S_OK;
+  }
+  if (_lazyItemIndex != (int)index)
+  {
+    _lazyItemIndex = -1;
+    RINOK(m_Archive.LazyCd_GetItem(index, _lazyItem))
+    _lazyItemIndex = (int)index;
+  }
+  item = &_lazyItem;
+  return S_OK;
+}
+
 static AString BytesToString(const CByteBuffer &data)
 {
   AString s;
@@ -348,7 +367,7 @@ Z7_COM7F_IMF(CHandler::GetArchiveProperty(PROPID propID, PROPVARIANT *value))
 
 Z7_COM7F_IMF(CHandler::GetNumberOfItems(UInt32 *numItems))
 {
-  *numItems = m_Items.Size();
+  *numItems = m_Archive.GetNumItems(m_Items);
   return S_OK;
 }
 
@@ -384,7 +403,9 @@ Z7_COM7F_IMF(CHandler::GetProperty(UInt32 index, PROPID propID, PROPVARIANT *val
 {
   COM_TRY_BEGIN
   NWindows::NCOM::CPropVariant prop;
-  const CItemEx &item = m_Items[index];
+  const CItemEx *itemPtr;
+  RINOK(GetItem(index, itemPtr))
+  const CItemEx &item = *itemPtr;
   const CExtraBlock &extra = item.GetMainExtra();
   
   switch (propID)
@@ -711,9 +732,11 @@ Z7_COM7F_IMF(CHandler::GetParent(UInt32 index, UInt32 *parent, UInt32 *parentTyp
 {
   *parentType = NParentType::kDir;
   *parent = (UInt32)(Int32)-1;
-  if (index >= m_Items.Size())
+  if (index >= m_Archive.GetNumItems(m_Items))
     return S_OK;
-  const CItemEx &item = m_Items[index];
+  const CItemEx *itemPtr;
+  RINOK(GetItem(index, itemPtr))
+  const CItemEx &item = *itemPtr;
 
   if (item.ParentOfAltStream >= 0)
   {
@@ -778,6 +801,7 @@ Z7_COM7F_IMF(CHandler::Open(IInStream *inStream,
   {
     Close();
     m_Archive.Force_ReadLocals_Mode = _force_OpenSeq;
+    m_Archive.LazyCd_Mode = _lazyCd;
     // m_Archive.Disable_VolsRead = _force_OpenSeq;
     // m_Archive.Disable_FindMarker = _force_OpenSeq;
     HRESULT res = m_Archive.Open(inStream, maxCheckStartPosition, callback, m_Items);
@@ -796,6 +820,7 @@ Z7_COM7F_IMF(CHandler::Open(IInStream *inStream,
 Z7_COM7F_IMF(CHandler::Close())
 {
   m_Items.Clear();
+  _lazyItemIndex = -1;
   m_Archive.Close();
   return S_OK;
 }
@@ -1601,14 +1626,16 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
   COM_TRY_BEGIN
   const bool allFilesMode = (numItems == (UInt32)(Int32)-1);
   if (allFilesMode)
-    numItems = m_Items.Size();
+    numItems = m_Archive.GetNumItems(m_Items);
   if (numItems == 0)
     return S_OK;
   UInt64 total = 0; // , totalPacked = 0;
   UInt32 i;
   for (i = 0; i < numItems; i++)
   {
-    const CItemEx &item = m_Items[allFilesMode ? i : indices[i]];
+    const CItemEx *itemPtr;
+    RINOK(GetItem(allFilesMode ? i : indices[i], itemPtr))
+    const CItemEx &item = *itemPtr;
     total += item.Size;
     // totalPacked += item.PackSize;
   }
@@ -1629,7 +1656,12 @@ Z7_COM7F_IMF(CHandler::Extract(const UInt32 *indices, UInt32 numItems,
     if (i >= numItems)
       return S_OK;
     const UInt32 index = allFilesMode ? i : indices[i];
-    CItemEx item = m_Items[index];
+    CItemEx item;
+    {
+      const CItemEx *itemPtr;
+      RINOK(GetItem(index, itemPtr))
+      item = *itemPtr;
+    }
     cur_Unpacked = item.Size;
     cur_Packed = item.PackSize;
 
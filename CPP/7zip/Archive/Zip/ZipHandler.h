@@ -15,6 +15,8 @@
 namespace NArchive {
 namespace NZip {
 
+struct CMergeArc;
+
 const unsigned kNumMethodNames1 = NFileHeader::NCompressionMethod::kZstdPk + 1;
 const unsigned kMethodNames2Start = NFileHeader::NCompressionMethod::kZstdWz;
 const unsigned kNumMethodNames2 = NFileHeader::NCompressionMethod::kWzAES + 1 - kMethodNames2Start;
@@ -49,6 +51,10 @@ private:
   CObjectVector<CItemEx> m_Items;
   CInArchive m_Archive;
 
+  // last item decoded from CD buffer in (m_Archive.IsLazyCd) mode
+  CItemEx _lazyItem;
+  int _lazyItemIndex;
+
   CBaseProps _props;
   CHandlerTimeOptions TimeOptions;
 
@@ -60,8 +66,11 @@ private:
   bool m_ForceUtf8;
   bool _force_SeqOutMode; // for creation
   bool _force_OpenSeq;
+  bool _lazyCd;
   bool _forceCodePage;
+  bool _inPlace;
   UInt32 _specifiedCodePage;
+  UStringVector _mergeArcNames;
 
   DECL_EXTERNAL_CODECS_VARS
 
@@ -77,13 +86,19 @@ private:
     m_ForceUtf8 = false;
     _force_SeqOutMode = false;
     _force_OpenSeq = false;
+    _lazyCd = false;
     _forceCodePage = false;
+    _inPlace = false;
     _specifiedCodePage = CP_OEMCP;
+    _mergeArcNames.Clear();
   }
 
   // void MarkAltStreams(CObjectVector<CItemEx> &items);
 
+  HRESULT GetItem(UInt32 index, const CItemEx *&item);
+
   HRESULT GetOutProperty(IArchiveUpdateCallback *callback, UInt32 callbackIndex, Int32 arcIndex, PROPID propID, PROPVARIANT *value);
+  HRESULT OpenMergeArcs(IArchiveUpdateCallback *callback, CObjectVector<CMergeArc> &mergeArcs);
 
 public:
   CHandler();
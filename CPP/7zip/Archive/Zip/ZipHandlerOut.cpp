@@ -97,6 +97,8 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   {
     if (!m_Archive.CanUpdate())
       return E_NOTIMPL;
+    // the updater works with full list of items
+    RINOK(m_Archive.LazyCd_ReadItems(m_Items))
   }
 
   CObjectVector<CUpdateItem> updateItems;
@@ -479,6 +481,12 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
   uo.Write_MTime = TimeOptions.Write_MTime.Val;
   uo.Write_ATime = TimeOptions.Write_ATime.Val;
   uo.Write_CTime = TimeOptions.Write_CTime.Val;
+  uo.InPlace = _inPlace;
+
+  CObjectVector<CMergeArc> mergeArcs;
+  RINOK(OpenMergeArcs(callback, mergeArcs))
+  if (!mergeArcs.IsEmpty())
+    uo.MergeArcs = &mergeArcs;
   /*
   uo.Write_NtfsTime = _Write_NtfsTime &&
     (_Write_MTime || _Write_ATime  || _Write_CTime);
@@ -496,6 +504,37 @@ Z7_COM7F_IMF(CHandler::UpdateItems(ISequentialOutStream *outStream, UInt32 numIt
 
 
 
+/* The archives for merge are opened via IArchiveOpenVolumeCallback interface
+   of update callback, because the handler doesn't work with files directly. */
+
+HRESULT CHandler::OpenMergeArcs(IArchiveUpdateCallback *callback, CObjectVector<CMergeArc> &mergeArcs)
+{
+  if (_mergeArcNames.IsEmpty())
+    return S_OK;
+  
+  Z7_DECL_CMyComPtr_QI_FROM(
+      IArchiveOpenVolumeCallback,
+      volumeCallback, callback)
+  if (!volumeCallback)
+    return E_NOTIMPL;
+
+  FOR_VECTOR (i, _mergeArcNames)
+  {
+    CMergeArc &mergeArc = mergeArcs.AddNew();
+    RINOK(volumeCallback->GetStream(_mergeArcNames[i], &mergeArc.Stream))
+    if (!mergeArc.Stream)
+      return E_INVALIDARG;
+    const HRESULT res = mergeArc.Archive.Open(mergeArc.Stream, NULL, NULL, mergeArc.Items);
+    if (res == S_FALSE)
+      return E_INVALIDARG;
+    RINOK(res)
+    if (!mergeArc.Archive.CanUpdate() || mergeArc.Archive.IsMultiVol)
+      return E_NOTIMPL;
+  }
+  return S_OK;
+}
+
+
 Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVARIANT *values, UInt32 numProps))
 {
   InitMethodProps();
@@ -572,6 +611,20 @@ Z7_COM7F_IMF(CHandler::SetProperties(const wchar_t * const *names, const PROPVAR
     {
       RINOK(PROPVARIANT_to_bool(prop, _force_OpenSeq))
     }
+    else if (name.IsEqualTo("lcd"))
+    {
+      RINOK(PROPVARIANT_to_bool(prop, _lazyCd))
+    }
+    else if (name.IsEqualTo("ip"))
+    {
+      RINOK(PROPVARIANT_to_bool(prop, _inPlace))
+    }
+    else if (name.IsEqualTo("merge"))
+    {
+      if (prop.vt != VT_BSTR || prop.bstrVal[0] == 0)
+        return E_INVALIDARG;
+      _mergeArcNames.Add(UString(prop.bstrVal));
+    }
     else
     {
       if (name.IsEqualTo_Ascii_NoCase("m") && prop.vt == VT_UI4)
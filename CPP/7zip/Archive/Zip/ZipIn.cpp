@@ -202,6 +202,8 @@ void CInArchive::Close()
  
   ArcInfo.Clear();
 
+  LazyCd_Free();
+
   ClearRefs();
 }
 
@@ -964,6 +966,15 @@ exceptions:
 
 void CInArchive::SafeRead(Byte *data, unsigned size)
 {
+  if (_memData)
+  {
+    if (size > _memRem)
+      throw CUnexpectEnd();
+    memcpy(data, _memData, size);
+    _memData += size;
+    _memRem -= size;
+    return;
+  }
   unsigned processed;
   HRESULT result = ReadFromCache(data, size, processed);
   if (result != S_OK)
@@ -1072,9 +1083,8 @@ bool CInArchive::ReadExtra(const CLocalItem &item, unsigned extraSize, CExtraBlo
   
   while (extraSize >= 4)
   {
-    CExtraSubBlock subBlock;
     const UInt32 pair = ReadUInt32();
-    subBlock.ID = (pair & 0xFFFF);
+    const UInt32 id = (pair & 0xFFFF);
     unsigned size = (unsigned)(pair >> 16);
     // const unsigned origSize = size;
     
@@ -1091,7 +1101,7 @@ bool CInArchive::ReadExtra(const CLocalItem &item, unsigned extraSize, CExtraBlo
  
     extraSize -= size;
     
-    if (subBlock.ID == NFileHeader::NExtraID::kZip64)
+    if (id == NFileHeader::NExtraID::kZip64)
     {
       extra.IsZip64 = true;
       bool isOK = true;
@@ -1157,8 +1167,10 @@ bool CInArchive::ReadExtra(const CLocalItem &item, unsigned extraSize, CExtraBlo
     }
     else
     {
+      // we read data directly to new item of vector to avoid copying of buffer
+      CExtraSubBlock &subBlock = extra.SubBlocks.AddNew();
+      subBlock.ID = id;
       ReadBuffer(subBlock.Data, size);
-      extra.SubBlocks.Add(subBlock);
       if (subBlock.ID == NFileHeader::NExtraID::kIzUnicodeName)
       {
         if (!subBlock.CheckIzUnicode(item.Name))
@@ -1878,7 +1890,28 @@ HRESULT CInArchive::FindCd(bool checkOffsetMode)
 
 HRESULT CInArchive::TryReadCd(CObjectVector<CItemEx> &items, const CCdInfo &cdInfo, UInt64 cdOffset, UInt64 cdSize)
 {
-  items.Clear();
+  LazyCd_Free();
+  // we don't use lazy mode for multivolume archives, where CD can be split to volumes
+  const bool lazyMode = LazyCd_Mode
+      && !IsMultiVol
+      && cdSize < ((UInt32)1 << 31)
+      && cdSize <= ArcInfo.FileEndPos;
+  {
+    /* we reserve the vector for expected number of items,
+       but the number from ECD can be wrong, so we also check it with (cdSize). */
+    UInt64 numReserve = cdSize / kCentralHeaderSize;
+    if (numReserve > cdInfo.NumEntries)
+      numReserve = cdInfo.NumEntries;
+    if (numReserve > ((UInt32)1 << 24))
+      numReserve = (UInt32)1 << 24;
+    if (lazyMode)
+    {
+      items.Clear();
+      LazyCd_Offsets.ClearAndReserve((unsigned)numReserve);
+    }
+    else
+      items.ClearAndReserve((unsigned)numReserve);
+  }
   IsCdUnsorted = false;
   
   // _startLocalFromCd_Disk = (UInt32)(Int32)-1;
@@ -1893,6 +1926,10 @@ HRESULT CInArchive::TryReadCd(CObjectVector<CItemEx> &items, const CCdInfo &cdIn
   {
     RINOK(Callback->SetTotal(&cdInfo.NumEntries, IsMultiVol ? &Vols.TotalBytesSize : NULL))
   }
+
+  if (lazyMode)
+    return TryReadCd_Lazy(cdInfo, cdSize);
+
   UInt64 numFileExpected = cdInfo.NumEntries;
   const UInt64 *totalFilesPtr = &numFileExpected;
   bool isCorrect_NumEntries = (cdInfo.IsFromEcd64 || numFileExpected >= ((UInt32)1 << 16));
@@ -1904,8 +1941,18 @@ HRESULT CInArchive::TryReadCd(CObjectVector<CItemEx> &items, const CCdInfo &cdIn
       return S_FALSE;
     CanStartNewVol = false;
     {
-      CItemEx cdItem;
-      RINOK(ReadCdItem(cdItem))
+      /* we parse the item directly in new item of vector.
+         So we don't need additional copying of name and extra buffers. */
+      CItemEx &cdItem = items.AddNew();
+      try
+      {
+        RINOK(ReadCdItem(cdItem))
+      }
+      catch(...)
+      {
+        items.DeleteBack();
+        throw;
+      }
       
       /*
       if (cdItem.Disk < _startLocalFromCd_Disk ||
@@ -1917,16 +1964,14 @@ HRESULT CInArchive::TryReadCd(CObjectVector<CItemEx> &items, const CCdInfo &cdIn
       }
       */
 
-      if (items.Size() > 0 && !IsCdUnsorted)
+      if (items.Size() > 1 && !IsCdUnsorted)
       {
-        const CItemEx &prev = items.Back();
+        const CItemEx &prev = items[items.Size() - 2];
         if (cdItem.Disk < prev.Disk
             || (cdItem.Disk == prev.Disk &&
             cdItem.LocalHeaderPos < prev.LocalHeaderPos))
           IsCdUnsorted = true;
       }
-
-      items.Add(cdItem);
     }
     if (Callback && (items.Size() & 0xFFF) == 0)
     {
@@ -1952,6 +1997,272 @@ HRESULT CInArchive::TryReadCd(CObjectVector<CItemEx> &items, const CCdInfo &cdIn
 }
 
 
+/*
+TryReadCd_Lazy()
+  reads full CD to LazyCd_Buf and checks the sizes of CD records.
+  It stores the offsets of records in LazyCd_Offsets,
+  but it doesn't parse names and extra fields.
+*/
+
+HRESULT CInArchive::TryReadCd_Lazy(const CCdInfo &cdInfo, UInt64 cdSize)
+{
+  const size_t size = (size_t)cdSize;
+  LazyCd_Buf.Alloc(size);
+  try
+  {
+    for (size_t pos = 0; pos < size;)
+    {
+      unsigned cur = (unsigned)1 << 20;
+      if (cur > size - pos)
+        cur = (unsigned)(size - pos);
+      SafeRead(LazyCd_Buf + pos, cur);
+      pos += cur;
+    }
+  }
+  catch(const CUnexpectEnd &) { return S_FALSE; }
+
+  UInt64 numFileExpected = cdInfo.NumEntries;
+  const UInt64 *totalFilesPtr = &numFileExpected;
+  bool isCorrect_NumEntries = (cdInfo.IsFromEcd64 || numFileExpected >= ((UInt32)1 << 16));
+
+  const Byte *buf = LazyCd_Buf;
+  size_t pos = 0;
+
+  while (pos < size)
+  {
+    const Byte *p = buf + pos;
+    if (size - pos < kCentralHeaderSize
+        || Get32(p) != NSignature::kCentralFileHeader)
+      return S_FALSE;
+    const size_t recSize = kCentralHeaderSize
+        + (size_t)Get16(p + 4 + 24)
+        + (size_t)Get16(p + 4 + 26)
+        + (size_t)Get16(p + 4 + 28);
+    if (recSize > size - pos)
+      return S_FALSE;
+    const unsigned index = LazyCd_Offsets.Add((UInt32)pos);
+    pos += recSize;
+
+    if (index != 0 && !IsCdUnsorted)
+    {
+      UInt32 disk, prevDisk;
+      UInt64 localHeaderPos, prevLocalHeaderPos;
+      RINOK(LazyCd_GetPos(index, disk, localHeaderPos))
+      RINOK(LazyCd_GetPos(index - 1, prevDisk, prevLocalHeaderPos))
+      if (disk < prevDisk
+          || (disk == prevDisk &&
+          localHeaderPos < prevLocalHeaderPos))
+        IsCdUnsorted = true;
+    }
+
+    if (Callback && (LazyCd_Offsets.Size() & 0xFFF) == 0)
+    {
+      const UInt64 numFiles = LazyCd_Offsets.Size();
+
+      if (numFiles > numFileExpected && totalFilesPtr)
+      {
+        if (isCorrect_NumEntries)
+          totalFilesPtr = NULL;
+        else
+          while (numFiles > numFileExpected)
+            numFileExpected += (UInt32)1 << 16;
+        RINOK(Callback->SetTotal(totalFilesPtr, NULL))
+      }
+
+      const UInt64 numBytes = pos;
+      RINOK(Callback->SetCompleted(&numFiles, &numBytes))
+    }
+  }
+
+  IsLazyCd = true;
+  return S_OK;
+}
+
+
+void CInArchive::LazyCd_Free()
+{
+  IsLazyCd = false;
+  LazyCd_Buf.Free();
+  LazyCd_Offsets.ClearAndFree();
+  NameIndex.Free();
+}
+
+
+HRESULT CInArchive::LazyCd_GetItem(unsigned index, CItemEx &item)
+{
+  const size_t offset = LazyCd_Offsets[index];
+  // TryReadCd_Lazy() has checked that the record is inside the buffer
+  _memData = LazyCd_Buf + offset + 4;
+  _memRem = LazyCd_Buf.Size() - offset - 4;
+
+  /* the warnings for extra fields are reported only in normal mode,
+     so the archive flags don't depend on the items that were decoded here. */
+  const bool headersWarning = HeadersWarning;
+  const bool extraMinorError = ExtraMinorError;
+
+  CItemEx item2;
+  HRESULT res;
+  try
+  {
+    res = ReadCdItem(item2);
+  }
+  catch(const CUnexpectEnd &) { res = S_FALSE; }
+  catch(...)
+  {
+    _memData = NULL;
+    HeadersWarning = headersWarning;
+    ExtraMinorError = extraMinorError;
+    throw;
+  }
+  _memData = NULL;
+  HeadersWarning = headersWarning;
+  ExtraMinorError = extraMinorError;
+
+  if (res == S_OK)
+    item = item2;
+  return res;
+}
+
+
+HRESULT CInArchive::LazyCd_GetPos(unsigned index, UInt32 &disk, UInt64 &localHeaderPos)
+{
+  const Byte *p = LazyCd_Buf + LazyCd_Offsets[index] + 4;
+  G16(30, disk);
+  G32(38, localHeaderPos);
+  if (ZIP64_IS_16_MAX(disk) || ZIP64_IS_32_MAX(localHeaderPos))
+  {
+    // real values can be stored in zip64 extra
+    CItemEx item;
+    RINOK(LazyCd_GetItem(index, item))
+    disk = item.Disk;
+    localHeaderPos = item.LocalHeaderPos;
+  }
+  return S_OK;
+}
+
+
+HRESULT CInArchive::LazyCd_FindItem(const CItemEx &item, int &index)
+{
+  index = -1;
+  unsigned left = 0, right = LazyCd_Offsets.Size();
+  while (left < right)
+  {
+    const unsigned mid = (unsigned)(((size_t)left + (size_t)right) / 2);
+    UInt32 disk;
+    UInt64 localHeaderPos;
+    RINOK(LazyCd_GetPos(mid, disk, localHeaderPos))
+    if (item.Disk < disk)
+      right = mid;
+    else if (item.Disk > disk)
+      left = mid + 1;
+    else if (item.LocalHeaderPos == localHeaderPos)
+    {
+      index = (int)mid;
+      break;
+    }
+    else if (item.LocalHeaderPos < localHeaderPos)
+      right = mid;
+    else
+      left = mid + 1;
+  }
+  return S_OK;
+}
+
+
+UInt32 CNameIndex::GetHash(const char *name, size_t size)
+{
+  // FNV-1a
+  UInt32 hash = 0x811C9DC5;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ (Byte)name[i]) * 0x01000193;
+  return hash;
+}
+
+void CNameIndex::Alloc(unsigned numItems)
+{
+  unsigned numBits = 4;
+  while (numBits < 31 && ((UInt32)1 << numBits) < numItems)
+    numBits++;
+  _mask = ((UInt32)1 << numBits) - 1;
+  _heads.ClearAndSetSize(_mask + 1);
+  memset(&_heads[0], 0xFF, ((size_t)_mask + 1) * sizeof(UInt32));
+  _next.ClearAndReserve(numItems);
+}
+
+void CNameIndex::Add(UInt32 hash)
+{
+  const UInt32 index = _next.Size();
+  UInt32 &head = _heads[hash & _mask];
+  _next.Add(head);
+  head = index;
+}
+
+
+void CInArchive::GetRawName(const CObjectVector<CItemEx> &items, unsigned index,
+    const char *&name, unsigned &size) const
+{
+  if (IsLazyCd)
+  {
+    const Byte *p = LazyCd_Buf + LazyCd_Offsets[index];
+    // TryReadCd_Lazy() has checked that the name is inside the buffer
+    size = Get16(p + 4 + 24);
+    name = (const char *)(p + kCentralHeaderSize);
+  }
+  else
+  {
+    const AString &s = items[index].Name;
+    size = s.Len();
+    name = s.Ptr();
+  }
+}
+
+
+int CInArchive::FindName(const CObjectVector<CItemEx> &items, const AString &name, int prevIndex)
+{
+  const unsigned numItems = GetNumItems(items);
+  if (NameIndex.IsEmpty())
+  {
+    NameIndex.Alloc(numItems);
+    for (unsigned i = 0; i < numItems; i++)
+    {
+      const char *name2;
+      unsigned size2;
+      GetRawName(items, i, name2, size2);
+      NameIndex.Add(CNameIndex::GetHash(name2, size2));
+    }
+  }
+  
+  /* the chains are in reverse order of items.
+     So we walk the full chain and select the nearest item after (prevIndex). */
+  int res = -1;
+  for (int index = NameIndex.GetFirst(CNameIndex::GetHash(name.Ptr(), name.Len()));
+      index > prevIndex; index = NameIndex.GetNext((unsigned)index))
+  {
+    const char *name2;
+    unsigned size2;
+    GetRawName(items, (unsigned)index, name2, size2);
+    if (size2 == name.Len() && memcmp(name2, name.Ptr(), size2) == 0)
+      res = index;
+  }
+  return res;
+}
+
+
+HRESULT CInArchive::LazyCd_ReadItems(CObjectVector<CItemEx> &items)
+{
+  if (!IsLazyCd)
+    return S_OK;
+  items.ClearAndReserve(LazyCd_Offsets.Size());
+  FOR_VECTOR (i, LazyCd_Offsets)
+  {
+    CItemEx &item = items.AddNew();
+    RINOK(LazyCd_GetItem(i, item))
+  }
+  LazyCd_Free();
+  return S_OK;
+}
+
+
 /*
 static int CompareCdItems(void *const *elem1, void *const *elem2, void *)
 {
@@ -2681,7 +2992,7 @@ else
     if (res != S_FALSE && res != S_OK)
       return res;
 
-    if (res == S_OK && items.Size() == 0)
+    if (res == S_OK && GetNumItems(items) == 0)
       res = S_FALSE;
 
     if (res == S_OK)
@@ -2698,35 +3009,65 @@ else
         UInt64 min_LocalHeaderPos = (UInt64)(Int64)-1;
 
         if (!IsCdUnsorted)
-          index = FindItem(items, firstItem);
+        {
+          if (IsLazyCd)
+          {
+            RINOK(LazyCd_FindItem(firstItem, index))
+          }
+          else
+            index = FindItem(items, firstItem);
+        }
         else
         {
-          FOR_VECTOR (i, items)
+          const unsigned numItems = GetNumItems(items);
+          for (unsigned i = 0; i < numItems; i++)
           {
-            const CItemEx &cdItem = items[i];
-            if (cdItem.Disk == firstItem.Disk
-                && (cdItem.LocalHeaderPos == firstItem.LocalHeaderPos))
+            UInt32 disk;
+            UInt64 localHeaderPos;
+            if (IsLazyCd)
+            {
+              RINOK(LazyCd_GetPos(i, disk, localHeaderPos))
+            }
+            else
+            {
+              const CItemEx &cdItem = items[i];
+              disk = cdItem.Disk;
+              localHeaderPos = cdItem.LocalHeaderPos;
+            }
+            if (disk == firstItem.Disk
+                && (localHeaderPos == firstItem.LocalHeaderPos))
               index = (int)i;
             
             if (i == 0
-                || cdItem.Disk < min_Disk
-                || (cdItem.Disk == min_Disk && cdItem.LocalHeaderPos < min_LocalHeaderPos))
+                || disk < min_Disk
+                || (disk == min_Disk && localHeaderPos < min_LocalHeaderPos))
             {
-              min_Disk = cdItem.Disk;
-              min_LocalHeaderPos = cdItem.LocalHeaderPos;
+              min_Disk = disk;
+              min_LocalHeaderPos = localHeaderPos;
             }
           }
         }
 
+        CItemEx lazyItem;
+        if (index != -1 && IsLazyCd)
+        {
+          RINOK(LazyCd_GetItem((unsigned)index, lazyItem))
+        }
+
         if (index == -1)
           res = S_FALSE;
-        else if (!AreItemsEqual(firstItem, items[(unsigned)index]))
+        else if (!AreItemsEqual(firstItem, IsLazyCd ? lazyItem : items[(unsigned)index]))
           res = S_FALSE;
         else
         {
           ArcInfo.CdWasRead = true;
           if (IsCdUnsorted)
             ArcInfo.FirstItemRelatOffset = min_LocalHeaderPos;
+          else if (IsLazyCd)
+          {
+            UInt32 disk;
+            RINOK(LazyCd_GetPos(0, disk, ArcInfo.FirstItemRelatOffset))
+          }
           else
             ArcInfo.FirstItemRelatOffset = items[0].LocalHeaderPos;
 
@@ -2743,7 +3084,7 @@ else
   CObjectVector<CItemEx> cdItems;
 
   bool needSetBase = false; // we set needSetBase only for LOCALS_CD_MODE
-  unsigned numCdItems = items.Size();
+  unsigned numCdItems = GetNumItems(items);
   
   #ifdef ZIP_SELF_CHECK
   res = S_FALSE; // if uncommented, it uses additional LOCALS-CD-MODE mode to check the code
@@ -2756,6 +3097,7 @@ else
     // so we clear items and read Locals and CD.
 
     items.Clear();
+    LazyCd_Free();
     localsWereRead = true;
     
     HeadersError = false;
@@ -2861,11 +3203,17 @@ else
 
     for (;;)
     {
-      CItemEx cdItem;
-      
-      RINOK(ReadCdItem(cdItem))
+      CItemEx &cdItem = cdItems.AddNew();
+      try
+      {
+        RINOK(ReadCdItem(cdItem))
+      }
+      catch(...)
+      {
+        cdItems.DeleteBack();
+        throw;
+      }
       
-      cdItems.Add(cdItem);
       if (Callback && (cdItems.Size() & 0xFFF) == 0)
       {
         const UInt64 numFiles = items.Size();
@@ -2930,7 +3278,7 @@ else
         cdInfo.ParseEcd64e(buf);
       }
       
-      RINOK(Skip64(recordSize - kEcd64_MainSize, items.Size()))
+      RINOK(Skip64(recordSize - kEcd64_MainSize, GetNumItems(items)))
     }
 
 
@@ -3105,7 +3453,7 @@ else
         // || cdInfo.NumEntries_in_ThisDisk != numCdItems
         || cdInfo.NumEntries != numCdItems
         || cdInfo.Size != cdSize
-        || (cdInfo.Offset != cdRelatOffset && !items.IsEmpty()))
+        || (cdInfo.Offset != cdRelatOffset && GetNumItems(items) != 0))
     {
       HeadersError = true;
       return S_OK;
@@ -3204,15 +3552,15 @@ else
 
   if (isZip64)
   {
-    if (cdInfo.NumEntries != items.Size()
-        || (ecd.NumEntries != items.Size() && ecd.NumEntries != 0xFFFF))
+    if (cdInfo.NumEntries != GetNumItems(items)
+        || (ecd.NumEntries != GetNumItems(items) && ecd.NumEntries != 0xFFFF))
       HeadersError = true;
   }
   else
   {
     // old 7-zip could store 32-bit number of CD items to 16-bit field.
     // if (ecd.NumEntries != items.Size())
-    if (ecd.NumEntries > items.Size())
+    if (ecd.NumEntries > GetNumItems(items))
       HeadersError = true;
 
     if (cdInfo.NumEntries != numCdItems)
@@ -3234,7 +3582,7 @@ else
 
   if ((UInt16)cdInfo.NumEntries != (UInt16)numCdItems
       || (UInt32)cdInfo.Size != (UInt32)cdSize
-      || ((UInt32)cdInfo.Offset != (UInt32)cdRelatOffset && !items.IsEmpty()))
+      || ((UInt32)cdInfo.Offset != (UInt32)cdRelatOffset && GetNumItems(items) != 0))
   {
     // return S_FALSE;
     HeadersError = true;
@@ -3412,7 +3760,7 @@ HRESULT CInArchive::Open(IInStream *stream, const UInt64 *searchLimit,
     catch (const CSystemException &e) { res = e.ErrorCode; }
     catch (const CUnexpectEnd &)
     {
-      if (items.IsEmpty())
+      if (GetNumItems(items) == 0)
         return S_FALSE;
       UnexpectedEnd = true;
       res = S_OK;
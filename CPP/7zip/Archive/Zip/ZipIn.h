@@ -41,6 +41,35 @@ public:
 };
 
 
+/* CNameIndex is hash index for exact-path lookups.
+   It stores only the numbers of items. The caller compares the names. */
+
+class CNameIndex
+{
+  CRecordVector<UInt32> _heads;
+  CRecordVector<UInt32> _next;
+  UInt32 _mask;
+public:
+  static UInt32 GetHash(const char *name, size_t size);
+
+  bool IsEmpty() const { return _heads.IsEmpty(); }
+  void Free() { _heads.ClearAndFree(); _next.ClearAndFree(); }
+  void Alloc(unsigned numItems);
+  // the number of added item is (_next.Size())
+  void Add(UInt32 hash);
+  int GetFirst(UInt32 hash) const
+  {
+    const UInt32 v = _heads[hash & _mask];
+    return v == (UInt32)(Int32)-1 ? -1 : (int)v;
+  }
+  int GetNext(unsigned index) const
+  {
+    const UInt32 v = _next[index];
+    return v == (UInt32)(Int32)-1 ? -1 : (int)v;
+  }
+};
+
+
 struct CInArchiveInfo
 {
   Int64 Base; /* Base offset of start of archive in stream.
@@ -272,6 +301,10 @@ class CInArchive
 
   bool _inBufMode;
 
+  // if (_memData) is set, SafeRead() reads from memory block instead of stream
+  const Byte *_memData;
+  size_t _memRem;
+
   bool IsArcOpen;
   bool CanStartNewVol;
 
@@ -318,6 +351,10 @@ class CInArchive
   HRESULT TryEcd64(UInt64 offset, CCdInfo &cdInfo);
   HRESULT FindCd(bool checkOffsetMode);
   HRESULT TryReadCd(CObjectVector<CItemEx> &items, const CCdInfo &cdInfo, UInt64 cdOffset, UInt64 cdSize);
+  HRESULT TryReadCd_Lazy(const CCdInfo &cdInfo, UInt64 cdSize);
+  HRESULT LazyCd_GetPos(unsigned index, UInt32 &disk, UInt64 &localHeaderPos);
+  HRESULT LazyCd_FindItem(const CItemEx &item, int &index);
+  void GetRawName(const CObjectVector<CItemEx> &items, unsigned index, const char *&name, unsigned &size) const;
   HRESULT ReadCd(CObjectVector<CItemEx> &items, UInt32 &cdDisk, UInt64 &cdOffset, UInt64 &cdSize);
   HRESULT ReadLocals(CObjectVector<CItemEx> &localItems);
 
@@ -356,17 +393,46 @@ public:
   bool Force_ReadLocals_Mode;
   bool Disable_VolsRead;
   bool Disable_FindMarker;
+
+  /* LazyCd_Mode: CD is read to one buffer (LazyCd_Buf) and only the offsets
+     of CD records are stored (LazyCd_Offsets). CItemEx items are not created,
+     and the caller decodes CD record with LazyCd_GetItem() when it needs it.
+     (IsLazyCd == true), if archive was opened in that mode. */
+  bool LazyCd_Mode;
+  bool IsLazyCd;
+  CByteBuffer LazyCd_Buf;
+  CRecordVector<UInt32> LazyCd_Offsets;
+
+  /* NameIndex is created by first FindName() call.
+     In lazy mode it uses the names from LazyCd_Buf without decoding of items. */
+  CNameIndex NameIndex;
  
   CInArchive():
+      _memData(NULL),
+      _memRem(0),
       IsArcOpen(false),
       Stream(NULL),
       StartStream(NULL),
       Callback(NULL),
       Force_ReadLocals_Mode(false),
       Disable_VolsRead(false),
-      Disable_FindMarker(false)
+      Disable_FindMarker(false),
+      LazyCd_Mode(false),
+      IsLazyCd(false)
       {}
 
+  unsigned GetNumItems(const CObjectVector<CItemEx> &items) const
+    { return IsLazyCd ? LazyCd_Offsets.Size() : items.Size(); }
+
+  void LazyCd_Free();
+  HRESULT LazyCd_GetItem(unsigned index, CItemEx &item);
+  HRESULT LazyCd_ReadItems(CObjectVector<CItemEx> &items);
+
+  /* FindName() returns the index of next item after (prevIndex) that has same name.
+     (prevIndex == -1) : it starts new search. The result is (-1), if there is no such item.
+     The caller must not change (items) after first call. */
+  int FindName(const CObjectVector<CItemEx> &items, const AString &name, int prevIndex = -1);
+
   UInt64 GetPhySize() const
   {
     if (IsMultiVol)
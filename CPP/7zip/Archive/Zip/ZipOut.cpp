@@ -29,6 +29,7 @@ HRESULT COutArchive::SetRestrictionFromCurrent()
 HRESULT COutArchive::Create(IOutStream *outStream)
 {
   m_CurPos = 0;
+  m_CdOffset = 0;
   if (!m_OutBuffer.Create(1 << 16))
     return E_OUTOFMEMORY;
   m_Stream = outStream;
@@ -45,6 +46,13 @@ void COutArchive::SeekToCurPos()
     throw CSystemException(res);
 }
 
+void COutArchive::SetCurPos_and_Seek(UInt64 pos)
+{
+  m_OutBuffer.FlushWithCheck();
+  m_CurPos = pos;
+  SeekToCurPos();
+}
+
 #define DOES_NEED_ZIP64(v) (v >= (UInt32)0xFFFFFFFF)
 // #define DOES_NEED_ZIP64(v) (v >= 0)
 
@@ -351,6 +359,7 @@ HRESULT COutArchive::WriteCentralDir(const CObjectVector<CItemOut> &items, const
   RINOK(ClearRestriction())
   
   const UInt64 cdOffset = GetCurPos();
+  m_CdOffset = cdOffset;
   FOR_VECTOR (i, items)
     WriteCentralHeader(items[i]);
   const UInt64 cd64EndOffset = GetCurPos();
@@ -50,6 +50,7 @@ class COutArchive
   UInt64 m_Base; // Base of archive (offset in output Stream)
   UInt64 m_CurPos; // Curent position in archive (relative from m_Base)
   UInt64 m_LocalHeaderPos; // LocalHeaderPos (relative from m_Base) for last WriteLocalHeader() call
+  UInt64 m_CdOffset; // offset of central directory (relative from m_Base) for last WriteCentralDir() call
 
   UInt32 m_LocalFileHeaderSize;
   UInt32 m_ExtraSize;
@@ -81,12 +82,16 @@ public:
   HRESULT Create(IOutStream *outStream);
   
   UInt64 GetCurPos() const { return m_CurPos; }
+  UInt64 GetCdOffset() const { return m_CdOffset; }
 
   void MoveCurPos(UInt64 distanceToMove)
   {
     m_CurPos += distanceToMove;
   }
 
+  // it flushes buffered data and seeks stream to new position (relative from m_Base)
+  void SetCurPos_and_Seek(UInt64 pos);
+
   void WriteLocalHeader(CItemOut &item, bool needCheck = false);
   void WriteLocalHeader_Replace(CItemOut &item);
 
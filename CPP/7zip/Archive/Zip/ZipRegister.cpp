@@ -23,6 +23,7 @@ REGISTER_ARC_IO(
     NArcInfoFlags::kFindSignature
   | NArcInfoFlags::kMultiSignature
   | NArcInfoFlags::kUseGlobalOffset
+  | NArcInfoFlags::kIndependentItems
   | NArcInfoFlags::kCTime
   // | NArcInfoFlags::kCTime_Default
   | NArcInfoFlags::kATime
@@ -466,8 +466,15 @@ static HRESULT UpdateItemOldData(
   }
   else
   {
-    item.LocalHeaderPos = archive.GetCurPos();
     rangeSize = itemEx.GetLocalFullSize();
+    if (ui.KeepInPlace)
+    {
+      // in-place update: the item is stored in output stream already
+      item.LocalHeaderPos = itemEx.LocalHeaderPos;
+      complexity += rangeSize;
+      return S_OK;
+    }
+    item.LocalHeaderPos = archive.GetCurPos();
   }
 
   CMyComPtr<ISequentialInStream> packStream;
@@ -486,6 +493,107 @@ static HRESULT UpdateItemOldData(
 }
 
 
+/* the paths of merged items must differ from the paths of other items.
+   Duplicated file is error, and duplicated directory is skipped.
+   The item of merged archive is compared with the items of previous sources
+   (items of update and previous merged archives) via name hash indexes. */
+
+static const AString &GetUpdateItemName(
+    const CObjectVector<CItemEx> &inputItems,
+    const CUpdateItem &ui, bool &isDir)
+{
+  if (ui.NewProps)
+  {
+    isDir = ui.IsDir;
+    return ui.Name;
+  }
+  const CItemEx &inputItem = inputItems[(unsigned)ui.IndexInArc];
+  isDir = inputItem.IsDir();
+  return inputItem.Name;
+}
+
+static HRESULT CheckMergeNames(
+    const CObjectVector<CItemEx> &inputItems,
+    const CObjectVector<CUpdateItem> &updateItems,
+    CObjectVector<CMergeArc> &mergeArcs)
+{
+  CNameIndex updateIndex;
+  updateIndex.Alloc(updateItems.Size());
+  {
+    FOR_VECTOR (k, updateItems)
+    {
+      bool isDir;
+      const AString &name = GetUpdateItemName(inputItems, updateItems[k], isDir);
+      updateIndex.Add(CNameIndex::GetHash(name, name.Len()));
+    }
+  }
+  
+  FOR_VECTOR (i, mergeArcs)
+  {
+    CMergeArc &mergeArc = mergeArcs[i];
+    mergeArc.SkipItems.ClearAndSetSize(mergeArc.Items.Size());
+    FOR_VECTOR (k, mergeArc.Items)
+    {
+      mergeArc.SkipItems[k] = false;
+      const CItemEx &item = mergeArc.Items[k];
+      const bool isDir = item.IsDir();
+      
+      // the duplicates inside one source are allowed as before
+      bool found = false;
+      bool foundIsDir = true;
+      
+      for (int index = updateIndex.GetFirst(CNameIndex::GetHash(item.Name, item.Name.Len()));
+          index >= 0; index = updateIndex.GetNext((unsigned)index))
+      {
+        bool isDir2;
+        if (GetUpdateItemName(inputItems, updateItems[(unsigned)index], isDir2) == item.Name)
+        {
+          found = true;
+          if (!isDir2)
+            foundIsDir = false;
+        }
+      }
+      
+      for (unsigned m = 0; m < i; m++)
+      {
+        CMergeArc &mergeArc2 = mergeArcs[m];
+        for (int index = -1;;)
+        {
+          index = mergeArc2.Archive.FindName(mergeArc2.Items, item.Name, index);
+          if (index < 0)
+            break;
+          found = true;
+          if (!mergeArc2.Items[(unsigned)index].IsDir())
+            foundIsDir = false;
+        }
+      }
+
+      if (!found)
+        continue;
+      if (!isDir || !foundIsDir)
+        return HRESULT_FROM_WIN32(ERROR_FILE_EXISTS);
+      mergeArc.SkipItems[k] = true;
+    }
+  }
+  
+  return S_OK;
+}
+
+static HRESULT ReadMergedItem(CMergeArc &mergeArc, unsigned index,
+    CItemEx &itemEx, CItemOut &item, CUpdateItem &ui)
+{
+  itemEx = mergeArc.Items[index];
+  if (mergeArc.Archive.Read_LocalItem_After_CdItem_Full(itemEx) != S_OK)
+    return E_NOTIMPL;
+  (CItem &)item = itemEx;
+  ui.NewData = false;
+  ui.NewProps = false;
+  ui.IndexInArc = (int)index;
+  ui.IndexInClient = 0;
+  return S_OK;
+}
+
+
 static HRESULT WriteDirHeader(COutArchive &archive, const CCompressionMethodMode *options,
     const CUpdateItem &ui, CItemOut &item)
 {
@@ -629,6 +737,7 @@ static HRESULT Update2St(
     const CUpdateOptions &updateOptions,
     const CCompressionMethodMode *options, bool outSeqMode,
     const CByteBuffer *comment,
+    CObjectVector<CItemOut> &items,
     IArchiveUpdateCallback *updateCallback,
     UInt64 &totalComplexity,
     IArchiveUpdateCallbackFile *opCallback
@@ -642,7 +751,7 @@ static HRESULT Update2St(
   CAddCommon compressor;
   compressor.SetOptions(*options);
   
-  CObjectVector<CItemOut> items;
+  items.Clear();
   UInt64 unpackSizeTotal = 0, packSizeTotal = 0;
 
   FOR_VECTOR (itemIndex, updateItems)
@@ -753,6 +862,30 @@ static HRESULT Update2St(
     lps->ProgressOffset += kLocalHeaderSize;
   }
 
+  // ---------- Copy items of merged archives ----------
+
+  if (updateOptions.MergeArcs)
+    FOR_VECTOR (i, *updateOptions.MergeArcs)
+    {
+      CMergeArc &mergeArc = (*updateOptions.MergeArcs)[i];
+      FOR_VECTOR (k, mergeArc.Items)
+      {
+        if (mergeArc.SkipItems[k])
+          continue;
+        CItemEx itemEx;
+        CItemOut item;
+        CUpdateItem ui;
+        RINOK(ReadMergedItem(mergeArc, k, itemEx, item, ui))
+        UInt64 complexity = 0;
+        lps->SendRatio = false;
+        RINOK(UpdateItemOldData(archive, &mergeArc.Archive, itemEx, ui, item, progress, NULL, complexity))
+        lps->SendRatio = true;
+        lps->ProgressOffset += complexity;
+        items.Add(item);
+        lps->ProgressOffset += kLocalHeaderSize;
+      }
+    }
+
   lps->InSize = unpackSizeTotal;
   lps->OutSize = packSizeTotal;
   RINOK(lps->SetCur())
@@ -905,6 +1038,7 @@ static HRESULT Update2(
     const CUpdateOptions &updateOptions,
     const CCompressionMethodMode &options, bool outSeqMode,
     const CByteBuffer *comment,
+    CObjectVector<CItemOut> &items,
     IArchiveUpdateCallback *updateCallback)
 {
   CMyComPtr<IArchiveUpdateCallbackFile> opCallback;
@@ -954,6 +1088,23 @@ static HRESULT Update2(
     complexity += kCentralHeaderSize;
   }
 
+  if (updateOptions.MergeArcs)
+    FOR_VECTOR (k, *updateOptions.MergeArcs)
+    {
+      CMergeArc &mergeArc = (*updateOptions.MergeArcs)[k];
+      FOR_VECTOR (m, mergeArc.Items)
+      {
+        if (mergeArc.SkipItems[m])
+          continue;
+        CItemEx inputItem = mergeArc.Items[m];
+        if (mergeArc.Archive.Read_LocalItem_After_CdItem_Full(inputItem) != S_OK)
+          return E_NOTIMPL;
+        complexity += inputItem.GetLocalFullSize();
+        complexity += kLocalHeaderSize;
+        complexity += kCentralHeaderSize;
+      }
+    }
+
   if (comment)
     complexity += comment->Size();
   complexity++; // end of central
@@ -1197,7 +1348,7 @@ static HRESULT Update2(
         inputItems, updateItems,
         updateOptions,
         &options2, outSeqMode,
-        comment, updateCallback, totalComplexity,
+        comment, items, updateCallback, totalComplexity,
         opCallback
         // , reportArcProp
         );
@@ -1213,7 +1364,7 @@ static HRESULT Update2(
   if (numThreads < 1)
     numThreads = 1;
 
-  CObjectVector<CItemOut> items;
+  items.Clear();
 
   CMtProgressMixer *mtProgressMixerSpec = new CMtProgressMixer;
   CMyComPtr<ICompressProgressInfo> progress = mtProgressMixerSpec;
@@ -1554,6 +1705,27 @@ static HRESULT Update2(
     mtProgressMixerSpec->Mixer2->SetProgressOffset(complexity);
     itemIndex++;
   }
+
+  // ---------- Copy items of merged archives ----------
+
+  if (updateOptions.MergeArcs)
+    FOR_VECTOR (k, *updateOptions.MergeArcs)
+    {
+      CMergeArc &mergeArc = (*updateOptions.MergeArcs)[k];
+      FOR_VECTOR (m, mergeArc.Items)
+      {
+        if (mergeArc.SkipItems[m])
+          continue;
+        CItemEx itemEx;
+        CItemOut item;
+        CUpdateItem ui;
+        RINOK(ReadMergedItem(mergeArc, m, itemEx, item, ui))
+        RINOK(UpdateItemOldData(archive, &mergeArc.Archive, itemEx, ui, item, progress, NULL, complexity))
+        items.Add(item);
+        complexity += kLocalHeaderSize;
+        mtProgressMixerSpec->Mixer2->SetProgressOffset(complexity);
+      }
+    }
   
   RINOK(mtCompressProgressMixer.SetRatioInfo(0, NULL, NULL))
 
@@ -1621,15 +1793,17 @@ static const size_t kCacheBlockSize = (1 << 20);
 static const size_t kCacheSize = (kCacheBlockSize << 2);
 static const size_t kCacheMask = (kCacheSize - 1);
 
-Z7_CLASS_IMP_NOQIB_2(
+Z7_CLASS_IMP_NOQIB_3(
   CCacheOutStream
   , IOutStream
   , IStreamSetRestriction
+  , IOutStreamCopyFrom
 )
   Z7_IFACE_COM7_IMP(ISequentialOutStream)
 
   CMyComPtr<IOutStream> _stream;
   CMyComPtr<ISequentialOutStream> _seqStream;
+  CMyComPtr<IOutStreamCopyFrom> _copyFrom;
   Byte *_cache;
   UInt64 _virtPos;
   UInt64 _virtSize;
@@ -1680,8 +1854,10 @@ HRESULT CCacheOutStream::Init(ISequentialOutStream *seqStream, IOutStream *strea
   _seqStream = seqStream;
   _stream = stream;
   _setRestriction = setRestriction;
+  _copyFrom.Release();
   if (_stream)
   {
+    _stream.QueryInterface(IID_IOutStreamCopyFrom, &_copyFrom);
     RINOK(_stream->Seek(0, STREAM_SEEK_CUR, &_virtPos))
     RINOK(_stream->Seek(0, STREAM_SEEK_END, &_virtSize))
     RINOK(_stream->Seek((Int64)_virtPos, STREAM_SEEK_SET, &_virtPos))
@@ -1918,6 +2094,335 @@ Z7_COM7F_IMF(CCacheOutStream::SetRestriction(UInt64 begin, UInt64 end))
 }
 
 
+/* CopyFrom() passes the data to (_stream) directly, if (_stream) supports it.
+   So we flush the cache and seek (_stream) to current position before. */
+
+Z7_COM7F_IMF(CCacheOutStream::CopyFrom(ISequentialInStream *inStream, UInt64 size, UInt64 *processedSize))
+{
+  *processedSize = 0;
+  if (!_copyFrom)
+    return E_NOTIMPL;
+  if (_hres != S_OK)
+    return _hres;
+  RINOK(FlushCache())
+  if (_phyPos != _virtPos)
+  {
+    _hres = _stream->Seek((Int64)_virtPos, STREAM_SEEK_SET, &_phyPos);
+    RINOK(_hres)
+    if (_phyPos != _virtPos)
+    {
+      _hres = E_FAIL;
+      return _hres;
+    }
+  }
+  const HRESULT res = _copyFrom->CopyFrom(inStream, size, processedSize);
+  if (res == E_NOTIMPL)
+    return res;
+  _phyPos += *processedSize;
+  if (_phySize < _phyPos)
+    _phySize = _phyPos;
+  _virtPos = _phyPos;
+  if (_virtSize < _virtPos)
+    _virtSize = _virtPos;
+  _cachedPos = _virtPos;
+  if (res != S_OK)
+  {
+    _hres = res;
+    return res;
+  }
+  // it updates the restriction for written data
+  return MyWrite(0);
+}
+
+
+
+/*
+  In-place update writes to the stream of the opened archive.
+  The last ecd in file is the point of commit: the archive readers look for
+  ecd at the end of file, and the central directory referenced by that ecd
+  is live. We never write to the data referenced by live central directory.
+
+  1) Old items are not rewritten: they stay at their positions.
+     New items, new central directory and ecd are written after the end of
+     old archive (after old ecd). The old archive is not changed in that step,
+     so if that step was interrupted, the old archive is still complete.
+
+  2) Deleted items and old central directory leave holes in archive.
+     Then we reuse the holes in the following order:
+       - the items from the end of archive are copied to the first holes
+         that are large enough. Then new central directory and ecd are
+         appended to the end of file. So the holes are used only when
+         they are not referenced by live central directory, and the old
+         positions of moved items are released only after new ecd was written.
+       - final central directory and ecd are written after the last used byte,
+         if it doesn't overlap live central directory. The file is truncated
+         after final ecd was written.
+     The items are moved only if it reduces the archive size by more than
+     the size of additional central directory.
+
+  7-Zip opens zip archive from first local header, and it uses the central
+  directory only if it references that first header. The first local header
+  can't be replaced without a moment when it's not referenced by live central
+  directory. So in-place update is not supported, if the first item is deleted
+  or changed. Such update requires full rewrite of archive.
+*/
+
+struct CInPlaceRef
+{
+  UInt64 Pos;
+  UInt64 Size;
+  unsigned Index;
+  
+  int Compare(const CInPlaceRef &a) const
+  {
+    return MyCompare(Pos, a.Pos);
+  }
+};
+
+static HRESULT PrepareInPlaceUpdate(
+    CInArchive *inArchive,
+    const CObjectVector<CItemEx> &inputItems,
+    CObjectVector<CUpdateItem> &updateItems,
+    CRecordVector<CInPlaceRef> &refs)
+{
+  if (!inArchive || !inArchive->CanUpdate() || !inArchive->ArcInfo.CdWasRead)
+    return E_NOTIMPL;
+
+  refs.Clear();
+  CUIntVector newIndexes;
+  {
+    FOR_VECTOR (i, updateItems)
+    {
+      CUpdateItem &ui = updateItems[i];
+      ui.KeepInPlace = false;
+      if (ui.NewData)
+      {
+        newIndexes.Add(i);
+        continue;
+      }
+      // changed local header can be larger than old local header
+      if (ui.NewProps)
+        return E_NOTIMPL;
+      CItemEx itemEx = inputItems[(unsigned)ui.IndexInArc];
+      if (inArchive->Read_LocalItem_After_CdItem_Full(itemEx) != S_OK)
+        return E_NOTIMPL;
+      ui.KeepInPlace = true;
+      CInPlaceRef ref;
+      ref.Pos = itemEx.LocalHeaderPos;
+      ref.Size = itemEx.GetLocalFullSize();
+      ref.Index = i;
+      refs.Add(ref);
+    }
+  }
+
+  refs.Sort2();
+
+  // the item at the start of archive must be kept (see comment above)
+  if (refs.IsEmpty() || refs[0].Pos != 0)
+    return E_NOTIMPL;
+
+  UInt64 endPos = 0;
+  {
+    FOR_VECTOR (i, refs)
+    {
+      const CInPlaceRef &ref = refs[i];
+      if (ref.Pos < endPos)
+        return E_NOTIMPL;
+      endPos = ref.Pos + ref.Size;
+    }
+  }
+  if (endPos > inArchive->GetPhySize())
+    return E_NOTIMPL;
+
+  // old items are stored in the order of their positions, and new items follow them
+  CObjectVector<CUpdateItem> items;
+  items.ClearAndReserve(updateItems.Size());
+  FOR_VECTOR (i, refs)
+  {
+    CInPlaceRef &ref = refs[i];
+    items.AddInReserved(updateItems[ref.Index]);
+    ref.Index = i;
+  }
+  FOR_VECTOR (i, newIndexes)
+    items.AddInReserved(updateItems[newIndexes[i]]);
+  updateItems = items;
+  return S_OK;
+}
+
+
+struct CInPlaceBlock
+{
+  UInt64 Pos;
+  UInt64 Size;
+  UInt64 NewPos;
+  unsigned Index; // index in (items)
+  
+  int Compare(const CInPlaceBlock &a) const
+  {
+    return MyCompare(Pos, a.Pos);
+  }
+};
+
+struct CInPlaceHole
+{
+  UInt64 Pos;
+  UInt64 End;
+};
+
+static int CompareItemsByPos(void *const *a1, void *const *a2, void * /* param */)
+{
+  const CItemOut &i1 = **(const CItemOut *const *)a1;
+  const CItemOut &i2 = **(const CItemOut *const *)a2;
+  return MyCompare(i1.LocalHeaderPos, i2.LocalHeaderPos);
+}
+
+
+/* CompactInPlace() is called after new archive was written and flushed.
+   (refs) : kept old items sorted by position.
+   (newItemsPos) : the position where new items were written. */
+
+static HRESULT CompactInPlace(
+    COutArchive &archive,
+    IOutStream *outStream, CCacheOutStream *cacheStream,
+    IInStream *inStream, UInt64 base,
+    UInt64 newItemsPos,
+    const CRecordVector<CInPlaceRef> &refs,
+    CObjectVector<CItemOut> &items,
+    const CByteBuffer *comment)
+{
+  UInt64 liveCdPos = archive.GetCdOffset();
+  UInt64 liveEnd = archive.GetCurPos();
+
+  CRecordVector<CInPlaceBlock> blocks;
+  {
+    FOR_VECTOR (i, items)
+    {
+      CInPlaceBlock b;
+      b.Pos = items[i].LocalHeaderPos;
+      b.NewPos = b.Pos;
+      b.Size = 0;
+      b.Index = i;
+      blocks.Add(b);
+    }
+    blocks.Sort2();
+    unsigned k = 0;
+    FOR_VECTOR (i, blocks)
+    {
+      CInPlaceBlock &b = blocks[i];
+      if (b.Pos < newItemsPos)
+      {
+        // kept old item. Both lists are sorted by position
+        while (k < refs.Size() && refs[k].Pos < b.Pos)
+          k++;
+        if (k == refs.Size() || refs[k].Pos != b.Pos)
+          return E_FAIL;
+        b.Size = refs[k].Size;
+      }
+      else
+        // new items were written one after another before central directory
+        b.Size = (i + 1 < blocks.Size() ? blocks[i + 1].Pos : liveCdPos) - b.Pos;
+    }
+  }
+
+  CRecordVector<CInPlaceHole> holes;
+  {
+    for (unsigned i = 1; i < blocks.Size(); i++)
+    {
+      CInPlaceHole h;
+      h.Pos = blocks[i - 1].Pos + blocks[i - 1].Size;
+      h.End = blocks[i].Pos;
+      if (h.Pos < h.End)
+        holes.Add(h);
+    }
+  }
+  
+  // (blocks) is not empty, and first block is at the start of archive
+  const UInt64 endPos = blocks.Back().Pos + blocks.Back().Size;
+  UInt64 newEndPos = endPos;
+  unsigned numMoved = 0;
+  
+  if (!holes.IsEmpty())
+  {
+    UInt64 movedEnd = 0;
+    /* we move the items from the end while there is suitable hole.
+       The first block can't be moved, because there is no hole before it. */
+    for (unsigned i = blocks.Size(); i != 0;)
+    {
+      CInPlaceBlock &b = blocks[--i];
+      int holeIndex = -1;
+      FOR_VECTOR (k, holes)
+      {
+        const CInPlaceHole &h = holes[k];
+        if (h.End > b.Pos)
+          break;
+        if (h.End - h.Pos >= b.Size)
+        {
+          holeIndex = (int)k;
+          break;
+        }
+      }
+      if (holeIndex < 0)
+      {
+        newEndPos = b.Pos + b.Size;
+        break;
+      }
+      CInPlaceHole &h = holes[(unsigned)holeIndex];
+      b.NewPos = h.Pos;
+      h.Pos += b.Size;
+      if (movedEnd < h.Pos)
+        movedEnd = h.Pos;
+      numMoved++;
+    }
+    if (newEndPos < movedEnd)
+      newEndPos = movedEnd;
+  }
+
+  if (numMoved != 0 && endPos - newEndPos > liveEnd - liveCdPos)
+  {
+    RINOK(archive.ClearRestriction())
+    /* the stream for copying is (cacheStream) that passes the data to
+       IOutStreamCopyFrom of file stream (copy_file_range() in Linux).
+       So one copy coder is enough for all moved items */
+    NCompress::CCopyCoder *copyCoderSpec = new NCompress::CCopyCoder;
+    CMyComPtr<ICompressCoder> copyCoder = copyCoderSpec;
+    CMyComPtr<ISequentialOutStream> copyStream;
+    archive.CreateStreamForCopying(copyStream);
+    FOR_VECTOR (i, blocks)
+    {
+      const CInPlaceBlock &b = blocks[i];
+      if (b.NewPos == b.Pos)
+        continue;
+      RINOK(InStream_SeekSet(inStream, base + b.Pos))
+      archive.SetCurPos_and_Seek(b.NewPos);
+      RINOK(copyCoder->Code(inStream, copyStream, NULL, &b.Size, NULL))
+      if (copyCoderSpec->TotalSize != b.Size)
+        return E_FAIL;
+      items[b.Index].LocalHeaderPos = b.NewPos;
+    }
+    RINOK(cacheStream->FinalFlush())
+    items.Sort(CompareItemsByPos, NULL);
+    // the moved items are referenced by new central directory
+    archive.SetCurPos_and_Seek(liveEnd);
+    RINOK(archive.WriteCentralDir(items, comment))
+    RINOK(cacheStream->FinalFlush())
+    liveCdPos = liveEnd;
+    liveEnd = archive.GetCurPos();
+  }
+  else
+    newEndPos = endPos;
+
+  /* final central directory is not larger than live central directory,
+     because it contains same items, and its offset is not larger */
+  if (newEndPos == liveCdPos
+      || newEndPos + (liveEnd - liveCdPos) > liveCdPos)
+    return S_OK;
+  archive.SetCurPos_and_Seek(newEndPos);
+  RINOK(archive.WriteCentralDir(items, comment))
+  RINOK(cacheStream->FinalFlush())
+  // we truncate the tail only after final ecd was written
+  return outStream->SetSize(base + archive.GetCurPos());
+}
+
 
 HRESULT Update(
     DECL_EXTERNAL_CODECS_LOC_VARS
@@ -1938,6 +2443,21 @@ HRESULT Update(
   }
   */
 
+  if (updateOptions.MergeArcs)
+  {
+    RINOK(CheckMergeNames(inputItems, updateItems, *updateOptions.MergeArcs))
+  }
+
+  const bool inPlace = updateOptions.InPlace;
+  CRecordVector<CInPlaceRef> inPlaceRefs;
+  if (inPlace)
+  {
+    if (compressionMethodMode.Force_SeqOutMode
+        || (removeSfx && inArchive && inArchive->ArcInfo.Base > 0))
+      return E_NOTIMPL;
+    RINOK(PrepareInPlaceUpdate(inArchive, inputItems, updateItems, inPlaceRefs))
+  }
+
   CMyComPtr<IStreamSetRestriction> setRestriction;
   seqOutStream->QueryInterface(IID_IStreamSetRestriction, (void **)&setRestriction);
   if (setRestriction)
@@ -1961,7 +2481,12 @@ HRESULT Update(
       */
     }
 
-    if (inArchive)
+    if (inPlace)
+    {
+      if (!outStreamReal)
+        return E_NOTIMPL;
+    }
+    else if (inArchive)
     {
       if (!inArchive->IsMultiVol && inArchive->ArcInfo.Base > 0 && !removeSfx)
       {
@@ -1995,12 +2520,24 @@ HRESULT Update(
     outSeqMode = (outStreamReal == NULL);
   }
 
+  if (inPlace)
+  {
+    // the stub (if present) and old archive are kept in stream
+    RINOK(outStream->Seek(inArchive->ArcInfo.Base, STREAM_SEEK_SET, NULL))
+  }
+
   COutArchive outArchive;
   outArchive.SetRestriction = setRestriction;
 
   RINOK(outArchive.Create(outStream))
 
-  if (inArchive)
+  if (inPlace)
+  {
+    // new items are written after the end of old archive
+    outArchive.SetCurPos_and_Seek(inArchive->GetPhySize());
+  }
+
+  if (inArchive && !inPlace)
   {
     if (!inArchive->IsMultiVol && (Int64)inArchive->ArcInfo.MarkerPos2 > inArchive->ArcInfo.Base)
     {
@@ -2012,16 +2549,29 @@ HRESULT Update(
     }
   }
 
+  const CByteBuffer *comment = inArchive ? &inArchive->ArcInfo.Comment : NULL;
+  CObjectVector<CItemOut> items;
+
   RINOK (Update2(
       EXTERNAL_CODECS_LOC_VARS
       outArchive, inArchive,
       inputItems, updateItems,
       updateOptions,
       compressionMethodMode, outSeqMode,
-      inArchive ? &inArchive->ArcInfo.Comment : NULL,
+      comment, items,
       updateCallback))
 
-  return cacheStream->FinalFlush();
+  RINOK(cacheStream->FinalFlush())
+
+  if (inPlace)
+  {
+    // new ecd is the last in file here. So new archive is live
+    RINOK(CompactInPlace(outArchive, outStream, cacheStream,
+        inArchive->GetBaseStream(), (UInt64)inArchive->ArcInfo.Base,
+        inArchive->GetPhySize(),
+        inPlaceRefs, items, comment))
+  }
+  return S_OK;
 }
 
 }}
@@ -35,6 +35,7 @@ struct CUpdateItem
   // bool Write_UnixTime_ATime;
   bool IsUtf8;
   bool Size_WasSetFromStream;
+  bool KeepInPlace; // in-place update: old item data stays at its position in archive
   // bool IsAltStream;
   int IndexInArc;
   unsigned IndexInClient;
@@ -77,6 +78,7 @@ struct CUpdateItem
     Write_UnixTime(false),
     IsUtf8(false),
     Size_WasSetFromStream(false),
+    KeepInPlace(false),
     // IsAltStream(false),
     Time(0),
     Size(0)
@@ -84,11 +86,26 @@ struct CUpdateItem
 };
 
 
+/* CMergeArc is the source archive for merge operation.
+   All items of such archive are copied without recompression. */
+
+struct CMergeArc
+{
+  CMyComPtr<IInStream> Stream;
+  CInArchive Archive;
+  CObjectVector<CItemEx> Items;
+  CBoolVector SkipItems; // the directory items that are present in another source
+};
+
 struct CUpdateOptions
 {
   bool Write_MTime;
   bool Write_ATime;
   bool Write_CTime;
+  bool InPlace; // (seqOutStream) is the stream of (inArchive) opened for writing
+  CObjectVector<CMergeArc> *MergeArcs;
+
+  CUpdateOptions(): InPlace(false), MergeArcs(NULL) {}
 };
 
 
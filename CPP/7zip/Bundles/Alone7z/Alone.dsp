@@ -734,6 +734,14 @@ SOURCE=..\..\Common\RegisterCodec.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Common\SolidCache.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\SolidCache.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\StreamBinder.cpp
 # End Source File
 # Begin Source File
@@ -877,6 +877,14 @@ SOURCE=..\..\Common\PropId.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Common\SolidCache.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\SolidCache.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\StreamBinder.cpp
 # End Source File
 # Begin Source File
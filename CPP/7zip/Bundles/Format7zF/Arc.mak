@@ -47,6 +47,7 @@ WIN_OBJS = \
   $O\ProgressMt.obj \
   $O\ProgressUtils.obj \
   $O\PropId.obj \
+  $O\SolidCache.obj \
   $O\StreamBinder.obj \
   $O\StreamObjects.obj \
   $O\StreamUtils.obj \
@@ -215,6 +216,7 @@ COMPRESS_OBJS = \
   $O\LzmsDecoder.obj \
   $O\LzOutWindow.obj \
   $O\LzxDecoder.obj \
+  $O\LzxEncoder.obj \
   $O\PpmdDecoder.obj \
   $O\PpmdEncoder.obj \
   $O\PpmdRegister.obj \
@@ -228,6 +230,7 @@ COMPRESS_OBJS = \
   $O\RarCodecsRegister.obj \
   $O\ShrinkDecoder.obj \
   $O\XpressDecoder.obj \
+  $O\XpressEncoder.obj \
   $O\XzDecoder.obj \
   $O\XzEncoder.obj \
   $O\ZlibDecoder.obj \
@@ -86,6 +86,7 @@ WIN_OBJS = \
   $O/OutBuffer.o \
   $O/ProgressUtils.o \
   $O/PropId.o \
+  $O/SolidCache.o \
   $O/StreamObjects.o \
   $O/StreamUtils.o \
   $O/UniqBlocks.o \
@@ -257,6 +258,7 @@ COMPRESS_OBJS = \
   $O/LzmsDecoder.o \
   $O/LzOutWindow.o \
   $O/LzxDecoder.o \
+  $O/LzxEncoder.o \
   $O/PpmdDecoder.o \
   $O/PpmdEncoder.o \
   $O/PpmdRegister.o \
@@ -264,6 +266,7 @@ COMPRESS_OBJS = \
   $O/QuantumDecoder.o \
   $O/ShrinkDecoder.o \
   $O/XpressDecoder.o \
+  $O/XpressEncoder.o \
   $O/XzDecoder.o \
   $O/XzEncoder.o \
   $O/ZlibDecoder.o \
@@ -964,6 +964,24 @@ SOURCE=..\..\Compress\LzxDecoder.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Compress\LzxEncoder.cpp
+
+!IF  "$(CFG)" == "7z - Win32 Release"
+
+# ADD CPP /O2
+# SUBTRACT CPP /YX /Yc /Yu
+
+!ELSEIF  "$(CFG)" == "7z - Win32 Debug"
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Compress\LzxEncoder.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Compress\QuantumDecoder.cpp
 # End Source File
 # Begin Source File
@@ -1047,6 +1065,24 @@ SOURCE=..\..\Compress\XpressDecoder.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Compress\XpressEncoder.cpp
+
+!IF  "$(CFG)" == "7z - Win32 Release"
+
+# ADD CPP /O2
+# SUBTRACT CPP /YX /Yc /Yu
+
+!ELSEIF  "$(CFG)" == "7z - Win32 Debug"
+
+!ENDIF 
+
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Compress\XpressEncoder.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Compress\XzDecoder.cpp
 # End Source File
 # Begin Source File
@@ -1451,6 +1487,14 @@ SOURCE=..\..\Common\RegisterCodec.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Common\SolidCache.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\SolidCache.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\StreamBinder.cpp
 # End Source File
 # Begin Source File
@@ -20,6 +20,12 @@
 #endif
 #endif
 
+// copy_file_range() was added in glibc 2.27
+#if defined(__linux__) && defined(__GLIBC__) \
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define Z7_USE_COPY_FILE_RANGE
+#endif
+
 #endif // _WIN32
 
 #include "../../Windows/FileFind.h"
@@ -326,6 +332,21 @@ Z7_COM7F_IMF(CInFileStream::GetSize(UInt64 *size))
   return ConvertBoolToHRESULT(File.GetLength(*size));
 }
 
+Z7_COM7F_IMF(CInFileStream::GetFileHandle(UINT_PTR *handle))
+{
+  *handle = 0;
+  #ifdef Z7_USE_COPY_FILE_RANGE
+  // the handle is used only by COutFileStream::CopyFrom()
+  const int fd = File.GetHandle();
+  if (fd == -1)
+    return E_NOTIMPL;
+  *handle = (UINT_PTR)fd;
+  return S_OK;
+  #else
+  return E_NOTIMPL;
+  #endif
+}
+
 #ifdef Z7_FILE_STREAMS_USE_WIN_FILE
 
 Z7_COM7F_IMF(CInFileStream::GetProps(UInt64 *size, FILETIME *cTime, FILETIME *aTime, FILETIME *mTime, UInt32 *attrib))
@@ -738,6 +759,45 @@ HRESULT COutFileStream::GetSize(UInt64 *size)
   return ConvertBoolToHRESULT(File.GetLength(*size));
 }
 
+Z7_COM7F_IMF(COutFileStream::CopyFrom(ISequentialInStream *inStream, UInt64 size, UInt64 *processedSize))
+{
+  *processedSize = 0;
+  
+  #ifdef Z7_USE_COPY_FILE_RANGE
+  
+  Z7_DECL_CMyComPtr_QI_FROM(
+      IStreamGetFileHandle,
+      getFileHandle, inStream)
+  if (!getFileHandle)
+    return E_NOTIMPL;
+  UINT_PTR handle;
+  if (getFileHandle->GetFileHandle(&handle) != S_OK)
+    return E_NOTIMPL;
+  const size_t kCopySizeMax = (size_t)1 << 30;
+  if (size > kCopySizeMax)
+    size = kCopySizeMax;
+  // copy_file_range() uses and moves current positions of both files
+  const ssize_t res = copy_file_range((int)handle, NULL, File.GetHandle(), NULL, (size_t)size, 0);
+  if (res == -1)
+  {
+    /* copy_file_range() is not supported for these files (old kernel,
+       different file systems, special files), or there is real error.
+       The caller will use Read() / Write() that will report real error. */
+    return E_NOTIMPL;
+  }
+  ProcessedSize += (UInt64)res;
+  *processedSize = (UInt64)res;
+  return S_OK;
+  
+  #else
+  
+  UNUSED_VAR(inStream)
+  UNUSED_VAR(size)
+  return E_NOTIMPL;
+  
+  #endif
+}
+
 #ifdef UNDER_CE
 
 Z7_COM7F_IMF(CStdOutFileStream::Write(const void *data, UInt32 size, UInt32 *processedSize))
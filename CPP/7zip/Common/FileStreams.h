@@ -29,13 +29,14 @@ Z7_PURE_INTERFACES_END
 
 
 /*
-Z7_CLASS_IMP_COM_5(
+Z7_CLASS_IMP_COM_6(
   CInFileStream
   , IInStream
   , IStreamGetSize
   , IStreamGetProps
   , IStreamGetProps2
   , IStreamGetProp
+  , IStreamGetFileHandle
 )
 */
 Z7_class_final(CInFileStream) :
@@ -44,14 +45,16 @@ Z7_class_final(CInFileStream) :
   public IStreamGetProps,
   public IStreamGetProps2,
   public IStreamGetProp,
+  public IStreamGetFileHandle,
   public CMyUnknownImp
 {
-  Z7_COM_UNKNOWN_IMP_5(
+  Z7_COM_UNKNOWN_IMP_6(
       IInStream,
       IStreamGetSize,
       IStreamGetProps,
       IStreamGetProps2,
-      IStreamGetProp)
+      IStreamGetProp,
+      IStreamGetFileHandle)
 
   Z7_IFACE_COM7_IMP(ISequentialInStream)
   Z7_IFACE_COM7_IMP(IInStream)
@@ -62,6 +65,8 @@ private:
 public:
   Z7_IFACE_COM7_IMP(IStreamGetProps2)
   Z7_IFACE_COM7_IMP(IStreamGetProp)
+private:
+  Z7_IFACE_COM7_IMP(IStreamGetFileHandle)
 
 private:
   NWindows::NFile::NIO::CInFile File;
@@ -130,9 +135,10 @@ Z7_CLASS_IMP_NOQIB_1(
 };
 
 
-Z7_CLASS_IMP_COM_1(
+Z7_CLASS_IMP_COM_2(
   COutFileStream
   , IOutStream
+  , IOutStreamCopyFrom
 )
   Z7_IFACE_COM7_IMP(ISequentialOutStream)
 public:
@@ -149,6 +155,11 @@ public:
     ProcessedSize = 0;
     return File.Open(fileName, creationDisposition);
   }
+  bool Open_Existing(CFSTR fileName)
+  {
+    ProcessedSize = 0;
+    return File.Open_Existing(fileName);
+  }
 
   HRESULT Close();
   
@@ -0,0 +1,140 @@
+// SlotRing.h
+
+#ifndef ZIP7_INC_SLOT_RING_H
+#define ZIP7_INC_SLOT_RING_H
+
+#include "../../Common/MyVector.h"
+#include "../../Common/MyWindows.h"
+
+#ifndef Z7_ST
+#include "VirtThread.h"
+#endif
+
+// the maximum number of worker threads in ordered multithreaded decoding
+const unsigned k_SlotRing_NumThreads_Max = 64;
+
+/*
+  CSlotRing<T> is the ring of slots for ordered multithreaded decoding
+  of independent blocks (folders, chunks, files).
+  Main thread reads the data of block to free slot (GetFreeSlot()),
+  and starts the slot (StartSlot()), that calls (T::Run()) in worker thread of slot.
+  Main thread gets the results in same order as the slots were started (FinishNext()),
+  so the callback calls and output writes are not reordered.
+  (T::Run()) must not throw exceptions.
+  If there is only one slot, or in single-thread version (Z7_ST),
+  StartSlot() calls (T::Run()) in main thread.
+*/
+
+template <class T>
+class CSlotRing
+{
+ #ifndef Z7_ST
+  class CThread Z7_final: public CVirtThread
+  {
+  public:
+    T *Slot;
+    void Execute() Z7_override { Slot->Run(); }
+    ~CThread() Z7_DESTRUCTOR_override
+    {
+      // we need WaitThreadFinish() call before destructors of this class members
+      CVirtThread::WaitThreadFinish();
+    }
+  };
+ #endif
+
+  struct CItem
+  {
+    T Slot;
+   #ifndef Z7_ST
+    // the thread is destroyed before (Slot)
+    CThread Thread;
+    CItem() { Thread.Slot = &Slot; }
+   #endif
+  };
+
+  CObjectVector<CItem> _items;
+  unsigned _next;       // the slot of first started block
+  unsigned _numStarted;
+
+  unsigned GetIndex(unsigned i) const
+  {
+    i += _next;
+    if (i >= _items.Size())
+      i -= _items.Size();
+    return i;
+  }
+
+  Z7_CLASS_NO_COPY(CSlotRing)
+public:
+  CSlotRing(): _next(0), _numStarted(0) {}
+  ~CSlotRing() { WaitAll(); }
+
+  /* it limits (numSlots) by k_SlotRing_NumThreads_Max.
+     It can be called only if there are no started slots. */
+  void Create(unsigned numSlots)
+  {
+    if (numSlots > k_SlotRing_NumThreads_Max)
+      numSlots = k_SlotRing_NumThreads_Max;
+    if (numSlots == 0)
+      numSlots = 1;
+    _next = 0;
+    while (_items.Size() > numSlots)
+      _items.DeleteBack();
+    while (_items.Size() < numSlots)
+      _items.AddNew();
+  }
+
+  unsigned NumSlots() const { return _items.Size(); }
+  unsigned NumStarted() const { return _numStarted; }
+  bool IsEmpty() const { return _numStarted == 0; }
+  bool IsFull() const { return _numStarted == _items.Size(); }
+
+  T &GetSlot(unsigned index) { return _items[index].Slot; }
+  /* the first started slot. Only the fields that were set
+     before StartSlot() can be read before FinishNext() */
+  const T &GetFirstStarted() const { return _items[_next].Slot; }
+  // the slot that will be started by next StartSlot() call
+  T &GetFreeSlot() { return _items[GetIndex(_numStarted)].Slot; }
+
+  HRESULT StartSlot()
+  {
+    CItem &item = _items[GetIndex(_numStarted)];
+   #ifndef Z7_ST
+    if (_items.Size() > 1)
+    {
+      WRes wres = item.Thread.Create();
+      if (wres == 0)
+        wres = item.Thread.Start();
+      if (wres != 0)
+        return HRESULT_FROM_WIN32(wres);
+    }
+    else
+   #endif
+      item.Slot.Run();
+    _numStarted++;
+    return S_OK;
+  }
+
+  /* it waits for the first started slot and removes it from ring.
+     The slot data is available until next StartSlot() call. */
+  T &FinishNext()
+  {
+    CItem &item = _items[_next];
+   #ifndef Z7_ST
+    if (_items.Size() > 1)
+      item.Thread.WaitExecuteFinish();
+   #endif
+    _next = GetIndex(1);
+    _numStarted--;
+    return item.Slot;
+  }
+
+  // it waits for all started slots without processing of results
+  void WaitAll()
+  {
+    while (_numStarted != 0)
+      FinishNext();
+  }
+};
+
+#endif
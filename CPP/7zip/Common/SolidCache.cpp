@@ -0,0 +1,97 @@
+// SolidCache.cpp
+
+#include "StdAfx.h"
+
+#ifndef _WIN32
+#include <stdio.h>
+#endif
+
+#include "SolidCache.h"
+
+static const size_t kCacheMemSizeMax = (size_t)1 << 26;
+
+void CSolidCache::Free()
+{
+  _inFile.Close();
+  _outFile.Close();
+  _tempFile.Remove();
+  _tempCreated = false;
+  _limited = false;
+  _buf.Free();
+  _bufSize = 0;
+  Size = 0;
+}
+
+void CSolidCache::Append(const void *data, size_t size)
+{
+  if (_limited || size == 0)
+    return;
+  if (_bufSize < kCacheMemSizeMax)
+  {
+    size_t cur = kCacheMemSizeMax - _bufSize;
+    if (cur > size)
+      cur = size;
+    const size_t newSize = _bufSize + cur;
+    if (_buf.Size() < newSize)
+    {
+      size_t allocSize = _buf.Size() * 2;
+      if (allocSize < newSize)
+        allocSize = newSize;
+      if (allocSize > kCacheMemSizeMax)
+        allocSize = kCacheMemSizeMax;
+      _buf.ChangeSize_KeepData(allocSize, _bufSize);
+    }
+    memcpy(_buf + _bufSize, data, cur);
+    _bufSize = newSize;
+    Size += cur;
+    data = (const Byte *)data + cur;
+    size -= cur;
+    if (size == 0)
+      return;
+  }
+  if (!_tempCreated)
+  {
+    if (!UseTempFile
+        || !_tempFile.CreateRandomInTempFolder(FTEXT("7zCache"), &_outFile)
+        || !_inFile.OpenShared(_tempFile.GetPath(), true))
+    {
+      _limited = true;
+      return;
+    }
+    _tempCreated = true;
+  }
+  if (!_outFile.WriteFull(data, size))
+  {
+    _limited = true;
+    return;
+  }
+  Size += size;
+}
+
+HRESULT CSolidCache::Read(UInt64 pos, void *data, size_t size)
+{
+  if (pos < _bufSize)
+  {
+    size_t cur = _bufSize - (size_t)pos;
+    if (cur > size)
+      cur = size;
+    memcpy(data, _buf + (size_t)pos, cur);
+    data = (Byte *)data + cur;
+    size -= cur;
+    pos += cur;
+    if (size == 0)
+      return S_OK;
+  }
+  pos -= _bufSize;
+  #ifdef _WIN32
+  UInt64 newPos;
+  if (!_inFile.Seek(pos, newPos))
+  #else
+  if (_inFile.seek((off_t)pos, SEEK_SET) != (off_t)pos)
+  #endif
+    return GetLastError_noZero_HRESULT();
+  size_t processed;
+  if (!_inFile.ReadFull(data, size, processed))
+    return GetLastError_noZero_HRESULT();
+  return (processed == size) ? S_OK : E_FAIL;
+}
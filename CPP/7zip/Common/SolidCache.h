@@ -0,0 +1,40 @@
+// SolidCache.h
+
+#ifndef ZIP7_INC_SOLID_CACHE_H
+#define ZIP7_INC_SOLID_CACHE_H
+
+#include "../../Common/MyBuffer.h"
+
+#include "../../Windows/FileDir.h"
+#include "../../Windows/FileIO.h"
+
+/* CSolidCache stores the unpacked data of solid stream between Extract() calls.
+   So if the caller extracts one item per call, next call doesn't decode
+   solid stream from start again.
+   First (kCacheMemSizeMax) bytes are stored in memory,
+   and the remaining data is stored in temp file.
+   If (UseTempFile == false) or if we can't write temp file,
+   the cache contains only the data in memory. */
+
+class CSolidCache
+{
+  CByteBuffer _buf;
+  size_t _bufSize; // the size of data in (_buf)
+  bool _limited;   // the cache doesn't contain new data after (Size)
+  bool _tempCreated;
+  NWindows::NFile::NDir::CTempFile _tempFile;
+  NWindows::NFile::NIO::COutFile _outFile;
+  NWindows::NFile::NIO::CInFile _inFile;
+public:
+  UInt64 Size; // the size of cached data from start of solid stream
+  bool UseTempFile;
+
+  CSolidCache(): _bufSize(0), _limited(false), _tempCreated(false), Size(0), UseTempFile(true) {}
+  bool IsLimited() const { return _limited; }
+  void Free();
+  void Append(const void *data, size_t size);
+  // (pos + size <= Size) is required
+  HRESULT Read(UInt64 pos, void *data, size_t size);
+};
+
+#endif
@@ -9,6 +9,7 @@
 namespace NCompress {
 
 static const UInt32 kBufSize = 1 << 17;
+static const UInt32 kCopyFromSize = 1 << 22;
 
 CCopyCoder::~CCopyCoder()
 {
@@ -25,14 +26,54 @@ Z7_COM7F_IMF(CCopyCoder::Code(ISequentialInStream *inStream,
     const UInt64 * /* inSize */, const UInt64 *outSize,
     ICompressProgressInfo *progress))
 {
+  TotalSize = 0;
+
+  if (outStream)
+  {
+    /* if (outStream) can copy data from (inStream) without our buffer
+       (copy_file_range() in Linux for two files), we use such copying.
+       If it's not supported, we continue with Read() / Write() */
+    Z7_DECL_CMyComPtr_QI_FROM(
+        IOutStreamCopyFrom,
+        copyFrom, outStream)
+    if (copyFrom)
+    for (;;)
+    {
+      UInt64 size = kCopyFromSize;
+      if (outSize)
+      {
+        const UInt64 rem = *outSize - TotalSize;
+        if (size > rem)
+        {
+          size = rem;
+          if (size == 0)
+            return S_OK;
+        }
+      }
+      UInt64 processed = 0;
+      const HRESULT res = copyFrom->CopyFrom(inStream, size, &processed);
+      if (res == E_NOTIMPL)
+        break;
+      if (processed > size)
+        return E_FAIL; // internal code failure
+      TotalSize += processed;
+      RINOK(res)
+      if (processed == 0)
+        return S_OK;
+      if (progress)
+      {
+        RINOK(progress->SetRatioInfo(&TotalSize, &TotalSize))
+      }
+    }
+  }
+
+  /* the buffer is allocated only if (outStream) can't copy data itself */
   if (!_buf)
   {
     _buf = (Byte *)::MidAlloc(kBufSize);
     if (!_buf)
       return E_OUTOFMEMORY;
   }
-
-  TotalSize = 0;
   
   for (;;)
   {
@@ -0,0 +1,421 @@
+// LzxEncoder.cpp
+
+#include "StdAfx.h"
+
+#include <string.h>
+
+#include "../../../C/Alloc.h"
+#include "../../../C/CpuArch.h"
+#include "../../../C/HuffEnc.h"
+
+#include "LzxEncoder.h"
+
+namespace NCompress {
+namespace NLzx {
+
+static const unsigned kEncodeNumPosSlots = kEncodeNumDictBits * 2;
+static const unsigned kEncodeNumMainSyms = 256 + kEncodeNumPosSlots * kNumLenSlots;
+// (dist + kNumReps - 1) must be coded with (posSlot < kEncodeNumPosSlots)
+static const UInt32 kEncodeDistMax = kEncodeBlockSizeMax - kNumReps;
+
+static const unsigned kNumLevelHuffBits = (1 << kNumLevelBits) - 1;
+
+static const UInt32 kTranslationSize = 12000000;
+
+struct CToken
+{
+  UInt16 MainSym;
+  UInt16 LenSym;
+  UInt32 Extra;
+};
+
+
+class CBitWriter
+{
+  Byte *_buf;
+  size_t _pos;
+  UInt32 _value;
+  unsigned _numBits;
+public:
+  void Init(Byte *buf)
+  {
+    _buf = buf;
+    _pos = 0;
+    _value = 0;
+    _numBits = 0;
+  }
+
+  // (numBits <= 16)
+  void WriteBits(UInt32 value, unsigned numBits)
+  {
+    _value = (_value << numBits) | value;
+    _numBits += numBits;
+    if (_numBits >= 16)
+    {
+      _numBits -= 16;
+      SetUi16(_buf + _pos, (UInt16)(_value >> _numBits))
+      _pos += 2;
+    }
+  }
+
+  // the decoder requires zero bits for padding to 16-bit word
+  size_t Flush()
+  {
+    if (_numBits != 0)
+      WriteBits(0, 16 - _numBits);
+    return _pos;
+  }
+};
+
+
+/* it's inverse function for x86_Filter() in LzxDecoder.cpp
+   for block that is decoded with (processedSize == 0). */
+
+static void x86_Filter_Encode(Byte *data, UInt32 size)
+{
+  const UInt32 kResidue = 10;
+  if (size <= kResidue)
+    return;
+  size -= kResidue;
+  for (UInt32 i = 0; i < size;)
+  {
+    if (data[i] != 0xE8)
+    {
+      i++;
+      continue;
+    }
+    Int32 v = (Int32)GetUi32(data + i + 1);
+    const Int32 cur = (Int32)i;
+    if (v >= -cur && v < (Int32)kTranslationSize)
+    {
+      v = (v < (Int32)kTranslationSize - cur) ? v + cur : v - (Int32)kTranslationSize;
+      SetUi32(data + i + 1, (UInt32)v)
+    }
+    i += 5;
+  }
+}
+
+
+/* the levels of previous table are zeros for each block,
+   because each WIM chunk is decoded without history */
+
+static void WriteTable(CBitWriter &bw, const Byte *levels, unsigned numSymbols)
+{
+  Byte syms[kMainTableSize];
+  Byte extras[kMainTableSize];
+  UInt32 freqs[kLevelTableSize];
+  memset(freqs, 0, sizeof(freqs));
+  unsigned num = 0;
+
+  for (unsigned i = 0; i < numSymbols;)
+  {
+    const unsigned level = levels[i];
+    if (level == 0)
+    {
+      const unsigned kRunMax = kLevelSym_Zero2_Start + (1 << kLevelSym_Zero2_NumBits) - 1;
+      unsigned run = 1;
+      while (i + run < numSymbols && run < kRunMax && levels[i + run] == 0)
+        run++;
+      if (run >= kLevelSym_Zero1_Start)
+      {
+        i += run;
+        unsigned sym = kLevelSym_Zero1;
+        run -= kLevelSym_Zero1_Start;
+        if (run >= (1 << kLevelSym_Zero1_NumBits))
+        {
+          sym = kLevelSym_Zero2;
+          run -= (1 << kLevelSym_Zero1_NumBits);
+        }
+        syms[num] = (Byte)sym;
+        extras[num] = (Byte)run;
+        num++;
+        freqs[sym]++;
+        continue;
+      }
+    }
+    const unsigned sym = (kNumHuffmanBits + 1 - level) % (kNumHuffmanBits + 1);
+    syms[num++] = (Byte)sym;
+    freqs[sym]++;
+    i++;
+  }
+
+  UInt32 codes[kLevelTableSize];
+  Byte lens[kLevelTableSize];
+  Huffman_Generate(freqs, codes, lens, kLevelTableSize, kNumLevelHuffBits);
+
+  unsigned i;
+  for (i = 0; i < kLevelTableSize; i++)
+    bw.WriteBits(lens[i], kNumLevelBits);
+  for (i = 0; i < num; i++)
+  {
+    const unsigned sym = syms[i];
+    bw.WriteBits(codes[sym], lens[sym]);
+    if (sym == kLevelSym_Zero1)
+      bw.WriteBits(extras[i], kLevelSym_Zero1_NumBits);
+    else if (sym == kLevelSym_Zero2)
+      bw.WriteBits(extras[i], kLevelSym_Zero2_NumBits);
+  }
+}
+
+
+CEncoder::CEncoder():
+    _tokens(NULL),
+    _buf(NULL),
+    _created(false),
+    _level(5)
+{
+  MatchFinder_Construct(&_lzInWindow);
+}
+
+CEncoder::~CEncoder()
+{
+  MatchFinder_Free(&_lzInWindow, &g_AlignedAlloc);
+  ::MidFree(_tokens);
+  ::MidFree(_buf);
+}
+
+
+HRESULT CEncoder::Create()
+{
+  if (!_tokens)
+  {
+    _tokens = (CToken *)::MidAlloc(kEncodeBlockSizeMax * sizeof(CToken));
+    if (!_tokens)
+      return E_OUTOFMEMORY;
+  }
+  if (!_buf)
+  {
+    _buf = (Byte *)::MidAlloc(kEncodeBlockSizeMax);
+    if (!_buf)
+      return E_OUTOFMEMORY;
+  }
+  if (!_created)
+  {
+    MatchFinder_SET_DIRECT_INPUT_BUF(&_lzInWindow, NULL, 0)
+    _lzInWindow.btMode = 0;
+    _lzInWindow.numHashBytes = 3;
+    _lzInWindow.numHashBytes_Min = 3;
+    _lzInWindow.expectedDataSize = kEncodeBlockSizeMax;
+    if (!MatchFinder_Create(&_lzInWindow, kEncodeBlockSizeMax, 0, kMatchMaxLen, 0, &g_AlignedAlloc))
+      return E_OUTOFMEMORY;
+    _created = true;
+  }
+  _lzInWindow.cutValue =
+      _level < 3 ? 4 :
+      _level < 5 ? 12 :
+      _level < 7 ? 32 :
+      _level < 9 ? 64 : 256;
+  return S_OK;
+}
+
+
+UInt32 CEncoder::GetMatch(UInt32 &dist)
+{
+  UInt32 pairs[kMatchMaxLen * 2 + 3];
+  UInt32 numPairs = (UInt32)(Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, pairs) - pairs);
+  // the distances increase with lengths, so we look for longest match with allowed distance
+  for (; numPairs != 0; numPairs -= 2)
+  {
+    const UInt32 d = pairs[(size_t)numPairs - 1] + 1;
+    if (d <= kEncodeDistMax)
+    {
+      dist = d;
+      return pairs[(size_t)numPairs - 2];
+    }
+  }
+  return 0;
+}
+
+void CEncoder::Skip(UInt32 num)
+{
+  if (num != 0)
+    Hc3Zip_MatchFinder_Skip(&_lzInWindow, num);
+}
+
+
+UInt32 CEncoder::GetRepLen(const Byte *data, UInt32 pos, UInt32 size, unsigned &repIndex) const
+{
+  UInt32 lenLimit = size - pos;
+  if (lenLimit > kMatchMaxLen)
+    lenLimit = kMatchMaxLen;
+  const Byte *cur = data + pos;
+  UInt32 bestLen = 0;
+  for (unsigned i = 0; i < kNumReps; i++)
+  {
+    const UInt32 rep = _reps[i];
+    if (rep > pos)
+      continue;
+    UInt32 len = 0;
+    for (; len < lenLimit && cur[len] == cur[(size_t)len - rep]; len++);
+    if (bestLen < len)
+    {
+      bestLen = len;
+      repIndex = i;
+    }
+  }
+  return bestLen;
+}
+
+
+HRESULT CEncoder::Encode(const Byte *data, size_t size, Byte *dest, size_t &packSize)
+{
+  packSize = size;
+  if (size > kEncodeBlockSizeMax)
+    return E_INVALIDARG;
+  if (size == 0)
+    return S_OK;
+  RINOK(Create())
+
+  memcpy(_buf, data, size);
+  x86_Filter_Encode(_buf, (UInt32)size);
+  data = _buf;
+
+  MatchFinder_SET_DIRECT_INPUT_BUF(&_lzInWindow, data, size)
+  MatchFinder_Init(&_lzInWindow);
+
+  _reps[0] = 1;
+  _reps[1] = 1;
+  _reps[2] = 1;
+
+  UInt32 mainFreqs[kEncodeNumMainSyms];
+  UInt32 lenFreqs[kNumLenSymbols];
+  memset(mainFreqs, 0, sizeof(mainFreqs));
+  memset(lenFreqs, 0, sizeof(lenFreqs));
+
+  const bool lazyMode = (_level >= 5);
+  CToken *tokens = _tokens;
+  UInt32 numTokens = 0;
+  UInt32 pos = 0;
+  UInt32 dist = 0;
+  UInt32 mainLen = GetMatch(dist);
+
+  for (;;)
+  {
+    unsigned repIndex = 0;
+    const UInt32 repLen = GetRepLen(data, pos, (UInt32)size, repIndex);
+    UInt32 len = mainLen;
+    // (posSlot < kNumReps) for rep matches
+    unsigned posSlot = kNumReps;
+    if (repLen >= kMatchMinLen && repLen + 1 >= mainLen)
+    {
+      len = repLen;
+      posSlot = repIndex;
+    }
+    else if (len >= kMatchMinLen)
+    {
+      for (unsigned i = 0; i < kNumReps; i++)
+        if (_reps[i] == dist)
+        {
+          posSlot = i;
+          break;
+        }
+    }
+    else
+    {
+      const Byte b = data[pos];
+      tokens[numTokens].MainSym = b;
+      numTokens++;
+      mainFreqs[b]++;
+      if (++pos == size)
+        break;
+      mainLen = GetMatch(dist);
+      continue;
+    }
+
+    if (lazyMode && len < kMatchMaxLen)
+    {
+      UInt32 dist2 = 0;
+      const UInt32 len2 = GetMatch(dist2);
+      if (len2 > len + (posSlot < kNumReps ? 1 : 0))
+      {
+        const Byte b = data[pos];
+        tokens[numTokens].MainSym = b;
+        numTokens++;
+        mainFreqs[b]++;
+        pos++;
+        mainLen = len2;
+        dist = dist2;
+        continue;
+      }
+      Skip(len - 2);
+    }
+    else
+      Skip(len - 1);
+
+    CToken &t = tokens[numTokens++];
+    t.Extra = 0;
+    if (posSlot < kNumReps)
+    {
+      const UInt32 rep = _reps[posSlot];
+      _reps[posSlot] = _reps[0];
+      _reps[0] = rep;
+    }
+    else
+    {
+      _reps[2] = _reps[1];
+      _reps[1] = _reps[0];
+      _reps[0] = dist;
+      const UInt32 v = dist + kNumReps - 1;
+      unsigned numBits = 1;
+      while ((v >> numBits) != 1)
+        numBits++;
+      posSlot = numBits * 2 + ((v >> (numBits - 1)) & 1);
+      const unsigned numDirectBits = (posSlot >> 1) - 1;
+      t.Extra = v - ((UInt32)(2 | (posSlot & 1)) << numDirectBits);
+    }
+    unsigned lenSlot = len - kMatchMinLen;
+    if (lenSlot >= kNumLenSlots - 1)
+    {
+      t.LenSym = (UInt16)(lenSlot - (kNumLenSlots - 1));
+      lenFreqs[t.LenSym]++;
+      lenSlot = kNumLenSlots - 1;
+    }
+    t.MainSym = (UInt16)(256 + posSlot * kNumLenSlots + lenSlot);
+    mainFreqs[t.MainSym]++;
+    pos += len;
+    if (pos == size)
+      break;
+    mainLen = GetMatch(dist);
+  }
+
+  UInt32 mainCodes[kEncodeNumMainSyms];
+  Byte mainLevels[kEncodeNumMainSyms];
+  UInt32 lenCodes[kNumLenSymbols];
+  Byte lenLevels[kNumLenSymbols];
+  Huffman_Generate(mainFreqs, mainCodes, mainLevels, kEncodeNumMainSyms, kNumHuffmanBits);
+  Huffman_Generate(lenFreqs, lenCodes, lenLevels, kNumLenSymbols, kNumHuffmanBits);
+
+  CBitWriter bw;
+  bw.Init(dest);
+  bw.WriteBits(kBlockType_Verbatim, kBlockType_NumBits);
+  // WIM mode: one bit flag for default block size (32 KB)
+  if (size == kEncodeBlockSizeMax)
+    bw.WriteBits(1, 1);
+  else
+  {
+    bw.WriteBits(0, 1);
+    bw.WriteBits((UInt32)size, 16);
+  }
+  WriteTable(bw, mainLevels, 256);
+  WriteTable(bw, mainLevels + 256, kEncodeNumMainSyms - 256);
+  WriteTable(bw, lenLevels, kNumLenSymbols);
+
+  for (UInt32 i = 0; i < numTokens; i++)
+  {
+    const CToken &t = tokens[i];
+    const unsigned sym = t.MainSym;
+    bw.WriteBits(mainCodes[sym], mainLevels[sym]);
+    if (sym < 256)
+      continue;
+    if (((sym - 256) % kNumLenSlots) == kNumLenSlots - 1)
+      bw.WriteBits(lenCodes[t.LenSym], lenLevels[t.LenSym]);
+    const unsigned posSlot = (sym - 256) / kNumLenSlots;
+    if (posSlot >= kNumReps)
+      bw.WriteBits(t.Extra, (posSlot >> 1) - 1);
+  }
+
+  packSize = bw.Flush();
+  return S_OK;
+}
+
+}}
@@ -0,0 +1,55 @@
+// LzxEncoder.h
+
+#ifndef ZIP7_INC_LZX_ENCODER_H
+#define ZIP7_INC_LZX_ENCODER_H
+
+#include "../../../C/LzFind.h"
+
+#include "../../Common/MyWindows.h"
+
+#include "Lzx.h"
+
+namespace NCompress {
+namespace NLzx {
+
+const unsigned kEncodeNumDictBits = kNumDictBits_Min;
+const UInt32 kEncodeBlockSizeMax = (UInt32)1 << kEncodeNumDictBits;
+
+/*
+  CEncoder compresses independent block (WIM chunk) in LZX format
+  with (numDictBits = 15), as one verbatim LZX block with x86 translation.
+  Such block can be decoded by NLzx::CDecoder(wimMode = true).
+*/
+
+struct CToken;
+
+class CEncoder
+{
+  CMatchFinder _lzInWindow;
+  CToken *_tokens;
+  Byte *_buf;
+  bool _created;
+  UInt32 _level;
+  UInt32 _reps[kNumReps];
+
+  UInt32 GetMatch(UInt32 &dist);
+  void Skip(UInt32 num);
+  UInt32 GetRepLen(const Byte *data, UInt32 pos, UInt32 size, unsigned &repIndex) const;
+  HRESULT Create();
+public:
+  CEncoder();
+  ~CEncoder();
+
+  void SetLevel(UInt32 level) { _level = level; }
+
+  // (dest) buffer must contain GetPackBufSize(size) bytes
+  static size_t GetPackBufSize(size_t size) { return size * 2 + ((size_t)1 << 12); }
+
+  /* (size <= kEncodeBlockSizeMax) is required.
+     it returns (packSize >= size), if block can't be compressed */
+  HRESULT Encode(const Byte *data, size_t size, Byte *dest, size_t &packSize);
+};
+
+}}
+
+#endif
@@ -0,0 +1,306 @@
+// XpressEncoder.cpp
+
+#include "StdAfx.h"
+
+#include <string.h>
+
+#include "../../../C/Alloc.h"
+#include "../../../C/CpuArch.h"
+#include "../../../C/HuffEnc.h"
+
+#include "XpressEncoder.h"
+
+namespace NCompress {
+namespace NXpress {
+
+static const unsigned kNumHuffBits = 15;
+static const unsigned kNumLenBits = 4;
+static const unsigned kLenMask = (1 << kNumLenBits) - 1;
+static const unsigned kNumPosSlots = 16;
+static const unsigned kNumSyms = 256 + (kNumPosSlots << kNumLenBits);
+static const unsigned kSymEnd = 256;
+
+static const UInt32 kMatchMinLen = 3;
+static const UInt32 kMatchMaxLen = kMatchMinLen + 0xFFFF;
+static const UInt32 kNumFastBytes = 273;
+
+struct CToken
+{
+  UInt32 Len;  // (Len == 0) for literal
+  UInt32 Dist; // it's byte value for literal
+};
+
+
+/* The decoder reads 16-bit words of bit stream in advance,
+   and the bytes of long match lengths are placed after these words.
+   So we emulate the reading of decoder: we reserve the positions for
+   next 16-bit words in same order as decoder reads them,
+   and we fill these positions later, when the bits are ready. */
+
+class CBitWriter
+{
+  Byte *_buf;
+  size_t _pos;
+  UInt32 _value;
+  unsigned _numBits;   // the number of bits in (_value) that were not written
+  unsigned _decBits;   // the number of bits in decoder's (Value) after normalization
+  unsigned _head;
+  unsigned _numWords;
+  size_t _words[4];    // reserved positions for 16-bit words
+
+  void ReserveWord()
+  {
+    _words[(_head + _numWords) & 3] = _pos;
+    _numWords++;
+    _pos += 2;
+  }
+  void WriteWord(UInt32 v)
+  {
+    SetUi16(_buf + _words[_head], (UInt16)v)
+    _head = (_head + 1) & 3;
+    _numWords--;
+  }
+public:
+  void Init(Byte *buf)
+  {
+    _buf = buf;
+    _pos = 0;
+    _value = 0;
+    _numBits = 0;
+    _head = 0;
+    _numWords = 0;
+    ReserveWord();
+    ReserveWord();
+    _decBits = 32;
+  }
+
+  void WriteBits(UInt32 value, unsigned numBits)
+  {
+    _value = (_value << numBits) | value;
+    _numBits += numBits;
+    if (_numBits >= 16)
+    {
+      _numBits -= 16;
+      WriteWord(_value >> _numBits);
+    }
+    _decBits -= numBits;
+    if (_decBits < 16)
+    {
+      ReserveWord();
+      _decBits += 16;
+    }
+  }
+
+  void WriteByte(Byte b) { _buf[_pos++] = b; }
+
+  size_t Flush()
+  {
+    if (_numBits != 0)
+    {
+      WriteWord(_value << (16 - _numBits));
+      _numBits = 0;
+    }
+    while (_numWords != 0)
+      WriteWord(0);
+    return _pos;
+  }
+};
+
+
+static unsigned GetPosSlot(UInt32 dist)
+{
+  unsigned i = 0;
+  while ((dist >>= 1) != 0)
+    i++;
+  return i;
+}
+
+static unsigned GetMatchSym(UInt32 len, UInt32 dist)
+{
+  len -= kMatchMinLen;
+  if (len > kLenMask)
+    len = kLenMask;
+  return 256 + (GetPosSlot(dist) << kNumLenBits) + (unsigned)len;
+}
+
+
+CEncoder::CEncoder():
+    _tokens(NULL),
+    _created(false),
+    _level(5)
+{
+  MatchFinder_Construct(&_lzInWindow);
+}
+
+CEncoder::~CEncoder()
+{
+  MatchFinder_Free(&_lzInWindow, &g_AlignedAlloc);
+  ::MidFree(_tokens);
+}
+
+
+HRESULT CEncoder::Create()
+{
+  if (!_tokens)
+  {
+    _tokens = (CToken *)::MidAlloc(kEncodeBlockSizeMax * sizeof(CToken));
+    if (!_tokens)
+      return E_OUTOFMEMORY;
+  }
+  if (!_created)
+  {
+    MatchFinder_SET_DIRECT_INPUT_BUF(&_lzInWindow, NULL, 0)
+    _lzInWindow.btMode = 0;
+    _lzInWindow.numHashBytes = 3;
+    _lzInWindow.numHashBytes_Min = 3;
+    _lzInWindow.expectedDataSize = kEncodeBlockSizeMax;
+    if (!MatchFinder_Create(&_lzInWindow, kEncodeBlockSizeMax, 0, kNumFastBytes, 0, &g_AlignedAlloc))
+      return E_OUTOFMEMORY;
+    _created = true;
+  }
+  _lzInWindow.cutValue =
+      _level < 3 ? 4 :
+      _level < 5 ? 12 :
+      _level < 7 ? 32 :
+      _level < 9 ? 64 : 256;
+  return S_OK;
+}
+
+
+UInt32 CEncoder::GetMatch(UInt32 &dist)
+{
+  UInt32 pairs[kNumFastBytes * 2 + 3];
+  const UInt32 numPairs = (UInt32)(Hc3Zip_MatchFinder_GetMatches(&_lzInWindow, pairs) - pairs);
+  if (numPairs == 0)
+    return 0;
+  UInt32 len = pairs[(size_t)numPairs - 2];
+  dist = pairs[(size_t)numPairs - 1] + 1;
+  if (len == kNumFastBytes)
+  {
+    UInt32 numAvail = Inline_MatchFinder_GetNumAvailableBytes(&_lzInWindow) + 1;
+    if (numAvail > kMatchMaxLen)
+      numAvail = kMatchMaxLen;
+    const Byte *p = Inline_MatchFinder_GetPointerToCurrentPos(&_lzInWindow) - 1;
+    for (; len < numAvail && p[len] == p[(size_t)len - dist]; len++);
+  }
+  return len;
+}
+
+void CEncoder::Skip(UInt32 num)
+{
+  if (num != 0)
+    Hc3Zip_MatchFinder_Skip(&_lzInWindow, num);
+}
+
+
+HRESULT CEncoder::Encode(const Byte *data, size_t size, Byte *dest, size_t &packSize)
+{
+  packSize = size;
+  if (size > kEncodeBlockSizeMax)
+    return E_INVALIDARG;
+  if (size == 0)
+    return S_OK;
+  RINOK(Create())
+
+  MatchFinder_SET_DIRECT_INPUT_BUF(&_lzInWindow, data, size)
+  MatchFinder_Init(&_lzInWindow);
+
+  UInt32 freqs[kNumSyms];
+  memset(freqs, 0, sizeof(freqs));
+
+  // lazy matching: we check the match at next position before writing current match
+  const bool lazyMode = (_level >= 5);
+  CToken *tokens = _tokens;
+  UInt32 numTokens = 0;
+  UInt32 pos = 0;
+  UInt32 dist = 0;
+  UInt32 len = GetMatch(dist);
+
+  for (;;)
+  {
+    if (len < kMatchMinLen)
+    {
+      const Byte b = data[pos];
+      tokens[numTokens].Len = 0;
+      tokens[numTokens].Dist = b;
+      numTokens++;
+      freqs[b]++;
+      if (++pos == size)
+        break;
+      len = GetMatch(dist);
+      continue;
+    }
+    if (lazyMode && len < kNumFastBytes)
+    {
+      UInt32 dist2 = 0;
+      const UInt32 len2 = GetMatch(dist2);
+      if (len2 > len)
+      {
+        const Byte b = data[pos];
+        tokens[numTokens].Len = 0;
+        tokens[numTokens].Dist = b;
+        numTokens++;
+        freqs[b]++;
+        pos++;
+        len = len2;
+        dist = dist2;
+        continue;
+      }
+      Skip(len - 2);
+    }
+    else
+      Skip(len - 1);
+    tokens[numTokens].Len = len;
+    tokens[numTokens].Dist = dist;
+    numTokens++;
+    freqs[GetMatchSym(len, dist)]++;
+    pos += len;
+    if (pos == size)
+      break;
+    len = GetMatch(dist);
+  }
+
+  freqs[kSymEnd]++;
+
+  UInt32 codes[kNumSyms];
+  Byte lens[kNumSyms];
+  Huffman_Generate(freqs, codes, lens, kNumSyms, kNumHuffBits);
+
+  for (unsigned i = 0; i < kNumSyms / 2; i++)
+    dest[i] = (Byte)(lens[(size_t)i * 2] | (lens[(size_t)i * 2 + 1] << 4));
+
+  CBitWriter bw;
+  bw.Init(dest + kNumSyms / 2);
+
+  for (UInt32 i = 0; i < numTokens; i++)
+  {
+    const CToken &t = tokens[i];
+    if (t.Len == 0)
+    {
+      bw.WriteBits(codes[t.Dist], lens[t.Dist]);
+      continue;
+    }
+    const unsigned sym = GetMatchSym(t.Len, t.Dist);
+    bw.WriteBits(codes[sym], lens[sym]);
+    const UInt32 lenRem = t.Len - kMatchMinLen;
+    if (lenRem >= kLenMask)
+    {
+      if (lenRem - kLenMask < 0xFF)
+        bw.WriteByte((Byte)(lenRem - kLenMask));
+      else
+      {
+        bw.WriteByte(0xFF);
+        bw.WriteByte((Byte)lenRem);
+        bw.WriteByte((Byte)(lenRem >> 8));
+      }
+    }
+    const unsigned numDirectBits = (sym - 256) >> kNumLenBits;
+    bw.WriteBits(t.Dist - ((UInt32)1 << numDirectBits), numDirectBits);
+  }
+
+  bw.WriteBits(codes[kSymEnd], lens[kSymEnd]);
+  packSize = kNumSyms / 2 + bw.Flush();
+  return S_OK;
+}
+
+}}
@@ -0,0 +1,48 @@
+// XpressEncoder.h
+
+#ifndef ZIP7_INC_XPRESS_ENCODER_H
+#define ZIP7_INC_XPRESS_ENCODER_H
+
+#include "../../../C/LzFind.h"
+
+#include "../../Common/MyWindows.h"
+
+namespace NCompress {
+namespace NXpress {
+
+const UInt32 kEncodeBlockSizeMax = (UInt32)1 << 16;
+
+/*
+  CEncoder compresses independent block (WIM chunk) in XPRESS-Huffman format,
+  that can be decoded by NXpress::Decode().
+*/
+
+struct CToken;
+
+class CEncoder
+{
+  CMatchFinder _lzInWindow;
+  CToken *_tokens;
+  bool _created;
+  UInt32 _level;
+
+  UInt32 GetMatch(UInt32 &dist);
+  void Skip(UInt32 num);
+  HRESULT Create();
+public:
+  CEncoder();
+  ~CEncoder();
+
+  void SetLevel(UInt32 level) { _level = level; }
+
+  // (dest) buffer must contain GetPackBufSize(size) bytes
+  static size_t GetPackBufSize(size_t size) { return size * 2 + 512; }
+
+  /* (size <= kEncodeBlockSizeMax) is required.
+     it returns (packSize >= size), if block can't be compressed */
+  HRESULT Encode(const Byte *data, size_t size, Byte *dest, size_t &packSize);
+};
+
+}}
+
+#endif
@@ -203,5 +203,45 @@ inputs:
 
 Z7_IFACE_CONSTR_STREAM(IStreamSetRestriction, 0x10)
 
+
+/*
+IStreamGetFileHandle::GetFileHandle(UINT_PTR *handle)
+  It returns OS file handle of file stream (file descriptor in posix).
+  The caller can use that handle only to call IOutStreamCopyFrom::CopyFrom()
+  of another stream, while the stream object is alive.
+  returns:
+    S_OK      : (*handle) is valid handle, and current position of that handle
+                is current position of stream.
+    E_NOTIMPL : there is no such handle.
+*/
+
+#define Z7_IFACEM_IStreamGetFileHandle(x) \
+  x(GetFileHandle(UINT_PTR *handle)) \
+
+Z7_IFACE_CONSTR_STREAM(IStreamGetFileHandle, 0x11)
+
+
+/*
+IOutStreamCopyFrom::CopyFrom(ISequentialInStream *inStream, UInt64 size, UInt64 *processedSize)
+  It copies up to (size) bytes from current position of (inStream) to current position
+  of output stream without reading data to caller's buffers.
+  The callee can support only some types of (inStream). For example, it can copy data
+  between two files in kernel (copy_file_range() in Linux), if (inStream) supports
+  IStreamGetFileHandle.
+  returns:
+    S_OK      : (*processedSize) bytes were copied, and the positions of both streams
+                were moved by (*processedSize).
+                (*processedSize == 0) means the end of input stream.
+                (*processedSize < size) is allowed also for another cases.
+    E_NOTIMPL : no data was copied. The callee can't copy data from such (inStream)
+                or copying failed. The caller must copy the data via Read() / Write().
+                So the error will be reported by Read() or Write() in that case.
+*/
+
+#define Z7_IFACEM_IOutStreamCopyFrom(x) \
+  x(CopyFrom(ISequentialInStream *inStream, UInt64 size, UInt64 *processedSize)) \
+
+Z7_IFACE_CONSTR_STREAM(IOutStreamCopyFrom, 0x12)
+
 Z7_PURE_INTERFACES_END
 #endif
@@ -172,7 +172,8 @@ enum Enum
   kNameTrailReplace,
 
   kDeleteAfterCompressing,
-  kSetArcMTime
+  kSetArcMTime,
+  kUpdateInPlace
 
   #ifndef Z7_NO_CRYPTO
   , kPassword
@@ -320,7 +321,8 @@ static const CSwitchForm kSwitchForms[] =
   { "snt", SWFRM_MINUS },
   
   { "sdel", SWFRM_SIMPLE },
-  { "stl", SWFRM_SIMPLE }
+  { "stl", SWFRM_SIMPLE },
+  { "sui", SWFRM_SIMPLE }
 
   #ifndef Z7_NO_CRYPTO
   , { "p", SWFRM_STRING }
@@ -918,6 +920,11 @@ static void SetAddCommandOptions(
   }
   
   options.UpdateArchiveItself = true;
+  /* the paths in "d" command are paths of archive items.
+     So the items selected by wildcards always have (q) state, if we use -u switch:
+       7z d a.7z -u- -up0q1!b.7z -up1q0!c.7z dir1
+     splits a.7z to b.7z (dir1) and c.7z (other items) without recompression. */
+  options.DeleteMode = (commandType == NCommandType::kDelete);
   
   options.Commands.Clear();
   CUpdateArchiveCommand updateMainCommand;
@@ -1599,6 +1606,7 @@ void CArcCmdLineParser::Parse2(CArcCmdLineOptions &options)
 
     updateOptions.DeleteAfterCompressing = parser[NKey::kDeleteAfterCompressing].ThereIs;
     updateOptions.SetArcMTime = parser[NKey::kSetArcMTime].ThereIs;
+    updateOptions.InPlace = parser[NKey::kUpdateInPlace].ThereIs;
 
     if (updateOptions.StdOutMode && updateOptions.EMailMode)
       throw CArcCmdLineException("stdout mode and email mode cannot be combined");
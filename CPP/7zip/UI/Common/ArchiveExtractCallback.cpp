@@ -2386,6 +2386,15 @@ Z7_COM7F_IMF(CArchiveExtractCallback::SetOperationResult(Int32 opRes))
 
 
 
+// in stdout mode all items are written to one stream, so the order of items is fixed
+
+Z7_COM7F_IMF(CArchiveExtractCallback::GetAnyOrder(Int32 *anyOrder))
+{
+  *anyOrder = BoolToInt(!_stdOutMode);
+  return S_OK;
+}
+
+
 Z7_COM7F_IMF(CArchiveExtractCallback::ReportExtractResult(UInt32 indexType, UInt32 index, Int32 opRes))
 {
   if (_folderArchiveExtractCallback2)
@@ -247,15 +247,17 @@ struct COwnerInfo
 class CArchiveExtractCallback Z7_final:
   public IArchiveExtractCallback,
   public IArchiveExtractCallbackMessage2,
+  public IArchiveExtractCallbackOrder,
   public ICryptoGetTextPassword,
   public ICompressProgressInfo,
   public IArchiveUpdateCallbackFile,
   public IArchiveGetDiskProperty,
   public CMyUnknownImp
 {
-  Z7_COM_UNKNOWN_IMP_5(
+  Z7_COM_UNKNOWN_IMP_6(
       /* IArchiveExtractCallback, */
       IArchiveExtractCallbackMessage2,
+      IArchiveExtractCallbackOrder,
       ICryptoGetTextPassword,
       ICompressProgressInfo,
       IArchiveUpdateCallbackFile,
@@ -264,6 +266,7 @@ class CArchiveExtractCallback Z7_final:
   Z7_IFACE_COM7_IMP(IProgress)
   Z7_IFACE_COM7_IMP(IArchiveExtractCallback)
   Z7_IFACE_COM7_IMP(IArchiveExtractCallbackMessage2)
+  Z7_IFACE_COM7_IMP(IArchiveExtractCallbackOrder)
   Z7_IFACE_COM7_IMP(ICryptoGetTextPassword)
   Z7_IFACE_COM7_IMP(ICompressProgressInfo)
   Z7_IFACE_COM7_IMP(IArchiveUpdateCallbackFile)
@@ -5,12 +5,22 @@
 #include "../../../../C/Sort.h"
 
 #include "../../../Common/StringConvert.h"
+#include "../../../Common/StringToInt.h"
 
 #include "../../../Windows/FileDir.h"
 #include "../../../Windows/FileName.h"
 #include "../../../Windows/ErrorMsg.h"
 #include "../../../Windows/PropVariant.h"
 #include "../../../Windows/PropVariantConv.h"
+#if !defined(Z7_SFX) && !defined(Z7_ST)
+#include "../../../Windows/System.h"
+#endif
+
+#include "../../Common/StreamUtils.h"
+#if !defined(Z7_SFX) && !defined(Z7_ST)
+#include "../../Common/MethodProps.h"
+#include "../../Common/SlotRing.h"
+#endif
 
 #include "../Common/ExtractingFilePath.h"
 #include "../Common/HashCalc.h"
@@ -35,6 +45,530 @@ static void SetErrorMessage(const char *message,
 }
 
 
+#if !defined(Z7_SFX) && !defined(Z7_ST)
+
+/* Parallel extraction for formats with NArcInfoFlags::kIndependentItems flag.
+   We open additional handler objects for same archive file.
+   The items are split to batches by packed size, and each batch is extracted
+   by own handler object in separate thread to memory buffer.
+   The main thread sends the buffered items to CArchiveExtractCallback
+   in original order of items. So only main thread works with files and UI,
+   and the callback sees same sequence of calls as in single-thread mode.
+   Big items, items of unknown size and encrypted items are extracted
+   by main handler object in main thread. */
+
+struct CBufferedItem
+{
+  UInt32 Index;
+  Int32 AskMode;
+  Int32 OpRes;
+  bool Prepared;
+  bool OpRes_Defined;
+  size_t Offset;
+};
+
+Z7_CLASS_IMP_COM_1(
+  CBatchExtractCallback
+  , IArchiveExtractCallback
+)
+  Z7_IFACE_COM7_IMP(IProgress)
+public:
+  CRecordVector<CBufferedItem> Items;
+  CDynBufSeqOutStream *BufSpec;
+  CMyComPtr<ISequentialOutStream> Buf;
+
+  CBatchExtractCallback()
+  {
+    BufSpec = new CDynBufSeqOutStream;
+    Buf = BufSpec;
+  }
+  void Init()
+  {
+    Items.Clear();
+    BufSpec->Init();
+  }
+  size_t GetItemSize(unsigned i) const
+  {
+    const size_t end = (i + 1 < Items.Size()) ? Items[i + 1].Offset : BufSpec->GetSize();
+    return end - Items[i].Offset;
+  }
+};
+
+Z7_COM7F_IMF(CBatchExtractCallback::SetTotal(UInt64 /* size */))
+{
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CBatchExtractCallback::SetCompleted(const UInt64 * /* completeValue */))
+{
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CBatchExtractCallback::GetStream(UInt32 index, ISequentialOutStream **outStream, Int32 askMode))
+{
+  *outStream = NULL;
+  CBufferedItem item;
+  item.Index = index;
+  item.AskMode = askMode;
+  item.OpRes = NArchive::NExtract::NOperationResult::kOK;
+  item.Prepared = false;
+  item.OpRes_Defined = false;
+  item.Offset = BufSpec->GetSize();
+  Items.Add(item);
+  // we don't need data in test mode
+  if (askMode == NArchive::NExtract::NAskMode::kExtract)
+  {
+    CMyComPtr<ISequentialOutStream> buf = Buf;
+    *outStream = buf.Detach();
+  }
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CBatchExtractCallback::PrepareOperation(Int32 /* askExtractMode */))
+{
+  if (Items.IsEmpty())
+    return E_FAIL;
+  Items.Back().Prepared = true;
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CBatchExtractCallback::SetOperationResult(Int32 opRes))
+{
+  if (Items.IsEmpty())
+    return E_FAIL;
+  CBufferedItem &item = Items.Back();
+  item.OpRes = opRes;
+  item.OpRes_Defined = true;
+  return S_OK;
+}
+
+
+/* CDirectExtractCallback is used for the items that are extracted
+   by main handler object. It converts the progress of each Extract() call
+   to the progress of whole archive. */
+
+Z7_CLASS_IMP_COM_4(
+  CDirectExtractCallback
+  , IArchiveExtractCallback
+  , IArchiveExtractCallbackMessage2
+  , ICryptoGetTextPassword
+  , ICompressProgressInfo
+)
+  Z7_IFACE_COM7_IMP(IProgress)
+
+  CMyComPtr<IArchiveExtractCallback> _callback;
+  CMyComPtr<IArchiveExtractCallbackMessage2> _callbackMessage;
+  CMyComPtr<ICryptoGetTextPassword> _getTextPassword;
+  CMyComPtr<ICompressProgressInfo> _ratioProgress;
+public:
+  UInt64 Completed;
+
+  void Init(IArchiveExtractCallback *callback)
+  {
+    _callback = callback;
+    callback->QueryInterface(IID_IArchiveExtractCallbackMessage2, (void **)&_callbackMessage);
+    callback->QueryInterface(IID_ICryptoGetTextPassword, (void **)&_getTextPassword);
+    callback->QueryInterface(IID_ICompressProgressInfo, (void **)&_ratioProgress);
+    Completed = 0;
+  }
+};
+
+Z7_COM7F_IMF(CDirectExtractCallback::SetTotal(UInt64 /* size */))
+{
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CDirectExtractCallback::SetCompleted(const UInt64 *completeValue))
+{
+  if (!completeValue)
+    return _callback->SetCompleted(NULL);
+  const UInt64 v = Completed + *completeValue;
+  return _callback->SetCompleted(&v);
+}
+
+Z7_COM7F_IMF(CDirectExtractCallback::GetStream(UInt32 index, ISequentialOutStream **outStream, Int32 askMode))
+{
+  return _callback->GetStream(index, outStream, askMode);
+}
+
+Z7_COM7F_IMF(CDirectExtractCallback::PrepareOperation(Int32 askExtractMode))
+{
+  return _callback->PrepareOperation(askExtractMode);
+}
+
+Z7_COM7F_IMF(CDirectExtractCallback::SetOperationResult(Int32 opRes))
+{
+  return _callback->SetOperationResult(opRes);
+}
+
+Z7_COM7F_IMF(CDirectExtractCallback::ReportExtractResult(UInt32 indexType, UInt32 index, Int32 opRes))
+{
+  if (!_callbackMessage)
+    return S_OK;
+  return _callbackMessage->ReportExtractResult(indexType, index, opRes);
+}
+
+Z7_COM7F_IMF(CDirectExtractCallback::CryptoGetTextPassword(BSTR *password))
+{
+  if (!_getTextPassword)
+    return E_NOTIMPL;
+  return _getTextPassword->CryptoGetTextPassword(password);
+}
+
+Z7_COM7F_IMF(CDirectExtractCallback::SetRatioInfo(const UInt64 *inSize, const UInt64 *outSize))
+{
+  if (!_ratioProgress)
+    return S_OK;
+  return _ratioProgress->SetRatioInfo(inSize, outSize);
+}
+
+
+struct CExtractSlot
+{
+  CMyComPtr<IInArchive> Archive;
+  CBatchExtractCallback *CallbackSpec;
+  CMyComPtr<IArchiveExtractCallback> Callback;
+  const UInt32 *Indices;
+  UInt32 NumItems;
+  UInt64 UnpackSize;
+  Int32 TestMode;
+  HRESULT Res;
+
+  CExtractSlot()
+  {
+    CallbackSpec = new CBatchExtractCallback;
+    Callback = CallbackSpec;
+  }
+  void Run()
+  {
+    try { Res = Archive->Extract(Indices, NumItems, TestMode, Callback); }
+    catch(...) { Res = E_OUTOFMEMORY; }
+  }
+};
+
+
+class CExtractQueue
+{
+public:
+  CSlotRing<CExtractSlot> Ring;
+  IInArchive *Archive;
+  IArchiveExtractCallback *ExtractCallback;
+  UInt64 Completed;
+
+  CExtractQueue(): Completed(0) {}
+
+  HRESULT WriteNext();
+  HRESULT Flush()
+  {
+    while (!Ring.IsEmpty())
+    {
+      RINOK(WriteNext())
+    }
+    return S_OK;
+  }
+};
+
+
+HRESULT CExtractQueue::WriteNext()
+{
+  const CExtractSlot &slot = Ring.FinishNext();
+
+  const CBatchExtractCallback &batch = *slot.CallbackSpec;
+  
+  FOR_VECTOR (i, batch.Items)
+  {
+    const CBufferedItem &item = batch.Items[i];
+    CMyComPtr<ISequentialOutStream> outStream;
+    RINOK(ExtractCallback->GetStream(item.Index, &outStream, item.AskMode))
+    if (!outStream && item.AskMode == NArchive::NExtract::NAskMode::kExtract)
+    {
+      // handlers with kIndependentItems flag skip such file without other calls
+      bool isDir = false;
+      RINOK(Archive_IsItem_Dir(Archive, item.Index, isDir))
+      if (!isDir)
+        continue;
+    }
+    if (item.Prepared)
+    {
+      RINOK(ExtractCallback->PrepareOperation(item.AskMode))
+    }
+    if (outStream)
+    {
+      RINOK(WriteStream(outStream, batch.BufSpec->GetBuffer() + item.Offset, batch.GetItemSize(i)))
+      outStream.Release();
+    }
+    if (item.OpRes_Defined)
+    {
+      RINOK(ExtractCallback->SetOperationResult(item.OpRes))
+    }
+  }
+  
+  RINOK(slot.Res)
+  Completed += slot.UnpackSize;
+  return ExtractCallback->SetCompleted(&Completed);
+}
+
+
+static UInt32 GetNumThreads(const CObjectVector<CProperty> &props)
+{
+  UInt32 numThreads = NSystem::GetNumberOfProcessors();
+  FOR_VECTOR (i, props)
+  {
+    const CProperty &prop = props[i];
+    UString name = prop.Name;
+    name.MakeLower_Ascii();
+    if (!name.IsPrefixedBy_Ascii_NoCase("mt"))
+      continue;
+    NCOM::CPropVariant v;
+    if (!prop.Value.IsEmpty())
+    {
+      const wchar_t *end;
+      const UInt32 n = ConvertStringToUInt32(prop.Value, &end);
+      if (*end == 0)
+        v = n;
+      else
+        v = prop.Value;
+    }
+    bool force;
+    if (ParseMtProp2(name.Ptr(2), v, numThreads, force) != S_OK)
+      return 1;
+  }
+  return numThreads;
+}
+
+
+static HRESULT OpenArchiveCopy(CCodecs *codecs, const CArc &arc,
+    const CExtractOptions &options, CMyComPtr<IInArchive> &archive)
+{
+  RINOK(codecs->CreateInArchive((unsigned)arc.FormatIndex, archive))
+  if (!archive)
+    return S_FALSE;
+
+ #ifdef Z7_EXTERNAL_CODECS
+  if (codecs->NeedSetLibCodecs)
+  {
+    const CArcInfoEx &ai = codecs->Formats[(unsigned)arc.FormatIndex];
+    if (ai.LibIndex >= 0 ?
+        !codecs->Libs[(unsigned)ai.LibIndex].SetCodecs :
+        !codecs->Libs.IsEmpty())
+    {
+      CMyComPtr<ISetCompressCodecsInfo> setCompressCodecsInfo;
+      archive.QueryInterface(IID_ISetCompressCodecsInfo, (void **)&setCompressCodecsInfo);
+      if (setCompressCodecsInfo)
+      {
+        RINOK(setCompressCodecsInfo->SetCompressCodecsInfo(codecs))
+      }
+    }
+  }
+ #endif
+
+  RINOK(SetProperties(archive, options.Properties))
+
+  CInFileStream *inStreamSpec = new CInFileStream;
+  CMyComPtr<IInStream> inStream(inStreamSpec);
+  if (!inStreamSpec->Open(us2fs(arc.Path)))
+    return S_FALSE;
+  // same value as in OpenArchive.cpp
+  const UInt64 maxStartPosition = (UInt64)1 << 23;
+  RINOK(archive->Open(inStream, &maxStartPosition, NULL))
+  
+  UInt32 numItems = 0, numItems2 = 0;
+  RINOK(arc.Archive->GetNumberOfItems(&numItems))
+  RINOK(archive->GetNumberOfItems(&numItems2))
+  return (numItems == numItems2) ? S_OK : S_FALSE;
+}
+
+
+struct CExtractBatch
+{
+  unsigned Start;
+  unsigned NumItems;
+  UInt64 UnpackSize;
+  bool Direct;
+};
+
+/* it returns S_FALSE, if parallel extraction is not possible.
+   In that case no callback calls were made. */
+
+static HRESULT ExtractParallel(
+    CCodecs *codecs,
+    const CArc &arc,
+    const CExtractOptions &options,
+    const CRecordVector<UInt32> &indices,
+    Int32 testMode,
+    IArchiveExtractCallback *ecs)
+{
+  UInt32 numThreads = GetNumThreads(options.Properties);
+  if (numThreads > k_SlotRing_NumThreads_Max)
+    numThreads = k_SlotRing_NumThreads_Max;
+  if (numThreads <= 1 || indices.Size() < 2 || arc.GetGlobalOffset() != 0)
+    return S_FALSE;
+
+  IInArchive *archive = arc.Archive;
+
+  UInt64 ramSize = (UInt64)sizeof(size_t) << 28;
+  NSystem::GetRamSize(ramSize);
+  // the memory buffers of all threads use up to 1/4 of RAM
+  const UInt64 batchSizeMax = ramSize / 4 / numThreads;
+
+  UInt64 totalPack = 0;
+  CRecordVector<UInt64> packSizes;
+  CRecordVector<UInt64> sizes;
+  CRecordVector<bool> direct;
+  {
+    FOR_VECTOR (i, indices)
+    {
+      const UInt32 index = indices[i];
+      UInt64 size = 0, packSize = 0;
+      bool sizeDefined, encrypted = false;
+      {
+        NCOM::CPropVariant prop;
+        RINOK(archive->GetProperty(index, kpidSize, &prop))
+        sizeDefined = ConvertPropVariantToUInt64(prop, size);
+      }
+      {
+        NCOM::CPropVariant prop;
+        RINOK(archive->GetProperty(index, kpidPackSize, &prop))
+        if (!ConvertPropVariantToUInt64(prop, packSize))
+          packSize = size;
+      }
+      // the password can be requested only in main thread
+      RINOK(Archive_GetItemBoolProp(archive, index, kpidEncrypted, encrypted))
+      totalPack += packSize;
+      packSizes.Add(packSize);
+      sizes.Add(size);
+      direct.Add(!sizeDefined || size > batchSizeMax || encrypted);
+    }
+  }
+
+  // we use several batches per thread for better load balancing
+  UInt64 batchPackSize = totalPack / numThreads / 4;
+  const UInt64 kBatchPackSize_Min = (UInt64)1 << 20;
+  if (batchPackSize < kBatchPackSize_Min)
+    batchPackSize = kBatchPackSize_Min;
+
+  CRecordVector<CExtractBatch> batches;
+  unsigned numParallelBatches = 0;
+  {
+    UInt64 curPack = 0;
+    FOR_VECTOR (i, indices)
+    {
+      const bool isDirect = direct[i];
+      if (!batches.IsEmpty())
+      {
+        CExtractBatch &b = batches.Back();
+        if (b.Direct == isDirect
+            && (isDirect || (curPack < batchPackSize && b.UnpackSize + sizes[i] <= batchSizeMax)))
+        {
+          b.NumItems++;
+          b.UnpackSize += sizes[i];
+          curPack += packSizes[i];
+          continue;
+        }
+      }
+      CExtractBatch b;
+      b.Start = i;
+      b.NumItems = 1;
+      b.UnpackSize = sizes[i];
+      b.Direct = isDirect;
+      batches.Add(b);
+      curPack = packSizes[i];
+      if (!isDirect)
+        numParallelBatches++;
+    }
+  }
+
+  if (numParallelBatches < 2)
+    return S_FALSE;
+  if (numThreads > numParallelBatches)
+    numThreads = numParallelBatches;
+
+  CExtractQueue queue;
+  queue.Archive = archive;
+  queue.ExtractCallback = ecs;
+  
+  queue.Ring.Create(numThreads);
+  for (UInt32 t = 0; t < numThreads; t++)
+  {
+    CExtractSlot &slot = queue.Ring.GetSlot(t);
+    slot.TestMode = testMode;
+    const HRESULT res = OpenArchiveCopy(codecs, arc, options, slot.Archive);
+    if (res != S_OK)
+    {
+      // we don't want to report errors of additional handler objects
+      return (res == E_ABORT || res == E_OUTOFMEMORY) ? res : S_FALSE;
+    }
+  }
+
+  UInt64 totalUnpack = 0;
+  FOR_VECTOR (i, sizes)
+    totalUnpack += sizes[i];
+  RINOK(ecs->SetTotal(totalUnpack))
+
+  CDirectExtractCallback *directCallbackSpec = new CDirectExtractCallback;
+  CMyComPtr<IArchiveExtractCallback> directCallback = directCallbackSpec;
+  directCallbackSpec->Init(ecs);
+
+  FOR_VECTOR (i, batches)
+  {
+    const CExtractBatch &b = batches[i];
+    if (b.Direct)
+    {
+      RINOK(queue.Flush())
+      directCallbackSpec->Completed = queue.Completed;
+      RINOK(archive->Extract(&indices[b.Start], b.NumItems, testMode, directCallback))
+      queue.Completed += b.UnpackSize;
+      RINOK(ecs->SetCompleted(&queue.Completed))
+      continue;
+    }
+    if (queue.Ring.IsFull())
+    {
+      RINOK(queue.WriteNext())
+    }
+    CExtractSlot &slot = queue.Ring.GetFreeSlot();
+    slot.Indices = &indices[b.Start];
+    slot.NumItems = b.NumItems;
+    slot.UnpackSize = b.UnpackSize;
+    slot.CallbackSpec->Init();
+    RINOK(queue.Ring.StartSlot())
+  }
+
+  return queue.Flush();
+}
+
+#endif
+
+
+/* The stream of subfile returns S_FALSE for unpacking error.
+   The unpacked subfile stream (-ttar.xz) also sets the error flags
+   in archive that contains subfile.
+   We report that error as the error of subfile. */
+
+static HRESULT ReportSubfileError(IFolderArchiveExtractCallback *callbackFAE,
+    UInt32 errorFlags, const UString &subfilePath)
+{
+  Int32 opRes;
+  if (errorFlags & kpv_ErrorFlags_UnexpectedEnd)
+    opRes = NArchive::NExtract::NOperationResult::kUnexpectedEnd;
+  else if (errorFlags & kpv_ErrorFlags_CrcError)
+    opRes = NArchive::NExtract::NOperationResult::kCRCError;
+  else if (errorFlags & kpv_ErrorFlags_UnsupportedMethod)
+    opRes = NArchive::NExtract::NOperationResult::kUnsupportedMethod;
+  else if (errorFlags & kpv_ErrorFlags_HeadersError)
+    opRes = NArchive::NExtract::NOperationResult::kHeadersError;
+  else if (errorFlags & kpv_ErrorFlags_IsNotArc)
+    opRes = NArchive::NExtract::NOperationResult::kIsNotArc;
+  else
+    opRes = NArchive::NExtract::NOperationResult::kDataError;
+  Z7_DECL_CMyComPtr_QI_FROM(
+      IFolderArchiveExtractCallback2,
+      callback2, callbackFAE)
+  if (!callback2)
+    return S_FALSE;
+  return callback2->ReportExtractResult(opRes, BoolToInt(false), subfilePath);
+}
+
+
 static HRESULT DecompressArchive(
     CCodecs *codecs,
     const CArchiveLink &arcLink,
@@ -51,6 +585,8 @@ static HRESULT DecompressArchive(
   const CArc &arc = arcLink.Arcs.Back();
   stdInProcessed = 0;
   IInArchive *archive = arc.Archive;
+  // the items of sequential archive can be unpacked only in one pass without indexes
+  const bool seqMode = (options.StdInMode || arc.IsSeqStream);
   CRecordVector<UInt32> realIndices;
   
   UStringVector removePathParts;
@@ -92,7 +628,7 @@ static HRESULT DecompressArchive(
 
   const bool allFilesAreAllowed = wildcardCensor.AreAllAllowed();
 
-  if (!options.StdInMode)
+  if (!seqMode)
   {
     UInt32 numItems;
     RINOK(archive->GetNumberOfItems(&numItems))
@@ -193,7 +729,7 @@ static HRESULT DecompressArchive(
 
   ecs->Init(
       options.NtOptions,
-      options.StdInMode ? &wildcardCensor : NULL,
+      seqMode ? &wildcardCensor : NULL,
       &arc,
       callbackFAE,
       options.StdOutMode, options.TestMode,
@@ -204,7 +740,7 @@ static HRESULT DecompressArchive(
   
   #ifdef SUPPORT_LINKS
   
-  if (!options.StdInMode &&
+  if (!seqMode &&
       !options.TestMode &&
       options.NtOptions.HardLinks.Val)
   {
@@ -219,15 +755,33 @@ static HRESULT DecompressArchive(
 
   CArchiveExtractCallback_Closer ecsCloser(ecs);
 
-  if (options.StdInMode)
+  if (seqMode)
   {
     result = archive->Extract(NULL, (UInt32)(Int32)-1, testMode, ecs);
-    NCOM::CPropVariant prop;
-    if (archive->GetArchiveProperty(kpidPhySize, &prop) == S_OK)
-      ConvertPropVariantToUInt64(prop, stdInProcessed);
+    if (options.StdInMode)
+    {
+      NCOM::CPropVariant prop;
+      if (archive->GetArchiveProperty(kpidPhySize, &prop) == S_OK)
+        ConvertPropVariantToUInt64(prop, stdInProcessed);
+    }
   }
   else
-    result = archive->Extract(&realIndices.Front(), realIndices.Size(), testMode, ecs);
+  {
+    result = S_FALSE;
+   #if !defined(Z7_SFX) && !defined(Z7_ST)
+    if (arc.FormatIndex >= 0
+        && codecs->Formats[(unsigned)arc.FormatIndex].Flags_IndependentItems()
+        && arcLink.Arcs.Size() == 1
+        && arcLink.VolumePaths.IsEmpty())
+      result = ExtractParallel(codecs, arc, options, realIndices, testMode, ecs);
+    if (result == S_FALSE)
+   #endif
+      result = archive->Extract(&realIndices.Front(), realIndices.Size(), testMode, ecs);
+  }
+
+  if (result == S_FALSE && arcLink.Arcs.Size() > 1)
+    result = ReportSubfileError(callbackFAE,
+        arcLink.Arcs[arcLink.Arcs.Size() - 2].ErrorInfo.GetErrorFlags(), arc.Path);
   
   const HRESULT res2 = ecsCloser.Close();
   if (result == S_OK)
@@ -156,6 +156,7 @@ struct CArcInfoEx
   bool Flags_PureStartOpen() const { return (Flags & NArcInfoFlags::kPureStartOpen) != 0; }
   bool Flags_ByExtOnlyOpen() const { return (Flags & NArcInfoFlags::kByExtOnlyOpen) != 0; }
   bool Flags_HashHandler() const { return (Flags & NArcInfoFlags::kHashHandler) != 0; }
+  bool Flags_IndependentItems() const { return (Flags & NArcInfoFlags::kIndependentItems) != 0; }
 
   bool Flags_CTime() const { return (Flags & NArcInfoFlags::kCTime) != 0; }
   bool Flags_ATime() const { return (Flags & NArcInfoFlags::kATime) != 0; }
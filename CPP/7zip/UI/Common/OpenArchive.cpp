@@ -24,6 +24,11 @@
 #include "../../Common/ProgressUtils.h"
 #include "../../Common/StreamUtils.h"
 
+#if !defined(Z7_SFX) && !defined(Z7_ST)
+#include "../../Common/StreamBinder.h"
+#include "../../Common/VirtThread.h"
+#endif
+
 #include "../../Compress/CopyCoder.h"
 
 #include "DefaultName.h"
@@ -1647,6 +1652,7 @@ HRESULT CArc::OpenStream2(const COpenOptions &op)
   ErrorInfo.ErrorFormatIndex = -1;
 
   IsParseArc = false;
+  IsSeqStream = (op.stream == NULL);
   ArcStreamOffset = 0;
   
   // OutputDebugStringA("1");
@@ -3223,6 +3229,218 @@ void CArchiveLink::Set_ErrorsText()
 }
 */
 
+
+#if !defined(Z7_SFX) && !defined(Z7_ST)
+
+/* if the handler doesn't provide IInStream for subfile (gz, bz2, xz),
+   we unpack the subfile in separate thread, and next level archive
+   (tar for -ttar.xz) reads the data via sequential stream in same pass. */
+
+class CSubfileExtractCallback Z7_final:
+  public IArchiveExtractCallback,
+  public CMyUnknownImp
+{
+  Z7_IFACES_IMP_UNK_1(IArchiveExtractCallback)
+  Z7_IFACE_COM7_IMP(IProgress)
+public:
+  CMyComPtr<ISequentialOutStream> OutStream;
+  Int32 OpRes;
+
+  CSubfileExtractCallback(): OpRes(NArchive::NExtract::NOperationResult::kOK) {}
+};
+
+Z7_COM7F_IMF(CSubfileExtractCallback::SetTotal(UInt64 /* size */))
+{
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CSubfileExtractCallback::SetCompleted(const UInt64 * /* completeValue */))
+{
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CSubfileExtractCallback::GetStream(UInt32 /* index */,
+    ISequentialOutStream **outStream, Int32 askExtractMode))
+{
+  *outStream = NULL;
+  // the handler will release the stream after unpacking, and it calls CloseWrite()
+  if (askExtractMode == NArchive::NExtract::NAskMode::kExtract)
+    *outStream = OutStream.Detach();
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CSubfileExtractCallback::PrepareOperation(Int32 /* askExtractMode */))
+{
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CSubfileExtractCallback::SetOperationResult(Int32 opRes))
+{
+  if (opRes != NArchive::NExtract::NOperationResult::kOK)
+    OpRes = opRes;
+  return S_OK;
+}
+
+
+class CSubfileExtractThread Z7_final: public CVirtThread
+{
+public:
+  CMyComPtr<IInArchive> Archive;
+  UInt32 Index;
+  CSubfileExtractCallback *CallbackSpec;
+  CMyComPtr<IArchiveExtractCallback> Callback;
+  HRESULT Result;
+
+  ~CSubfileExtractThread() Z7_DESTRUCTOR_override
+  {
+    /* WaitThreadFinish() will be called in ~CVirtThread().
+       But we need WaitThreadFinish() call before
+       destructors of this class members.
+    */
+    CVirtThread::WaitThreadFinish();
+  }
+private:
+  virtual void Execute() Z7_override
+  {
+    Result = Archive->Extract(&Index, 1, BoolToInt(false), Callback);
+    // if the handler has not requested the stream, we close it here
+    CallbackSpec->OutStream.Release();
+  }
+};
+
+
+// it returns the error flags of archive for the result of unpacking of subfile
+static UInt32 Get_ErrorFlags_for_OpRes(Int32 opRes)
+{
+  switch (opRes)
+  {
+    case NArchive::NExtract::NOperationResult::kOK:
+    case NArchive::NExtract::NOperationResult::kDataAfterEnd: return 0;
+    case NArchive::NExtract::NOperationResult::kUnsupportedMethod: return kpv_ErrorFlags_UnsupportedMethod;
+    case NArchive::NExtract::NOperationResult::kCRCError:          return kpv_ErrorFlags_CrcError;
+    case NArchive::NExtract::NOperationResult::kUnexpectedEnd:     return kpv_ErrorFlags_UnexpectedEnd;
+    case NArchive::NExtract::NOperationResult::kHeadersError:      return kpv_ErrorFlags_HeadersError;
+    case NArchive::NExtract::NOperationResult::kIsNotArc:          return kpv_ErrorFlags_IsNotArc;
+    default:                                                       return kpv_ErrorFlags_DataError;
+  }
+}
+
+
+static HRESULT TestSubfile(IInArchive *archive, UInt32 index, UInt32 &errorFlags)
+{
+  CSubfileExtractCallback *callbackSpec = new CSubfileExtractCallback;
+  CMyComPtr<IArchiveExtractCallback> callback = callbackSpec;
+  RINOK(archive->Extract(&index, 1, BoolToInt(true), callback))
+  errorFlags = Get_ErrorFlags_for_OpRes(callbackSpec->OpRes);
+  return S_OK;
+}
+
+
+Z7_CLASS_IMP_NOQIB_1(
+  CSubfileSeqStream
+  , ISequentialInStream
+)
+  bool _started;
+  bool _finished;
+  CMyComPtr<ISequentialInStream> _binderStream;
+  CStreamBinder _binder;
+  CSubfileExtractThread _thread;
+public:
+  // the errors of unpacking of subfile (kpv_ErrorFlags_*)
+  UInt32 ErrorFlags;
+  // the error info of archive that contains subfile. It's set after next level was opened
+  CArcErrorInfo *ErrorInfo;
+
+  CSubfileSeqStream(): _started(false), _finished(false), ErrorFlags(0), ErrorInfo(NULL) {}
+  ~CSubfileSeqStream()
+  {
+    // it calls CloseRead(), so unpacking thread will be stopped, if it was not finished
+    _binderStream.Release();
+  }
+  HRESULT Init(IInArchive *archive, UInt32 index);
+  HRESULT ReadToEnd();
+  void SetErrorInfo(CArcErrorInfo *errorInfo)
+  {
+    ErrorInfo = errorInfo;
+    errorInfo->ErrorFlags |= ErrorFlags;
+  }
+};
+
+HRESULT CSubfileSeqStream::Init(IInArchive *archive, UInt32 index)
+{
+  CSubfileExtractCallback *callbackSpec = new CSubfileExtractCallback;
+  _thread.Callback = callbackSpec;
+  _thread.CallbackSpec = callbackSpec;
+  _thread.Archive = archive;
+  _thread.Index = index;
+  _thread.Result = E_FAIL;
+  _binder.CreateStreams2(_binderStream, callbackSpec->OutStream);
+  RINOK(_binder.Create_ReInit())
+  const WRes wres = _thread.Create();
+  if (wres != 0)
+    return HRESULT_FROM_WIN32(wres);
+  return S_OK;
+}
+
+Z7_COM7F_IMF(CSubfileSeqStream::Read(void *data, UInt32 size, UInt32 *processedSize))
+{
+  if (processedSize)
+    *processedSize = 0;
+  if (_finished)
+    return S_OK;
+  if (!_started)
+  {
+    // we start unpacking only when next level handler reads the data
+    _started = true;
+    const WRes wres = _thread.Start();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  UInt32 cur = 0;
+  const HRESULT res = _binderStream->Read(data, size, &cur);
+  if (processedSize)
+    *processedSize = cur;
+  RINOK(res)
+  if (cur != 0 || size == 0)
+    return S_OK;
+  // end of stream: we check the result of unpacking
+  _finished = true;
+  {
+    const WRes wres = _thread.WaitExecuteFinish();
+    if (wres != 0)
+      return HRESULT_FROM_WIN32(wres);
+  }
+  RINOK(_thread.Result)
+  /* the data error in subfile can't be reported as item error of next level archive.
+     So we set the error flags of archive that contains subfile,
+     and we return S_FALSE, as handlers do for data error in stream. */
+  const UInt32 flags = Get_ErrorFlags_for_OpRes(_thread.CallbackSpec->OpRes);
+  if (flags == 0)
+    return S_OK;
+  ErrorFlags |= flags;
+  if (ErrorInfo)
+    ErrorInfo->ErrorFlags |= flags;
+  return S_FALSE;
+}
+
+HRESULT CSubfileSeqStream::ReadToEnd()
+{
+  const UInt32 kBufSize = 1 << 16;
+  CByteBuffer buf(kBufSize);
+  for (;;)
+  {
+    UInt32 processed;
+    const HRESULT res = Read(buf, kBufSize, &processed);
+    if (res != S_OK)
+      return res;
+    if (processed == 0)
+      return S_OK;
+  }
+}
+
+#endif
+
+
 HRESULT CArchiveLink::Open(COpenOptions &op)
 {
   Release();
@@ -3308,32 +3526,56 @@ HRESULT CArchiveLink::Open(COpenOptions &op)
     if (op.types->Size() > Arcs.Size())
       resSpec = E_NOTIMPL;
     
+    // (typeIsSpecified) means that the type of next level was specified (-ttar.xz)
+    const bool typeIsSpecified = (op.types->Size() > Arcs.Size());
+
     UInt32 mainSubfile;
     {
+      UInt32 numItems;
+      RINOK(arc.Archive->GetNumberOfItems(&numItems))
       NCOM::CPropVariant prop;
       RINOK(arc.Archive->GetArchiveProperty(kpidMainSubfile, &prop))
       if (prop.vt == VT_UI4)
         mainSubfile = prop.ulVal;
+      else if (typeIsSpecified && numItems == 1)
+        mainSubfile = 0;
       else
         break;
-      UInt32 numItems;
-      RINOK(arc.Archive->GetNumberOfItems(&numItems))
       if (mainSubfile >= numItems)
         break;
     }
 
-  
-    CMyComPtr<IInArchiveGetStream> getStream;
-    if (arc.Archive->QueryInterface(IID_IInArchiveGetStream, (void **)&getStream) != S_OK || !getStream)
-      break;
-    
     CMyComPtr<ISequentialInStream> subSeqStream;
-    if (getStream->GetStream(mainSubfile, &subSeqStream) != S_OK || !subSeqStream)
-      break;
+    #if !defined(Z7_SFX) && !defined(Z7_ST)
+    CSubfileSeqStream *subSeqStreamSpec = NULL;
+    #endif
+    {
+      CMyComPtr<IInArchiveGetStream> getStream;
+      if (arc.Archive->QueryInterface(IID_IInArchiveGetStream, (void **)&getStream) == S_OK && getStream)
+        if (getStream->GetStream(mainSubfile, &subSeqStream) != S_OK)
+          subSeqStream.Release();
+    }
     
     CMyComPtr<IInStream> subStream;
-    if (subSeqStream.QueryInterface(IID_IInStream, &subStream) != S_OK || !subStream)
-      break;
+    if (subSeqStream)
+      subSeqStream.QueryInterface(IID_IInStream, &subStream);
+    
+    if (!subStream)
+    {
+      // we can open next level as sequential stream only, if its type was specified
+      if (!typeIsSpecified)
+        break;
+      if (!subSeqStream)
+      {
+        #if !defined(Z7_SFX) && !defined(Z7_ST)
+        subSeqStreamSpec = new CSubfileSeqStream;
+        subSeqStream = subSeqStreamSpec;
+        RINOK(subSeqStreamSpec->Init(arc.Archive, mainSubfile))
+        #else
+        break;
+        #endif
+      }
+    }
     
     CArc arc2;
     RINOK(arc.GetItem_Path(mainSubfile, arc2.Path))
@@ -3367,6 +3609,7 @@ HRESULT CArchiveLink::Open(COpenOptions &op)
     op2.excludedFormats = &excl;
     op2.stdInMode = false;
     op2.stream = subStream;
+    op2.seqStream = subSeqStream;
     op2.filePath = arc2.Path;
     op2.callback = op.callback;
     op2.callbackSpec = op.callbackSpec;
@@ -3378,10 +3621,36 @@ HRESULT CArchiveLink::Open(COpenOptions &op)
     {
       NonOpen_ErrorInfo = arc2.ErrorInfo;
       NonOpen_ArcPath = arc2.Path;
+      #if !defined(Z7_SFX) && !defined(Z7_ST)
+      if (typeIsSpecified)
+      {
+        /* the next level handler rejects the garbage from broken subfile.
+           So we check the subfile, and we report the errors of unpacking instead of (IsNotArc) */
+        UInt32 errorFlags = 0;
+        if (subSeqStreamSpec)
+        {
+          const HRESULT res2 = subSeqStreamSpec->ReadToEnd();
+          if (res2 != S_FALSE)
+            RINOK(res2)
+          errorFlags = subSeqStreamSpec->ErrorFlags;
+        }
+        else
+        {
+          RINOK(TestSubfile(arc.Archive, mainSubfile, errorFlags))
+        }
+        if (errorFlags != 0)
+          NonOpen_ErrorInfo.ErrorFlags = errorFlags;
+      }
+      #endif
       break;
     }
     RINOK(result)
     RINOK(arc.GetItem_MTime(mainSubfile, arc2.MTime))
+    #if !defined(Z7_SFX) && !defined(Z7_ST)
+    // the unpacking errors that will be found later are reported to archive that contains subfile
+    if (subSeqStreamSpec)
+      subSeqStreamSpec->SetErrorInfo(&Arcs.Back().ErrorInfo);
+    #endif
     Arcs.Add(arc2);
   }
   IsOpen = !Arcs.IsEmpty();
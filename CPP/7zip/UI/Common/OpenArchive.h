@@ -286,6 +286,7 @@ public:
   CMyComPtr<IArchiveGetRootProps> GetRootProps;
 
   bool IsParseArc;
+  bool IsSeqStream; // archive was opened from sequential stream: stdin or unpacked subfile (-ttar.xz)
 
   bool IsTree;
   bool IsReadOnly;
@@ -329,6 +330,7 @@ public:
 
   CArc():
     // MTime_Defined(false),
+    IsSeqStream(false),
     IsTree(false),
     IsReadOnly(false),
     Ask_Deleted(false),
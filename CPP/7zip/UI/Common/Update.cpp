@@ -39,6 +39,12 @@ static const char * const kUpdateIsNotSupoorted =
 static const char * const kUpdateIsNotSupported_MultiVol =
   "Updating for multivolume archives is not implemented";
 
+static const char * const kUpdateIsNotSupported_Chain =
+  "Updating for compressed tar archives is not implemented";
+
+static const char * const kUpdateIsNotSupported_InPlace =
+  "The archive format does not support in-place update";
+
 using namespace NWindows;
 using namespace NCOM;
 using namespace NFile;
@@ -192,8 +198,20 @@ static const char * const kSFXExtension =
 bool CUpdateOptions::InitFormatIndex(const CCodecs *codecs,
     const CObjectVector<COpenType> &types, const UString &arcPath)
 {
-  if (types.Size() > 1)
+  if (types.Size() > 2)
     return false;
+  if (types.Size() == 2)
+  {
+    /* (-ttar.gzip), (-ttar.bzip2), (-ttar.xz):
+       tar handler compresses output stream itself in same pass */
+    if (types[0].FormatIndex < 0 || types[1].FormatIndex < 0)
+      return false;
+    if (!codecs->Formats[(unsigned)types[0].FormatIndex].Name.IsEqualTo_Ascii_NoCase("tar"))
+      return false;
+    CProperty &prop = MethodMode.Properties.AddNew();
+    prop.Name = "cm";
+    prop.Value = codecs->Formats[(unsigned)types[1].FormatIndex].Name;
+  }
   // int arcTypeIndex = -1;
   if (types.Size() != 0)
   {
@@ -344,9 +362,30 @@ int FindAltStreamColon_in_Path(const wchar_t *path);
 
 
 
+// the handler that supports in-place update accepts "ip" property
+
+static bool IsInPlaceUpdateSupported(const CCodecs *codecs, int formatIndex)
+{
+  CMyComPtr<IOutArchive> outArchive;
+  if (formatIndex < 0
+      || codecs->CreateOutArchive((unsigned)formatIndex, outArchive) != S_OK
+      || !outArchive)
+    return false;
+  Z7_DECL_CMyComPtr_QI_FROM(
+      ISetProperties,
+      setProperties, outArchive)
+  if (!setProperties)
+    return false;
+  CObjectVector<CProperty> props;
+  props.AddNew().Name = "ip";
+  return SetProperties(outArchive, props) == S_OK;
+}
+
+
 static HRESULT Compress(
     const CUpdateOptions &options,
     bool isUpdatingItself,
+    bool inPlace,
     CCodecs *codecs,
     const CActionSet &actionSet,
     const CArc *arc,
@@ -394,7 +433,21 @@ static HRESULT Compress(
     throw kUpdateIsNotSupoorted;
 
   // we need to set properties to get fileTimeType.
-  RINOK(SetProperties(outArchive, options.MethodMode.Properties))
+  if (inPlace)
+  {
+    // the handler that doesn't support in-place update must reject "ip" property
+    CMyComPtr<ISetProperties> setProperties;
+    outArchive.QueryInterface(IID_ISetProperties, &setProperties);
+    if (!setProperties)
+      throw kUpdateIsNotSupoorted;
+    CObjectVector<CProperty> props = options.MethodMode.Properties;
+    props.AddNew().Name = "ip";
+    RINOK(SetProperties(outArchive, props))
+  }
+  else
+  {
+    RINOK(SetProperties(outArchive, options.MethodMode.Properties))
+  }
 
   NFileTimeType::EEnum fileTimeType;
   {
@@ -691,6 +744,13 @@ static HRESULT Compress(
       bool isOK = false;
       FString realPath;
       
+      if (inPlace)
+      {
+        // we don't add that path to tempFiles, because we must not delete the archive
+        realPath = us2fs(archivePath.GetFinalPath());
+        isOK = outStreamSpec->Open_Existing(realPath);
+      }
+      else
       for (unsigned i = 0; i < (1 << 16); i++)
       {
         if (archivePath.Temp)
@@ -852,6 +912,11 @@ static HRESULT Compress(
 
   HRESULT result = outArchive->UpdateItems(tailStream, updatePairs2.Size(), updateCallback);
   // callback->Finalize();
+  if (inPlace && result == E_NOTIMPL)
+  {
+    errorInfo.Message = "The archive cannot be updated in place";
+    errorInfo.FileNames.Add(us2fs(archivePath.GetFinalPath()));
+  }
   RINOK(result)
 
   if (!updateCallbackSpec->AreAllFilesClosed())
@@ -1110,7 +1175,7 @@ HRESULT UpdateArchive(
   if (options.StdOutMode && options.EMailMode)
     return E_FAIL;
 
-  if (types.Size() > 1)
+  if (types.Size() > 2)
     return E_NOTIMPL;
 
   bool renameMode = !options.RenamePairs.IsEmpty();
@@ -1219,6 +1284,13 @@ HRESULT UpdateArchive(
         return E_NOTIMPL;
      #endif
 
+      if (types.Size() > 1)
+      {
+        errorInfo.FileNames.Add(us2fs(arcPath));
+        errorInfo.Message = kUpdateIsNotSupported_Chain;
+        return E_NOTIMPL;
+      }
+
       if (!options.StdOutMode && options.UpdateArchiveItself)
         if (fi.IsReadOnly())
         {
@@ -1257,6 +1329,17 @@ HRESULT UpdateArchive(
       op.stream = NULL;
       op.filePath = arcPath;
 
+      CMyComPtr<IInStream> inPlaceStream;
+      if (options.InPlace)
+      {
+        // in-place update opens the archive for writing also. So we allow shared writing
+        CInFileStream *inStreamSpec = new CInFileStream;
+        inPlaceStream = inStreamSpec;
+        if (!inStreamSpec->OpenShared(us2fs(arcPath), true))
+          return errorInfo.SetFromLastError("cannot open file", us2fs(arcPath));
+        op.stream = inPlaceStream;
+      }
+
       RINOK(callback->StartOpenArchive(arcPath))
 
       HRESULT result = arcLink.Open_Strict(op, openCallback);
@@ -1295,6 +1378,12 @@ HRESULT UpdateArchive(
         errorInfo.Message = "There is some data block after the end of the archive";
         return E_NOTIMPL;
       }
+      if (options.InPlace && !IsInPlaceUpdateSupported(codecs, arc.FormatIndex))
+      {
+        errorInfo.FileNames.Add(us2fs(arcPath));
+        errorInfo.Message = kUpdateIsNotSupported_InPlace;
+        return E_NOTIMPL;
+      }
       if (options.MethodMode.Type.FormatIndex < 0)
       {
         options.MethodMode.Type.FormatIndex = arcLink.GetArc()->FormatIndex;
@@ -1343,7 +1432,7 @@ HRESULT UpdateArchive(
   {
     bool needScanning = false;
     
-    if (!renameMode)
+    if (!renameMode && !options.DeleteMode)
     FOR_VECTOR (i, options.Commands)
       if (options.Commands[i].ActionSet.NeedScanning())
         needScanning = true;
@@ -1429,6 +1518,13 @@ HRESULT UpdateArchive(
 
   CTempFiles tempFiles;
 
+  const bool inPlace = options.InPlace
+      && thereIsInArchive
+      && !options.StdOutMode
+      && options.UpdateArchiveItself
+      && !options.SfxMode
+      && options.VolumesSizes.Size() == 0;
+
   bool createTempFile = false;
 
   if (!options.StdOutMode && options.UpdateArchiveItself)
@@ -1436,7 +1532,7 @@ HRESULT UpdateArchive(
     CArchivePath &ap = options.Commands[0].ArchivePath;
     ap = options.ArchivePath;
     // if ((archive != 0 && !usesTempDir) || !options.WorkingDir.IsEmpty())
-    if ((thereIsInArchive || !options.WorkingDir.IsEmpty()) && !usesTempDir && options.VolumesSizes.Size() == 0)
+    if ((thereIsInArchive || !options.WorkingDir.IsEmpty()) && !usesTempDir && options.VolumesSizes.Size() == 0 && !inPlace)
     {
       createTempFile = true;
       ap.Temp = true;
@@ -1486,7 +1582,7 @@ HRESULT UpdateArchive(
       // ap.TempPrefix = tempDirPrefix;
     }
     if (!options.StdOutMode &&
-        (ci > 0 || !createTempFile))
+        (ci > 0 || !(createTempFile || inPlace)))
     {
       const FString path = us2fs(ap.GetFinalPath());
       if (NFind::DoesFileOrDirExist(path))
@@ -1559,6 +1655,7 @@ HRESULT UpdateArchive(
 
     RINOK(Compress(options,
         isUpdating,
+        isUpdating && inPlace,
         codecs,
         command.ActionSet,
         arc,
@@ -96,6 +96,8 @@ struct CUpdateOptions
 
   bool DeleteAfterCompressing;
   bool SetArcMTime;
+  bool InPlace; // update existing archive file without temporary archive
+  bool DeleteMode; // "d" command: wildcards select items in archive, and we don't scan the disk
 
   CBoolPair NtSecurity;
   CBoolPair AltStreams;
@@ -141,6 +143,8 @@ struct CUpdateOptions
     
     DeleteAfterCompressing(false),
     SetArcMTime(false),
+    InPlace(false),
+    DeleteMode(false),
 
     ArcNameMode(k_ArcNameMode_Smart),
     PathMode(NWildcard::k_RelatPath)
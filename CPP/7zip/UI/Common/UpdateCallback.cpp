@@ -957,6 +957,39 @@ Z7_COM7F_IMF(CArchiveUpdateCallback::GetVolumeStream(UInt32 index, ISequentialOu
   COM_TRY_END
 }
 
+/* IArchiveOpenVolumeCallback is used by handler to open additional
+   source archives in update operation (7z: -mmerge=path). */
+
+Z7_COM7F_IMF(CArchiveUpdateCallback::GetProperty(PROPID propID, PROPVARIANT *value))
+{
+  COM_TRY_BEGIN
+  NCOM::CPropVariant prop;
+  if (propID == kpidName)
+    prop = ArcFileName;
+  prop.Detach(value);
+  return S_OK;
+  COM_TRY_END
+}
+
+Z7_COM7F_IMF(CArchiveUpdateCallback::GetStream(const wchar_t *name, IInStream **inStream))
+{
+  COM_TRY_BEGIN
+  *inStream = NULL;
+  const FString path = us2fs(name);
+  NFind::CFileInfo fi;
+  if (!fi.Find_FollowLink(path))
+    return GetLastError_noZero_HRESULT();
+  if (fi.IsDir())
+    return S_FALSE;
+  CInFileStream *inStreamSpec = new CInFileStream;
+  CMyComPtr<IInStream> inStreamLoc(inStreamSpec);
+  if (!inStreamSpec->Open(path))
+    return GetLastError_noZero_HRESULT();
+  *inStream = inStreamLoc.Detach();
+  return S_OK;
+  COM_TRY_END
+}
+
 Z7_COM7F_IMF(CArchiveUpdateCallback::CryptoGetTextPassword2(Int32 *passwordIsDefined, BSTR *password))
 {
   COM_TRY_BEGIN
@@ -85,6 +85,7 @@ class CArchiveUpdateCallback Z7_final:
   public ICryptoGetTextPassword2,
   public ICryptoGetTextPassword,
   public ICompressProgressInfo,
+  public IArchiveOpenVolumeCallback,
   public IInFileStream_Callback,
   public CMyUnknownImp
 {
@@ -97,6 +98,7 @@ class CArchiveUpdateCallback Z7_final:
     Z7_COM_QI_ENTRY(ICryptoGetTextPassword2)
     Z7_COM_QI_ENTRY(ICryptoGetTextPassword)
     Z7_COM_QI_ENTRY(ICompressProgressInfo)
+    Z7_COM_QI_ENTRY(IArchiveOpenVolumeCallback)
   Z7_COM_QI_END
   Z7_COM_ADDREF_RELEASE
 
@@ -112,6 +114,7 @@ class CArchiveUpdateCallback Z7_final:
   Z7_IFACE_COM7_IMP(IArchiveGetRootProps)
   Z7_IFACE_COM7_IMP(ICryptoGetTextPassword2)
   Z7_IFACE_COM7_IMP(ICryptoGetTextPassword)
+  Z7_IFACE_COM7_IMP(IArchiveOpenVolumeCallback)
 
 
   void UpdateProcessedItemStatus(unsigned dirIndex);
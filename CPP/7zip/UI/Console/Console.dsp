@@ -797,6 +797,14 @@ SOURCE=..\..\Common\RegisterArc.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\..\Common\StreamBinder.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\StreamBinder.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\..\Common\StreamObjects.cpp
 # End Source File
 # Begin Source File
@@ -819,6 +827,14 @@ SOURCE=..\..\Common\UniqBlocks.cpp
 
 SOURCE=..\..\Common\UniqBlocks.h
 # End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\VirtThread.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\..\Common\VirtThread.h
+# End Source File
 # End Group
 # Begin Group "Compress"
 
@@ -1267,6 +1267,7 @@ HRESULT ListArchives(
  
     CReadArcItem item;
     UStringVector pathParts;
+    bool subfileError = false;
     
     for (UInt32 i = 0; i < numItems; i++)
     {
@@ -1275,8 +1276,14 @@ HRESULT ListArchives(
 
       HRESULT res = arc.GetItem_Path2(i, fp.FilePath);
 
-      if (stdInMode && res == E_INVALIDARG)
+      if ((stdInMode || arc.IsSeqStream) && res == E_INVALIDARG)
         break;
+      if (arc.IsSeqStream && res == S_FALSE && arcLink.Arcs.Size() > 1)
+      {
+        // the unpacking error of subfile was reported to archive that contains subfile
+        subfileError = true;
+        break;
+      }
       RINOK(res)
 
       if (arc.Ask_Aux)
@@ -1356,6 +1363,21 @@ HRESULT ListArchives(
       fp.PrintSum(stat2);
     }
 
+    if (subfileError)
+    {
+      numErrors++;
+      g_StdOut.Flush();
+      if (g_ErrStream)
+      {
+        const CArc &parentArc = arcLink.Arcs[arcLink.Arcs.Size() - 2];
+        *g_ErrStream << endl << kError;
+        g_ErrStream->NormalizePrint_UString(parentArc.Path);
+        *g_ErrStream << endl;
+        ErrorInfo_Print(*g_ErrStream, parentArc.ErrorInfo);
+        g_ErrStream->Flush();
+      }
+    }
+
     if (enableHeaders)
     {
       if (arcLink.NonOpen_ErrorInfo.ErrorFormatIndex >= 0)
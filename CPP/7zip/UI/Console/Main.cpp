@@ -190,6 +190,7 @@ static const char * const kHelpString =
     "  -stl : set archive timestamp from the most recently modified file\n"
     "  -stm{HexMask} : set CPU thread affinity mask (hexadecimal number)\n"
     "  -stx{Type} : exclude archive type\n"
+    "  -sui : update archive in place (without temporary archive)\n"
     "  -t{Type} : Set type of archive\n"
     "  -u[-][p#][q#][r#][x#][y#][z#][!newArchiveName] : Update options\n"
     "  -v{Size}[b|k|m|g] : Create volumes\n"
@@ -816,6 +816,12 @@ bool COutFile::Open(const char *name, DWORD creationDisposition)
   return Create(name, false);
 }
 
+bool COutFile::Open_Existing(const char *name)
+{
+  Path = name; // change it : set it only if open is success.
+  return OpenBinary(name, O_WRONLY);
+}
+
 ssize_t COutFile::write_part(const void *data, size_t size) throw()
 {
   if (size > kChunkSizeMax)
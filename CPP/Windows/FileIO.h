@@ -266,6 +266,8 @@ class COutFile: public CFileBase
 public:
   bool Open(CFSTR fileName, DWORD shareMode, DWORD creationDisposition, DWORD flagsAndAttributes);
   bool Open(CFSTR fileName, DWORD creationDisposition);
+  // it opens existing file for writing without truncation
+  bool Open_Existing(CFSTR fileName) { return Open(fileName, OPEN_EXISTING); }
   bool Create(CFSTR fileName, bool createAlways);
   bool CreateAlways(CFSTR fileName, DWORD flagsAndAttributes);
 
@@ -311,6 +313,7 @@ public:
 
   CFileBase(): _handle(-1), PreserveATime(false) {}
   ~CFileBase() { Close(); }
+  int GetHandle() const { return _handle; }
   // void Detach() { _handle = -1; }
   bool Close();
   bool GetLength(UInt64 &length) const;
@@ -360,6 +363,8 @@ public:
   bool Close();
   bool Create(const char *name, bool createAlways);
   bool Open(const char *name, DWORD creationDisposition);
+  // it opens existing file for writing without truncation
+  bool Open_Existing(const char *name);
   ssize_t write_full(const void *data, size_t size, size_t &processed) throw();
 
   bool WriteFull(const void *data, size_t size) throw()
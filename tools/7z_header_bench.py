@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+# 7z_header_bench.py : measures the time from last data byte to archive close in 7z
+#
+# For archives with many files most of the time after the last data byte
+# is spent in writing of 7z header: serialization of names, times,
+# attributes and substream info, and compression of header.
+#
+# The script creates many small files and packs them to base archive.
+# Then it runs "7zz u arc.7z -si<name>" for copy of base archive,
+# where the new item is read from stdin. The old folders are copied before
+# the new item, so the item from stdin is the last data of archive.
+# The new item is stored (-m0=Copy), so the encoder doesn't keep buffered data.
+# The script closes stdin after the last data byte and measures the time
+# until the exit of 7zz. The archive is tested after each run.
+# The runs with -mhc=off show the time of header writing without
+# header compression.
+#
+# Usage:
+#   7z_header_bench.py path/to/7zz [path/to/other/7zz ...]
+#       [--files N] [--mmt LIST] [--mhc LIST] [--runs N] [--dir DIR] [--keep]
+#
+#   --files N  : number of files in archive (default 1000000)
+#   --mmt LIST : comma separated list of -mmt values (default 1,4)
+#   --mhc LIST : comma separated list of -mhc values (default on,off)
+#   --runs N   : number of runs for each case; minimal time is shown (default 3)
+#   --dir DIR  : work directory (default: new temp directory)
+#   --keep     : don't delete work directory
+
+import argparse
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+FILES_PER_DIR = 1000
+STDIN_NAME = 'zz_stdin.bin'
+STDIN_SIZE = 1 << 20
+STDIN_CHUNK = 1 << 16
+
+
+def make_files(src_dir, num_files):
+    for i in range(num_files):
+        d = os.path.join(src_dir, 'd%05d' % (i // FILES_PER_DIR))
+        if i % FILES_PER_DIR == 0:
+            os.makedirs(d, exist_ok=True)
+        with open(os.path.join(d, 'file_%08d.txt' % i), 'w') as f:
+            f.write('%d\n' % i)
+
+
+def run_7z(exe, args, cwd):
+    return subprocess.run([exe] + args, cwd=cwd,
+                          stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL).returncode
+
+
+def run_update(exe, arc, mmt, mhc, data, cwd):
+    # returns (time from last data byte to exit, total time)
+    p = subprocess.Popen([exe, 'u', '-t7z', '-m0=Copy', '-mmt=%s' % mmt, '-mhc=%s' % mhc,
+                          arc, '-si' + STDIN_NAME],
+                         cwd=cwd, stdin=subprocess.PIPE,
+                         stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    t_start = time.monotonic()
+    for pos in range(0, len(data), STDIN_CHUNK):
+        p.stdin.write(data[pos:pos + STDIN_CHUNK])
+    p.stdin.close()
+    t_last = time.monotonic()
+    if p.wait() != 0:
+        raise Exception('update failed')
+    t_end = time.monotonic()
+    return t_end - t_last, t_end - t_start
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('exe', nargs='+')
+    parser.add_argument('--files', type=int, default=1000000)
+    parser.add_argument('--mmt', default='1,4')
+    parser.add_argument('--mhc', default='on,off')
+    parser.add_argument('--runs', type=int, default=3)
+    parser.add_argument('--dir')
+    parser.add_argument('--keep', action='store_true')
+    args = parser.parse_args()
+    exes = [os.path.abspath(e) for e in args.exe]
+    mmts = args.mmt.split(',')
+    mhcs = args.mhc.split(',')
+
+    work = args.dir if args.dir else tempfile.mkdtemp(prefix='7z_header_')
+    os.makedirs(work, exist_ok=True)
+    src = os.path.join(work, 'src')
+    base = os.path.join(work, 'base.7z')
+    arc = os.path.join(work, 'arc.7z')
+
+    if not os.path.exists(base):
+        shutil.rmtree(src, ignore_errors=True)
+        os.makedirs(src)
+        t = time.monotonic()
+        make_files(src, args.files)
+        print('files created: %d, %.1f sec' % (args.files, time.monotonic() - t))
+        t = time.monotonic()
+        if run_7z(exes[0], ['a', '-t7z', '-mx1', base, '.'], src) != 0:
+            print('cannot create base archive')
+            return 1
+        print('base archive: %d bytes, %.1f sec' % (
+            os.path.getsize(base), time.monotonic() - t))
+        shutil.rmtree(src)
+
+    data = random.Random(1).randbytes(STDIN_SIZE)
+
+    cases = [(exe, mhc, mmt) for exe in exes for mhc in mhcs for mmt in mmts]
+    best = {}
+    # the runs of different cases are interleaved to reduce the effect of system load changes
+    for run in range(args.runs):
+        for c in cases:
+            exe, mhc, mmt = c
+            shutil.copyfile(base, arc)
+            r = run_update(exe, arc, mmt, mhc, data, work)
+            if run_7z(exe, ['t', arc], work) != 0:
+                print('archive test failed: %s -mmt=%s -mhc=%s' % (exe, mmt, mhc))
+                return 1
+            if c not in best or r[0] < best[c][0]:
+                best[c] = r
+
+    print('%-40s %5s %5s %12s %12s' % ('exe', 'mmt', 'mhc', 'close (sec)', 'total (sec)'))
+    for c in cases:
+        exe, mhc, mmt = c
+        print('%-40s %5s %5s %12.3f %12.3f' % (exe[-40:], mmt, mhc, best[c][0], best[c][1]))
+
+    if not args.keep and not args.dir:
+        shutil.rmtree(work)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,443 @@
+#!/usr/bin/env python3
+# ntfs_test_image.py : writes a small NTFS image to test the NTFS handler
+#
+# The image contains files with compressed $DATA attributes (LZNT1, 64 KiB
+# compression units of 16 clusters of 4 KiB), so it covers these cases of
+# compressed-attribute reading:
+#   - unit that is compressed with LZNT1 (packed clusters + sparse tail run)
+#   - unit that is stored (16 packed clusters without sparse run)
+#   - unit that is sparse (only sparse run)
+#   - stored (uncompressed) 4 KiB chunks inside LZNT1 unit
+#   - last unit that is shorter than compression unit
+#   - file that contains only one compression unit
+#   - runs that are merged over the unit boundaries
+# and also resident, plain non-resident and fully sparse files.
+#
+# Usage:
+#   ntfs_test_image.py ntfs.img [--files DIR] [--corrupt]
+#
+#   --files DIR  : writes the expected contents of files to DIR.
+#                  So the check is:
+#                    7zz x ntfs.img -oout -mmt=1 '-x![SYSTEM]' && diff -r DIR out
+#                    7zz x ntfs.img -oout4 -mmt=4 '-x![SYSTEM]' && diff -r DIR out4
+#   --corrupt    : breaks first LZNT1 chunk of "text.txt".
+#                  The extraction must report data error for that file only.
+#
+# The image is not full NTFS volume: it contains only $MFT records that
+# are required to 7-Zip (no $Bitmap, $LogFile, and no directory indexes).
+
+import argparse
+import os
+import random
+import struct
+import sys
+
+SECTOR_SIZE = 512
+CLUSTER_SIZE_LOG = 12
+CLUSTER_SIZE = 1 << CLUSTER_SIZE_LOG
+REC_SIZE = 1024
+CU_LOG = 4  # compression unit is (1 << 4) clusters
+CU_CLUSTERS = 1 << CU_LOG
+CU_SIZE = CU_CLUSTERS * CLUSTER_SIZE
+CHUNK_SIZE = 1 << 12  # LZNT1 chunk
+
+NUM_SYS_RECS = 16
+REC_ROOT = 5
+MFT_CLUSTER = 4
+
+ATTR_SI = 0x10
+ATTR_FILE_NAME = 0x30
+ATTR_DATA = 0x80
+
+FILE_ATTRIBUTE_ARCHIVE = 0x20
+FILE_ATTRIBUTE_SPARSE = 0x200
+FILE_ATTRIBUTE_COMPRESSED = 0x800
+DUP_FILE_NAME_INDEX_PRESENT = 0x10000000
+
+# 2023-01-01 00:00:00 UTC in FILETIME
+FILE_TIME = 133170048000000000
+
+
+def align(v, a):
+    return (v + a - 1) & ~(a - 1)
+
+
+# ---------- LZNT1 encoder ----------
+
+def lznt1_num_dist_bits(pos):
+    # that is same calculation as in decoder
+    n = 4
+    while ((pos - 1) >> n) != 0:
+        n += 1
+    return n
+
+
+def lznt1_compress_chunk(chunk):
+    """returns compressed data of chunk without chunk header"""
+    out = bytearray()
+    heads = {}
+    pos = 0
+    size = len(chunk)
+    while pos < size:
+        flags_pos = len(out)
+        out.append(0)
+        flags = 0
+        for bit in range(8):
+            if pos >= size:
+                break
+            best_len = 0
+            best_dist = 0
+            if pos != 0 and pos + 3 <= size:
+                nb = lznt1_num_dist_bits(pos)
+                max_len = min((0xFFFF >> nb) + 3, size - pos)
+                for cand in reversed(heads.get(chunk[pos:pos + 3], [])):
+                    dist = pos - cand - 1
+                    if dist >= (1 << nb):
+                        break
+                    n = 3
+                    while n < max_len and chunk[cand + n] == chunk[pos + n]:
+                        n += 1
+                    if n > best_len:
+                        best_len = n
+                        best_dist = dist
+                        if n == max_len:
+                            break
+            if best_len >= 3:
+                nb = lznt1_num_dist_bits(pos)
+                out += struct.pack('<H', (best_dist << (16 - nb)) | (best_len - 3))
+                flags |= 1 << bit
+                step = best_len
+            else:
+                out.append(chunk[pos])
+                step = 1
+            for k in range(pos, pos + step):
+                if k + 3 <= size:
+                    lst = heads.setdefault(chunk[k:k + 3], [])
+                    lst.append(k)
+                    if len(lst) > 32:
+                        del lst[0]
+            pos += step
+        out[flags_pos] = flags
+    return out
+
+
+def lznt1_compress_unit(data):
+    """returns LZNT1 stream for one compression unit"""
+    out = bytearray()
+    for offs in range(0, len(data), CHUNK_SIZE):
+        chunk = data[offs:offs + CHUNK_SIZE]
+        packed = lznt1_compress_chunk(chunk)
+        if len(packed) < CHUNK_SIZE:
+            out += struct.pack('<H', 0xB000 | (len(packed) - 1))
+            out += packed
+        else:
+            # stored chunk: the decoder requires full 4 KiB size for it
+            out += struct.pack('<H', 0x3000 | (CHUNK_SIZE - 1))
+            out += chunk.ljust(CHUNK_SIZE, b'\0')
+    return out
+
+
+# ---------- volume writer ----------
+
+class Volume:
+    def __init__(self):
+        self.clusters = bytearray()
+        self.next_cluster = 0
+
+    def alloc(self, data):
+        """writes data to new clusters and returns first cluster number"""
+        lcn = self.next_cluster
+        num = align(len(data), CLUSTER_SIZE) // CLUSTER_SIZE
+        end = (lcn + num) * CLUSTER_SIZE
+        if len(self.clusters) < end:
+            self.clusters += bytes(end - len(self.clusters))
+        self.clusters[lcn * CLUSTER_SIZE:lcn * CLUSTER_SIZE + len(data)] = data
+        self.next_cluster += num
+        return lcn
+
+
+def add_run(runs, length, lcn):
+    """adds run (lcn is None for sparse run), and merges it with previous run"""
+    if runs:
+        prev_len, prev_lcn = runs[-1]
+        if lcn is None and prev_lcn is None:
+            runs[-1] = (prev_len + length, None)
+            return
+        if lcn is not None and prev_lcn is not None and prev_lcn + prev_len == lcn:
+            runs[-1] = (prev_len + length, prev_lcn)
+            return
+    runs.append((length, lcn))
+
+
+def encode_runs(runs):
+    out = bytearray()
+    prev = 0
+    for length, lcn in runs:
+        lb = length.to_bytes(max(1, (length.bit_length() + 7) // 8), 'little')
+        if lcn is None:
+            ob = b''
+        else:
+            delta = lcn - prev
+            prev = lcn
+            n = 1
+            while not -(1 << (n * 8 - 1)) <= delta < (1 << (n * 8 - 1)):
+                n += 1
+            ob = delta.to_bytes(n, 'little', signed=True)
+        out.append((len(ob) << 4) | len(lb))
+        out += lb + ob
+    out.append(0)
+    return out
+
+
+def write_compressed(vol, data, corrupt):
+    """writes data as compressed attribute. returns (runs, pack_size)"""
+    runs = []
+    pack_size = 0
+    first_lznt1 = True
+    for offs in range(0, max(len(data), 1), CU_SIZE):
+        unit = data[offs:offs + CU_SIZE]
+        if unit.count(0) == len(unit):
+            add_run(runs, CU_CLUSTERS, None)
+            continue
+        packed = lznt1_compress_unit(unit)
+        num = align(len(packed), CLUSTER_SIZE) // CLUSTER_SIZE
+        if num >= CU_CLUSTERS:
+            # the unit is stored without compression
+            add_run(runs, CU_CLUSTERS, vol.alloc(unit.ljust(CU_SIZE, b'\0')))
+            pack_size += CU_SIZE
+            continue
+        if corrupt and first_lznt1:
+            # first flag byte of first chunk must not start from match
+            packed[2] |= 1
+        first_lznt1 = False
+        add_run(runs, num, vol.alloc(packed))
+        add_run(runs, CU_CLUSTERS - num, None)
+        pack_size += num * CLUSTER_SIZE
+    return runs, pack_size
+
+
+def attr_resident(attr_type, value, instance):
+    hdr_size = 0x18
+    length = align(hdr_size + len(value), 8)
+    a = bytearray(length)
+    struct.pack_into('<IIBBHHHIHH', a, 0, attr_type, length, 0, 0, hdr_size, 0, instance,
+                     len(value), hdr_size, 0)
+    a[hdr_size:hdr_size + len(value)] = value
+    return a
+
+
+def attr_nonresident(attr_type, runs, size, alloc_size, pack_size, compressed, instance):
+    hdr_size = 0x48 if compressed else 0x40
+    mapping = encode_runs(runs)
+    length = align(hdr_size + len(mapping), 8)
+    a = bytearray(length)
+    num_clusters = sum(r[0] for r in runs)
+    struct.pack_into('<IIBBHHH', a, 0, attr_type, length, 1, 0, hdr_size,
+                     1 if compressed else 0, instance)
+    struct.pack_into('<QQHB', a, 0x10, 0, num_clusters - 1, hdr_size, CU_LOG if compressed else 0)
+    struct.pack_into('<QQQ', a, 0x28, alloc_size, size, size)
+    if compressed:
+        struct.pack_into('<Q', a, 0x40, pack_size)
+    a[hdr_size:hdr_size + len(mapping)] = mapping
+    return a
+
+
+def si_value(attrib):
+    return struct.pack('<QQQQIIIIIIQQ', FILE_TIME, FILE_TIME, FILE_TIME, FILE_TIME,
+                       attrib, 0, 0, 0, 0, 0, 0, 0)
+
+
+def file_name_value(parent_ref, name, attrib, size, alloc_size):
+    n = name.encode('utf-16-le')
+    return struct.pack('<QQQQQQQIIBB', parent_ref, FILE_TIME, FILE_TIME, FILE_TIME, FILE_TIME,
+                       alloc_size, size, attrib, 0, len(name), 3) + n
+
+
+def mft_record(rec_number, flags, attrs):
+    rec = bytearray(REC_SIZE)
+    usa_offset = 0x30
+    num_usa = REC_SIZE // SECTOR_SIZE + 1
+    attr_offset = align(usa_offset + num_usa * 2, 8)
+    pos = attr_offset
+    for i, a in enumerate(attrs):
+        rec[pos:pos + len(a)] = a
+        pos += len(a)
+    struct.pack_into('<II', rec, pos, 0xFFFFFFFF, 0)
+    pos += 8
+    if pos > REC_SIZE - 8:
+        raise ValueError('MFT record %d is too big' % rec_number)
+    struct.pack_into('<4sHHQHHHHIIQHHI', rec, 0, b'FILE', usa_offset, num_usa, 0,
+                     1, 1, attr_offset, flags, pos, REC_SIZE, 0, len(attrs), 0, rec_number)
+    # update sequence array
+    usn = 1
+    struct.pack_into('<H', rec, usa_offset, usn)
+    for i in range(1, num_usa):
+        end = i * SECTOR_SIZE - 2
+        rec[usa_offset + i * 2:usa_offset + i * 2 + 2] = rec[end:end + 2]
+        struct.pack_into('<H', rec, end, usn)
+    return rec
+
+
+class Entry:
+    def __init__(self, name, parent, data=None, is_dir=False, mode='compressed'):
+        self.name = name
+        self.parent = parent
+        self.data = data
+        self.is_dir = is_dir
+        self.mode = mode
+        self.rec = 0
+
+
+def make_entries():
+    rnd = random.Random(12345)
+    words = [b'alpha', b'beta', b'gamma', b'delta', b'ntfs', b'cluster', b'unit', b'lznt1', b'7-zip']
+    text = bytearray()
+    line = 0
+    while len(text) < 300000:
+        text += b'%6d ' % line + b' '.join(rnd.choice(words) for _ in range(rnd.randint(3, 12))) + b'\n'
+        line += 1
+    text = bytes(text)
+
+    def rand_bytes(n):
+        return bytes(rnd.getrandbits(8) for _ in range(n))
+
+    # units: text, zeros (sparse), random (stored), half random + half zeros
+    # (LZNT1 unit with stored chunks), and short last unit of text
+    mixed = (text[:CU_SIZE] + bytes(CU_SIZE) + rand_bytes(CU_SIZE)
+             + rand_bytes(CU_SIZE // 2) + bytes(CU_SIZE // 2) + text[:10000])
+
+    entries = []
+    root = None
+    d = Entry('dir', root, is_dir=True)
+    entries.append(d)
+    entries.append(Entry('text.txt', root, text))
+    entries.append(Entry('random.bin', root, rand_bytes(CU_SIZE * 2 + 22222)))
+    entries.append(Entry('mixed.bin', root, mixed))
+    entries.append(Entry('small.txt', root, text[:5000]))
+    entries.append(Entry('zeros.bin', root, bytes(CU_SIZE * 3)))
+    entries.append(Entry('empty.txt', root, b''))
+    entries.append(Entry('resident.txt', root, b'resident data\n', mode='resident'))
+    entries.append(Entry('plain.bin', root, text[:20000], mode='plain'))
+    entries.append(Entry('nested.txt', d, text[1000:150000]))
+    return entries
+
+
+def build_image(entries, corrupt):
+    vol = Volume()
+    num_recs = NUM_SYS_RECS + len(entries)
+    mft_size = align(num_recs * REC_SIZE, CLUSTER_SIZE)
+    mft_clusters = mft_size // CLUSTER_SIZE
+
+    # clusters 0 .. MFT_CLUSTER-1 : boot sector and reserved
+    vol.alloc(bytes(MFT_CLUSTER * CLUSTER_SIZE))
+    mft_lcn = vol.alloc(bytes(mft_size))
+    assert mft_lcn == MFT_CLUSTER
+
+    for i, e in enumerate(entries):
+        e.rec = NUM_SYS_RECS + i
+
+    recs = {}
+
+    def ref(rec_number):
+        return rec_number | (1 << 48)
+
+    def std_attrs(name, parent_ref, attrib, size, alloc_size):
+        return [attr_resident(ATTR_SI, si_value(attrib), 0),
+                attr_resident(ATTR_FILE_NAME, file_name_value(parent_ref, name, attrib, size, alloc_size), 1)]
+
+    # $MFT
+    mft_attrs = std_attrs('$MFT', ref(REC_ROOT), 6, mft_size, mft_size)
+    mft_attrs.append(attr_nonresident(ATTR_DATA, [(mft_clusters, MFT_CLUSTER)],
+                                      mft_size, mft_size, mft_size, False, 2))
+    recs[0] = mft_record(0, 1, mft_attrs)
+    # root folder
+    recs[REC_ROOT] = mft_record(REC_ROOT, 3, std_attrs(
+        '.', ref(REC_ROOT), 6 | DUP_FILE_NAME_INDEX_PRESENT, 0, 0))
+
+    for e in entries:
+        parent_ref = ref(e.parent.rec if e.parent else REC_ROOT)
+        if e.is_dir:
+            recs[e.rec] = mft_record(e.rec, 3, std_attrs(
+                e.name, parent_ref, DUP_FILE_NAME_INDEX_PRESENT, 0, 0))
+            continue
+        data = e.data
+        if e.mode == 'resident':
+            attrib = FILE_ATTRIBUTE_ARCHIVE
+            data_attr = attr_resident(ATTR_DATA, data, 2)
+            alloc_size = align(len(data), 8)
+        elif e.mode == 'plain':
+            attrib = FILE_ATTRIBUTE_ARCHIVE
+            alloc_size = align(len(data), CLUSTER_SIZE)
+            runs = [(alloc_size // CLUSTER_SIZE, vol.alloc(data))]
+            data_attr = attr_nonresident(ATTR_DATA, runs, len(data), alloc_size, alloc_size, False, 2)
+        else:
+            attrib = FILE_ATTRIBUTE_ARCHIVE | FILE_ATTRIBUTE_COMPRESSED
+            if not data:
+                alloc_size = 0
+                data_attr = attr_resident(ATTR_DATA, b'', 2)
+            else:
+                runs, pack_size = write_compressed(vol, data, corrupt and e.name == 'text.txt')
+                alloc_size = align(len(data), CU_SIZE)
+                if pack_size == 0:
+                    attrib |= FILE_ATTRIBUTE_SPARSE
+                data_attr = attr_nonresident(ATTR_DATA, runs, len(data), alloc_size, pack_size, True, 2)
+        recs[e.rec] = mft_record(e.rec, 1, std_attrs(e.name, parent_ref, attrib, len(data), alloc_size)
+                                 + [data_attr])
+
+    mft = bytearray(mft_size)
+    for n, r in recs.items():
+        mft[n * REC_SIZE:(n + 1) * REC_SIZE] = r
+    vol.clusters[MFT_CLUSTER * CLUSTER_SIZE:MFT_CLUSTER * CLUSTER_SIZE + mft_size] = mft
+
+    num_sectors = len(vol.clusters) // SECTOR_SIZE
+    boot = bytearray(SECTOR_SIZE)
+    boot[0:3] = b'\xEB\x52\x90'
+    boot[3:11] = b'NTFS    '
+    struct.pack_into('<HB', boot, 0x0B, SECTOR_SIZE, CLUSTER_SIZE // SECTOR_SIZE)
+    boot[0x15] = 0xF8
+    struct.pack_into('<HHI', boot, 0x18, 63, 255, 0)
+    boot[0x24] = 0x80
+    boot[0x26] = 0x80
+    struct.pack_into('<QQQ', boot, 0x28, num_sectors, MFT_CLUSTER, MFT_CLUSTER)
+    # (-10) : MFT record size is (1 << 10) bytes
+    struct.pack_into('<IIQ', boot, 0x40, 0xF6, 1, 0x1234567890ABCDEF)
+    boot[0x1FE:0x200] = b'\x55\xAA'
+    vol.clusters[0:SECTOR_SIZE] = boot
+    # the copy of boot sector follows the last sector of volume
+    return bytes(vol.clusters) + bytes(boot)
+
+
+def write_files(entries, root_dir):
+    for e in entries:
+        parts = [e.name]
+        p = e.parent
+        while p:
+            parts.insert(0, p.name)
+            p = p.parent
+        path = os.path.join(root_dir, *parts)
+        if e.is_dir:
+            os.makedirs(path, exist_ok=True)
+        else:
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            with open(path, 'wb') as f:
+                f.write(e.data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='writes NTFS image with compressed files')
+    parser.add_argument('image')
+    parser.add_argument('--files', metavar='DIR', help='write expected files to DIR')
+    parser.add_argument('--corrupt', action='store_true', help='break first LZNT1 chunk of text.txt')
+    args = parser.parse_args()
+
+    entries = make_entries()
+    image = build_image(entries, args.corrupt)
+    with open(args.image, 'wb') as f:
+        f.write(image)
+    if args.files:
+        write_files(entries, args.files)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
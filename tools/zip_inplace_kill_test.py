@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+# zip_inplace_kill_test.py : checks that in-place zip update (-sui) is crash-safe
+#
+# The script creates a zip archive, where one large item in the middle is
+# followed by many small items. Deleting the large item with -sui makes
+# the updater move the small items from the end of archive to the hole,
+# and then write final central directory and truncate the file.
+# The script runs "7zz d -sui" many times and kills the process after
+# random delay. After each run the archive must be opened without errors
+# by 7-Zip and by Python zipfile, and both must show either old or new
+# list of items with correct data.
+#
+# Usage:
+#   zip_inplace_kill_test.py path/to/7zz [--runs N] [--dir DIR] [--keep]
+#
+#   --runs N  : number of killed runs (default 40)
+#   --dir DIR : work directory (default: new temp directory)
+#   --keep    : don't delete work directory
+
+import argparse
+import os
+import random
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+import zipfile
+
+BIG_NAME = 'big.bin'
+BIG_SIZE = 48 << 20
+NUM_SMALL = 1500
+SMALL_SIZE_MAX = 24 << 10
+
+
+def make_files(src_dir, rnd):
+    names = []
+    contents = {}
+    def add(name, size):
+        data = rnd.randbytes(size)
+        with open(os.path.join(src_dir, name), 'wb') as f:
+            f.write(data)
+        names.append(name)
+        contents[name] = data
+    for i in range(20):
+        add('a%03d.bin' % i, rnd.randint(1, SMALL_SIZE_MAX))
+    add(BIG_NAME, BIG_SIZE)
+    for i in range(NUM_SMALL):
+        add('s%04d.bin' % i, rnd.randint(1, SMALL_SIZE_MAX))
+    return names, contents
+
+
+def run_7z(exe, args, cwd):
+    return subprocess.run([exe] + args, cwd=cwd,
+                          stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL).returncode
+
+
+def check_archive(exe, path, contents, old_names, new_names):
+    # returns state name ('old' / 'new') or raises error
+    if run_7z(exe, ['t', path], os.path.dirname(path)) != 0:
+        raise Exception('7-Zip test failed')
+    with zipfile.ZipFile(path) as z:
+        names = z.namelist()
+        bad = z.testzip()
+        if bad is not None:
+            raise Exception('zipfile: bad item ' + bad)
+        for n in names:
+            if z.read(n) != contents[n]:
+                raise Exception('zipfile: wrong data ' + n)
+    s = set(names)
+    if s == old_names:
+        return 'old'
+    if s == new_names:
+        return 'new'
+    raise Exception('unexpected list of items')
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('exe')
+    parser.add_argument('--runs', type=int, default=40)
+    parser.add_argument('--dir')
+    parser.add_argument('--keep', action='store_true')
+    args = parser.parse_args()
+    exe = os.path.abspath(args.exe)
+
+    work = args.dir if args.dir else tempfile.mkdtemp(prefix='zip_inplace_')
+    os.makedirs(work, exist_ok=True)
+    src = os.path.join(work, 'src')
+    os.makedirs(src, exist_ok=True)
+    rnd = random.Random(1)
+    names, contents = make_files(src, rnd)
+
+    base = os.path.join(work, 'base.zip')
+    if os.path.exists(base):
+        os.remove(base)
+    # stored items: so the data copying takes most of update time
+    if run_7z(exe, ['a', '-tzip', '-mx0', base] + names, src) != 0:
+        print('cannot create archive')
+        return 1
+
+    old_names = set(names)
+    new_names = old_names - {BIG_NAME}
+    arc = os.path.join(work, 'arc.zip')
+
+    base_size = os.path.getsize(base)
+
+    def start_update():
+        shutil.copyfile(base, arc)
+        p = subprocess.Popen([exe, 'd', '-sui', arc, BIG_NAME], cwd=work,
+                             stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        # the updater appends new central directory first,
+        # and the compaction follows it. So we wait for the growth of file.
+        while p.poll() is None and os.path.getsize(arc) <= base_size:
+            pass
+        return p, time.monotonic()
+
+    # full run to get the time of writing
+    p, t = start_update()
+    if p.wait() != 0:
+        print('in-place update failed')
+        return 1
+    write_time = time.monotonic() - t
+    if check_archive(exe, arc, contents, old_names, new_names) != 'new':
+        print('in-place update: wrong result')
+        return 1
+    print('base size = %d, new size = %d, write time = %.3f sec' % (
+        base_size, os.path.getsize(arc), write_time))
+
+    stats = {'old': 0, 'new': 0}
+    errors = 0
+    for run in range(args.runs):
+        p, t = start_update()
+        delay = rnd.uniform(0, write_time)
+        while time.monotonic() - t < delay:
+            pass
+        p.send_signal(signal.SIGKILL)
+        p.wait()
+        try:
+            state = check_archive(exe, arc, contents, old_names, new_names)
+            stats[state] += 1
+        except Exception as e:
+            errors += 1
+            print('run %d, delay = %.3f : ERROR : %s' % (run, delay, e))
+            shutil.copyfile(arc, os.path.join(work, 'bad_%d.zip' % run))
+
+    print('runs = %d, old = %d, new = %d, errors = %d' % (
+        args.runs, stats['old'], stats['new'], errors))
+    if not args.keep and not args.dir and errors == 0:
+        shutil.rmtree(work)
+    return 1 if errors else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())